@@ -17,11 +17,36 @@
  *   ./tinysh_shell -h         Display help message
  *   ./tinysh_shell -m         Start directly in menu mode
  *   ./tinysh_shell -t         Run test framework
+ *   ./tinysh_shell -f FILE    Keep settings in another flash image
+ *   ./tinysh_shell -r FILE    Keep state across restarts in another file
+ *   ./tinysh_shell -s PORT    Also serve sessions over TCP
+ *   ./tinysh_shell -s PORT -T Same, speaking telnet
+ *   ./tinysh_shell -i NAME    Also serve a shared-memory channel
+ *   ./tinysh_shell -q NAME CMD...
+ *                             Run commands through a running shell's channel
+ *   ./tinysh_shell -c 64      Build "ch 0" to "ch 63" at startup
  */
 
 #include "project-conf.h"
 #include "tinysh.h"
 #include "tiny_port.h"
+#include "tinysh_term.h"
+#include "tinysh_status.h"
+#include "tinysh_table.h"
+#include "tinysh_metric.h"
+#include "tinysh_memo.h"
+#include "tinysh_complete.h"
+#include "tinysh_apropos.h"
+#include "tinysh_param.h"
+#include "tinysh_kv.h"
+#include "tinysh_retain.h"
+#include "tinysh_timer.h"
+#include "tinysh_build.h"
+#include "tiny_server.h"
+#include "tiny_ipc.h"
+#include "tiny_fanout.h"
+#include "tiny_transcript.h"
+#include "tinysh_session.h"
 #include "tinysh_test.h"
 
 #if MENU_ENABLED
@@ -35,6 +60,12 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <errno.h>
+
+/* Longest time the main loop blocks waiting for input */
+#ifndef MAIN_LOOP_TICK_MS
+#define MAIN_LOOP_TICK_MS   50
+#endif
 
 // Signal handler to clean up before exit
 void sigint_handler(int sig) {
@@ -43,6 +74,8 @@ void sigint_handler(int sig) {
     // Reset shell context in case we're stuck somewhere
     tinysh_reset_context();
     
+    // Give the status row back before restoring the terminal
+    tinysh_status_enable(0);
     tiny_port_cleanup();
     printf("\nExiting tinysh_shell\n");
     exit(0);
@@ -58,7 +91,7 @@ void reboot_cmd_handler(int argc, const char **argv) {
     // Get the admin command argument (for demonstration)
     void *arg = tinysh_get_arg();
     if (arg) {
-        uintptr_t value = (uintptr_t)tinysh_get_real_arg((tinysh_cmd_t*)0); // Get real value without admin flag
+        uintptr_t value = (uintptr_t)arg & 0xFFFFFF; // Real value without the admin flag
         tinysh_printf("Admin command executed with arg: 0x%lx\r\n", value);
     }
     
@@ -68,10 +101,174 @@ void reboot_cmd_handler(int argc, const char **argv) {
     tinysh_printf("On a real system, this would restart the hardware\r\n");
 }
 
+/* Per-channel commands, built from the channel count */
+static unsigned char channel_mem[256 + CHANNEL_MAX * 96];
+static tinysh_arena_t channel_arena;
+static bool channel_on[CHANNEL_MAX];
+
+/**
+ * Channel command handler: the channel number is the command's argument
+ */
+static void channel_cmd_handler(int argc, const char **argv) {
+    int ch = (int)(intptr_t)tinysh_get_arg();
+
+    if (argc == 2 && (strcmp(argv[1], "on") == 0 || strcmp(argv[1], "off") == 0)) {
+        channel_on[ch] = strcmp(argv[1], "on") == 0;
+    } else if (argc > 1) {
+        tinysh_puts("Usage: [on|off]\r\n");
+        return;
+    }
+    tinysh_printf("Channel %d %s\r\n", ch, channel_on[ch] ? "on" : "off");
+}
+
+/**
+ * Build the "ch" context with one command per channel
+ */
+static void build_channels(int count) {
+    tinysh_cmd_t *ch;
+    int n;
+
+    tinysh_arena_init(&channel_arena, "channels", channel_mem, sizeof(channel_mem));
+    ch = tinysh_build_command(&channel_arena, 0, "ch", "per-channel commands", 0, 0, 0);
+    n = ch ? tinysh_build_family(&channel_arena, ch, "%d", 0, count, "channel state", "[on|off]",
+                                 channel_cmd_handler) : 0;
+    if (n < count) tiny_port_printf("Built %d of %d channel commands\r\n", n, count);
+}
+
+/**
+ * Deliver one input character to the menu or the shell
+ * Called by the terminal layer for everything that is not a
+ * terminal report.
+ */
+static void deliver_input(char c) {
+    int secret = tinysh_secret_char(c);
+
+    // Passwords go into the transcript starred, and so does their echo
+    tiny_transcript_record(0, TRANSCRIPT_IN, secret ? "*" : &c, 1);
+    tiny_transcript_star(secret);
+#if MENU_ENABLED
+    // First try to handle it with menu system if in menu mode
+    if (!tinysh_menu_hook(c)) {
+        // If not in menu mode, pass to regular shell
+        tinysh_char_in(c);
+    }
+#else
+    // No menu system, just pass to shell
+    tinysh_char_in(c);
+#endif
+    tiny_transcript_star(0);
+}
+
+/**
+ * Parse FILE[:SECTOR_SIZE:SECTORS] for the fake flash
+ *
+ * @return 0 on success, -1 if the geometry is malformed
+ */
+static int parse_flash_option(const char *arg, const char **file,
+                              unsigned long *sector_size, unsigned short *sectors) {
+    static char path[256];
+    const char *colon = strchr(arg, ':');
+    char *end;
+    unsigned long n;
+
+    snprintf(path, sizeof(path), "%.*s", colon ? (int)(colon - arg) : (int)strlen(arg), arg);
+    *file = path;
+    if (!colon) {
+        return 0;
+    }
+
+    *sector_size = strtoul(colon + 1, &end, 0);
+    if (*end != ':') {
+        return -1;
+    }
+    n = strtoul(end + 1, &end, 0);
+    if (*end || n == 0 || n > 0xFFFF) {
+        return -1;
+    }
+    *sectors = (unsigned short)n;
+    return 0;
+}
+
+/**
+ * Parse PORT[:WORKERS] for the session server
+ *
+ * @return 0 on success, -1 if malformed
+ */
+static int parse_server_option(const char *arg, unsigned short *port, int *workers) {
+    char *end;
+    unsigned long n;
+
+    n = strtoul(arg, &end, 10);
+    if (end == arg || n > 0xFFFF) {
+        return -1;
+    }
+    *port = (unsigned short)n;
+    if (*end == ':') {
+        n = strtoul(end + 1, &end, 10);
+        if (n < 1 || n > SERVER_MAX_WORKERS) {
+            return -1;
+        }
+        *workers = (int)n;
+    }
+    return *end ? -1 : 0;
+}
+
+/**
+ * Run each command through a shell's shared-memory channel and print the
+ * output; all are submitted before the first result is read
+ *
+ * @return Exit code: 0 if every command ran
+ */
+static int run_query(const char *name, int count, char **lines) {
+    tiny_ipc_client_t client;
+    tiny_ipc_frame_t frame;
+    int sent = 0, done = 0, failed = 0;
+
+    if (tiny_ipc_connect(&client, name) < 0) {
+        fprintf(stderr, "Cannot attach to %s: %s\n", name, strerror(errno));
+        return 1;
+    }
+    while (done < count) {
+        // Keep the request ring as full as it goes, then drain
+        while (sent < count && tiny_ipc_submit(&client, lines[sent], -1)) {
+            sent++;
+        }
+        if (tiny_ipc_next(&client, &frame, 5000) < 0) {
+            fprintf(stderr, "No answer from %s\n", name);
+            failed = 1;
+            break;
+        }
+        fwrite(frame.data, 1, frame.len, stdout);
+        if (frame.flags & IPC_FRAME_END) {
+            if (frame.status != IPC_STATUS_OK) {
+                fprintf(stderr, "%s: status %d\n", lines[done], frame.status);
+                failed = 1;
+            }
+            done++;
+        }
+        tiny_ipc_release(&client, &frame);
+    }
+    tiny_ipc_disconnect(&client);
+    return failed;
+}
+
 /* Main function */
 int main(int argc, char *argv[]) {
-    int c;
+    int c, err;
     bool start_in_menu_mode = false;
+    const char *flash_file = FLASH_FILE;
+    unsigned long flash_sector_size = FLASH_SECTOR_SIZE;
+    unsigned short flash_sectors = FLASH_SECTOR_COUNT;
+    const tinysh_flash_t *flash;
+    const char *retain_file = RETAIN_FILE;
+    unsigned short server_port = 0;
+    int server_workers = 2;
+    bool server = false;
+    bool telnet = false;
+    const char *ipc_name = NULL;
+    char *fanout_specs = NULL;
+    const char *transcript_path = NULL;
+    long channels = CHANNEL_COUNT;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -80,8 +277,63 @@ int main(int argc, char *argv[]) {
             printf("  -h, --help    : Show this help message\n");
             printf("  -m, --menu    : Start directly in menu mode\n");
             printf("  -t, --test    : Run test framework\n");
+            printf("  -f, --flash FILE[:SECTOR_SIZE:SECTORS]\n");
+            printf("                : Flash image for saved settings (default %s:%d:%d)\n",
+                   FLASH_FILE, FLASH_SECTOR_SIZE, FLASH_SECTOR_COUNT);
+            printf("  -r, --retain FILE\n");
+            printf("                : State kept across restarts (default %s)\n", RETAIN_FILE);
+            printf("  -s, --server PORT[:WORKERS]\n");
+            printf("                : Serve sessions on %s:PORT (0 = any), 2 workers by default\n",
+                   SERVER_BIND_ADDR);
+            printf("  -T, --telnet  : Speak telnet on the session server\n");
+            printf("  -i, --ipc NAME: Serve a shared-memory channel named NAME (\"/tinysh\")\n");
+            printf("  -q, --query NAME CMD...\n");
+            printf("                : Run each CMD through the channel of a running shell\n");
+            printf("  -F, --fanout SPEC[,SPEC...]\n");
+            printf("                : Devices for 'fanout run': PATH[@BAUD] or tcp:HOST:PORT\n");
+            printf("  -L, --log PATH: Record all sessions to PATH (\"|CMD\" pipes into CMD)\n");
+            printf("  -c, --channels N\n");
+            printf("                : Build ch 0..N-1 commands (default %d, at most %d)\n",
+                   CHANNEL_COUNT, CHANNEL_MAX);
             return 0;
         }
+        else if ((strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--flash") == 0) && i + 1 < argc) {
+            if (parse_flash_option(argv[++i], &flash_file, &flash_sector_size, &flash_sectors) < 0) {
+                fprintf(stderr, "Bad flash geometry: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--retain") == 0) && i + 1 < argc) {
+            retain_file = argv[++i];
+        }
+        else if ((strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--server") == 0) && i + 1 < argc) {
+            if (parse_server_option(argv[++i], &server_port, &server_workers) < 0) {
+                fprintf(stderr, "Bad server port: %s\n", argv[i]);
+                return 1;
+            }
+            server = true;
+        }
+        else if (strcmp(argv[i], "-T") == 0 || strcmp(argv[i], "--telnet") == 0) {
+            telnet = true;
+        }
+        else if ((strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--ipc") == 0) && i + 1 < argc) {
+            ipc_name = argv[++i];
+        }
+        else if ((strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "--query") == 0) && i + 1 < argc) {
+            return run_query(argv[i + 1], argc - i - 2, &argv[i + 2]);
+        }
+        else if ((strcmp(argv[i], "-F") == 0 || strcmp(argv[i], "--fanout") == 0) && i + 1 < argc) {
+            fanout_specs = argv[++i];
+        }
+        else if ((strcmp(argv[i], "-L") == 0 || strcmp(argv[i], "--log") == 0) && i + 1 < argc) {
+            transcript_path = argv[++i];
+        }
+        else if ((strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--channels") == 0) && i + 1 < argc) {
+            if (tinysh_parse_long(argv[++i], -1, &channels) < 0 || channels < 0 || channels > CHANNEL_MAX) {
+                fprintf(stderr, "Bad channel count: %s\n", argv[i]);
+                return 1;
+            }
+        }
         else if (strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--menu") == 0) {
             start_in_menu_mode = true;
         }
@@ -113,14 +365,56 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    // Setup TinyShell
+    // Setup TinyShell; the port restores what the last run retained
+    tinysh_term_set_input(deliver_input);
+    tinysh_retain_attach(tiny_port_retain_open(retain_file));
     tiny_port_setup();
+    tinysh_term_init();
+    tinysh_status_init();
+    tinysh_table_init();
+    tinysh_metric_init();
+    tinysh_memo_init();
+    tinysh_apropos_init();
+    tinysh_param_init();
+    tinysh_timer_init();
+    tiny_transcript_init();
     
     // Add example commands
     extern tinysh_cmd_t sysinfo_cmd;
     extern tinysh_cmd_t echo_cmd;
+    extern tinysh_cmd_t cat_cmd;
     tinysh_add_command(&sysinfo_cmd);
+    tinysh_memo_enable(&sysinfo_cmd, 1000);   // polled by scripts, output is static
     tinysh_add_command(&echo_cmd);
+    tinysh_add_command(&cat_cmd);
+    tinysh_complete_register(&cat_cmd, tiny_port_complete_path, NULL);
+    tinysh_add_command(&server_cmd);
+    tinysh_add_command(&quota_cmd);
+    tinysh_add_command(&telnet_cmd);
+    tinysh_add_command(&attach_cmd);
+    tinysh_add_command(&scrollback_cmd);
+    tinysh_add_command(&ipc_cmd);
+    tinysh_add_command(&fanout_cmd);
+    tinysh_add_command(&transcript_cmd);
+    tinysh_add_command(&retain_cmd);
+    tinysh_add_command(&arenas_cmd);
+    if (channels > 0) build_channels((int)channels);
+    tiny_server_threadsafe(&echo_cmd);        // no shared state: run in parallel
+    tiny_server_threadsafe(&cat_cmd);
+    tiny_server_threadsafe(&fanout_cmd);      // waits on devices under its own lock
+    tinysh_metric_register(&load_metric);
+    tinysh_param_register(&erase_delay_param);
+
+    // Settings store on the fake flash; restore what was saved
+    tinysh_kv_init();
+    flash = tiny_port_flash_open(flash_file, flash_sector_size, flash_sectors);
+    err = flash ? tinysh_kv_mount(flash) : KV_ERR_IO;
+    if (err == KV_OK) {
+        tinysh_kv_load_params();
+    } else {
+        tiny_port_printf("Settings store unavailable (%s): %s\r\n", flash_file, tinysh_kv_error(err));
+    }
+
     extern tinysh_cmd_t quit_cmd;
     tinysh_add_command(&quit_cmd);
     
@@ -164,26 +458,76 @@ int main(int argc, char *argv[]) {
         tinysh_menu_enter();
     }
 #endif
+
+    // Transcript first, so the other services' sessions are all in it
+    if (transcript_path && tiny_transcript_start(transcript_path) < 0) {
+        tiny_port_printf("Transcript %s failed: %s\r\n", transcript_path, strerror(errno));
+    }
+
+    // Session server, once the command tree is complete
+    if (server) {
+        tiny_server_telnet(telnet);
+        int port = tiny_server_start(server_port, server_workers);
+        if (port < 0) {
+            tiny_port_printf("Session server failed on port %u: %s\r\n", server_port, strerror(errno));
+        } else {
+            tiny_port_printf("Serving %s sessions on %s:%d (%d workers)\r\n", telnet ? "telnet" : "TCP",
+                             SERVER_BIND_ADDR, port, server_workers);
+        }
+    }
+    if (ipc_name) {
+        if (tiny_ipc_start(ipc_name, 0) < 0) {
+            tiny_port_printf("Channel %s failed: %s\r\n", ipc_name, strerror(errno));
+        } else {
+            tiny_port_printf("Serving channel %s\r\n", ipc_name);
+        }
+    }
+    for (char *spec = fanout_specs ? strtok(fanout_specs, ",") : NULL; spec; spec = strtok(NULL, ",")) {
+        if (tiny_fanout_open(spec, NULL, 0) < 0) {
+            tiny_port_printf("Device %s failed: %s\r\n", spec, strerror(errno));
+        }
+    }
+
+#if STATUS_LINE_ENABLED
+    // Status bar on the bottom row, outside the scrolling area
+    tinysh_status_enable(1);
+#endif
     
     /* Main loop section */
-    // Main loop - read characters from stdin and pass to TinyShell
-    while ((c = getchar()) != EOF && is_tinyshell_active()) {
-        // Debug to check raw incoming characters
-        // printf("Got char: %d\n", c);
-        
-    #if MENU_ENABLED
-        // First try to handle it with menu system if in menu mode
-        if (!tinysh_menu_hook(c)) {
-            // If not in menu mode, pass to regular shell
-            tinysh_char_in(c);
+    // Main loop - read characters from stdin and pass to TinyShell.
+    // Input is polled with a short timeout so periodic work (live menu
+    // values) keeps running while the user is idle. The executor lock
+    // keeps it apart from session handlers running on server workers.
+    while (is_tinyshell_active()) {
+        c = tiny_port_getchar_timeout(MAIN_LOOP_TICK_MS);
+        if (c == EOF) {
+            break;
         }
-    #else
-        // No menu system, just pass to shell
-        tinysh_char_in(c);
+
+        tiny_server_lock();
+        if (c != TINY_PORT_TIMEOUT) {
+            // Terminal reports are filtered out, the rest goes to deliver_input()
+            tinysh_term_input((char)c);
+        }
+
+        tinysh_term_tick();
+        tinysh_status_tick();
+        tinysh_metric_tick();
+        tinysh_timer_tick();
+    #if MENU_ENABLED
+        tinysh_menu_tick();
     #endif
+        tiny_transcript_flush();
+        tinysh_retain_tick();
+        tiny_server_unlock();
     }
     
-    // Cleanup terminal settings
+    // Close remote sessions, the channel, fan-out devices and the transcript, then clean up terminal settings
+    tiny_ipc_close();
+    tiny_server_stop();
+    tiny_fanout_drop(NULL);
+    tiny_transcript_stop();
+    tinysh_status_enable(0);
     tiny_port_cleanup();
     
     return 0;
@@ -11,6 +11,7 @@
  * - Buffer and memory settings
  * - Command handling settings
  * - Authentication settings
+ * - Status line settings
  * - Menu system settings
  *
  * Usage:
@@ -68,6 +69,62 @@
 #define DEFAULT_ADMIN_PASSWORD      "embedded2024"  // Custom admin password
 #endif
 
+/* Status line on the bottom terminal row, shown at startup.
+   It can always be switched with the "status" command. */
+#ifndef STATUS_LINE_ENABLED
+#define STATUS_LINE_ENABLED       0
+#endif
+
+/* Fake flash holding the settings store (tinysh_kv.h) on Linux: an image
+   file mapped into memory. Override with -f FILE[:SECTOR_SIZE:SECTORS]. */
+#ifndef FLASH_FILE
+#define FLASH_FILE                "tinysh_flash.bin"
+#endif
+#ifndef FLASH_SECTOR_SIZE
+#define FLASH_SECTOR_SIZE         4096
+#endif
+#ifndef FLASH_SECTOR_COUNT
+#define FLASH_SECTOR_COUNT        4
+#endif
+
+/* File standing in for no-init RAM (tinysh_retain.h) on Linux, so state
+   survives a restart as it would a reset. Override with -r FILE. */
+#ifndef RETAIN_FILE
+#define RETAIN_FILE               "tinysh_retain.bin"
+#endif
+
+/* Example per-channel commands built at run time (tinysh_build.h), "ch 0"
+   to "ch N-1". Override the count with -c N. */
+#ifndef CHANNEL_COUNT
+#define CHANNEL_COUNT             8
+#endif
+#ifndef CHANNEL_MAX
+#define CHANNEL_MAX               64
+#endif
+
+/* Command search (tinysh_apropos.h) indexes the whole tree, so its tables
+   grow with the channel commands: each adds a node, a word (its number)
+   and five postings. The word table is a power of two with room to spare. */
+#ifndef APROPOS_MAX_COMMANDS
+#define APROPOS_MAX_COMMANDS      (128 + CHANNEL_MAX)
+#endif
+#ifndef APROPOS_MAX_TERMS
+#if CHANNEL_MAX <= 192
+#define APROPOS_MAX_TERMS         512
+#else
+#define APROPOS_MAX_TERMS         1024
+#endif
+#endif
+#ifndef APROPOS_MAX_POSTINGS
+#define APROPOS_MAX_POSTINGS      (1024 + CHANNEL_MAX * 5)
+#endif
+
+/* Session server (tiny_server.h): sessions run on worker threads, so
+   the shell keeps its current session and output per thread */
+#ifndef TINYSH_THREADS
+#define TINYSH_THREADS            1
+#endif
+
 /* Menu System Configuration */
 #ifndef MENU_ENABLED
 #define MENU_ENABLED              1  // Enable by default
@@ -86,7 +143,7 @@
 #define MENU_MAX_ITEMS            16 // Total slots per menu (commands + Back)
 #endif
 #ifndef MENU_DISPLAY_ITEMS
-#define MENU_DISPLAY_ITEMS        10  // Number of items to display at once
+#define MENU_DISPLAY_ITEMS        10  // Items shown until the terminal size is known
 #endif
 #ifndef MAX_CMD_MENU_ITEMS
 #define MAX_CMD_MENU_ITEMS        (MENU_MAX_ITEMS - 1)  // max USER commands
@@ -0,0 +1,604 @@
+#define _GNU_SOURCE             /* cfmakeraw, cfsetspeed */
+#include "tiny_fanout.h"
+#include "tinysh.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+/* A device and its last response */
+typedef struct {
+    int fd;                          /* -1: free slot */
+    char name[16];
+    int timeout_ms;
+
+    /* Run in progress */
+    int state;                       /* FANOUT_* */
+    int sent;                        /* bytes of the line written */
+    int waiting;                     /* still in the run */
+    unsigned long deadline;
+
+    /* Response */
+    char out[FANOUT_OUT_SIZE];
+    int len;
+    unsigned long lost;              /* bytes beyond FANOUT_OUT_SIZE */
+    unsigned long elapsed;           /* ms to the prompt, or to the end */
+    int group;                       /* first device with the same answer */
+
+    /* Counters */
+    unsigned long runs;
+    unsigned long timeouts;
+} fanout_dev_t;
+
+static fanout_dev_t devices[FANOUT_MAX_DEVICES];
+static int ndevices = 0;             /* slots in use, up to the last one */
+static char tx[BUFFER_SIZE + 2];     /* line being sent, with CR */
+static int tx_len = 0;
+static char echo_line[BUFFER_SIZE + 1];
+
+/* Guards all of the above; the command runs without the executor lock
+   (see tiny_fanout.h), so waiting on devices holds up only other fan-outs */
+static pthread_mutex_t fanout_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+/* Forward declarations */
+static int find(const char *name);
+static int open_tcp(const char *hostport, int timeout_ms);
+static int connect_within(int fd, const struct addrinfo *ai, unsigned long deadline);
+static int open_tty(const char *spec);
+static void drain(fanout_dev_t *d);
+static void finish(int epfd, fanout_dev_t *d, int state, unsigned long start);
+static void receive(int epfd, fanout_dev_t *d, unsigned long start);
+static void transmit(int epfd, fanout_dev_t *d);
+static void tidy(fanout_dev_t *d);
+static int same_answer(const fanout_dev_t *a, const fanout_dev_t *b);
+static void list(void);
+static void add(int argc, const char **argv);
+static void run(int argc, const char **argv);
+void fanout_cmd_handler(int argc, const char **argv);
+
+/* Fanout command */
+tinysh_cmd_t fanout_cmd = {
+    0, "fanout", "run a command line on many devices",
+    "[add {PATH[@BAUD]|tcp:HOST:PORT} [NAME] [MS] | drop {NAME|all} | run LINE...]",
+    fanout_cmd_handler, 0, 0, 0
+};
+
+/**
+ * Slot of a named device, -1 if none
+ */
+static int find(const char *name) {
+    int i;
+
+    for (i = 0; i < ndevices; i++) {
+        if (devices[i].fd >= 0 && strcmp(devices[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+/**
+ * Start a nonblocking connect and wait for it until deadline
+ *
+ * @return 0 once connected, -1 on error or timeout (errno set)
+ */
+static int connect_within(int fd, const struct addrinfo *ai, unsigned long deadline) {
+    struct pollfd pfd;
+    unsigned long now;
+    socklen_t len = sizeof(int);
+    int err = 0, n;
+
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) return 0;
+    if (errno != EINPROGRESS) return -1;
+
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    for (;;) {
+        now = tinysh_time_ms();
+        if (now >= deadline) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        n = poll(&pfd, 1, (int)(deadline - now));
+        if (n > 0) break;
+        if (n < 0 && errno != EINTR) return -1;
+    }
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) return -1;
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Connect to HOST:PORT, giving up after timeout_ms over all its addresses
+ */
+static int open_tcp(const char *hostport, int timeout_ms) {
+    struct addrinfo hints, *res, *ai;
+    char host[64];
+    const char *colon = strrchr(hostport, ':');
+    unsigned long deadline;
+    int fd = -1, err;
+
+    if (!colon || colon == hostport || (size_t)(colon - hostport) >= sizeof(host)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(host, hostport, (size_t)(colon - hostport));
+    host[colon - hostport] = 0;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    err = getaddrinfo(host, colon + 1, &hints, &res);
+    if (err) {
+        errno = err == EAI_SYSTEM ? errno : EHOSTUNREACH;
+        return -1;
+    }
+    deadline = tinysh_time_ms() + (unsigned long)timeout_ms;
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect_within(fd, ai, deadline) == 0) break;
+        err = errno;
+        close(fd);
+        errno = err;
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+/**
+ * Open a serial port or PTY, raw, at the given speed if any
+ */
+static int open_tty(const char *spec) {
+    char path[128];
+    const char *at = strrchr(spec, '@');
+    struct termios tio;
+    unsigned long baud = 0;
+    int fd;
+
+    if (at) {
+        baud = strtoul(at + 1, NULL, 10);
+        if ((size_t)(at - spec) >= sizeof(path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memcpy(path, spec, (size_t)(at - spec));
+        path[at - spec] = 0;
+    } else {
+        snprintf(path, sizeof(path), "%s", spec);
+    }
+
+    fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return -1;
+    if (isatty(fd) && tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        if (baud && cfsetspeed(&tio, (speed_t)baud) < 0) {
+            close(fd);
+            errno = EINVAL;
+            return -1;
+        }
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+/**
+ * Open a device and add it
+ */
+int tiny_fanout_open(const char *spec, const char *name, int timeout_ms) {
+    const char *base;
+    int fd, i, err;
+
+    if (strncmp(spec, "tcp:", 4) == 0) {
+        fd = open_tcp(spec + 4, timeout_ms > 0 ? timeout_ms : FANOUT_TIMEOUT_MS);
+    } else {
+        fd = open_tty(spec);
+    }
+    if (fd < 0) return -1;
+
+    if (!name) {
+        base = strncmp(spec, "tcp:", 4) == 0 ? spec + 4 : strrchr(spec, '/');
+        name = base ? (*base == '/' ? base + 1 : base) : spec;
+    }
+    i = tiny_fanout_attach(fd, name, timeout_ms);
+    if (i < 0) {
+        err = errno;
+        close(fd);
+        errno = err;
+    }
+    return i;
+}
+
+/**
+ * Add an already open link
+ */
+int tiny_fanout_attach(int fd, const char *name, int timeout_ms) {
+    fanout_dev_t *d;
+    char shortname[sizeof(devices[0].name)];
+    int i;
+
+    snprintf(shortname, sizeof(shortname), "%s", name);
+    pthread_mutex_lock(&fanout_lock);
+    if (shortname[0] == 0 || find(shortname) >= 0) {
+        pthread_mutex_unlock(&fanout_lock);
+        errno = EEXIST;
+        return -1;
+    }
+    for (i = 0; i < ndevices && devices[i].fd >= 0; i++);
+    if (i == FANOUT_MAX_DEVICES) {
+        pthread_mutex_unlock(&fanout_lock);
+        errno = ENOSPC;
+        return -1;
+    }
+    if (i == ndevices) ndevices++;
+
+    d = &devices[i];
+    memset(d, 0, sizeof(*d));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    d->fd = fd;
+    memcpy(d->name, shortname, sizeof(d->name));
+    d->timeout_ms = timeout_ms > 0 ? timeout_ms : FANOUT_TIMEOUT_MS;
+    d->state = FANOUT_IDLE;
+    pthread_mutex_unlock(&fanout_lock);
+    return i;
+}
+
+/**
+ * Close and remove a device, or all
+ */
+int tiny_fanout_drop(const char *name) {
+    int i, n = 0;
+
+    pthread_mutex_lock(&fanout_lock);
+    for (i = 0; i < ndevices; i++) {
+        if (devices[i].fd < 0 || (name && strcmp(devices[i].name, name) != 0)) continue;
+        close(devices[i].fd);
+        devices[i].fd = -1;
+        n++;
+    }
+    while (ndevices > 0 && devices[ndevices - 1].fd < 0) ndevices--;
+    pthread_mutex_unlock(&fanout_lock);
+    return n;
+}
+
+/**
+ * Throw away whatever a device sent since the last run (late answers)
+ */
+static void drain(fanout_dev_t *d) {
+    char scratch[256];
+
+    while (read(d->fd, scratch, sizeof(scratch)) > 0);
+}
+
+/**
+ * A device is out of the run
+ */
+static void finish(int epfd, fanout_dev_t *d, int state, unsigned long start) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, d->fd, NULL);
+    d->state = state;
+    d->waiting = 0;
+    d->elapsed = tinysh_time_ms() - start;
+    if (state == FANOUT_TIMEOUT) d->timeouts++;
+}
+
+/**
+ * Device readable: keep what fits, and check for its prompt
+ * The prompt only counts once the line was sent and a line end came
+ * back, so the echo of a prompt sent earlier does not end the run.
+ */
+static void receive(int epfd, fanout_dev_t *d, unsigned long start) {
+    static const char prompt[] = FANOUT_PROMPT;
+    char scratch[256];
+    int plen = (int)sizeof(prompt) - 1;
+    ssize_t n;
+
+    for (;;) {
+        if (d->len < FANOUT_OUT_SIZE) {
+            n = read(d->fd, d->out + d->len, (size_t)(FANOUT_OUT_SIZE - d->len));
+            if (n > 0) d->len += (int)n;
+        } else {
+            n = read(d->fd, scratch, sizeof(scratch));
+            if (n > 0) d->lost += (unsigned long)n;
+        }
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            finish(epfd, d, FANOUT_ERROR, start);
+            return;
+        }
+        if (n < 0) break;
+    }
+
+    if (d->sent == tx_len && d->len >= plen && memchr(d->out, '\n', (size_t)d->len) &&
+        memcmp(d->out + d->len - plen, prompt, (size_t)plen) == 0) {
+        finish(epfd, d, FANOUT_DONE, start);
+    }
+}
+
+/**
+ * Device writable: send more of the line
+ */
+static void transmit(int epfd, fanout_dev_t *d) {
+    struct epoll_event ev;
+    ssize_t n;
+
+    n = write(d->fd, tx + d->sent, (size_t)(tx_len - d->sent));
+    if (n > 0) d->sent += (int)n;
+    if (d->sent == tx_len) {
+        ev.events = EPOLLIN;
+        ev.data.ptr = d;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, d->fd, &ev);
+    }
+}
+
+/**
+ * Send a command line to every device and collect the responses
+ */
+int tiny_fanout_run(const char *line) {
+    struct epoll_event ev, events[FANOUT_MAX_DEVICES];
+    unsigned long start, now;
+    fanout_dev_t *d;
+    int epfd, i, n, waiting = 0, wait_ms, done = 0;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) return 0;
+
+    pthread_mutex_lock(&fanout_lock);
+    snprintf(echo_line, sizeof(echo_line), "%s", line);
+    tx_len = snprintf(tx, sizeof(tx), "%s\r", echo_line);
+
+    start = tinysh_time_ms();
+    for (i = 0; i < ndevices; i++) {
+        d = &devices[i];
+        if (d->fd < 0) continue;
+        drain(d);
+        d->len = 0;
+        d->lost = 0;
+        d->sent = 0;
+        d->runs++;
+        d->deadline = start + (unsigned long)d->timeout_ms;
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.ptr = d;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, d->fd, &ev) < 0) {
+            d->state = FANOUT_ERROR;
+            d->elapsed = 0;
+            continue;
+        }
+        d->waiting = 1;
+        waiting++;
+    }
+
+    while (waiting) {
+        now = tinysh_time_ms();
+        wait_ms = -1;
+        for (i = 0; i < ndevices; i++) {
+            d = &devices[i];
+            if (d->fd < 0 || !d->waiting) continue;
+            if (now >= d->deadline) {
+                finish(epfd, d, FANOUT_TIMEOUT, start);
+                waiting--;
+            } else if (wait_ms < 0 || (int)(d->deadline - now) < wait_ms) {
+                wait_ms = (int)(d->deadline - now);
+            }
+        }
+        if (!waiting) break;
+
+        n = epoll_wait(epfd, events, FANOUT_MAX_DEVICES, wait_ms);
+        if (n < 0 && errno != EINTR) break;
+        for (i = 0; i < n; i++) {
+            d = events[i].data.ptr;
+            if (!d->waiting) continue;
+            if (events[i].events & EPOLLOUT) transmit(epfd, d);
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) receive(epfd, d, start);
+            if (!d->waiting) waiting--;
+        }
+    }
+    close(epfd);
+
+    for (i = 0; i < ndevices; i++) {
+        d = &devices[i];
+        if (d->fd < 0) continue;
+        tidy(d);
+        if (d->state == FANOUT_DONE) done++;
+    }
+    pthread_mutex_unlock(&fanout_lock);
+    return done;
+}
+
+/**
+ * Reduce a response to what the command printed: no echo of the line,
+ * no prompt after it, LF line ends
+ */
+static void tidy(fanout_dev_t *d) {
+    int i, j, start = 0, end = d->len, elen = tinysh_strlen(echo_line);
+    char *nl;
+
+    if (end >= elen && memcmp(d->out, echo_line, (size_t)elen) == 0) {
+        nl = memchr(d->out, '\n', (size_t)end);
+        if (nl) start = (int)(nl - d->out) + 1;
+    }
+    if (d->state == FANOUT_DONE) {
+        while (end > start && d->out[end - 1] != '\n') end--;
+    }
+    for (i = start, j = 0; i < end; i++) {
+        if (d->out[i] != '\r') d->out[j++] = d->out[i];
+    }
+    d->len = j;
+}
+
+/**
+ * Do two devices count as having answered the same
+ */
+static int same_answer(const fanout_dev_t *a, const fanout_dev_t *b) {
+    return a->state == b->state && a->len == b->len &&
+           memcmp(a->out, b->out, (size_t)a->len) == 0;
+}
+
+/**
+ * Outcome of the last run on a device
+ */
+int tiny_fanout_result(int index, const char **out, int *len) {
+    int state = -1;
+
+    pthread_mutex_lock(&fanout_lock);
+    if (index >= 0 && index < ndevices && devices[index].fd >= 0) {
+        if (out) *out = devices[index].out;
+        if (len) *len = devices[index].len;
+        state = devices[index].state;
+    }
+    pthread_mutex_unlock(&fanout_lock);
+    return state;
+}
+
+/**
+ * Print the last run's responses, identical ones grouped
+ * Groups are listed largest first, so the odd ones out come last.
+ */
+void tiny_fanout_report(void) {
+    static const char *what[] = { "not run", "answered", "timed out", "link failed" };
+    fanout_dev_t *d;
+    unsigned long slowest;
+    int i, j, size, best, shown = 0, total = 0, groups = 0;
+    int sizes[FANOUT_MAX_DEVICES];
+    char printed[FANOUT_MAX_DEVICES];
+
+    pthread_mutex_lock(&fanout_lock);
+    for (i = 0; i < ndevices; i++) {
+        sizes[i] = 0;
+        printed[i] = 0;
+        d = &devices[i];
+        if (d->fd < 0) continue;
+        total++;
+        for (j = 0; j < i && (devices[j].fd < 0 || !same_answer(&devices[j], d)); j++);
+        d->group = j;
+        sizes[j]++;
+        if (j == i) groups++;
+    }
+    if (!total) {
+        tinysh_printf("No devices\r\n");
+        pthread_mutex_unlock(&fanout_lock);
+        return;
+    }
+
+    while (shown < total) {
+        for (best = -1, i = 0; i < ndevices; i++) {
+            if (devices[i].fd >= 0 && !printed[i] && devices[i].group == i &&
+                (best < 0 || sizes[i] > sizes[best])) best = i;
+        }
+        size = sizes[best];
+        printed[best] = 1;
+        shown += size;
+
+        slowest = 0;
+        tinysh_printf("=== ");
+        for (i = best; i < ndevices; i++) {
+            d = &devices[i];
+            if (d->fd < 0 || d->group != best) continue;
+            tinysh_printf("%s ", d->name);
+            if (d->elapsed > slowest) slowest = d->elapsed;
+        }
+        tinysh_printf("(%d, %s, %lu ms)\r\n", size, what[devices[best].state], slowest);
+
+        d = &devices[best];
+        for (i = 0, j = 0; i < d->len; i++) {
+            if (d->out[i] != '\n') continue;
+            tinysh_write(d->out + j, i - j);
+            tinysh_printf("\r\n");
+            j = i + 1;
+        }
+        if (j < d->len) {
+            tinysh_write(d->out + j, d->len - j);
+            tinysh_printf("\r\n");
+        }
+        if (d->lost) tinysh_printf("(%lu more bytes not kept)\r\n", d->lost);
+    }
+    tinysh_printf("%d devices, %d distinct answers\r\n", total, groups);
+    pthread_mutex_unlock(&fanout_lock);
+}
+
+/**
+ * List devices and how their last run went
+ */
+static void list(void) {
+    static const char *what[] = { "-", "ok", "timeout", "error" };
+    fanout_dev_t *d;
+    int i, n = 0;
+
+    pthread_mutex_lock(&fanout_lock);
+    for (i = 0; i < ndevices; i++) {
+        d = &devices[i];
+        if (d->fd < 0) continue;
+        if (!n++) tinysh_printf("Name             Timeout  Runs  Timeouts  Last\r\n");
+        tinysh_printf("%-16s %5d ms %5lu %9lu  %s\r\n", d->name, d->timeout_ms,
+                      d->runs, d->timeouts, what[d->state]);
+    }
+    pthread_mutex_unlock(&fanout_lock);
+    if (!n) tinysh_printf("No devices; add one with 'fanout add'\r\n");
+}
+
+/**
+ * fanout add SPEC [NAME] [MS]
+ */
+static void add(int argc, const char **argv) {
+    long timeout = 0;
+
+    if (argc < 3 || (argc > 4 && (tinysh_parse_long(argv[4], -1, &timeout) < 0 ||
+                                  timeout < 0 || timeout > INT_MAX))) {
+        tinysh_printf("Usage: fanout add {PATH[@BAUD]|tcp:HOST:PORT} [NAME] [MS]\r\n");
+        return;
+    }
+    if (tiny_fanout_open(argv[2], argc > 3 ? argv[3] : NULL, (int)timeout) < 0) {
+        tinysh_printf("Cannot add %s: %s\r\n", argv[2], strerror(errno));
+    }
+}
+
+/**
+ * fanout run LINE...: the arguments, joined, are the line
+ */
+static void run(int argc, const char **argv) {
+    char line[BUFFER_SIZE + 1];
+    int i, len = 0;
+
+    if (argc < 3) {
+        tinysh_printf("Usage: fanout run LINE...\r\n");
+        return;
+    }
+    line[0] = 0;
+    for (i = 2; i < argc && len < BUFFER_SIZE; i++) {
+        len += snprintf(line + len, sizeof(line) - (size_t)len, "%s%s", i > 2 ? " " : "", argv[i]);
+    }
+    pthread_mutex_lock(&fanout_lock);
+    tiny_fanout_run(line);
+    tiny_fanout_report();
+    pthread_mutex_unlock(&fanout_lock);
+}
+
+/**
+ * Fanout command handler
+ */
+void fanout_cmd_handler(int argc, const char **argv) {
+    if (argc < 2) {
+        list();
+    } else if (strcmp(argv[1], "add") == 0) {
+        add(argc, argv);
+    } else if (strcmp(argv[1], "run") == 0) {
+        run(argc, argv);
+    } else if (strcmp(argv[1], "drop") == 0 && argc == 3) {
+        if (!tiny_fanout_drop(strcmp(argv[2], "all") == 0 ? NULL : argv[2])) {
+            tinysh_printf("No device %s\r\n", argv[2]);
+        }
+    } else {
+        tinysh_printf("Usage: fanout %s\r\n", fanout_cmd.usage);
+    }
+}
@@ -0,0 +1,119 @@
+/**
+ * TinyShell Fan-out (Linux host)
+ * -----------------------------
+ * Runs the same command line on many devices at once, e.g. 20 boards on
+ * USB serial adapters or PTYs, each running a shell, and shows what they
+ * answered side by side.
+ *
+ * Features:
+ * - Devices are serial ports or PTYs ("/dev/ttyUSB0", "/dev/ttyACM1@115200")
+ *   or shells served over TCP ("tcp:127.0.0.1:2323", see tiny_server.h)
+ * - One epoll loop sends the line to every device and collects every
+ *   response, so all links progress in parallel and a run takes as long
+ *   as the slowest device, not the sum
+ * - A response ends when the device shows its prompt again, or at the
+ *   device's own timeout
+ * - Responses are shown grouped: devices that answered identically are
+ *   listed together with the output once, timeouts and errors apart
+ * - Echo and prompt are stripped, line ends normalized
+ * - TCP devices connect within the device's timeout, so a dead host
+ *   fails the "add" instead of hanging it
+ * - The device table has its own lock: mark fanout_cmd with
+ *   tiny_server_threadsafe() and a run waiting on slow devices holds up
+ *   only other fan-outs, not every session
+ *
+ * Example Usage:
+ *
+ * tinysh_add_command(&fanout_cmd);
+ * tiny_server_threadsafe(&fanout_cmd);
+ * tiny_fanout_open("/dev/ttyUSB0@115200", "b1", 0);
+ * tiny_fanout_open("tcp:127.0.0.1:2323", "sim", 500);
+ * tiny_fanout_run("sysinfo");
+ * tiny_fanout_report();
+ *
+ * tinysh> fanout run sysinfo
+ */
+
+#ifndef TINY_FANOUT_H
+#define TINY_FANOUT_H
+
+#include "tinysh.h"
+
+/* Most devices */
+#ifndef FANOUT_MAX_DEVICES
+#define FANOUT_MAX_DEVICES        32
+#endif
+
+/* Response bytes kept per device; the rest is counted, not kept */
+#ifndef FANOUT_OUT_SIZE
+#define FANOUT_OUT_SIZE           4096
+#endif
+
+/* Longest a device may take to answer, unless given its own */
+#ifndef FANOUT_TIMEOUT_MS
+#define FANOUT_TIMEOUT_MS         2000
+#endif
+
+/* Output ending in this is the device's prompt: its response is complete */
+#ifndef FANOUT_PROMPT
+#define FANOUT_PROMPT             "> "
+#endif
+
+/* Outcome of a device's last run */
+#define FANOUT_IDLE               0     // Not run yet
+#define FANOUT_DONE               1     // Answered, prompt seen
+#define FANOUT_TIMEOUT            2     // No prompt in time; partial output kept
+#define FANOUT_ERROR              3     // Link failed or closed
+
+/**
+ * Open a device and add it
+ *
+ * @param spec       "PATH[@BAUD]" or "tcp:HOST:PORT"
+ * @param name       Name shown in reports, NULL to derive one from spec
+ * @param timeout_ms Response timeout, 0 for FANOUT_TIMEOUT_MS; also the
+ *                   longest a TCP connect may take
+ * @return Device index, or -1 on error (errno set)
+ */
+int tiny_fanout_open(const char *spec, const char *name, int timeout_ms);
+
+/**
+ * Add an already open link, e.g. one end of a socketpair
+ * The descriptor is made nonblocking and closed with the device.
+ *
+ * @return Device index, or -1 if the table is full or the name taken
+ */
+int tiny_fanout_attach(int fd, const char *name, int timeout_ms);
+
+/**
+ * Close and remove a device, or every device when name is NULL
+ *
+ * @return Devices removed
+ */
+int tiny_fanout_drop(const char *name);
+
+/**
+ * Send a command line to every device and collect the responses
+ *
+ * @return Devices that answered before their timeout
+ */
+int tiny_fanout_run(const char *line);
+
+/**
+ * Outcome of the last run on a device
+ *
+ * @param index Device index
+ * @param out   Receives the cleaned-up response, can be NULL
+ * @param len   Receives its length, can be NULL
+ * @return FANOUT_* outcome, or -1 for no such device
+ */
+int tiny_fanout_result(int index, const char **out, int *len);
+
+/**
+ * Print the last run's responses, identical ones grouped
+ */
+void tiny_fanout_report(void);
+
+/* Fanout command: lists devices, "add", "drop", "run" */
+extern tinysh_cmd_t fanout_cmd;
+
+#endif /* TINY_FANOUT_H */
@@ -0,0 +1,813 @@
+#define _GNU_SOURCE             /* syscall */
+#include "tiny_ipc.h"
+#include "tiny_server.h"
+#include "tiny_transcript.h"
+#include "tinysh_term.h"
+#include "tinysh.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/* "TIPC" */
+#define IPC_MAGIC    0x43504954u
+#define IPC_VERSION  1
+
+/* Frames start on this boundary */
+#define FRAME_ALIGN  16
+
+/* Smallest frame worth opening: header and one aligned block of output */
+#define FRAME_MIN    (sizeof(ipc_hdr_t) + FRAME_ALIGN)
+
+/* How often an idle serving thread checks for stop */
+#define IDLE_MS      200
+
+#define COUNT(var, n)  __atomic_fetch_add(&(var), (n), __ATOMIC_RELAXED)
+#define LOAD(var)      __atomic_load_n(&(var), __ATOMIC_RELAXED)
+
+/* Frame header in a ring */
+typedef struct {
+    uint32_t len;                    // Payload bytes
+    uint32_t id;                     // Request id
+    uint16_t flags;                  // IPC_FRAME_*
+    int16_t status;                  // IPC_STATUS_*, with IPC_FRAME_END
+    uint32_t reserved;
+} ipc_hdr_t;
+
+/* One direction; head and tail run freely and wrap at 2^32 */
+typedef struct {
+    uint32_t head;                   // Bytes published by the producer
+    uint32_t tail;                   // Bytes released by the consumer
+    uint32_t data_seq;               // Futex word, bumped when head moves
+    uint32_t space_seq;              // Futex word, bumped when tail moves
+    uint32_t data_wait;              // Consumer sleeps on data_seq
+    uint32_t space_wait;             // Producer sleeps on space_seq
+    uint32_t pad[10];                // Own cache line
+} ipc_ring_t;
+
+/* Shared region: this header, then the request ring's bytes, then the
+   response ring's */
+struct tiny_ipc_shared {
+    uint32_t magic;                  // Written last by the shell
+    uint32_t version;
+    uint32_t ring_size;
+    uint32_t server_pid;
+    uint32_t client_pid;             // 0 when no client is attached
+    uint32_t next_id;                // Last request id handed out
+    uint32_t pad[10];
+    ipc_ring_t req;
+    ipc_ring_t resp;
+};
+
+/* Shell side of the open channel */
+typedef struct {
+    tiny_ipc_shared_t *shm;
+    unsigned long size;              // Bytes mapped
+    uint32_t mask;                   // ring_size - 1
+    char name[64];
+    tinysh_line_t line;              // Context and auth level of the channel
+    unsigned session;                // Number in transcripts
+
+    /* Response being written */
+    uint32_t head;                   // Producer position, unpublished part included
+    ipc_hdr_t *frame;                // Open frame, NULL if none
+    uint32_t id;                     // Request it answers
+    int dropped;                     // Output of this request was lost
+    int owed;                        // End frame not sent yet, for id and status
+    int16_t owed_status;
+
+    /* Serving thread */
+    pthread_t thread;
+    int threaded;
+    int stop;
+
+    /* Counters */
+    unsigned long requests;
+    unsigned long frames;
+    unsigned long bytes_out;
+    unsigned long bytes_dropped;
+    unsigned long stalls;
+    unsigned long malformed;         // Request frames past what was published
+} ipc_server_t;
+
+/* What the channel replaces on its thread while a request runs */
+typedef struct {
+    tinysh_line_t *line;
+    int plain;
+    void (*char_out)(unsigned char);
+    int (*printf)(const char *, ...);
+    void (*block_out)(const char *, int);
+} ipc_saved_t;
+
+static ipc_server_t srv;
+
+/* Forward declarations */
+static long futex_wait(uint32_t *addr, uint32_t val, int timeout_ms);
+static void futex_wake(uint32_t *addr);
+static long ms_left(const struct timespec *deadline);
+static char *ring_data(tiny_ipc_shared_t *shm, const ipc_ring_t *r);
+static void ring_publish(ipc_ring_t *r, uint32_t head);
+static void ring_release(ipc_ring_t *r, uint32_t tail);
+static int ring_wait_data(ipc_ring_t *r, uint32_t pos, int timeout_ms);
+static int ring_wait_space(ipc_ring_t *r, uint32_t head, uint32_t size, uint32_t need, int timeout_ms);
+static uint32_t frame_room(void);
+static int frame_open(int timeout_ms);
+static void frame_close(uint16_t flags, int16_t status);
+static void ipc_write(const char *buf, int len);
+static void ipc_char_out(unsigned char c);
+static int ipc_printf(const char *fmt, ...);
+static void begin(uint32_t id);
+static void record_request(const char *line);
+static void serve(char *line, uint32_t id);
+static void finish(int16_t status);
+static void *serve_main(void *arg);
+void ipc_cmd_handler(int argc, const char **argv);
+
+/* IPC command */
+tinysh_cmd_t ipc_cmd = {
+    0, "ipc", "show shared-memory channel state", _NOARG_,
+    ipc_cmd_handler, 0, 0, 0
+};
+
+/**
+ * Sleep while *addr == val; shared between processes, so not PRIVATE
+ */
+static long futex_wait(uint32_t *addr, uint32_t val, int timeout_ms) {
+    struct timespec ts, *tp = NULL;
+
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+        tp = &ts;
+    }
+    return syscall(SYS_futex, addr, FUTEX_WAIT, val, tp, NULL, 0);
+}
+
+/**
+ * Wake every sleeper on addr
+ */
+static void futex_wake(uint32_t *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * Milliseconds until a CLOCK_MONOTONIC deadline, 0 once it passed
+ */
+static long ms_left(const struct timespec *deadline) {
+    struct timespec now;
+    long ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = (deadline->tv_sec - now.tv_sec) * 1000L +
+         (deadline->tv_nsec - now.tv_nsec) / 1000000L;
+    return ms > 0 ? ms : 0;
+}
+
+/**
+ * First byte of a ring's data area
+ */
+static char *ring_data(tiny_ipc_shared_t *shm, const ipc_ring_t *r) {
+    char *base = (char *)(shm + 1);
+    return r == &shm->req ? base : base + shm->ring_size;
+}
+
+/**
+ * Producer: make everything before head visible, waking a sleeping consumer
+ */
+static void ring_publish(ipc_ring_t *r, uint32_t head) {
+    __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&r->data_seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->data_wait, __ATOMIC_SEQ_CST)) futex_wake(&r->data_seq);
+}
+
+/**
+ * Consumer: give back everything before tail, waking a sleeping producer
+ */
+static void ring_release(ipc_ring_t *r, uint32_t tail) {
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&r->space_seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->space_wait, __ATOMIC_SEQ_CST)) futex_wake(&r->space_seq);
+}
+
+/**
+ * Consumer: wait until the producer published past pos
+ * The waiting flag is raised before the last check, so a producer that
+ * publishes after that check sees it and wakes us; one that published
+ * before has changed the sequence and the wait returns at once.
+ *
+ * @param timeout_ms Longest wait, -1 for no limit
+ * @return 0, or -1 on timeout
+ */
+static int ring_wait_data(ipc_ring_t *r, uint32_t pos, int timeout_ms) {
+    struct timespec deadline;
+    uint32_t seq;
+    long left = -1;
+
+    if (timeout_ms > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    for (;;) {
+        seq = __atomic_load_n(&r->data_seq, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) != pos) return 0;
+        if (timeout_ms == 0) return -1;
+        if (timeout_ms > 0 && (left = ms_left(&deadline)) == 0) return -1;
+
+        __atomic_store_n(&r->data_wait, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == pos) {
+            futex_wait(&r->data_seq, seq, (int)left);
+        }
+        __atomic_store_n(&r->data_wait, 0, __ATOMIC_SEQ_CST);
+    }
+}
+
+/**
+ * Producer: wait until need bytes past head are free
+ *
+ * @return 0, or -1 on timeout
+ */
+static int ring_wait_space(ipc_ring_t *r, uint32_t head, uint32_t size, uint32_t need, int timeout_ms) {
+    struct timespec deadline;
+    uint32_t seq;
+    long left;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    for (;;) {
+        seq = __atomic_load_n(&r->space_seq, __ATOMIC_SEQ_CST);
+        if (size - (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) >= need) return 0;
+        if ((left = ms_left(&deadline)) == 0 || LOAD(srv.stop)) return -1;
+
+        __atomic_store_n(&r->space_wait, 1, __ATOMIC_SEQ_CST);
+        if (size - (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) < need) {
+            futex_wait(&r->space_seq, seq, (int)left);
+        }
+        __atomic_store_n(&r->space_wait, 0, __ATOMIC_SEQ_CST);
+    }
+}
+
+/**
+ * Output bytes the open frame can still take: free space, rounded down so
+ * the frame's padding fits too, and never past the end of the ring
+ */
+static uint32_t frame_room(void) {
+    ipc_ring_t *r = &srv.shm->resp;
+    uint32_t size = srv.shm->ring_size;
+    uint32_t pos = srv.head + sizeof(ipc_hdr_t) + srv.frame->len;
+    uint32_t contiguous = size - (srv.head & srv.mask) - sizeof(ipc_hdr_t) - srv.frame->len;
+    uint32_t free = (size - (pos - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))) & ~(uint32_t)(FRAME_ALIGN - 1);
+
+    return free < contiguous ? free : contiguous;
+}
+
+/**
+ * Open a response frame for the current request, padding to the start of
+ * the ring when too little is left before its end
+ *
+ * @param timeout_ms Longest wait for the client to release space
+ * @return 0, or -1 if the client did not make room
+ */
+static int frame_open(int timeout_ms) {
+    ipc_ring_t *r = &srv.shm->resp;
+    char *data = ring_data(srv.shm, r);
+    uint32_t size = srv.shm->ring_size;
+    uint32_t left = size - (srv.head & srv.mask);
+    ipc_hdr_t *h;
+
+    if (left < FRAME_MIN) {
+        if (ring_wait_space(r, srv.head, size, left, timeout_ms) < 0) goto stalled;
+        h = (ipc_hdr_t *)(data + (srv.head & srv.mask));
+        h->len = left - sizeof(ipc_hdr_t);
+        h->id = srv.id;
+        h->flags = IPC_FRAME_PAD;
+        h->status = 0;
+        srv.head += left;
+        ring_publish(r, srv.head);
+    }
+    if (ring_wait_space(r, srv.head, size, FRAME_MIN, timeout_ms) < 0) goto stalled;
+
+    h = (ipc_hdr_t *)(data + (srv.head & srv.mask));
+    h->len = 0;
+    h->id = srv.id;
+    h->flags = 0;
+    h->status = 0;
+    srv.frame = h;
+    return 0;
+
+stalled:
+    if (timeout_ms > 0) COUNT(srv.stalls, 1);
+    return -1;
+}
+
+/**
+ * Publish the open frame
+ */
+static void frame_close(uint16_t flags, int16_t status) {
+    srv.frame->flags = flags;
+    srv.frame->status = status;
+    srv.head += sizeof(ipc_hdr_t) + ((srv.frame->len + FRAME_ALIGN - 1) & ~(uint32_t)(FRAME_ALIGN - 1));
+    srv.frame = NULL;
+    COUNT(srv.frames, 1);
+    ring_publish(&srv.shm->resp, srv.head);
+}
+
+/**
+ * Output function: append to the open frame, starting new frames as the
+ * ring end or the client's unreleased data is reached
+ */
+static void ipc_write(const char *buf, int len) {
+    uint32_t room, n;
+
+    tiny_transcript_record(srv.session, TRANSCRIPT_OUT, buf, len);
+    while (len > 0) {
+        if (srv.dropped) {
+            COUNT(srv.bytes_dropped, (unsigned long)len);
+            return;
+        }
+        if (!srv.frame && frame_open(IPC_STALL_MS) < 0) {
+            srv.dropped = 1;
+            continue;
+        }
+        room = frame_room();
+        if (room == 0) {
+            frame_close(0, 0);
+            continue;
+        }
+        n = (uint32_t)len < room ? (uint32_t)len : room;
+        memcpy((char *)(srv.frame + 1) + srv.frame->len, buf, n);
+        srv.frame->len += n;
+        COUNT(srv.bytes_out, n);
+        buf += n;
+        len -= (int)n;
+    }
+}
+
+/**
+ * Output function: one character
+ */
+static void ipc_char_out(unsigned char c) {
+    char ch = (char)c;
+    ipc_write(&ch, 1);
+}
+
+/**
+ * Output function: formatted, straight into the frame when it fits
+ */
+static int ipc_printf(const char *fmt, ...) {
+    char buf[512];
+    va_list args;
+    uint32_t room;
+    int n;
+
+    if (srv.frame && !srv.dropped && (room = frame_room()) > 1) {
+        char *dst = (char *)(srv.frame + 1) + srv.frame->len;
+
+        va_start(args, fmt);
+        n = vsnprintf(dst, room, fmt, args);
+        va_end(args);
+        if (n >= 0 && (uint32_t)n < room) {
+            tiny_transcript_record(srv.session, TRANSCRIPT_OUT, dst, n);
+            srv.frame->len += (uint32_t)n;
+            COUNT(srv.bytes_out, (unsigned long)n);
+            return n;
+        }
+    }
+    va_start(args, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n < 0) return n;
+    if (n >= (int)sizeof(buf)) n = sizeof(buf) - 1;
+    ipc_write(buf, n);
+    return n;
+}
+
+/**
+ * Start the response to a request
+ */
+static void begin(uint32_t id) {
+    srv.id = id;
+    srv.frame = NULL;
+    srv.dropped = 0;
+    COUNT(srv.requests, 1);
+}
+
+/**
+ * Record a request in the transcript, a password in it starred
+ */
+static void record_request(const char *line) {
+    static const char stars[] = "****************";
+    int len = tinysh_strlen(line), at = tinysh_secret_at(line), n;
+
+    if (at < 0) at = len;
+    tiny_transcript_record(srv.session, TRANSCRIPT_IN, line, at);
+    for (; at < len; at += n) {
+        n = len - at < (int)sizeof(stars) - 1 ? len - at : (int)sizeof(stars) - 1;
+        tiny_transcript_record(srv.session, TRANSCRIPT_IN, stars, n);
+    }
+    tiny_transcript_record(srv.session, TRANSCRIPT_IN, "\r", 1);
+}
+
+/**
+ * Run one request on the calling thread and write its response
+ *
+ * @param line Request, terminated, at most BUFFER_SIZE long
+ */
+static void serve(char *line, uint32_t id) {
+    ipc_saved_t saved;
+    int16_t status;
+
+    begin(id);
+    saved.char_out = tinysh_char_out;
+    saved.printf = tinysh_printf;
+    saved.block_out = tinysh_block_out;
+    saved.line = tinysh_line_select(&srv.line);
+    record_request(line);
+    saved.plain = tinysh_term_plain(1);  /* a program reads it, not a terminal */
+    tinysh_char_out = ipc_char_out;
+    tinysh_printf = ipc_printf;
+    tinysh_block_out = ipc_write;
+
+    status = tinysh_exec_line(line) == 0 ? IPC_STATUS_OK : IPC_STATUS_NO_COMMAND;
+
+    tinysh_block_out = saved.block_out;
+    tinysh_printf = saved.printf;
+    tinysh_char_out = saved.char_out;
+    tinysh_term_plain(saved.plain);
+    tinysh_line_select(saved.line);
+    if (srv.dropped && status == IPC_STATUS_OK) status = IPC_STATUS_TRUNCATED;
+    tiny_transcript_flush();
+    finish(status);
+}
+
+/**
+ * End the response to the request begun
+ */
+static void finish(int16_t status) {
+
+    /* The end frame carries the status; a client that has not made room
+       for it gets it before any later response */
+    if (srv.frame || (!srv.dropped && frame_open(IPC_STALL_MS) == 0)) {
+        frame_close(IPC_FRAME_END, status);
+    } else {
+        srv.owed = 1;
+        srv.owed_status = status;
+    }
+}
+
+/**
+ * Serve every queued request on the calling thread
+ */
+int tiny_ipc_poll(void) {
+    ipc_ring_t *r;
+    char *data;
+    uint32_t head, tail, len, id, need;
+    uint16_t flags;
+    const ipc_hdr_t *h;
+    int served = 0;
+
+    if (!srv.shm) return 0;
+    if (srv.owed) {
+        if (frame_open(0) < 0) return 0;
+        frame_close(IPC_FRAME_END, srv.owed_status);
+        srv.owed = 0;
+    }
+    r = &srv.shm->req;
+    data = ring_data(srv.shm, r);
+    tail = r->tail;
+
+    while (!srv.owed && (head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) != tail) {
+        char line[BUFFER_SIZE + 1];
+
+        /* Everything comes out before the frame is released: after that
+           the client may overwrite it */
+        h = (const ipc_hdr_t *)(data + (tail & srv.mask));
+        len = h->len;
+        id = h->id;
+        flags = h->flags;
+        need = len > srv.shm->ring_size ? 0 :
+               sizeof(ipc_hdr_t) + ((len + FRAME_ALIGN - 1) & ~(uint32_t)(FRAME_ALIGN - 1));
+        if (!need || need > head - tail || (tail & srv.mask) + need > srv.shm->ring_size) {
+            /* Not a frame the client published: drop what is queued */
+            COUNT(srv.malformed, 1);
+            ring_release(r, head);
+            tail = head;
+            continue;
+        }
+        if (!(flags & IPC_FRAME_PAD) && len <= BUFFER_SIZE) {
+            /* Copied out, so the client can queue more while it runs */
+            memcpy(line, h + 1, len);
+            line[len] = 0;
+        }
+        tail += need;
+        ring_release(r, tail);
+        if (flags & IPC_FRAME_PAD) continue;
+
+        if (len > BUFFER_SIZE) {
+            begin(id);
+            finish(IPC_STATUS_TOO_LONG);
+        } else {
+            serve(line, id);
+        }
+        served++;
+    }
+    return served;
+}
+
+/**
+ * Serving thread: sleep on the request ring, or on the response ring while
+ * an end frame is owed, and run requests under the executor lock
+ */
+static void *serve_main(void *arg) {
+    ipc_ring_t *r = &srv.shm->req;
+    uint32_t left;
+
+    (void)arg;
+    while (!LOAD(srv.stop)) {
+        if (srv.owed) {
+            left = srv.shm->ring_size - (srv.head & srv.mask);
+            if (ring_wait_space(&srv.shm->resp, srv.head, srv.shm->ring_size,
+                                FRAME_MIN + (left < FRAME_MIN ? left : 0), IDLE_MS) < 0) continue;
+        } else if (ring_wait_data(r, r->tail, IDLE_MS) < 0) {
+            continue;
+        }
+        tiny_server_lock();
+        tiny_ipc_poll();
+        tiny_server_unlock();
+    }
+    return NULL;
+}
+
+/**
+ * Create the region, replacing a stale one of the same name
+ */
+int tiny_ipc_open(const char *name, unsigned long ring_size) {
+    tiny_ipc_shared_t *shm;
+    unsigned long size;
+    int fd;
+
+    if (srv.shm) {
+        errno = EBUSY;
+        return -1;
+    }
+    if (!ring_size) ring_size = IPC_RING_SIZE;
+    if (ring_size < 256 || ring_size > (1UL << 30) || (ring_size & (ring_size - 1))) {
+        errno = EINVAL;
+        return -1;
+    }
+    size = sizeof(tiny_ipc_shared_t) + 2 * ring_size;
+
+    shm_unlink(name);
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, (off_t)size) < 0) {
+        close(fd);
+        shm_unlink(name);
+        return -1;
+    }
+    shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        shm_unlink(name);
+        return -1;
+    }
+
+    memset(&srv, 0, sizeof(srv));
+    snprintf(srv.name, sizeof(srv.name), "%s", name);
+    srv.shm = shm;
+    srv.size = size;
+    srv.mask = (uint32_t)ring_size - 1;
+    srv.session = tiny_server_session_id();
+    tinysh_line_init(&srv.line);
+
+    shm->version = IPC_VERSION;
+    shm->ring_size = (uint32_t)ring_size;
+    shm->server_pid = (uint32_t)getpid();
+    __atomic_store_n(&shm->magic, IPC_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * Create the region and serve it on a thread of its own
+ */
+int tiny_ipc_start(const char *name, unsigned long ring_size) {
+    int err;
+
+    if (tiny_ipc_open(name, ring_size) < 0) return -1;
+    err = pthread_create(&srv.thread, NULL, serve_main, NULL);
+    if (err) {
+        tiny_ipc_close();
+        errno = err;
+        return -1;
+    }
+    srv.threaded = 1;
+    return 0;
+}
+
+/**
+ * Stop serving and remove the region
+ */
+void tiny_ipc_close(void) {
+    if (!srv.shm) return;
+    if (srv.threaded) {
+        __atomic_store_n(&srv.stop, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&srv.shm->req.data_seq, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&srv.shm->req.data_seq);
+        __atomic_fetch_add(&srv.shm->resp.space_seq, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&srv.shm->resp.space_seq);
+        pthread_join(srv.thread, NULL);
+    }
+    __atomic_store_n(&srv.shm->magic, 0, __ATOMIC_RELEASE);
+    munmap(srv.shm, srv.size);
+    shm_unlink(srv.name);
+    srv.shm = NULL;
+}
+
+/**
+ * Attach to a region as its client
+ * A client pid whose process is gone is taken over.
+ */
+int tiny_ipc_connect(tiny_ipc_client_t *c, const char *name) {
+    tiny_ipc_shared_t *shm;
+    struct stat st;
+    uint32_t pid = (uint32_t)getpid(), owner;
+    int fd;
+
+    memset(c, 0, sizeof(*c));
+    fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) < 0 || (unsigned long)st.st_size < sizeof(tiny_ipc_shared_t)) {
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+    shm = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) return -1;
+
+    if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != IPC_MAGIC ||
+        shm->version != IPC_VERSION ||
+        (unsigned long)st.st_size < sizeof(tiny_ipc_shared_t) + 2UL * shm->ring_size) {
+        munmap(shm, (size_t)st.st_size);
+        errno = EPROTO;
+        return -1;
+    }
+
+    owner = 0;
+    while (!__atomic_compare_exchange_n(&shm->client_pid, &owner, pid, 0,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        if (owner == pid || kill((pid_t)owner, 0) == 0 || errno != ESRCH) {
+            munmap(shm, (size_t)st.st_size);
+            errno = EBUSY;
+            return -1;
+        }
+    }
+
+    /* Responses left by an earlier client are of no use to this one */
+    c->shm = shm;
+    c->size = (unsigned long)st.st_size;
+    c->read_pos = __atomic_load_n(&shm->resp.head, __ATOMIC_ACQUIRE);
+    ring_release(&shm->resp, c->read_pos);
+    return 0;
+}
+
+/**
+ * Detach from a region
+ */
+void tiny_ipc_disconnect(tiny_ipc_client_t *c) {
+    if (!c->shm) return;
+    __atomic_store_n(&c->shm->client_pid, 0, __ATOMIC_SEQ_CST);
+    munmap(c->shm, c->size);
+    c->shm = NULL;
+}
+
+/**
+ * Submit a command line; does not wait for the result
+ */
+uint32_t tiny_ipc_submit(tiny_ipc_client_t *c, const char *line, int len) {
+    tiny_ipc_shared_t *shm = c->shm;
+    ipc_ring_t *r = &shm->req;
+    char *data = ring_data(shm, r);
+    uint32_t size = shm->ring_size;
+    uint32_t head = r->head;
+    uint32_t left = size - (head & (size - 1));
+    uint32_t need, total, id;
+    ipc_hdr_t *h;
+
+    if (len < 0) len = (int)strlen(line);
+    need = sizeof(ipc_hdr_t) + (((uint32_t)len + FRAME_ALIGN - 1) & ~(uint32_t)(FRAME_ALIGN - 1));
+    total = need > left ? left + need : need;
+    if (need > size / 2 || size - (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) < total) {
+        return 0;
+    }
+
+    if (need > left) {
+        h = (ipc_hdr_t *)(data + (head & (size - 1)));
+        h->len = left - sizeof(ipc_hdr_t);
+        h->id = 0;
+        h->flags = IPC_FRAME_PAD;
+        h->status = 0;
+        head += left;
+    }
+    do {
+        id = __atomic_add_fetch(&shm->next_id, 1, __ATOMIC_RELAXED);
+    } while (id == 0);
+
+    h = (ipc_hdr_t *)(data + (head & (size - 1)));
+    h->len = (uint32_t)len;
+    h->id = id;
+    h->flags = 0;
+    h->status = 0;
+    memcpy(h + 1, line, (size_t)len);
+    ring_publish(r, head + need);
+    c->last_id = id;
+    return id;
+}
+
+/**
+ * Wait for the next response frame
+ */
+int tiny_ipc_next(tiny_ipc_client_t *c, tiny_ipc_frame_t *f, int timeout_ms) {
+    ipc_ring_t *r = &c->shm->resp;
+    char *data = ring_data(c->shm, r);
+    uint32_t mask = c->shm->ring_size - 1;
+    ipc_hdr_t *h;
+
+    for (;;) {
+        if (ring_wait_data(r, c->read_pos, timeout_ms) < 0) return -1;
+        h = (ipc_hdr_t *)(data + (c->read_pos & mask));
+        c->read_pos += sizeof(ipc_hdr_t) + ((h->len + FRAME_ALIGN - 1) & ~(uint32_t)(FRAME_ALIGN - 1));
+        if (h->flags & IPC_FRAME_PAD) continue;
+
+        f->id = h->id;
+        f->flags = h->flags;
+        f->status = h->status;
+        f->data = (const char *)(h + 1);
+        f->len = h->len;
+        f->next = c->read_pos;
+        return 0;
+    }
+}
+
+/**
+ * Give a frame's space back to the shell
+ */
+void tiny_ipc_release(tiny_ipc_client_t *c, const tiny_ipc_frame_t *f) {
+    ring_release(&c->shm->resp, f->next);
+}
+
+/**
+ * IPC command handler
+ */
+void ipc_cmd_handler(int argc, const char **argv) {
+    tiny_ipc_shared_t *shm = srv.shm;
+    uint32_t req_fill, resp_fill, client;
+
+    (void)argc;
+    (void)argv;
+
+    if (!shm) {
+        tinysh_printf("No shared-memory channel\r\n");
+        return;
+    }
+    client = __atomic_load_n(&shm->client_pid, __ATOMIC_RELAXED);
+    req_fill = __atomic_load_n(&shm->req.head, __ATOMIC_ACQUIRE) -
+               __atomic_load_n(&shm->req.tail, __ATOMIC_ACQUIRE);
+    resp_fill = __atomic_load_n(&shm->resp.head, __ATOMIC_ACQUIRE) -
+                __atomic_load_n(&shm->resp.tail, __ATOMIC_ACQUIRE);
+
+    tinysh_printf("Channel %s, %lu B per ring, %s\r\n", srv.name,
+                  (unsigned long)shm->ring_size, srv.threaded ? "own thread" : "polled");
+    if (client) {
+        tinysh_printf("Client pid %lu\r\n", (unsigned long)client);
+    } else {
+        tinysh_printf("No client\r\n");
+    }
+    tinysh_printf("Requests %lu, output %lu B in %lu frames\r\n",
+                  LOAD(srv.requests), LOAD(srv.bytes_out), LOAD(srv.frames));
+    tinysh_printf("Dropped %lu B, stalls %lu, malformed frames %lu\r\n",
+                  LOAD(srv.bytes_dropped), LOAD(srv.stalls), LOAD(srv.malformed));
+    tinysh_printf("Request ring %lu%% full, response ring %lu%% full\r\n",
+                  (unsigned long)req_fill * 100UL / shm->ring_size,
+                  (unsigned long)resp_fill * 100UL / shm->ring_size);
+}
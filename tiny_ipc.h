@@ -0,0 +1,168 @@
+/**
+ * TinyShell Shared-Memory Control Channel (Linux)
+ * ----------------------------------------------
+ * Lets local processes run shell commands through a named shared memory
+ * region instead of scraping a PTY: no terminal, no echo or prompt, and
+ * no copies of the output on the client side.
+ *
+ * Features:
+ * - One region (shm_open) holds a request ring and a response ring
+ * - Framed messages carry a request id, so a client can submit many
+ *   requests before reading any result (pipelining); results come back
+ *   in order
+ * - Futex wakeups, only issued when the other side is actually asleep
+ * - Commands run through the shell's own command tree, with the
+ *   channel's own context and auth level. tiny_ipc_start() serves them
+ *   on a thread under the executor lock (tiny_server.h), so they never
+ *   overlap console or session handlers; single-threaded ports call
+ *   tiny_ipc_poll() from their main loop instead
+ * - Handler output is written straight into response frames in shared
+ *   memory; the client reads it in place and then releases it. Long
+ *   output spans several frames
+ * - A client that stops reading stalls output for at most IPC_STALL_MS,
+ *   after which that output is dropped and counted
+ * - "ipc" command: channel state and counters
+ *
+ * Frames are 16-byte aligned and never wrap around the end of a ring; a
+ * padding frame fills the gap instead. One client at a time may use a
+ * region.
+ *
+ * Example Usage:
+ *
+ * // In the shell
+ * tiny_ipc_start("/tinysh", 0);        // or tiny_ipc_open() + tiny_ipc_poll()
+ *
+ * // In a client
+ * tiny_ipc_client_t c;
+ * tiny_ipc_frame_t f;
+ * tiny_ipc_connect(&c, "/tinysh");
+ * id = tiny_ipc_submit(&c, "sysinfo", -1);
+ * do {
+ *     tiny_ipc_next(&c, &f, 1000);
+ *     fwrite(f.data, 1, f.len, stdout);   // points into shared memory
+ *     tiny_ipc_release(&c, &f);
+ * } while (!(f.flags & IPC_FRAME_END));
+ * tiny_ipc_disconnect(&c);
+ *
+ * $ ./tinysh_shell -q /tinysh sysinfo "echo hi"
+ */
+
+#ifndef TINY_IPC_H
+#define TINY_IPC_H
+
+#include "tinysh.h"
+#include <stdint.h>
+
+/* Bytes in each ring, a power of two */
+#ifndef IPC_RING_SIZE
+#define IPC_RING_SIZE             65536
+#endif
+
+/* Longest the shell waits for a client to make room for output */
+#ifndef IPC_STALL_MS
+#define IPC_STALL_MS              1000
+#endif
+
+/* Frame flags */
+#define IPC_FRAME_END             0x01  // Last frame of a response
+#define IPC_FRAME_PAD             0x02  // Filler up to the end of the ring (internal)
+
+/* Status in the last frame of a response */
+#define IPC_STATUS_OK             0     // A handler ran
+#define IPC_STATUS_NO_COMMAND     -1    // Nothing ran: no match, admin only, or a context
+#define IPC_STATUS_TOO_LONG       -2    // Request longer than BUFFER_SIZE
+#define IPC_STATUS_TRUNCATED      -3    // Ran, but output was dropped (client too slow)
+
+/* Opaque layout of the shared region */
+typedef struct tiny_ipc_shared tiny_ipc_shared_t;
+
+/* Client side of a channel */
+typedef struct {
+    tiny_ipc_shared_t *shm;          // Mapping
+    unsigned long size;              // Bytes mapped
+    uint32_t last_id;                // Id of the last request submitted
+    uint32_t read_pos;               // Next response frame (internal)
+} tiny_ipc_client_t;
+
+/* A response frame, in shared memory until released */
+typedef struct {
+    uint32_t id;                     // Request it answers
+    uint16_t flags;                  // IPC_FRAME_*
+    int16_t status;                  // IPC_STATUS_*, valid with IPC_FRAME_END
+    const char *data;                // Output bytes, not terminated
+    uint32_t len;                    // Number of output bytes
+    uint32_t next;                   // Ring position after the frame (internal)
+} tiny_ipc_frame_t;
+
+/**
+ * Create the region, replacing a stale one of the same name
+ *
+ * @param name      Region name, "/name"
+ * @param ring_size Bytes per ring, a power of two, at least 256; 0 for
+ *                  IPC_RING_SIZE
+ * @return 0, or -1 on error (errno set)
+ */
+int tiny_ipc_open(const char *name, unsigned long ring_size);
+
+/**
+ * Serve every queued request on the calling thread
+ * The caller must be the only one running handlers at the time.
+ *
+ * @return Number of requests served
+ */
+int tiny_ipc_poll(void);
+
+/**
+ * Create the region and serve it on a thread of its own
+ * Register every command first; see tiny_server.h.
+ *
+ * @return 0, or -1 on error (errno set)
+ */
+int tiny_ipc_start(const char *name, unsigned long ring_size);
+
+/**
+ * Stop serving and remove the region
+ */
+void tiny_ipc_close(void);
+
+/**
+ * Attach to a region as its client
+ *
+ * @return 0, or -1 on error (errno: ENOENT no such region, EBUSY another
+ *         client is attached, EPROTO not a shell region)
+ */
+int tiny_ipc_connect(tiny_ipc_client_t *c, const char *name);
+
+/**
+ * Detach from a region
+ */
+void tiny_ipc_disconnect(tiny_ipc_client_t *c);
+
+/**
+ * Submit a command line; does not wait for the result
+ *
+ * @param line Command line
+ * @param len  Length of line, -1 if it is terminated
+ * @return Request id (never 0), or 0 if the request ring is full
+ */
+uint32_t tiny_ipc_submit(tiny_ipc_client_t *c, const char *line, int len);
+
+/**
+ * Wait for the next response frame
+ *
+ * @param f          Receives the frame; release it when done
+ * @param timeout_ms Longest wait, -1 for no limit
+ * @return 0, or -1 on timeout
+ */
+int tiny_ipc_next(tiny_ipc_client_t *c, tiny_ipc_frame_t *f, int timeout_ms);
+
+/**
+ * Give a frame's space back to the shell
+ * Frames must be released in the order they were received.
+ */
+void tiny_ipc_release(tiny_ipc_client_t *c, const tiny_ipc_frame_t *f);
+
+/* IPC command */
+extern tinysh_cmd_t ipc_cmd;
+
+#endif /* TINY_IPC_H */
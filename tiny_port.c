@@ -1,17 +1,44 @@
 #include "tiny_port.h"
 #include "tinysh.h"
+#include "tinysh_term.h"
+#include "tinysh_table.h"
+#include "tinysh_metric.h"
+#include "tinysh_complete.h"
+#include "tinysh_param.h"
+#include "tinysh_retain.h"
+#include "tinysh_timer.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <termios.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <dirent.h>
 
 static struct termios orig_termios; /* Original terminal settings */
+static volatile sig_atomic_t winch_pending = 0; /* SIGWINCH seen */
+
+/* Output since the last drain measurement */
+#define DRAIN_SAMPLE_MIN 64         /* smaller bursts say little about the link */
+#define DRAIN_USEC_MIN   2000       /* shorter drains are below clock and scheduler noise */
+static unsigned long burst_bytes = 0;
+
+static void note_output(unsigned long bytes);
+static void measure_drain(void);
+static unsigned long local_seconds(void);
 
 /* Forward declare command handlers */
 void cmd_sysinfo(int argc, const char **argv);
 void cmd_echo(int argc, const char **argv);
+void cmd_cat(int argc, const char **argv);
 
 /**
  * Output a character to stdout
@@ -19,6 +46,7 @@ void cmd_echo(int argc, const char **argv);
 void tiny_port_putchar(unsigned char c) {
     putchar(c);
     fflush(stdout);
+    note_output(1);
 }
 
 /**
@@ -33,9 +61,123 @@ int tiny_port_printf(const char *fmt, ...) {
     va_end(args);
     
     fflush(stdout);
+    if (result > 0) {
+        note_output((unsigned long)result);
+    }
     return result;
 }
 
+/**
+ * Output a block of bytes with one write
+ */
+void tiny_port_write(const char *buf, int len) {
+    fwrite(buf, 1, (size_t)len, stdout);
+    fflush(stdout);
+    note_output((unsigned long)len);
+}
+
+/**
+ * Account output bytes to the current burst
+ */
+static void note_output(unsigned long bytes) {
+    burst_bytes += bytes;
+}
+
+/**
+ * Wait for the burst to leave the tty and report how long it took
+ * Only tcdrain() is timed, over the bytes still queued when it starts, so
+ * time the handler spent computing is not taken for a slow line. A burst
+ * the line has already sent, as on pseudo-terminals, which report nothing
+ * queued, or one that drains too fast to time, tells nothing about the
+ * link and is not reported: taken as instant it would read as a very fast
+ * link and outweigh the real samples for many bursts.
+ */
+static void measure_drain(void) {
+    struct timespec start, now;
+    unsigned long bytes = burst_bytes;
+    int queued;
+    long usec;
+
+    burst_bytes = 0;
+    if (bytes < DRAIN_SAMPLE_MIN) return;
+    if (ioctl(STDOUT_FILENO, TIOCOUTQ, &queued) < 0 || queued < DRAIN_SAMPLE_MIN) return;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (tcdrain(STDOUT_FILENO) < 0) return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usec = (now.tv_sec - start.tv_sec) * 1000000L + (now.tv_nsec - start.tv_nsec) / 1000L;
+    if (usec < DRAIN_USEC_MIN) return;
+    tinysh_term_note_drain((unsigned long)queued, (unsigned long)usec);
+}
+
+/**
+ * SIGWINCH handler - just note it, the size is read from the main loop
+ */
+static void winch_handler(int sig) {
+    (void)sig;
+    winch_pending = 1;
+}
+
+/**
+ * Read the window size from the tty and pass it to the terminal layer
+ *
+ * @return 0 on success, -1 if the tty does not know its size
+ */
+static int update_window_size(void) {
+    struct winsize ws;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_row == 0 || ws.ws_col == 0) {
+        return -1;
+    }
+    tinysh_term_set_size(ws.ws_row, ws.ws_col);
+    return 0;
+}
+
+/**
+ * Wait for one input character with a timeout
+ */
+int tiny_port_getchar_timeout(int timeout_ms) {
+    struct pollfd pfd;
+    unsigned char c;
+    ssize_t n;
+    int ready;
+
+    pfd.fd = STDIN_FILENO;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    // Output done until the shell goes idle is one burst
+    measure_drain();
+
+    // Read the fd directly: stdio buffering would hide pending input from poll()
+    ready = poll(&pfd, 1, timeout_ms);
+
+    // A resize interrupts poll(), pick up the new size before anything else
+    if (winch_pending) {
+        winch_pending = 0;
+        update_window_size();
+    }
+
+    if (ready <= 0) {
+        return TINY_PORT_TIMEOUT;
+    }
+
+    n = read(STDIN_FILENO, &c, 1);
+    if (n == 1) {
+        return c;
+    }
+    return (n < 0 && errno == EINTR) ? TINY_PORT_TIMEOUT : EOF;
+}
+
+/**
+ * Monotonic millisecond clock
+ */
+unsigned long tiny_port_millis(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000UL + (unsigned long)(ts.tv_nsec / 1000000L);
+}
+
 /**
  * Set terminal to raw mode
  */
@@ -67,6 +209,17 @@ int tiny_port_init(void) {
     return 0;
 }
 
+/**
+ * Local wall-clock time for "at" jobs: epoch seconds moved by the UTC offset
+ */
+static unsigned long local_seconds(void) {
+    time_t now = time(NULL);
+    struct tm tm;
+
+    localtime_r(&now, &tm);
+    return (unsigned long)(now + tm.tm_gmtoff);
+}
+
 /**
  * Reset terminal to original settings
  */
@@ -81,14 +234,40 @@ void tiny_port_setup(void) {
     // Register output functions
     tinysh_out(tiny_port_putchar);
     tinysh_print_out(tiny_port_printf);
+    tinysh_write_out(tiny_port_write);
+    tinysh_time_source(tiny_port_millis);
+    tinysh_timer_clock(local_seconds);
     
     // Set initial prompt (optional)
     tinysh_set_prompt("tinysh> ");
     
+    // Learn the window size: from the tty driver when there is one,
+    // otherwise (serial line) by asking the terminal itself
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = winch_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGWINCH, &sa, NULL);  // no SA_RESTART: wake up poll()
+    if (update_window_size() < 0 && isatty(STDIN_FILENO)) {
+        tinysh_term_query_size();
+    }
+
     // Display welcome message
     tiny_port_printf("\r\nTinyShell v%s starting on Ubuntu\r\n", TINYSHELL_VERSION);
     tiny_port_printf("Type '?' for help\r\n");
 
+    // State kept across the last reset, timed so its cost is known
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int err = tinysh_retain_restore();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    unsigned long us = (unsigned long)((t1.tv_sec - t0.tv_sec) * 1000000L + (t1.tv_nsec - t0.tv_nsec) / 1000L);
+    if (err == RETAIN_OK) {
+        tiny_port_printf("Retained state restored in %lu us\r\n", us);
+    } else if (err == RETAIN_STALE || err == RETAIN_CORRUPT) {
+        tiny_port_printf("Retained state discarded: %s\r\n", tinysh_retain_error(err));
+    }
+
     // Set TinyShell active flag
     tinyshell_active = 1;
 }
@@ -102,17 +281,39 @@ tinysh_cmd_t echo_cmd = {
     0, "echo", "echo arguments", "[args...]", cmd_echo, 0, 0, 0
 };
 
+/* Example metric - system load average over the last minute */
+static long sample_load(void);
+TINYSH_METRIC(load_metric, "load", 60, sample_load, 1000);
+
+/* Example parameter - sector erase time of the fake flash */
+static uint32_t erase_delay_ms = 10;
+TINYSH_PARAM(erase_delay_param, "erase_delay", PARAM_UINT, &erase_delay_ms, 0, 1000, "ms", NULL);
+
+tinysh_cmd_t cat_cmd = {
+    0, "cat", "print a file", "<file>", cmd_cat, 0, 0, 0
+};
+
 /**
  * Example command - print system info
  */
 void cmd_sysinfo(int argc, const char **argv) {
+    static const tinysh_table_col_t cols[] = {
+        {"Item", 0, 0},
+        {"Value", 0, 0}
+    };
+    char buffer_size[12], history_depth[12];
     (void)argc; // Unused
     (void)argv; // Unused
     
-    tiny_port_printf("System: Ubuntu Linux\r\n");
-    tiny_port_printf("TinyShell version: %s\r\n", TINYSHELL_VERSION);
-    tiny_port_printf("Buffer size: %d bytes\r\n", BUFFER_SIZE);
-    tiny_port_printf("History depth: %d entries\r\n", HISTORY_DEPTH);
+    snprintf(buffer_size, sizeof(buffer_size), "%d bytes", BUFFER_SIZE);
+    snprintf(history_depth, sizeof(history_depth), "%d entries", HISTORY_DEPTH);
+
+    tinysh_table_begin(cols, 2);
+    tinysh_table_add("System", "Ubuntu Linux");
+    tinysh_table_add("TinyShell version", TINYSHELL_VERSION);
+    tinysh_table_add("Buffer size", buffer_size);
+    tinysh_table_add("History depth", history_depth);
+    tinysh_table_end();
 }
 
 /**
@@ -120,8 +321,187 @@ void cmd_sysinfo(int argc, const char **argv) {
  */
 void cmd_echo(int argc, const char **argv) {
     for (int i = 1; i < argc; i++) {
-        tiny_port_printf("%s ", argv[i]);
+        tinysh_printf("%s ", argv[i]);
     }
-    tiny_port_printf("\r\n");
+    tinysh_printf("\r\n");
 }
 
+/**
+ * Example metric sampler - 1-minute load average x100
+ */
+static long sample_load(void) {
+    double load = 0;
+    FILE *f = fopen("/proc/loadavg", "r");
+
+    if (f) {
+        if (fscanf(f, "%lf", &load) != 1) load = 0;
+        fclose(f);
+    }
+    return (long)(load * 100);
+}
+
+/**
+ * Example command - print a file
+ */
+void cmd_cat(int argc, const char **argv) {
+    char line[BUFFER_SIZE];
+    FILE *f;
+
+    if (argc < 2) {
+        tinysh_printf("Usage: cat <file>\r\n");
+        return;
+    }
+    f = fopen(argv[1], "r");
+    if (!f) {
+        tinysh_printf("%s: %s\r\n", argv[1], strerror(errno));
+        return;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = 0;
+        tinysh_printf("%s\r\n", line);
+    }
+    fclose(f);
+}
+
+/**
+ * Argument completer - file system paths
+ */
+void tiny_port_complete_path(int argi, const char *prefix, void *arg) {
+    char dir[BUFFER_SIZE + 1], path[BUFFER_SIZE + 1];
+    const char *slash = strrchr(prefix, '/');
+    const char *base = slash ? slash + 1 : prefix;
+    int dir_len = slash ? (int)(slash - prefix) + 1 : 0;
+    size_t base_len = strlen(base);
+    struct dirent *de;
+    DIR *d;
+    (void)argi;
+    (void)arg;
+
+    snprintf(dir, sizeof(dir), "%.*s", dir_len, prefix);
+    d = opendir(dir_len ? dir : ".");
+    if (!d) return;
+
+    while ((de = readdir(d)) != NULL) {
+        struct stat st;
+        int is_dir;
+
+        // Hidden entries only when asked for
+        if (de->d_name[0] == '.' && base[0] != '.') continue;
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        if (strncmp(de->d_name, base, base_len) != 0) continue;
+
+        if (snprintf(path, sizeof(path), "%s%s", dir, de->d_name) >= (int)sizeof(path) - 1) {
+            continue;
+        }
+        is_dir = de->d_type == DT_DIR;
+        if (de->d_type == DT_UNKNOWN || de->d_type == DT_LNK) {
+            is_dir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+        }
+        if (is_dir) strcat(path, "/");
+        tinysh_complete_add(path);
+    }
+    closedir(d);
+}
+
+/* Fake flash: an image file mapped into memory, following NOR rules */
+static unsigned char *flash_mem = NULL;
+static tinysh_flash_t port_flash;
+
+/**
+ * Fake flash read
+ */
+static int flash_read(unsigned long addr, void *buf, int len) {
+    if (len < 0 || addr + (unsigned long)len > port_flash.sector_size * port_flash.sector_count) {
+        return -1;
+    }
+    memcpy(buf, flash_mem + addr, (size_t)len);
+    return 0;
+}
+
+/**
+ * Fake flash write - programming can only clear bits
+ */
+static int flash_write(unsigned long addr, const void *buf, int len) {
+    const unsigned char *p = (const unsigned char *)buf;
+    int i;
+
+    if (len < 0 || addr + (unsigned long)len > port_flash.sector_size * port_flash.sector_count) {
+        return -1;
+    }
+    for (i = 0; i < len; i++) {
+        if ((flash_mem[addr + i] & p[i]) != p[i]) return -1;  // needs an erase first
+    }
+    for (i = 0; i < len; i++) {
+        flash_mem[addr + i] &= p[i];
+    }
+    return 0;
+}
+
+/**
+ * Fake flash sector erase, taking as long as erase_delay says
+ */
+static int flash_erase(unsigned short sector) {
+    if (sector >= port_flash.sector_count) return -1;
+    usleep(erase_delay_ms * 1000);
+    memset(flash_mem + (unsigned long)sector * port_flash.sector_size, 0xFF, port_flash.sector_size);
+    return 0;
+}
+
+/**
+ * Map the fake flash image, creating or growing it as erased flash
+ */
+const tinysh_flash_t *tiny_port_flash_open(const char *path, unsigned long sector_size,
+                                           unsigned short sectors) {
+    size_t size = sector_size * sectors;
+    struct stat st;
+    void *mem;
+    int fd;
+
+    if (flash_mem) {
+        munmap(flash_mem, port_flash.sector_size * port_flash.sector_count);
+        flash_mem = NULL;
+    }
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) < 0 || ((size_t)st.st_size < size && ftruncate(fd, (off_t)size) < 0)) {
+        close(fd);
+        return NULL;
+    }
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) return NULL;
+
+    // Bytes the file did not have yet read as erased flash
+    if ((size_t)st.st_size < size) {
+        memset((unsigned char *)mem + st.st_size, 0xFF, size - (size_t)st.st_size);
+    }
+
+    flash_mem = (unsigned char *)mem;
+    port_flash.sector_size = sector_size;
+    port_flash.sector_count = sectors;
+    port_flash.read = flash_read;
+    port_flash.write = flash_write;
+    port_flash.erase = flash_erase;
+    return &port_flash;
+}
+
+/**
+ * Map the retained-state file, growing a new or short one with zeros
+ */
+tinysh_retain_t *tiny_port_retain_open(const char *path) {
+    struct stat st;
+    void *mem;
+    int fd;
+
+    fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) < 0 || ((size_t)st.st_size < sizeof(tinysh_retain_t) &&
+                               ftruncate(fd, (off_t)sizeof(tinysh_retain_t)) < 0)) {
+        close(fd);
+        return NULL;
+    }
+    mem = mmap(NULL, sizeof(tinysh_retain_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return mem == MAP_FAILED ? NULL : (tinysh_retain_t *)mem;
+}
@@ -34,6 +34,10 @@
 #define TINY_PORT_H
 
 #include "tinysh.h"  // Include this to access tinysh_cmd_t
+#include "tinysh_metric.h"
+#include "tinysh_param.h"
+#include "tinysh_kv.h"
+#include "tinysh_retain.h"
 
 /**
  * Initialize the terminal for raw input mode
@@ -63,17 +67,86 @@ void tiny_port_putchar(unsigned char c);
  */
 int tiny_port_printf(const char *fmt, ...);
 
+/**
+ * Block output function - writes len bytes with one write
+ * 
+ * @param buf Bytes to write
+ * @param len Number of bytes
+ */
+void tiny_port_write(const char *buf, int len);
+
 /**
  * Setup TinyShell with proper output functions and initial prompt
+ * Restores the retained state (tinysh_retain.h) if a block is attached.
  */
 void tiny_port_setup(void);
 
+/* Returned by tiny_port_getchar_timeout() when no input arrived in time */
+#define TINY_PORT_TIMEOUT   (-2)
+
+/**
+ * Wait up to timeout_ms for one input character
+ *
+ * Lets the main loop keep periodic work (menu refresh, timers) running
+ * while the user is idle.
+ *
+ * @param timeout_ms Maximum time to wait, -1 to block
+ * @return Character (0-255), TINY_PORT_TIMEOUT, or EOF on end of input
+ */
+int tiny_port_getchar_timeout(int timeout_ms);
+
+/**
+ * Monotonic millisecond clock, registered as the TinyShell time source
+ *
+ * @return Milliseconds since an arbitrary fixed point
+ */
+unsigned long tiny_port_millis(void);
+
 /* Command prototypes */
 void cmd_sysinfo(int argc, const char **argv);
 void cmd_echo(int argc, const char **argv);
+void cmd_cat(int argc, const char **argv);
+
+/**
+ * Argument completer for file system paths (see tinysh_complete.h)
+ */
+void tiny_port_complete_path(int argi, const char *prefix, void *arg);
+
+/**
+ * Open the fake flash device for the settings store (tinysh_kv.h)
+ *
+ * An image file mapped into memory. Missing or new parts of the file
+ * read as erased (0xFF); writes can only clear bits, as on NOR flash,
+ * and an erase takes erase_delay milliseconds.
+ *
+ * @param path        Image file, created if missing
+ * @param sector_size Bytes per sector
+ * @param sectors     Number of sectors
+ * @return Device, or NULL if the file cannot be mapped
+ */
+const tinysh_flash_t *tiny_port_flash_open(const char *path, unsigned long sector_size,
+                                           unsigned short sectors);
+
+/**
+ * Map the file that stands in for no-init RAM (tinysh_retain.h)
+ *
+ * The file keeps its contents from one run to the next, as retained RAM
+ * keeps them across a reset. A new file reads as zeros: a cold boot.
+ *
+ * @param path File, created if missing
+ * @return Block, or NULL if the file cannot be mapped
+ */
+tinysh_retain_t *tiny_port_retain_open(const char *path);
 
 /* Command structures */
 extern tinysh_cmd_t sysinfo_cmd;
 extern tinysh_cmd_t echo_cmd;
+extern tinysh_cmd_t cat_cmd;
+
+/* Example metric */
+extern tinysh_metric_t load_metric;
+
+/* Example parameter */
+extern tinysh_param_t erase_delay_param;
 
 #endif /* TINY_PORT_H */
\ No newline at end of file
@@ -0,0 +1,1088 @@
+#define _GNU_SOURCE             /* accept4, recursive mutex initializer */
+#include "tiny_server.h"
+#include "tinysh.h"
+#include "tinysh_session.h"
+#include "tinysh_telnet.h"
+#include "tinysh_memo.h"
+#include "tinysh_table.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/* Connections handed to a worker and not yet picked up */
+#define PENDING_MAX  16
+
+/* Events taken per epoll_wait() */
+#define EVENTS_MAX   32
+
+/* Counters written by one thread and read by others */
+#define COUNT(var, n)  __atomic_fetch_add(&(var), (n), __ATOMIC_RELAXED)
+#define LOAD(var)      __atomic_load_n(&(var), __ATOMIC_RELAXED)
+#define STORE(var, v)  __atomic_store_n(&(var), (v), __ATOMIC_RELAXED)
+
+#if SERVER_MAX_SESSIONS > SESSION_SCHED_MAX
+#error "SERVER_MAX_SESSIONS exceeds SESSION_SCHED_MAX"
+#endif
+
+/* A detached session, as registered: where it is, and who may attach */
+typedef struct {
+    unsigned id;                     /* 0 = none */
+    int worker;                      /* holding it */
+    unsigned long since;
+    unsigned char auth;              /* its auth level */
+} server_detached_t;
+
+/* A client connection */
+typedef struct {
+    int fd;                          /* -1 while detached */
+    int slot;                        /* index in the worker's conns[] */
+    unsigned events;                 /* EPOLL* interest registered */
+    unsigned long lines;             /* session lines already counted */
+    unsigned long detached_ms;       /* when its connection was lost */
+    server_detached_t attach;        /* hand the connection to this session */
+    int telnet_on;
+    tinysh_telnet_t telnet;
+    tinysh_session_t session;
+} server_conn_t;
+
+/* A connection on its way to a worker */
+typedef struct {
+    int fd;
+    unsigned attach_id;              /* session to take over, 0 for a new one */
+    unsigned char auth;              /*   with this auth level, the attaching one's */
+    int telnet_on;
+    tinysh_telnet_t telnet;          /* negotiated so far */
+} server_pending_t;
+
+/* A worker thread and the sessions it serves */
+typedef struct {
+    pthread_t thread;
+    int epfd;
+    int wakefd;                      /* eventfd: new connections, or stop */
+    pthread_mutex_t lock;            /* guards pending[] */
+    server_pending_t pending[PENDING_MAX];
+    int npending;
+    server_conn_t *conns[SERVER_MAX_SESSIONS];
+    int ndetached;                   /* conns without a connection */
+    tinysh_sched_t sched;            /* fair share of this worker's time */
+
+    /* Counters */
+    unsigned long sessions;          /* open or pending, set by the acceptor too */
+    unsigned long accepted;
+    unsigned long lines;
+    unsigned long bytes_in;
+    unsigned long bytes_out;
+    unsigned long serialized;        /* handlers run under the executor lock */
+    unsigned long direct;            /* thread-safe handlers run without it */
+    tinysh_sched_stats_t sched_stats; /* published after each round */
+
+    /* Values when the server command last ran, for rates */
+    unsigned long last_lines;
+    unsigned long last_in;
+    unsigned long last_out;
+} server_worker_t;
+
+static server_worker_t workers[SERVER_MAX_WORKERS];
+static int nworkers = 0;
+static int listen_fd = -1;
+static int stop_fd = -1;            /* eventfd telling the acceptor to stop */
+static pthread_t acceptor;
+static int running = 0;
+static unsigned short listen_port = 0;
+static unsigned long refused = 0;
+static unsigned long last_ms = 0;
+static int telnet = 0;
+
+/* Detached sessions. An entry is claimed (removed) by whoever attaches
+   or expires the session first. */
+static server_detached_t detached[SERVER_MAX_DETACHED];
+static int ndetached = 0;
+static pthread_mutex_t detach_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned next_id = 0;
+
+/* Thread-safe commands: appended under threadsafe_lock, read without it;
+   an entry is written before the count that publishes it */
+static tinysh_cmd_t *threadsafe[SERVER_MAX_THREADSAFE];
+static int nthreadsafe = 0;
+static pthread_mutex_t threadsafe_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Held while a handler that is not thread-safe runs */
+static pthread_mutex_t exec_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+/* Worker running on this thread, NULL on the console's */
+static TINYSH_TLS server_worker_t *self = NULL;
+
+/* Forward declarations */
+static int is_threadsafe(tinysh_cmd_t *cmd);
+static int exec_enter(tinysh_cmd_t *cmd);
+static void exec_leave(tinysh_cmd_t *cmd, int locked);
+static void conn_flush(tinysh_session_t *s);
+static void conn_telnet_event(tinysh_telnet_t *t, int ev);
+static void conn_update(server_worker_t *w, server_conn_t *c);
+static void detach_entry(server_worker_t *w, server_conn_t *c, server_detached_t *d);
+static int detach_add(const server_detached_t *d);
+static int detach_claim(unsigned id, server_detached_t *d);
+static int may_attach(const server_detached_t *d, unsigned char auth);
+static void conn_open(server_worker_t *w, int fd);
+static void conn_close(server_worker_t *w, server_conn_t *c);
+static void conn_detach(server_worker_t *w, server_conn_t *c);
+static void conn_adopt(server_worker_t *w, server_pending_t *p);
+static void conn_move(server_worker_t *w, server_conn_t *c);
+static void conn_event(server_worker_t *w, server_conn_t *c, unsigned events);
+static void worker_sweep(server_worker_t *w);
+static int worker_wake(server_worker_t *w);
+static void *worker_main(void *arg);
+static int hand_to(server_worker_t *w, const server_pending_t *p);
+static void hand_over(int fd);
+static void *acceptor_main(void *arg);
+static void close_fds(void);
+void server_cmd_handler(int argc, const char **argv);
+void telnet_cmd_handler(int argc, const char **argv);
+void attach_cmd_handler(int argc, const char **argv);
+
+/* Server command */
+tinysh_cmd_t server_cmd = {
+    0, "server", "show session server workers", _NOARG_,
+    server_cmd_handler, 0, 0, 0
+};
+
+/* Telnet command */
+tinysh_cmd_t telnet_cmd = {
+    0, "telnet", "show this connection's telnet state", "[linemode on|off]",
+    telnet_cmd_handler, 0, 0, 0
+};
+
+/* Attach command */
+tinysh_cmd_t attach_cmd = {
+    0, "attach", "list detached sessions, or take one over", "[ID]",
+    attach_cmd_handler, 0, 0, 0
+};
+
+/**
+ * Can a command's handler run without the executor lock
+ * Cached commands never can: the memo cache is shared.
+ */
+static int is_threadsafe(tinysh_cmd_t *cmd) {
+    int i, n = __atomic_load_n(&nthreadsafe, __ATOMIC_ACQUIRE);
+
+    if (!cmd || tinysh_memo_enabled(cmd)) return 0;
+    for (i = 0; i < n; i++) {
+        if (threadsafe[i] == cmd) return 1;
+    }
+    return 0;
+}
+
+/**
+ * Executor: before a handler, help or completion
+ *
+ * @return 1 if it took the executor lock
+ */
+static int exec_enter(tinysh_cmd_t *cmd) {
+    if (is_threadsafe(cmd)) {
+        if (self) COUNT(self->direct, 1);
+        return 0;
+    }
+    pthread_mutex_lock(&exec_lock);
+    if (self) COUNT(self->serialized, 1);
+    return 1;
+}
+
+/**
+ * Executor: after a handler, help or completion
+ * Unlocks only what exec_enter() locked, whatever changed since.
+ */
+static void exec_leave(tinysh_cmd_t *cmd, int locked) {
+    (void)cmd;
+    if (locked) pthread_mutex_unlock(&exec_lock);
+}
+
+/**
+ * Send as much buffered output as the socket takes
+ * Also the session's flush callback when its buffer fills.
+ */
+static void conn_flush(tinysh_session_t *s) {
+    server_conn_t *c = s->user;
+    const char *p;
+    ssize_t n;
+    int len, plain;
+
+    for (;;) {
+        if (c->telnet_on) {
+            /* Negotiation first, then output up to the next data byte
+               255, which goes out doubled through the same queue */
+            p = tinysh_telnet_pending(&c->telnet, &len);
+            if (len) {
+                n = send(c->fd, p, (size_t)len, MSG_NOSIGNAL);
+                if (n <= 0) break;
+                tinysh_telnet_consume(&c->telnet, (int)n);
+                if (self) COUNT(self->bytes_out, (unsigned long)n);
+                continue;
+            }
+        }
+        p = tinysh_session_pending(s, &len);
+        if (!len) break;
+        if (c->telnet_on) {
+            plain = tinysh_telnet_plain(p, len);
+            if (!plain) {
+                if (tinysh_telnet_queue(&c->telnet, "\377\377", 2) < 0) break;
+                tinysh_session_consume(s, 1);
+                continue;
+            }
+            len = plain;
+        }
+        n = send(c->fd, p, (size_t)len, MSG_NOSIGNAL);
+        if (n <= 0) break;
+        tinysh_session_consume(s, (int)n);
+        if (self) COUNT(self->bytes_out, (unsigned long)n);
+    }
+}
+
+/**
+ * Telnet told us the client's window size, or line mode changed
+ */
+static void conn_telnet_event(tinysh_telnet_t *t, int ev) {
+    server_conn_t *c = t->user;
+
+    if (ev == TELNET_EV_SIZE) {
+        tinysh_session_set_size(&c->session, t->rows, t->cols);
+    } else if (ev == TELNET_EV_MODE) {
+        c->session.line.local_echo = (char)tinysh_telnet_linemode(t);
+    }
+}
+
+/**
+ * Wait for input while the session is open and its queue has room, and
+ * for the socket to drain while output is pending
+ */
+static void conn_update(server_worker_t *w, server_conn_t *c) {
+    struct epoll_event ev;
+    unsigned events = 0;
+    int len;
+
+    tinysh_session_pending(&c->session, &len);
+    if (tinysh_session_active(&c->session) && tinysh_session_queue_room(&c->session)) {
+        events |= EPOLLIN;
+    }
+    if (len) events |= EPOLLOUT;
+    if (c->telnet_on && c->telnet.reply_len) events |= EPOLLOUT;
+    if (events == c->events) return;
+
+    c->events = events;
+    ev.events = events;
+    ev.data.ptr = c;
+    epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/**
+ * Registry entry for a session of this worker
+ */
+static void detach_entry(server_worker_t *w, server_conn_t *c, server_detached_t *d) {
+    d->id = c->session.id;
+    d->worker = (int)(w - workers);
+    d->since = c->detached_ms;
+    d->auth = c->session.line.auth_level;
+}
+
+/**
+ * Register a detached session
+ *
+ * @return 0, or -1 if too many are detached
+ */
+static int detach_add(const server_detached_t *d) {
+    int err = -1;
+
+    pthread_mutex_lock(&detach_lock);
+    if (ndetached < SERVER_MAX_DETACHED) {
+        detached[ndetached++] = *d;
+        err = 0;
+    }
+    pthread_mutex_unlock(&detach_lock);
+    return err;
+}
+
+/**
+ * Take a detached session out of the registry
+ *
+ * @param d Receives the entry, can be NULL
+ * @return Worker holding it, or -1 if it is not there (any more)
+ */
+static int detach_claim(unsigned id, server_detached_t *d) {
+    int i, worker = -1;
+
+    pthread_mutex_lock(&detach_lock);
+    for (i = 0; i < ndetached; i++) {
+        if (detached[i].id == id) {
+            worker = detached[i].worker;
+            if (d) *d = detached[i];
+            detached[i] = detached[--ndetached];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&detach_lock);
+    return worker;
+}
+
+/**
+ * Whether a caller may take over a detached session
+ * Connections carry no identity, so its owner is whoever holds its auth
+ * level: an admin session needs a caller who authenticated again.
+ */
+static int may_attach(const server_detached_t *d, unsigned char auth) {
+    return auth >= d->auth;
+}
+
+/**
+ * Start a session on a new connection
+ */
+static void conn_open(server_worker_t *w, int fd) {
+    struct epoll_event ev;
+    server_conn_t *c = NULL;
+    int i, one = 1;
+
+    for (i = 0; i < SERVER_MAX_SESSIONS && w->conns[i]; i++);
+    if (i < SERVER_MAX_SESSIONS) c = malloc(sizeof(*c));
+    if (!c) {
+        close(fd);
+        COUNT(w->sessions, -1UL);
+        COUNT(refused, 1);
+        return;
+    }
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    c->fd = fd;
+    c->slot = i;
+    c->events = EPOLLIN;
+    c->lines = 0;
+    c->attach.id = 0;
+    c->telnet_on = LOAD(telnet);
+    tinysh_session_init(&c->session, conn_flush, c);
+    tinysh_session_scrollback(&c->session, 1);
+    c->session.id = tiny_server_session_id();
+    if (c->telnet_on) {
+        tinysh_telnet_init(&c->telnet, conn_telnet_event, c);
+        tinysh_telnet_start(&c->telnet, SERVER_TELNET_LINEMODE);
+    }
+
+    ev.events = c->events;
+    ev.data.ptr = c;
+    if (tinysh_sched_add(&w->sched, &c->session) < 0) {
+        close(fd);
+        free(c);
+        COUNT(w->sessions, -1UL);
+        return;
+    }
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        tinysh_sched_remove(&w->sched, &c->session);
+        close(fd);
+        free(c);
+        COUNT(w->sessions, -1UL);
+        return;
+    }
+    w->conns[i] = c;
+
+    tinysh_session_start(&c->session);
+    conn_flush(&c->session);
+    conn_update(w, c);
+}
+
+/**
+ * End a session
+ */
+static void conn_close(server_worker_t *w, server_conn_t *c) {
+    tinysh_sched_remove(&w->sched, &c->session);
+    if (c->fd >= 0) {
+        epoll_ctl(w->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+    } else {
+        detach_claim(c->session.id, NULL);
+        w->ndetached--;
+    }
+    tinysh_session_scrollback(&c->session, 0);
+    w->conns[c->slot] = NULL;
+    free(c);
+    COUNT(w->sessions, -1UL);
+}
+
+/**
+ * The connection is gone but the session was not ended: keep it, to be
+ * attached later
+ */
+static void conn_detach(server_worker_t *w, server_conn_t *c) {
+    server_detached_t d;
+
+    c->detached_ms = tinysh_time_ms();
+    detach_entry(w, c, &d);
+    if (!tinysh_session_active(&c->session) || detach_add(&d) < 0) {
+        conn_close(w, c);
+        return;
+    }
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    c->events = 0;
+    w->ndetached++;
+    tinysh_session_detach(&c->session);
+}
+
+/**
+ * A connection arrives to take over a detached session here
+ * Its telnet state comes along; the missed output is replayed. The
+ * session's auth level is not: it gets the attaching session's.
+ */
+static void conn_adopt(server_worker_t *w, server_pending_t *p) {
+    static const char gone[] = "That session has ended\r\n";
+    struct epoll_event ev;
+    server_detached_t d;
+    server_conn_t *c = NULL;
+    int i;
+
+    for (i = 0; i < SERVER_MAX_SESSIONS; i++) {
+        if (w->conns[i] && w->conns[i]->session.id == p->attach_id && w->conns[i]->fd < 0) c = w->conns[i];
+    }
+    if (!c) {
+        /* It ended while the connection was on its way: start afresh */
+        if (send(p->fd, gone, sizeof(gone) - 1, MSG_NOSIGNAL) < 0) {
+            /* the new session notices */
+        }
+        COUNT(w->sessions, 1);
+        conn_open(w, p->fd);
+        return;
+    }
+
+    c->fd = p->fd;
+    c->events = EPOLLIN;
+    ev.events = c->events;
+    ev.data.ptr = c;
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0) {
+        close(c->fd);
+        c->fd = -1;
+        detach_entry(w, c, &d);
+        detach_add(&d);
+        return;
+    }
+    w->ndetached--;
+    c->session.line.auth_level = p->auth;
+
+    c->telnet_on = p->telnet_on;
+    c->session.line.local_echo = 0;
+    if (c->telnet_on) {
+        c->telnet = p->telnet;
+        c->telnet.user = c;
+        c->telnet.event = conn_telnet_event;
+        if (c->telnet.rows) tinysh_session_set_size(&c->session, c->telnet.rows, c->telnet.cols);
+        c->session.line.local_echo = (char)tinysh_telnet_linemode(&c->telnet);
+    }
+    tinysh_session_replay(&c->session);
+    conn_flush(&c->session);
+    conn_update(w, c);
+}
+
+/**
+ * Hand this connection to the session it attaches to, and end its own
+ */
+static void conn_move(server_worker_t *w, server_conn_t *c) {
+    server_pending_t p;
+
+    p.fd = c->fd;
+    p.attach_id = c->attach.id;
+    p.auth = c->session.line.auth_level;
+    p.telnet_on = c->telnet_on;
+    if (c->telnet_on) p.telnet = c->telnet;
+
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    tinysh_sched_remove(&w->sched, &c->session);
+    tinysh_session_scrollback(&c->session, 0);
+    w->conns[c->slot] = NULL;
+    COUNT(w->sessions, -1UL);
+
+    if (hand_to(&workers[c->attach.worker], &p) < 0) {
+        detach_add(&c->attach);
+        close(p.fd);
+    }
+    free(c);
+}
+
+/**
+ * Socket readable, writable, or gone
+ * Input is only queued here; the scheduler decides when it runs.
+ */
+static void conn_event(server_worker_t *w, server_conn_t *c, unsigned events) {
+    tinysh_session_t *s = &c->session;
+    char buf[SERVER_READ_CHUNK];
+    ssize_t n;
+    int room;
+
+    if (events & EPOLLIN) {
+        room = tinysh_session_queue_room(s);
+        if (room > (int)sizeof(buf)) room = (int)sizeof(buf);
+        if (!room) return;
+        n = recv(c->fd, buf, (size_t)room, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            conn_detach(w, c);
+            return;
+        }
+        if (n > 0) {
+            COUNT(w->bytes_in, (unsigned long)n);
+            if (c->telnet_on) n = tinysh_telnet_input(&c->telnet, buf, (int)n);
+            if (n > 0) tinysh_session_queue(s, buf, (int)n);
+        }
+    } else if (events & (EPOLLERR | EPOLLHUP)) {
+        conn_detach(w, c);
+    }
+}
+
+/**
+ * After a round: send output, count lines, end finished sessions, move
+ * attaching connections, expire detached sessions, and publish the
+ * scheduler counters
+ */
+static void worker_sweep(server_worker_t *w) {
+    tinysh_sched_stats_t st;
+    server_conn_t *c;
+    unsigned long now = tinysh_time_ms();
+    int i, len;
+
+    for (i = 0; i < SERVER_MAX_SESSIONS; i++) {
+        c = w->conns[i];
+        if (!c) continue;
+
+        COUNT(w->lines, c->session.lines - c->lines);
+        c->lines = c->session.lines;
+        if (c->fd < 0) {
+            if (!tinysh_session_active(&c->session) ||
+                (now - c->detached_ms > SERVER_DETACH_MS && detach_claim(c->session.id, NULL) >= 0)) {
+                conn_close(w, c);
+            }
+            continue;
+        }
+        conn_flush(&c->session);
+        if (c->attach.id) {
+            conn_move(w, c);
+            continue;
+        }
+        tinysh_session_pending(&c->session, &len);
+        if (!tinysh_session_active(&c->session) && !len) {
+            conn_close(w, c);   /* quit, and everything sent */
+            continue;
+        }
+        conn_update(w, c);
+    }
+
+    tinysh_sched_stats(&w->sched, &st);
+    STORE(w->sched_stats.backlogged, st.backlogged);
+    STORE(w->sched_stats.queued, st.queued);
+    STORE(w->sched_stats.rounds, st.rounds);
+    STORE(w->sched_stats.throttled_bytes, st.throttled_bytes);
+    STORE(w->sched_stats.throttled_lines, st.throttled_lines);
+    STORE(w->sched_stats.throttled_out, st.throttled_out);
+}
+
+/**
+ * Pick up connections from the acceptor
+ *
+ * @return 0, or -1 when the server is stopping
+ */
+static int worker_wake(server_worker_t *w) {
+    server_pending_t p[PENDING_MAX];
+    uint64_t value;
+    int i, n;
+
+    if (read(w->wakefd, &value, sizeof(value)) < 0 && errno != EAGAIN) return -1;
+    if (!LOAD(running)) return -1;
+
+    pthread_mutex_lock(&w->lock);
+    n = w->npending;
+    memcpy(p, w->pending, sizeof(p[0]) * (size_t)n);
+    w->npending = 0;
+    pthread_mutex_unlock(&w->lock);
+
+    for (i = 0; i < n; i++) {
+        if (p[i].attach_id) conn_adopt(w, &p[i]);
+        else conn_open(w, p[i].fd);
+    }
+    return 0;
+}
+
+/**
+ * Worker thread: one epoll loop over this worker's sessions
+ * Each iteration queues what arrived, runs one scheduler round, and
+ * sends the output. It only blocks when no session can make progress,
+ * and then wakes each second while sessions are detached, to expire them.
+ */
+static void *worker_main(void *arg) {
+    server_worker_t *w = arg;
+    struct epoll_event events[EVENTS_MAX];
+    int i, n;
+
+    self = w;
+    for (;;) {
+        n = epoll_wait(w->epfd, events, EVENTS_MAX,
+                       tinysh_sched_ready(&w->sched) ? 0 : w->ndetached ? 1000 : -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            if (!events[i].data.ptr) {
+                if (worker_wake(w) < 0) goto done;
+            } else {
+                conn_event(w, events[i].data.ptr, events[i].events);
+            }
+        }
+        tinysh_sched_run(&w->sched);
+        worker_sweep(w);
+    }
+
+done:
+    for (i = 0; i < SERVER_MAX_SESSIONS; i++) {
+        if (w->conns[i]) conn_close(w, w->conns[i]);
+    }
+    for (i = 0; i < w->npending; i++) close(w->pending[i].fd);
+    w->npending = 0;
+    return NULL;
+}
+
+/**
+ * Queue a connection for a worker and wake it
+ * New connections count against the worker's sessions; one attaching
+ * to a session there does not, that session is counted already.
+ *
+ * @return 0, or -1 if the worker cannot take it
+ */
+static int hand_to(server_worker_t *w, const server_pending_t *p) {
+    uint64_t one = 1;
+
+    pthread_mutex_lock(&w->lock);
+    if ((!p->attach_id && LOAD(w->sessions) >= SERVER_MAX_SESSIONS) || w->npending == PENDING_MAX) {
+        pthread_mutex_unlock(&w->lock);
+        return -1;
+    }
+    w->pending[w->npending++] = *p;
+    if (!p->attach_id) {
+        COUNT(w->sessions, 1);
+        COUNT(w->accepted, 1);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    if (write(w->wakefd, &one, sizeof(one)) < 0) {
+        /* counter saturated: the worker is awake anyway */
+    }
+    return 0;
+}
+
+/**
+ * Give a new connection to the worker with the fewest sessions
+ * Ties rotate, so short sessions still spread over all workers.
+ */
+static void hand_over(int fd) {
+    static int next = 0;
+    server_worker_t *w = &workers[next], *v;
+    server_pending_t p;
+    int i;
+
+    for (i = 1; i < nworkers; i++) {
+        v = &workers[(next + i) % nworkers];
+        if (LOAD(v->sessions) < LOAD(w->sessions)) w = v;
+    }
+    next = (next + 1) % nworkers;
+
+    p.fd = fd;
+    p.attach_id = 0;
+    p.auth = TINYSH_AUTH_NONE;
+    p.telnet_on = 0;
+    if (hand_to(w, &p) < 0) {
+        close(fd);
+        COUNT(refused, 1);
+    }
+}
+
+/**
+ * Acceptor thread
+ */
+static void *acceptor_main(void *arg) {
+    struct pollfd p[2];
+    int fd;
+
+    (void)arg;
+    p[0].fd = listen_fd;
+    p[0].events = POLLIN;
+    p[1].fd = stop_fd;
+    p[1].events = POLLIN;
+
+    for (;;) {
+        if (poll(p, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (p[1].revents) break;
+        if (p[0].revents & POLLIN) {
+            fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd >= 0) hand_over(fd);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Close the listening socket and the workers' descriptors
+ */
+static void close_fds(void) {
+    int i;
+
+    for (i = 0; i < nworkers; i++) {
+        if (workers[i].epfd >= 0) close(workers[i].epfd);
+        if (workers[i].wakefd >= 0) close(workers[i].wakefd);
+        pthread_mutex_destroy(&workers[i].lock);
+    }
+    nworkers = 0;
+    if (stop_fd >= 0) close(stop_fd);
+    if (listen_fd >= 0) close(listen_fd);
+    stop_fd = listen_fd = -1;
+}
+
+/**
+ * Start listening and start the worker threads
+ */
+int tiny_server_start(unsigned short port, int nw) {
+    struct sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+    struct epoll_event ev;
+    int i, err, one = 1;
+
+    if (running || nw < 1 || nw > SERVER_MAX_WORKERS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, SERVER_BIND_ADDR, &addr.sin_addr) != 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) return -1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, 64) < 0 ||
+        getsockname(listen_fd, (struct sockaddr *)&addr, &alen) < 0) {
+        goto fail;
+    }
+    listen_port = ntohs(addr.sin_port);
+    stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (stop_fd < 0) goto fail;
+
+    for (nworkers = 0; nworkers < nw; nworkers++) {
+        server_worker_t *w = &workers[nworkers];
+
+        memset(w, 0, sizeof(*w));
+        pthread_mutex_init(&w->lock, NULL);
+        w->epfd = epoll_create1(EPOLL_CLOEXEC);
+        w->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (w->epfd < 0 || w->wakefd < 0) {
+            nworkers++;
+            goto fail;
+        }
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->wakefd, &ev) < 0) {
+            nworkers++;
+            goto fail;
+        }
+    }
+
+    tinysh_exec_hooks(exec_enter, exec_leave);
+    __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < nworkers; i++) {
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+    }
+    pthread_create(&acceptor, NULL, acceptor_main, NULL);
+    last_ms = tinysh_time_ms();
+    return listen_port;
+
+fail:
+    err = errno;
+    close_fds();
+    errno = err;
+    return -1;
+}
+
+/**
+ * Close every session and stop the threads
+ */
+void tiny_server_stop(void) {
+    uint64_t one = 1;
+    int i;
+
+    if (!running) return;
+    __atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+
+    if (write(stop_fd, &one, sizeof(one)) < 0) {
+        /* cannot fail on a fresh eventfd */
+    }
+    pthread_join(acceptor, NULL);
+    for (i = 0; i < nworkers; i++) {
+        if (write(workers[i].wakefd, &one, sizeof(one)) < 0) {
+            /* idem */
+        }
+        pthread_join(workers[i].thread, NULL);
+    }
+    tinysh_exec_hooks(NULL, NULL);
+    close_fds();
+}
+
+/**
+ * Let a command's handler run without the executor lock
+ */
+int tiny_server_threadsafe(tinysh_cmd_t *cmd) {
+    int i, err = 0;
+
+    pthread_mutex_lock(&threadsafe_lock);
+    for (i = 0; i < nthreadsafe && threadsafe[i] != cmd; i++);
+    if (i == nthreadsafe) {
+        if (nthreadsafe == SERVER_MAX_THREADSAFE) {
+            err = -1;
+        } else {
+            threadsafe[nthreadsafe] = cmd;
+            __atomic_store_n(&nthreadsafe, nthreadsafe + 1, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&threadsafe_lock);
+    return err;
+}
+
+/**
+ * Number a session
+ */
+unsigned tiny_server_session_id(void) {
+    return COUNT(next_id, 1) + 1;
+}
+
+/**
+ * Speak telnet on new connections
+ */
+void tiny_server_telnet(int on) {
+    STORE(telnet, on != 0);
+}
+
+/**
+ * Take the executor lock
+ */
+void tiny_server_lock(void) {
+    pthread_mutex_lock(&exec_lock);
+}
+
+/**
+ * Release the executor lock
+ */
+void tiny_server_unlock(void) {
+    pthread_mutex_unlock(&exec_lock);
+}
+
+/**
+ * Server command handler
+ * Rates are over the time since the command last ran.
+ */
+void server_cmd_handler(int argc, const char **argv) {
+    static const tinysh_table_col_t cols[] = {
+        {"Worker", 0, TABLE_ALIGN_RIGHT},
+        {"Sessions", 0, TABLE_ALIGN_RIGHT},
+        {"Accepted", 0, TABLE_ALIGN_RIGHT},
+        {"Lines/s", 0, TABLE_ALIGN_RIGHT},
+        {"In B/s", 0, TABLE_ALIGN_RIGHT},
+        {"Out B/s", 0, TABLE_ALIGN_RIGHT},
+        {"Locked", 0, TABLE_ALIGN_RIGHT},
+        {"Direct", 0, TABLE_ALIGN_RIGHT}
+    };
+    static const tinysh_table_col_t sched_cols[] = {
+        {"Worker", 0, TABLE_ALIGN_RIGHT},
+        {"Queued B", 0, TABLE_ALIGN_RIGHT},
+        {"Backlogged", 0, TABLE_ALIGN_RIGHT},
+        {"Rounds", 0, TABLE_ALIGN_RIGHT},
+        {"Bytes cap", 0, TABLE_ALIGN_RIGHT},
+        {"Lines cap", 0, TABLE_ALIGN_RIGHT},
+        {"Output cap", 0, TABLE_ALIGN_RIGHT}
+    };
+    char cell[8][16];
+    unsigned long now, elapsed, lines, in, out;
+    int i;
+
+    (void)argc;
+    (void)argv;
+
+    if (!running) {
+        tinysh_puts("Server not running (start with -s PORT[:WORKERS])\r\n");
+        return;
+    }
+
+    now = tinysh_time_ms();
+    elapsed = now - last_ms;
+    if (!elapsed) elapsed = 1;
+    last_ms = now;
+
+    tinysh_printf("Listening on %s:%u, %d worker%s, %lu refused\r\n",
+                  SERVER_BIND_ADDR, listen_port, nworkers, nworkers == 1 ? "" : "s",
+                  LOAD(refused));
+    tinysh_table_begin(cols, 8);
+    for (i = 0; i < nworkers; i++) {
+        server_worker_t *w = &workers[i];
+
+        lines = LOAD(w->lines);
+        in = LOAD(w->bytes_in);
+        out = LOAD(w->bytes_out);
+        snprintf(cell[0], sizeof(cell[0]), "%d", i);
+        snprintf(cell[1], sizeof(cell[1]), "%lu", LOAD(w->sessions));
+        snprintf(cell[2], sizeof(cell[2]), "%lu", LOAD(w->accepted));
+        snprintf(cell[3], sizeof(cell[3]), "%lu", (lines - w->last_lines) * 1000 / elapsed);
+        snprintf(cell[4], sizeof(cell[4]), "%lu", (in - w->last_in) * 1000 / elapsed);
+        snprintf(cell[5], sizeof(cell[5]), "%lu", (out - w->last_out) * 1000 / elapsed);
+        snprintf(cell[6], sizeof(cell[6]), "%lu", LOAD(w->serialized));
+        snprintf(cell[7], sizeof(cell[7]), "%lu", LOAD(w->direct));
+        w->last_lines = lines;
+        w->last_in = in;
+        w->last_out = out;
+        tinysh_table_add(cell[0], cell[1], cell[2], cell[3], cell[4],
+                         cell[5], cell[6], cell[7]);
+    }
+    tinysh_table_end();
+
+    /* Fair scheduling: queue depth, and how often each quota stopped a session */
+    tinysh_table_begin(sched_cols, 7);
+    for (i = 0; i < nworkers; i++) {
+        tinysh_sched_stats_t *st = &workers[i].sched_stats;
+
+        snprintf(cell[0], sizeof(cell[0]), "%d", i);
+        snprintf(cell[1], sizeof(cell[1]), "%lu", LOAD(st->queued));
+        snprintf(cell[2], sizeof(cell[2]), "%u", (unsigned)LOAD(st->backlogged));
+        snprintf(cell[3], sizeof(cell[3]), "%lu", LOAD(st->rounds));
+        snprintf(cell[4], sizeof(cell[4]), "%lu", LOAD(st->throttled_bytes));
+        snprintf(cell[5], sizeof(cell[5]), "%lu", LOAD(st->throttled_lines));
+        snprintf(cell[6], sizeof(cell[6]), "%lu", LOAD(st->throttled_out));
+        tinysh_table_add(cell[0], cell[1], cell[2], cell[3], cell[4], cell[5], cell[6]);
+    }
+    tinysh_table_end();
+}
+
+/**
+ * Telnet command handler
+ * Acts on the connection it was typed in; the worker serving it runs the
+ * handler, so its state is not shared.
+ */
+void telnet_cmd_handler(int argc, const char **argv) {
+    tinysh_session_t *s = tinysh_session_current();
+    server_conn_t *c = s && s->flush == conn_flush ? s->user : NULL;
+    tinysh_telnet_t *t;
+
+    if (!c || !c->telnet_on) {
+        tinysh_printf("Not a telnet connection\r\n");
+        return;
+    }
+    t = &c->telnet;
+
+    if (argc == 3 && strcmp(argv[1], "linemode") == 0 &&
+        (strcmp(argv[2], "on") == 0 || strcmp(argv[2], "off") == 0)) {
+        tinysh_telnet_set_linemode(t, argv[2][1] == 'n');
+        tinysh_printf("Line mode %s requested; the client's answer shows in 'telnet'\r\n", argv[2]);
+        return;
+    }
+    if (argc > 1) {
+        tinysh_printf("Usage: telnet [linemode on|off]\r\n");
+        return;
+    }
+
+    if (t->rows) {
+        tinysh_printf("Window %ux%u (NAWS)\r\n", t->cols, t->rows);
+    } else {
+        tinysh_printf("Window unknown, %ux%u assumed\r\n", s->size.cols, s->size.rows);
+    }
+    tinysh_printf("Line mode %s, echo by %s, SGA %s\r\n",
+                  tinysh_telnet_linemode(t) ? "on" : "off",
+                  t->us_echo == TELNET_Q_YES ? "shell" : "client",
+                  t->us_sga == TELNET_Q_YES ? "on" : "off");
+    tinysh_printf("IAC sequences %lu, replies dropped %lu B\r\n", t->commands, t->dropped);
+}
+
+/**
+ * Attach command handler
+ * Only sessions the caller may take over are listed or attached. The
+ * connection moves when the worker sweeps, after the handler; the worker
+ * serving this session runs it, so flushing here is safe.
+ */
+void attach_cmd_handler(int argc, const char **argv) {
+    static const tinysh_table_col_t cols[] = {
+        {"Session", 0, TABLE_ALIGN_RIGHT},
+        {"Worker", 0, TABLE_ALIGN_RIGHT},
+        {"Detached s", 0, TABLE_ALIGN_RIGHT}
+    };
+    tinysh_session_t *s = tinysh_session_current();
+    server_conn_t *c = s && s->flush == conn_flush ? s->user : NULL;
+    unsigned long now = tinysh_time_ms();
+    unsigned char auth = tinysh_get_auth_level();
+    server_detached_t list[SERVER_MAX_DETACHED], d;
+    char cell[3][24];
+    long id;
+    int i, n;
+
+    if (argc > 2 || (argc == 2 && (tinysh_parse_long(argv[1], -1, &id) < 0 || id <= 0))) {
+        tinysh_puts("Usage: attach [ID]\r\n");
+        return;
+    }
+
+    if (argc == 1) {
+        pthread_mutex_lock(&detach_lock);
+        for (i = n = 0; i < ndetached; i++) {
+            if (may_attach(&detached[i], auth)) list[n++] = detached[i];
+        }
+        pthread_mutex_unlock(&detach_lock);
+
+        if (c) tinysh_printf("This is session %u\r\n", c->session.id);
+        if (!n) {
+            tinysh_puts("No detached sessions\r\n");
+            return;
+        }
+        tinysh_table_begin(cols, 3);
+        for (i = 0; i < n; i++) {
+            snprintf(cell[0], sizeof(cell[0]), "%u", list[i].id);
+            snprintf(cell[1], sizeof(cell[1]), "%d", list[i].worker);
+            snprintf(cell[2], sizeof(cell[2]), "%lu", (now - list[i].since) / 1000);
+            tinysh_table_add(cell[0], cell[1], cell[2]);
+        }
+        tinysh_table_end();
+        return;
+    }
+
+    if (!c) {
+        tinysh_puts("Only server sessions can attach\r\n");
+        return;
+    }
+    /* One the caller may not take is put back, and looks like none */
+    n = detach_claim((unsigned)id, &d);
+    if (n >= 0 && !may_attach(&d, auth)) {
+        detach_add(&d);
+        n = -1;
+    }
+    if (n < 0) {
+        tinysh_printf("No detached session %ld\r\n", id);
+        return;
+    }
+    c->attach = d;
+    tinysh_printf("Attaching to session %ld\r\n", id);
+
+    /* Nothing more from this session: not its prompt, nor queued input */
+    conn_flush(s);
+    tinysh_session_detach(s);
+    c->session.line.active = 0;
+}
@@ -0,0 +1,151 @@
+/**
+ * TinyShell Session Server (Linux)
+ * -------------------------------
+ * Serves shell sessions (tinysh_session.h) over TCP, so test automation
+ * can drive many shells at once next to the console.
+ *
+ * Features:
+ * - Worker threads, each running its own epoll loop over its own
+ *   sessions; nothing is shared between workers on the I/O path
+ * - An acceptor thread hands each new connection to the worker with the
+ *   fewest sessions
+ * - Nonblocking sockets: output waits in the session buffer and is sent
+ *   as the socket drains
+ * - Received input is queued per session and run by the worker's fair
+ *   scheduler (tinysh_sched_t), one round per loop iteration; a full
+ *   queue stops reading from that socket, so TCP pushes back on clients
+ *   that paste faster than their quota
+ * - The command tree is shared and read-only once the server runs:
+ *   register every command before tiny_server_start()
+ * - Handlers run one at a time (console included) under the executor
+ *   lock, unless marked with tiny_server_threadsafe(); help, completion
+ *   and cached (tinysh_memo.h) commands always take the lock
+ * - Optional telnet protocol (tinysh_telnet.h) instead of raw TCP: option
+ *   negotiation, the client's window size for the session's terminal,
+ *   and line mode on request ("telnet linemode on")
+ * - Sessions outlive their connection: when a client goes away without
+ *   "quit", its session is detached and keeps running queued input, its
+ *   output kept in the session's scrollback. "attach ID" from another
+ *   connection takes it over and replays the output that was missed;
+ *   "attach" lists detached sessions. Unclaimed ones are closed after
+ *   SERVER_DETACH_MS
+ * - "server" command: sessions, lines and throughput per worker, plus
+ *   queue depth and throttling counts
+ *
+ * Example Usage:
+ *
+ * tinysh_add_command(&server_cmd);
+ * tiny_server_threadsafe(&echo_cmd);
+ * tiny_server_telnet(1);                 // optional
+ * port = tiny_server_start(2323, 4);
+ *
+ * while (running) {
+ *     c = tiny_port_getchar_timeout(50);
+ *     tiny_server_lock();
+ *     ...console input and periodic work...
+ *     tiny_server_unlock();
+ * }
+ * tiny_server_stop();
+ *
+ * $ nc localhost 2323                     // or: telnet localhost 2323
+ * tinysh> echo hi
+ * tinysh> attach                          // after a dropped connection
+ * tinysh> attach 3
+ */
+
+#ifndef TINY_SERVER_H
+#define TINY_SERVER_H
+
+#include "tinysh.h"
+
+/* Most worker threads */
+#ifndef SERVER_MAX_WORKERS
+#define SERVER_MAX_WORKERS        8
+#endif
+
+/* Sessions one worker serves; further connections to it are refused */
+#ifndef SERVER_MAX_SESSIONS
+#define SERVER_MAX_SESSIONS       64
+#endif
+
+/* Commands that can be marked thread-safe */
+#ifndef SERVER_MAX_THREADSAFE
+#define SERVER_MAX_THREADSAFE     16
+#endif
+
+/* Address to listen on; loopback unless the shell should be reachable */
+#ifndef SERVER_BIND_ADDR
+#define SERVER_BIND_ADDR          "127.0.0.1"
+#endif
+
+/* Offer telnet line mode to every new connection */
+#ifndef SERVER_TELNET_LINEMODE
+#define SERVER_TELNET_LINEMODE    0
+#endif
+
+/* Detached sessions kept, and how long one waits to be attached */
+#ifndef SERVER_MAX_DETACHED
+#define SERVER_MAX_DETACHED       16
+#endif
+#ifndef SERVER_DETACH_MS
+#define SERVER_DETACH_MS          600000
+#endif
+
+/* Bytes read from a socket per event */
+#ifndef SERVER_READ_CHUNK
+#define SERVER_READ_CHUNK         512
+#endif
+
+/**
+ * Start listening and start the worker threads
+ *
+ * @param port    TCP port, 0 for any free one
+ * @param workers Worker threads, 1..SERVER_MAX_WORKERS
+ * @return Port listened on, or -1 on error (errno set)
+ */
+int tiny_server_start(unsigned short port, int workers);
+
+/**
+ * Close every session and stop the threads
+ */
+void tiny_server_stop(void);
+
+/**
+ * Let a command's handler run without the executor lock
+ * Only for handlers that touch no shared state but their arguments and
+ * the output functions. Call before tiny_server_start().
+ *
+ * @return 0 on success, -1 if the table is full
+ */
+int tiny_server_threadsafe(tinysh_cmd_t *cmd);
+
+/**
+ * Number a session the server does not run, e.g. the shared-memory
+ * channel, from the same count as its own, for transcripts
+ */
+unsigned tiny_server_session_id(void);
+
+/**
+ * Speak telnet on new connections instead of raw TCP
+ * Call before tiny_server_start().
+ */
+void tiny_server_telnet(int on);
+
+/**
+ * Take and release the executor lock (recursive)
+ * The console's main loop holds it while it handles input and runs
+ * periodic work, so those never overlap a session's handler.
+ */
+void tiny_server_lock(void);
+void tiny_server_unlock(void);
+
+/* Server command */
+extern tinysh_cmd_t server_cmd;
+
+/* Telnet command: the connection's telnet state, line mode on or off */
+extern tinysh_cmd_t telnet_cmd;
+
+/* Attach command: list detached sessions, or take one over */
+extern tinysh_cmd_t attach_cmd;
+
+#endif /* TINY_SERVER_H */
@@ -0,0 +1,598 @@
+#include "tiny_transcript.h"
+#include "tinysh.h"
+#include "tinysh_session.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#if TRANSCRIPT_RING_SIZE & (TRANSCRIPT_RING_SIZE - 1)
+#error "TRANSCRIPT_RING_SIZE must be a power of two"
+#endif
+
+/* Counters written by one thread and read by others */
+#define COUNT(var, n)  __atomic_fetch_add(&(var), (n), __ATOMIC_RELAXED)
+#define LOAD(var)      __atomic_load_n(&(var), __ATOMIC_RELAXED)
+#define STORE(var, v)  __atomic_store_n(&(var), (v), __ATOMIC_RELAXED)
+
+/* Record types */
+#define TYPE_IN      TRANSCRIPT_IN
+#define TYPE_OUT     TRANSCRIPT_OUT
+#define TYPE_PAD     2            /* fills the end of the ring */
+
+/* Record header; the payload follows */
+typedef struct {
+    uint32_t ready;               /* set last: the record is complete */
+    uint32_t len;                 /* payload bytes */
+    uint32_t session;
+    uint32_t type;
+    uint64_t time_us;             /* wall clock, of the first byte */
+} record_t;
+
+#define HDR          ((uint64_t)sizeof(record_t))
+#define ALIGN8(n)    (((n) + 7) & ~(uint64_t)7)
+#define RING_MASK    ((uint64_t)TRANSCRIPT_RING_SIZE - 1)
+
+/* Bytes one thread gathered, all of one session and direction */
+typedef struct {
+    unsigned session;
+    int dir;
+    int len;
+    uint64_t time_us;
+    char buf[TRANSCRIPT_STAGE_SIZE];
+} stage_t;
+
+/* Ring: producers advance head, the writer advances tail; both only grow.
+   Consumed space is zeroed, so a record is ready only once marked. */
+static uint64_t ring[TRANSCRIPT_RING_SIZE / 8];
+static uint64_t head = 0;
+static uint64_t tail = 0;
+static int running = 0;
+
+static TINYSH_TLS stage_t stage;
+
+/* Counters */
+static unsigned long records = 0;
+static unsigned long bytes = 0;
+static unsigned long dropped_records = 0;
+static unsigned long dropped_bytes = 0;
+static unsigned long written = 0;
+static unsigned long write_errors = 0;
+
+/* Writer */
+static pthread_t writer;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_wake = PTHREAD_COND_INITIALIZER;
+static int stopping = 0;
+static int out_fd = -1;
+static FILE *out_pipe = NULL;
+static char out_path[128];
+static char wbuf[TRANSCRIPT_WRITE_SIZE];
+static int wlen = 0;
+static uint64_t last_us = 0;          /* time of the last record written */
+static unsigned long noted_records = 0; /* drops already noted in the file */
+static unsigned long noted_bytes = 0;
+
+/* Console output functions the taps forward to */
+static void (*con_char_out)(unsigned char) = NULL;
+static int (*con_printf)(const char *, ...) = NULL;
+static void (*con_block_out)(const char *, int) = NULL;
+static char con_star = 0;             /* console output is a password's echo */
+static tinysh_line_t *con_line = NULL; /* the console's line state */
+
+/* Forward declarations */
+static uint64_t now_us(void);
+static void put(unsigned session, int type, uint64_t time_us, const char *buf, int len);
+static void session_tap(const tinysh_session_t *s, int what, const char *buf, int len);
+static void console_record(const char *buf, int len);
+static void console_char_out(unsigned char c);
+static void console_write(const char *buf, int len);
+static int console_printf(const char *fmt, ...);
+static void write_out(void);
+static void emit(const char *text, int len);
+static void emit_escaped(const char *buf, int len);
+static void emit_record(const record_t *r);
+static int drain(void);
+static void pass(void);
+static void *writer_main(void *arg);
+void transcript_cmd_handler(int argc, const char **argv);
+
+/* Transcript command */
+tinysh_cmd_t transcript_cmd = {
+    0, "transcript", "show or control session transcripts", "[start PATH|stop]",
+    transcript_cmd_handler, 0, 0, 0
+};
+
+/**
+ * Wall clock in microseconds
+ */
+static uint64_t now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+/**
+ * Put one record in the ring, or count it as dropped
+ * Space is reserved by moving head with a compare-and-swap; a record
+ * that would cross the end of the ring starts at 0, after a padding
+ * record (or, if even a header does not fit, bare skipped bytes).
+ */
+static void put(unsigned session, int type, uint64_t time_us, const char *buf, int len) {
+    uint64_t h, pos, need = ALIGN8(HDR + (uint64_t)len), skip;
+    record_t *r;
+
+    h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    do {
+        pos = h & RING_MASK;
+        skip = pos + need > TRANSCRIPT_RING_SIZE ? TRANSCRIPT_RING_SIZE - pos : 0;
+        if (h + skip + need - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) > TRANSCRIPT_RING_SIZE) {
+            COUNT(dropped_records, 1);
+            COUNT(dropped_bytes, (unsigned long)len);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&head, &h, h + skip + need, 1,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    if (skip >= HDR) {
+        r = (record_t *)((char *)ring + pos);
+        r->len = (uint32_t)(skip - HDR);
+        r->type = TYPE_PAD;
+        __atomic_store_n(&r->ready, 1, __ATOMIC_RELEASE);
+    }
+    if (skip) pos = 0;
+
+    r = (record_t *)((char *)ring + pos);
+    r->len = (uint32_t)len;
+    r->session = session;
+    r->type = (uint32_t)type;
+    r->time_us = time_us;
+    memcpy(r + 1, buf, (size_t)len);
+    __atomic_store_n(&r->ready, 1, __ATOMIC_RELEASE);
+    COUNT(records, 1);
+    COUNT(bytes, (unsigned long)len);
+}
+
+/**
+ * Record bytes of a session
+ * Chunks at least as big as the stage skip it.
+ */
+void tiny_transcript_record(unsigned session, int dir, const char *buf, int len) {
+    int n;
+
+    if (len <= 0 || !LOAD(running)) return;
+    if (stage.len && (stage.session != session || stage.dir != dir)) tiny_transcript_flush();
+    if (!stage.len && len >= TRANSCRIPT_STAGE_SIZE) {
+        if (len > TRANSCRIPT_RING_SIZE / 4) len = TRANSCRIPT_RING_SIZE / 4;
+        put(session, dir, now_us(), buf, len);
+        return;
+    }
+
+    while (len > 0) {
+        if (!stage.len) {
+            stage.session = session;
+            stage.dir = dir;
+            stage.time_us = now_us();
+        }
+        n = TRANSCRIPT_STAGE_SIZE - stage.len;
+        if (n > len) n = len;
+        memcpy(stage.buf + stage.len, buf, (size_t)n);
+        stage.len += n;
+        buf += n;
+        len -= n;
+        if (stage.len == TRANSCRIPT_STAGE_SIZE) tiny_transcript_flush();
+    }
+}
+
+/**
+ * Put what this thread gathered into the ring
+ */
+void tiny_transcript_flush(void) {
+    if (!stage.len) return;
+    if (LOAD(running)) put(stage.session, stage.dir, stage.time_us, stage.buf, stage.len);
+    stage.len = 0;
+}
+
+/**
+ * Session tap: a batch ends when the session leaves the thread
+ */
+static void session_tap(const tinysh_session_t *s, int what, const char *buf, int len) {
+    if (what == SESSION_TAP_END) {
+        tiny_transcript_flush();
+    } else {
+        tiny_transcript_record(s->id, what == SESSION_TAP_IN ? TRANSCRIPT_IN : TRANSCRIPT_OUT, buf, len);
+    }
+}
+
+/**
+ * Record console output, starred while it echoes a password
+ */
+static void console_record(const char *buf, int len) {
+    char stars[64];
+    int i, n;
+
+    if (!con_star) {
+        tiny_transcript_record(0, TRANSCRIPT_OUT, buf, len);
+        return;
+    }
+    for (; len > 0; buf += n, len -= n) {
+        n = len < (int)sizeof(stars) ? len : (int)sizeof(stars);
+        for (i = 0; i < n; i++) stars[i] = (buf[i] == '\r' || buf[i] == '\n') ? buf[i] : '*';
+        tiny_transcript_record(0, TRANSCRIPT_OUT, stars, n);
+    }
+}
+
+/**
+ * Star the console's output
+ */
+void tiny_transcript_star(int on) {
+    con_star = (char)(on != 0);
+}
+
+/**
+ * Console output taps
+ */
+static void console_char_out(unsigned char c) {
+    char ch = (char)c;
+
+    console_record(&ch, 1);
+    con_char_out(c);
+}
+
+static void console_write(const char *buf, int len) {
+    int i;
+
+    console_record(buf, len);
+    if (con_block_out) {
+        con_block_out(buf, len);
+    } else {
+        for (i = 0; i < len; i++) con_char_out((unsigned char)buf[i]);
+    }
+}
+
+static int console_printf(const char *fmt, ...) {
+    char buf[BUFFER_SIZE * 2];
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (len < 0) return len;
+    console_write(buf, len < (int)sizeof(buf) ? len : (int)sizeof(buf) - 1);
+    return len;
+}
+
+/**
+ * Tap the sessions and the console
+ */
+void tiny_transcript_init(void) {
+    if (con_char_out) return;
+    con_char_out = tinysh_char_out;
+    con_printf = tinysh_printf;
+    con_line = tinysh_line_current();
+    con_block_out = tinysh_block_out;
+    tinysh_char_out = console_char_out;
+    tinysh_printf = console_printf;
+    tinysh_block_out = console_write;
+    tinysh_session_tap(session_tap);
+}
+
+/**
+ * Write what the writer gathered
+ * A failed write loses that block, counted; the shell is not held up.
+ */
+static void write_out(void) {
+    int done = 0;
+    ssize_t n;
+
+    while (done < wlen) {
+        n = write(out_fd, wbuf + done, (size_t)(wlen - done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            COUNT(write_errors, 1);
+            break;
+        }
+        done += (int)n;
+        COUNT(written, (unsigned long)n);
+    }
+    wlen = 0;
+}
+
+/**
+ * Append text to the write buffer
+ */
+static void emit(const char *text, int len) {
+    int n;
+
+    while (len > 0) {
+        if (wlen == TRANSCRIPT_WRITE_SIZE) write_out();
+        n = TRANSCRIPT_WRITE_SIZE - wlen;
+        if (n > len) n = len;
+        memcpy(wbuf + wlen, text, (size_t)n);
+        wlen += n;
+        text += n;
+        len -= n;
+    }
+}
+
+/**
+ * Append a payload, escaped so each record stays on one line
+ */
+static void emit_escaped(const char *buf, int len) {
+    static const char hex[] = "0123456789abcdef";
+    unsigned char c;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        if (TRANSCRIPT_WRITE_SIZE - wlen < 4) write_out();
+        c = (unsigned char)buf[i];
+        if (c == '\\') {
+            wbuf[wlen++] = '\\';
+            wbuf[wlen++] = '\\';
+        } else if (c >= ' ' && c < 0x7f) {
+            wbuf[wlen++] = (char)c;
+        } else if (c == '\r' || c == '\n' || c == '\t') {
+            wbuf[wlen++] = '\\';
+            wbuf[wlen++] = c == '\r' ? 'r' : c == '\n' ? 'n' : 't';
+        } else {
+            wbuf[wlen++] = '\\';
+            wbuf[wlen++] = 'x';
+            wbuf[wlen++] = hex[c >> 4];
+            wbuf[wlen++] = hex[c & 15];
+        }
+    }
+}
+
+/**
+ * Append one record as a line
+ */
+static void emit_record(const record_t *r) {
+    char text[48];
+    int n;
+
+    n = snprintf(text, sizeof(text), "%+ld %u %c ",
+                 (long)(r->time_us / 1000) - (long)(last_us / 1000),
+                 (unsigned)r->session, r->type == TYPE_IN ? '<' : '>');
+    last_us = r->time_us;
+    emit(text, n);
+    emit_escaped((const char *)(r + 1), (int)r->len);
+    emit("\n", 1);
+}
+
+/**
+ * Take the ready records out of the ring, in order
+ * Stops at the first record still being filled.
+ *
+ * @return Records taken
+ */
+static int drain(void) {
+    uint64_t t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+    uint64_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    uint64_t pos, adv;
+    record_t *r;
+    int n = 0;
+
+    while (t < h) {
+        pos = t & RING_MASK;
+        r = (record_t *)((char *)ring + pos);
+        if (TRANSCRIPT_RING_SIZE - pos < HDR) {
+            adv = TRANSCRIPT_RING_SIZE - pos;
+        } else {
+            if (!__atomic_load_n(&r->ready, __ATOMIC_ACQUIRE)) break;
+            if (r->type == TYPE_PAD) {
+                adv = HDR + r->len;
+            } else {
+                adv = ALIGN8(HDR + r->len);
+                if (!n++) {
+                    char text[32];
+                    int len = snprintf(text, sizeof(text), "@%llu\n",
+                                       (unsigned long long)(r->time_us / 1000));
+                    emit(text, len);
+                    last_us = r->time_us;
+                }
+                emit_record(r);
+            }
+        }
+        memset(r, 0, (size_t)adv);
+        t += adv;
+        __atomic_store_n(&tail, t, __ATOMIC_RELEASE);
+    }
+    return n;
+}
+
+/**
+ * One writer pass: drain, note new drops, write
+ */
+static void pass(void) {
+    unsigned long lost = LOAD(dropped_records), lost_bytes = LOAD(dropped_bytes);
+    char text[80];
+    int n;
+
+    drain();
+    if (lost != noted_records) {
+        n = snprintf(text, sizeof(text), "! dropped %lu records, %lu bytes\n",
+                     lost - noted_records, lost_bytes - noted_bytes);
+        emit(text, n);
+        noted_records = lost;
+        noted_bytes = lost_bytes;
+    }
+    if (wlen) write_out();
+}
+
+/**
+ * Writer thread
+ * A pipe whose reader is gone must fail the write, not kill the shell,
+ * so SIGPIPE is blocked here.
+ */
+static void *writer_main(void *arg) {
+    struct timespec ts;
+    sigset_t set;
+    int tries;
+
+    (void)arg;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    pthread_mutex_lock(&writer_lock);
+    while (!stopping) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += (long)TRANSCRIPT_FLUSH_MS * 1000000L;
+        ts.tv_sec += ts.tv_nsec / 1000000000L;
+        ts.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&writer_wake, &writer_lock, &ts);
+        pthread_mutex_unlock(&writer_lock);
+        pass();
+        pthread_mutex_lock(&writer_lock);
+    }
+    pthread_mutex_unlock(&writer_lock);
+
+    /* Records still being filled get a moment to complete */
+    for (tries = 0; tries < 20; tries++) {
+        pass();
+        if (__atomic_load_n(&tail, __ATOMIC_ACQUIRE) == __atomic_load_n(&head, __ATOMIC_ACQUIRE)) break;
+        usleep(1000);
+    }
+    return NULL;
+}
+
+/**
+ * Start recording
+ */
+int tiny_transcript_start(const char *path) {
+    char text[64];
+    struct tm tm;
+    time_t now = time(NULL);
+    uint64_t us = now_us();
+    int err;
+
+    if (LOAD(running)) {
+        errno = EBUSY;
+        return -1;
+    }
+    if (path[0] == '|') {
+        out_pipe = popen(path + 1, "w");
+        out_fd = out_pipe ? fileno(out_pipe) : -1;
+    } else {
+        out_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+    }
+    if (out_fd < 0) {
+        out_pipe = NULL;
+        return -1;
+    }
+    snprintf(out_path, sizeof(out_path), "%s", path);
+
+    gmtime_r(&now, &tm);
+    wlen = (int)strftime(text, sizeof(text), "# tinysh transcript %Y-%m-%dT%H:%M:%S", &tm);
+    wlen += snprintf(text + wlen, sizeof(text) - (size_t)wlen, ".%03uZ\n", (unsigned)(us / 1000 % 1000));
+    memcpy(wbuf, text, (size_t)wlen);
+    noted_records = LOAD(dropped_records);
+    noted_bytes = LOAD(dropped_bytes);
+    stopping = 0;
+
+    __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+    err = pthread_create(&writer, NULL, writer_main, NULL);
+    if (err) {
+        STORE(running, 0);
+        if (out_pipe) pclose(out_pipe);
+        else close(out_fd);
+        out_fd = -1;
+        out_pipe = NULL;
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Stop recording
+ * Bytes other threads still hold in their stage are lost.
+ */
+void tiny_transcript_stop(void) {
+    if (!LOAD(running)) return;
+    tiny_transcript_flush();
+    STORE(running, 0);
+
+    pthread_mutex_lock(&writer_lock);
+    stopping = 1;
+    pthread_cond_signal(&writer_wake);
+    pthread_mutex_unlock(&writer_lock);
+    pthread_join(writer, NULL);
+
+    if (out_pipe) pclose(out_pipe);
+    else close(out_fd);
+    out_fd = -1;
+    out_pipe = NULL;
+}
+
+/**
+ * Counters
+ */
+void tiny_transcript_stats(tiny_transcript_stats_t *st) {
+    st->running = LOAD(running);
+    st->records = LOAD(records);
+    st->bytes = LOAD(bytes);
+    st->dropped_records = LOAD(dropped_records);
+    st->dropped_bytes = LOAD(dropped_bytes);
+    st->written = LOAD(written);
+    st->write_errors = LOAD(write_errors);
+    st->ring_used = (unsigned long)(__atomic_load_n(&head, __ATOMIC_ACQUIRE) -
+                                    __atomic_load_n(&tail, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * Transcript command handler
+ * Anyone can look; starting and stopping take admin rights, since a
+ * transcript may be required. Piping into a command runs it on the
+ * host, so only the local console may do that.
+ */
+void transcript_cmd_handler(int argc, const char **argv) {
+    tiny_transcript_stats_t st;
+    char path[BUFFER_SIZE + 1];
+    int i, len = 0;
+
+    if (argc > 1) {
+        if (tinysh_get_auth_level() != TINYSH_AUTH_ADMIN) {
+            tinysh_puts("Starting and stopping transcripts requires admin privileges\r\n");
+            return;
+        }
+        if (strcmp(argv[1], "stop") == 0 && argc == 2) {
+            tiny_transcript_stop();
+            tinysh_puts("Transcript stopped\r\n");
+        } else if (strcmp(argv[1], "start") == 0 && argc > 2) {
+            path[0] = 0;
+            for (i = 2; i < argc && len < BUFFER_SIZE; i++) {
+                len += snprintf(path + len, sizeof(path) - (size_t)len, "%s%s", i > 2 ? " " : "", argv[i]);
+            }
+            if (path[0] == '|' && tinysh_line_current() != con_line) {
+                tinysh_puts("Piping a transcript is only allowed on the local console\r\n");
+            } else if (tiny_transcript_start(path) < 0) {
+                tinysh_printf("Cannot record to %s: %s\r\n", path, strerror(errno));
+            }
+        } else {
+            tinysh_puts("Usage: transcript [start PATH|stop]\r\n");
+        }
+        return;
+    }
+
+    tiny_transcript_stats(&st);
+    if (st.running) {
+        tinysh_printf("Recording to %s\r\n", out_path);
+    } else {
+        tinysh_puts("Not recording\r\n");
+    }
+    tinysh_printf("Records %lu (%lu B), written %lu B, write errors %lu\r\n",
+                  st.records, st.bytes, st.written, st.write_errors);
+    tinysh_printf("Dropped %lu records (%lu B), ring %lu%% full\r\n",
+                  st.dropped_records, st.dropped_bytes,
+                  st.ring_used * 100UL / TRANSCRIPT_RING_SIZE);
+}
@@ -0,0 +1,135 @@
+/**
+ * TinyShell Session Transcripts (Linux)
+ * ------------------------------------
+ * Records every session's input and output, and the console's, to a
+ * file or through a compressor, without slowing the shell down.
+ *
+ * Features:
+ * - Tapped where input is received and output written (tinysh_session.h
+ *   tap, and the console's output functions)
+ * - Each thread gathers bytes of one session and direction in a small
+ *   buffer of its own, so echo typed one character at a time becomes one
+ *   record, not one per byte
+ * - Records go into one lock-free ring shared by all threads: a thread
+ *   reserves space with a compare-and-swap, fills it, and marks it
+ *   ready. No locks, no system calls on the interactive path
+ * - A full ring drops the record and counts it; the shell never waits
+ *   for the disk. The transcript itself says where records were lost
+ * - A writer thread drains the ring every TRANSCRIPT_FLUSH_MS and writes
+ *   in blocks of TRANSCRIPT_WRITE_SIZE
+ * - Text records with millisecond timestamps as deltas, which compress
+ *   well; "|CMD" as the path pipes them into a command, e.g. gzip
+ * - "transcript" command: state and counters; admins can start and stop,
+ *   into a command ("|CMD") only from the local console
+ * - Passwords (auth) are recorded starred, as typed and as echoed
+ *
+ * Records are 8-byte aligned and never wrap around the end of the ring;
+ * the rest of the ring is skipped instead.
+ *
+ * Transcript format, one line per record:
+ *
+ * # tinysh transcript 2026-10-18T09:30:00.125Z
+ * @1792315800125                    // absolute time (ms), each pass
+ * +0 3 < echo hi\r                   // +ms since the last record,
+ * +2 3 > echo hi\n\rhi \r\ntinysh>   //   session (0 = console),
+ * ! dropped 12 records, 4096 bytes   //   < input, > output, escaped
+ *
+ * Example Usage:
+ *
+ * tiny_transcript_init();                  // on the console's thread
+ * tiny_transcript_start("|gzip -c >> transcript.gz");
+ * ...
+ * tiny_transcript_flush();                 // console loop, each pass
+ * ...
+ * tiny_transcript_stop();
+ */
+
+#ifndef TINY_TRANSCRIPT_H
+#define TINY_TRANSCRIPT_H
+
+#include "tinysh.h"
+
+/* Ring shared by all threads, a power of two */
+#ifndef TRANSCRIPT_RING_SIZE
+#define TRANSCRIPT_RING_SIZE      262144
+#endif
+
+/* Bytes a thread gathers before it makes them a record */
+#ifndef TRANSCRIPT_STAGE_SIZE
+#define TRANSCRIPT_STAGE_SIZE     256
+#endif
+
+/* How often the writer drains the ring */
+#ifndef TRANSCRIPT_FLUSH_MS
+#define TRANSCRIPT_FLUSH_MS       100
+#endif
+
+/* Largest write the writer issues */
+#ifndef TRANSCRIPT_WRITE_SIZE
+#define TRANSCRIPT_WRITE_SIZE     65536
+#endif
+
+/* Directions */
+#define TRANSCRIPT_IN             0
+#define TRANSCRIPT_OUT            1
+
+/* Transcript counters */
+typedef struct {
+    int running;
+    unsigned long records;           // Records put in the ring
+    unsigned long bytes;             //   their payload
+    unsigned long dropped_records;   // Lost to a full ring
+    unsigned long dropped_bytes;
+    unsigned long written;           // Bytes written out
+    unsigned long write_errors;
+    unsigned long ring_used;         // Bytes in the ring now
+} tiny_transcript_stats_t;
+
+/**
+ * Tap the sessions, and this thread's output functions as the console's
+ * Call once, on the console's thread, after its output functions are set.
+ */
+void tiny_transcript_init(void);
+
+/**
+ * Start recording
+ *
+ * @param path File to append to, or "|CMD" to write into a command; the
+ *             transcript command only passes that on from the console
+ * @return 0, or -1 on error (errno set)
+ */
+int tiny_transcript_start(const char *path);
+
+/**
+ * Stop recording: what is in the ring is written, the file closed
+ */
+void tiny_transcript_stop(void);
+
+/**
+ * Record bytes of a session (0 = console)
+ * Gathered on this thread until the session or direction changes, the
+ * buffer fills, or tiny_transcript_flush().
+ */
+void tiny_transcript_record(unsigned session, int dir, const char *buf, int len);
+
+/**
+ * Put what this thread gathered into the ring
+ */
+void tiny_transcript_flush(void);
+
+/**
+ * Record the console's output starred, line ends kept, while on: set
+ * around the echo of a password character (tinysh_secret_char()), whose
+ * input is recorded as '*'
+ */
+void tiny_transcript_star(int on);
+
+/**
+ * Counters
+ */
+void tiny_transcript_stats(tiny_transcript_stats_t *st);
+
+/* Transcript command */
+extern tinysh_cmd_t transcript_cmd;
+
+#endif /* TINY_TRANSCRIPT_H */
@@ -1,20 +1,19 @@
 #include <string.h>
 #include <stdint.h> 
 #include "tinysh.h"
+#include "tinysh_term.h"
+#include "tinysh_memo.h"
+#include "tinysh_complete.h"
 
 /* ANSI escape code for clearing from cursor to end of line */
 #define ANSI_ERASE_TO_EOL "\x1b[K"
 
-void (*tinysh_char_out)(unsigned char);	/* Pointer to the output stream */
-int (*tinysh_printf)(const char *, ...);
-
-/* Global flag for TinyShell active state */
-char tinyshell_active = 1;
+TINYSH_TLS void (*tinysh_char_out)(unsigned char);	/* Pointer to the output stream */
+TINYSH_TLS int (*tinysh_printf)(const char *, ...);
+unsigned long (*tinysh_millis)(void);     /* Optional clock, see tinysh_time_source() */
+TINYSH_TLS void (*tinysh_block_out)(const char *, int); /* Optional block output, see tinysh_write_out() */
 
 #if AUTHENTICATION_ENABLED
-/* Authentication state */
-unsigned char tinysh_auth_level = TINYSH_AUTH_NONE;
-
 /* Authentication command */
 tinysh_cmd_t auth_cmd = {
     0, "auth", "authenticate as admin", "password", auth_cmd_handler, 0, 0, 0
@@ -27,36 +26,55 @@ tinysh_cmd_t help_cmd = {
 };
 
 tinysh_cmd_t quit_cmd = {
-    0, "quit", "exit shell", _NOARG_, quit_fnt, (void *)&tinyshell_active, 0, 0
+    0, "quit", "exit shell", _NOARG_, quit_fnt, 0, 0, 0
 };
 
-#if HISTORY_DEPTH > 0
-// History management using a simplified approach
-// Instead of a true ring buffer which is complex to manage with variable length strings,
-// we use a rolling index into a fixed array of buffers.
-// Optimization: Using a single large buffer and pointers would be more RAM efficient
-// but much more complex. For now, we stick to the array but ensure safety.
-static char input_buffers[HISTORY_DEPTH][BUFFER_SIZE+1];
-static int cur_buf_index=0;
-#endif
+/* Line editor state. The console uses console_line; other sessions select
+ * their own with tinysh_line_select() while their input is processed.
+ * History uses a rolling index into a fixed array of buffers (see
+ * tinysh_line_t) rather than a ring of variable length strings.
+ */
+static tinysh_line_t console_line={{{0}},0,0,{0},0,0,TINYSH_AUTH_NONE,1,0,{0}};
+static TINYSH_TLS tinysh_line_t *ls=&console_line;
 
-static char trash_buffer[BUFFER_SIZE+1]={0};
-static char context_buffer[BUFFER_SIZE+1]={0};
-static int cur_context=0;
-static int cur_index=0;
+static TINYSH_TLS char trash_buffer[BUFFER_SIZE+1]={0};
 static char prompt[]=_PROMPT_;
 static tinysh_cmd_t *root_cmd=&help_cmd;
-static tinysh_cmd_t *cur_cmd_ctx=0;
-static void *tinysh_arg=0;
+static TINYSH_TLS void *tinysh_arg=0;
+static TINYSH_TLS unsigned long handler_runs=0;  /* see tinysh_exec_line() */
+static int (*exec_enter)(tinysh_cmd_t *cmd)=0;  /* see tinysh_exec_hooks() */
+static void (*exec_leave)(tinysh_cmd_t *cmd, int token)=0;
+static unsigned long tree_generation=0;   /* bumped when commands are added */
+static int ext_used=0;                    /* of each line's extension area */
+
+#if DISPATCH_CACHE
+/* last command line that resolved to a handler, and how (per thread) */
+static TINYSH_TLS struct {
+  uint32_t hash;                  /* of the raw line */
+  unsigned short len;             /* 0 = empty */
+  tinysh_cmd_t *ctx;              /* context it was typed in */
+  unsigned long generation;       /* tree_generation at the time */
+  unsigned char auth;             /* auth level at the time */
+  tinysh_cmd_t *cmd;              /* resolved command */
+  unsigned char argc;
+  unsigned short arg_off[MAX_ARGS]; /* argv[1..] start in the line */
+  unsigned short arg_end[MAX_ARGS]; /* and end */
+  char line[BUFFER_SIZE+1];       /* to rule out hash collisions */
+} dispatch_cache;
+static TINYSH_TLS const char *dispatch_line=0;  /* line being resolved, 0 = not caching */
+static TINYSH_TLS unsigned long dispatch_hit_count=0;
+#endif
 
 int tinysh_strlen(const char *s);
 void tinysh_puts(const char *s);
 void start_of_line();
 int complete_command_line(tinysh_cmd_t *cmd, char *_str);
+static int complete_arguments(tinysh_cmd_t *cmd, char *line, char *args);
 int help_command_line(tinysh_cmd_t *cmd, char *_str);
 void display_child_help(tinysh_cmd_t *cmd);
 int exec_command_line(tinysh_cmd_t *cmd, char *_str);
 void exec_command(tinysh_cmd_t *cmd, char *str);
+static void run_command(tinysh_cmd_t *cmd, int argc, const char **argv);
 void do_context(tinysh_cmd_t *cmd, char *str);
 int parse_command(tinysh_cmd_t **_cmd, char **_str);
 int strstart(const char *s1, const char *s2);
@@ -70,6 +88,49 @@ int tinysh_strlen(const char *s)
   return i;
 }
 
+/* current time in ms from the registered clock, 0 when none is set
+ */
+unsigned long tinysh_time_ms(void)
+{
+  return tinysh_millis ? tinysh_millis() : 0;
+}
+
+/* 32-bit FNV-1a hash of len bytes of s (len < 0: up to the terminating 0).
+ * Used wherever we only need to know if a string changed or to key a
+ * small table, so we never have to keep a copy of the string itself.
+ */
+uint32_t tinysh_hash(const char *s, int len)
+{
+  uint32_t h=2166136261U;
+
+  if(!s) return h;
+  while(len<0 ? *s : len-->0)
+    {
+      h^=(unsigned char)*s++;
+      h*=16777619U;
+    }
+  return h;
+}
+
+/* CRC-32 (IEEE, reflected 0xEDB88320) of len bytes, continuing from crc;
+ * start with 0. Bitwise rather than table driven: it only guards small
+ * records, and 1 KB of table costs more than the cycles on a small part.
+ */
+uint32_t tinysh_crc32(uint32_t crc, const void *buf, int len)
+{
+  const unsigned char *p=(const unsigned char *)buf;
+  int i;
+
+  crc=~crc;
+  while(len-->0)
+    {
+      crc^=*p++;
+      for(i=0; i<8; i++)
+        crc=(crc>>1)^(0xEDB88320U & (0U-(crc&1)));
+    }
+  return ~crc;
+}
+
 /* Safer version of puts that checks for NULL */
 void tinysh_puts(const char *s)
 {
@@ -79,6 +140,23 @@ void tinysh_puts(const char *s)
     tinysh_char_out((unsigned char)*s++);
 }
 
+/* write len bytes in one go when the port has block output,
+ * one character at a time otherwise
+ */
+void tinysh_write(const char *buf, int len)
+{
+  if (!buf || len <= 0) return;
+
+  if (tinysh_block_out)
+    {
+      tinysh_block_out(buf, len);
+      return;
+    }
+  if (!tinysh_char_out) return;
+  while(len-->0)
+    tinysh_char_out((unsigned char)*buf++);
+}
+
 /* callback for help function
  */
 void help_fnt(int argc, const char **argv)
@@ -118,13 +196,13 @@ void quit_fnt(int argc, const char **argv) {
   if (val != NULL) {
     *val = 0;
   } else {
-    // Direct fallback in case arg is NULL
-    tinyshell_active = 0;
+    // No flag given: end the current session
+    ls->active = 0;
   }
 
   // Clear authentication status when quitting
 #if AUTHENTICATION_ENABLED
-  tinysh_auth_level = TINYSH_AUTH_NONE;
+  ls->auth_level = TINYSH_AUTH_NONE;
 #endif
 
   if(tinysh_printf)
@@ -137,7 +215,7 @@ void quit_fnt(int argc, const char **argv) {
 * Check if TinyShell is active
 */
 char is_tinyshell_active(void) {
-  return tinyshell_active;
+  return ls->active;
 }
 
 #if AUTHENTICATION_ENABLED
@@ -149,7 +227,7 @@ void auth_cmd_handler(int argc, const char **argv) {
     }
     
     if (tinysh_verify_password(argv[1])) {
-        tinysh_auth_level = TINYSH_AUTH_ADMIN;
+        ls->auth_level = TINYSH_AUTH_ADMIN;
         tinysh_printf("Authentication successful. Admin privileges granted.\r\n");
     } else {
         tinysh_printf("Authentication failed. Incorrect password.\r\n");
@@ -164,16 +242,16 @@ unsigned char tinysh_verify_password(const char *password) {
 
 /* Auth level getter/setter */
 void tinysh_set_auth_level(unsigned char level) {
-    tinysh_auth_level = level;
+    ls->auth_level = level;
 }
 
 unsigned char tinysh_get_auth_level(void) {
-    return tinysh_auth_level;
+    return ls->auth_level;
 }
 
 /* Initialize auth system */
 void tinysh_auth_init(void) {
-    tinysh_auth_level = TINYSH_AUTH_NONE;
+    ls->auth_level = TINYSH_AUTH_NONE;
     tinysh_add_command(&auth_cmd);
 }
 #endif
@@ -274,21 +352,18 @@ int parse_command(tinysh_cmd_t **_cmd, char **_str)
 void do_context(tinysh_cmd_t *cmd, char *str)
 {
   while(*str)
-    context_buffer[cur_context++]=*str++;
-  context_buffer[cur_context]=0;
-  cur_cmd_ctx=cmd;
+    ls->context_buffer[ls->cur_context++]=*str++;
+  ls->context_buffer[ls->cur_context]=0;
+  ls->cur_cmd_ctx=cmd;
 }
 
-/* execute the given command by calling callback with appropriate
- * arguments
+/* check admin rights and call the command's handler
  */
-void exec_command(tinysh_cmd_t *cmd, char *str)
+static void run_command(tinysh_cmd_t *cmd, int argc, const char **argv)
 {
-  if (!cmd) return; // Safety check
-
 #if AUTHENTICATION_ENABLED
   /* Check admin rights */
-  if (tinysh_is_admin_command(cmd) && tinysh_auth_level < TINYSH_AUTH_ADMIN) {
+  if (tinysh_is_admin_command(cmd) && ls->auth_level < TINYSH_AUTH_ADMIN) {
       tinysh_printf("Error: Command requires admin privileges\r\n");
       tinysh_printf("Use 'auth <password>' to authenticate\r\n");
       return;
@@ -302,10 +377,32 @@ void exec_command(tinysh_cmd_t *cmd, char *str)
   void *real_arg = cmd->arg;
 #endif
 
-  /* Continue with normal command execution */
+  /* Call command function if present */
+  if(cmd->function)
+    {
+      void (*leave)(tinysh_cmd_t *, int)=exec_leave;
+      int token=exec_enter?exec_enter(cmd):0;
+
+      handler_runs++;
+      tinysh_arg = real_arg;
+      tinysh_memo_call(cmd, argc, argv);  /* handler, or its cached output */
+      if(leave) leave(cmd,token);
+    }
+}
+
+/* execute the given command by calling callback with appropriate
+ * arguments
+ */
+void exec_command(tinysh_cmd_t *cmd, char *str)
+{
+  if (!cmd) return; // Safety check
+
   const char *argv[MAX_ARGS];
   int argc=0;
   int i;
+#if DISPATCH_CACHE
+  char *args=str;
+#endif
 
   /* Original command execution code */
   for(i=0;i<BUFFER_SIZE-1 && str[i];i++)
@@ -324,12 +421,75 @@ void exec_command(tinysh_cmd_t *cmd, char *str)
       if(!*str) break;
       *str++=0;
     }
-  /* Call command function if present */
-  if(cmd->function)
+
+#if DISPATCH_CACHE
+  /* remember where everything was so the same line can skip all this */
+  if(dispatch_line)
     {
-      tinysh_arg = real_arg;
-      cmd->function(argc, argv);
+      int base=(int)(args-dispatch_line);
+
+      dispatch_cache.cmd=cmd;
+      dispatch_cache.argc=(unsigned char)argc;
+      for(i=1;i<argc;i++)
+        {
+          dispatch_cache.arg_off[i]=(unsigned short)(base+(argv[i]-trash_buffer));
+          dispatch_cache.arg_end[i]=(unsigned short)(dispatch_cache.arg_off[i]+tinysh_strlen(argv[i]));
+        }
+      dispatch_cache.len=(unsigned short)tinysh_strlen(dispatch_line);
+      memcpy(dispatch_cache.line,dispatch_line,dispatch_cache.len+1);
+      dispatch_cache.hash=tinysh_hash(dispatch_line,dispatch_cache.len);
+      dispatch_cache.ctx=ls->cur_cmd_ctx;
+      dispatch_cache.generation=tree_generation;
+      dispatch_cache.auth=tinysh_get_auth_level();
+      dispatch_line=0;
+    }
+#endif
+
+  run_command(cmd,argc,argv);
+}
+
+#if DISPATCH_CACHE
+/* run line straight from the dispatch cache if it is the line that was
+ * resolved last, in the same context, tree and auth level.
+ * return 1 if it was run
+ */
+static int exec_cached_line(const char *line)
+{
+  const char *argv[MAX_ARGS];
+  int len=tinysh_strlen(line);
+  int i;
+
+  if(!dispatch_cache.len
+     || dispatch_cache.len!=len
+     || dispatch_cache.ctx!=ls->cur_cmd_ctx
+     || dispatch_cache.generation!=tree_generation
+     || dispatch_cache.auth!=tinysh_get_auth_level()
+     || dispatch_cache.hash!=tinysh_hash(line,len)
+     || memcmp(dispatch_cache.line,line,len))
+    return 0;
+
+  memcpy(trash_buffer,line,len+1);
+  argv[0]=dispatch_cache.cmd->name;
+  for(i=1;i<dispatch_cache.argc;i++)
+    {
+      trash_buffer[dispatch_cache.arg_end[i]]=0;
+      argv[i]=trash_buffer+dispatch_cache.arg_off[i];
     }
+  dispatch_hit_count++;
+  run_command(dispatch_cache.cmd,dispatch_cache.argc,argv);
+  return 1;
+}
+#endif
+
+/* number of command lines run from the dispatch cache
+ */
+unsigned long tinysh_dispatch_hits(void)
+{
+#if DISPATCH_CACHE
+  return dispatch_hit_count;
+#else
+  return 0;
+#endif
 }
 
 /* try to execute the current command line
@@ -393,6 +553,45 @@ int exec_command_line(tinysh_cmd_t *cmd, char *_str)
     }
 }
 
+/* print s wrapped at word boundaries to fit the terminal width, with
+ * continuation lines indented to column indent. when that leaves too
+ * little room, s starts on a line of its own, indented less
+ */
+static void puts_wrapped(const char *s, int indent)
+{
+  int width=(int)tinysh_term_cols()-1-indent;
+  int i;
+
+  if(width<16)
+    {
+      if(indent>4 && (int)tinysh_term_cols()-1-4>=16)
+        {
+          tinysh_puts("\n\r");
+          tinysh_term_pad(4);
+          puts_wrapped(s,4);
+          return;
+        }
+      /* too narrow to be worth wrapping, let the terminal do it */
+      tinysh_puts(s);
+      return;
+    }
+
+  while(tinysh_strlen(s)>width)
+    {
+      int cut=width;
+
+      while(cut>0 && s[cut]!=' ') cut--;
+      if(cut==0) cut=width; /* single long word */
+      for(i=0;i<cut;i++)
+        tinysh_char_out((unsigned char)s[i]);
+      s+=cut;
+      while(*s==' ') s++;
+      tinysh_puts("\n\r");
+      tinysh_term_pad(indent);
+    }
+  tinysh_puts(s);
+}
+
 /* display help for list of commands
 */
 void display_child_help(tinysh_cmd_t *cmd)
@@ -407,8 +606,6 @@ void display_child_help(tinysh_cmd_t *cmd)
   for(cm=cmd;cm;cm=cm->next)
     if(cm->help)
       {
-        int i;
-        
         // Add asterisk indicator for admin commands
 #if AUTHENTICATION_ENABLED
         if (tinysh_is_admin_command(cm)) {
@@ -422,9 +619,8 @@ void display_child_help(tinysh_cmd_t *cmd)
         
         tinysh_puts(cm->name);
         // Adjust padding to maintain alignment with the indicators
-        for(i=tinysh_strlen(cm->name);i<len+2;i++)
-          tinysh_char_out(' ');
-        tinysh_puts(cm->help);
+        tinysh_term_pad(len+2-tinysh_strlen(cm->name));
+        puts_wrapped(cm->help,len+4);
         tinysh_puts("\n\r");
       }
 }
@@ -481,8 +677,8 @@ int help_command_line(tinysh_cmd_t *cmd, char *_str)
         }
       else /* NULLMATCH */
         {
-          if(cur_cmd_ctx)
-            display_child_help(cur_cmd_ctx->child);
+          if(ls->cur_cmd_ctx)
+            display_child_help(ls->cur_cmd_ctx->child);
           else
             display_child_help(root_cmd);
           return 0;
@@ -490,6 +686,28 @@ int help_command_line(tinysh_cmd_t *cmd, char *_str)
     }
 }
 
+/* complete the arguments of a leaf command through its completer.
+ * The completion is appended as is rather than typed, since it may hold
+ * characters with a meaning of their own ('/' in paths)
+ */
+static int complete_arguments(tinysh_cmd_t *cmd, char *line, char *args)
+{
+  char insert[BUFFER_SIZE];
+  char *s;
+  int len=tinysh_strlen(line);
+  int ret;
+
+  ret=tinysh_complete_args(cmd,args,insert,sizeof(insert));
+  for(s=insert;*s && len<BUFFER_SIZE;s++)
+    {
+      if(ECHO_INPUT)
+        tinysh_char_out((unsigned char)*s);
+      line[len++]=*s;
+    }
+  line[len]=0;
+  return ret;
+}
+
 /* try to complete current command line
  */
 int complete_command_line(tinysh_cmd_t *cmd, char *_str)
@@ -508,6 +726,8 @@ int complete_command_line(tinysh_cmd_t *cmd, char *_str)
       for(_str_len=0;__str[_str_len]&&__str[_str_len]!=' ';_str_len++);
       if(ret==MATCH && *str)
         {
+          if(!cmd->child) /* typing arguments */
+            return complete_arguments(cmd,_str,str)>0;
           cmd=cmd->child;
         }
       else if(ret==AMBIG || ret==MATCH || ret==NULLMATCH)
@@ -521,12 +741,18 @@ int complete_command_line(tinysh_cmd_t *cmd, char *_str)
               int r=strstart(cm->name,__str);
               if(r==FULLMATCH)
                 {
+                  int had_space=(*(str-1)==' ');
+
                   for(i=_str_len;cmd->name[i];i++)
                     tinysh_char_in(cmd->name[i]);
-                  if(*(str-1)!=' ')
+                  if(!had_space)
                     tinysh_char_in(' ');
                   if(!cmd->child)
                     {
+                      /* second TAB after the name: first argument */
+                      if(had_space &&
+                         (ret=complete_arguments(cmd,_str,str))>=0)
+                        return ret;
                       if(cmd->usage)
                         {
                           tinysh_puts(cmd->usage);
@@ -600,23 +826,19 @@ void start_of_line()
 {
   /* display start of new line */
   tinysh_puts(prompt);
-  if(cur_context)
+  if(ls->cur_context)
     {
-      tinysh_puts(context_buffer);
+      tinysh_puts(ls->context_buffer);
       tinysh_puts("> ");
     }
-  cur_index=0;
+  ls->cur_index=0;
 }
 
 /* character input
  */
 void tinysh_char_in(char c)
 {
-#if HISTORY_DEPTH > 0
-  char *line=input_buffers[cur_buf_index];
-#else
-  static char line[BUFFER_SIZE+1];
-#endif
+  char *line=ls->input_buffers[ls->cur_buf_index];
 
   // Safety check - ensure output functions are initialized
   if (!tinysh_char_out) {
@@ -628,97 +850,114 @@ void tinysh_char_in(char c)
       tinysh_cmd_t *cmd;
 
       /* first, echo the newline */
-      if(ECHO_INPUT){
+      if(ECHO_INPUT && !ls->local_echo){
           tinysh_puts("\n\r");
       }
       while(*line && *line==' ') line++;
       if(*line) /* not empty line */
         {
-          cmd=cur_cmd_ctx?cur_cmd_ctx->child:root_cmd;
+          cmd=ls->cur_cmd_ctx?ls->cur_cmd_ctx->child:root_cmd;
+#if DISPATCH_CACHE
+          if(!exec_cached_line(line))
+            {
+              dispatch_cache.len=0;
+              dispatch_line=line;
+              exec_command_line(cmd,line);
+              dispatch_line=0;
+            }
+#else
           exec_command_line(cmd,line);
+#endif
 #if HISTORY_DEPTH > 0
-          cur_buf_index=(cur_buf_index+1)%HISTORY_DEPTH;
-          input_buffers[cur_buf_index][0]=0;
-#else
-          line[0]=0;
+          ls->cur_buf_index=(ls->cur_buf_index+1)%HISTORY_DEPTH;
 #endif
-          cur_index=0;
+          ls->input_buffers[ls->cur_buf_index][0]=0;
+          ls->cur_index=0;
         }
       if(ECHO_INPUT)
         start_of_line();   
       }
-  else if(c==TOPCHAR) /* return to top level */
+  else if(c==TOPCHAR && ls->cur_index==0) /* return to top level */
     {
       if(ECHO_INPUT)
         tinysh_char_out((unsigned char)c);
 
-      cur_context = 0;
-      cur_cmd_ctx = 0;
-      context_buffer[0] = 0;  // Also clear the buffer for consistency
+      ls->cur_context = 0;
+      ls->cur_cmd_ctx = 0;
+      ls->context_buffer[0] = 0;  // Also clear the buffer for consistency
     }
   else if(c==8 || c==127) /* backspace */
     {
-      if(cur_index>0)
+      if(ls->cur_index>0)
         {
-          tinysh_puts("\b \b");
-          cur_index--;
-          line[cur_index]=0;
+          if(!ls->local_echo)
+            tinysh_puts("\b \b");
+          ls->cur_index--;
+          line[ls->cur_index]=0;
         }
     }
 #if HISTORY_DEPTH > 1
   else if(c==16) /* CTRL-P: back in history */
     {
-      int prevline=(cur_buf_index+HISTORY_DEPTH-1)%HISTORY_DEPTH;
+      int prevline=(ls->cur_buf_index+HISTORY_DEPTH-1)%HISTORY_DEPTH;
 
-      if(input_buffers[prevline][0])
+      if(ls->input_buffers[prevline][0])
         {
-          line=input_buffers[prevline];
+          line=ls->input_buffers[prevline];
           /* Go to start of line, reprint prompt, print new line, clear rest of line */
           tinysh_char_out('\r');
           start_of_line();
           tinysh_puts(line);
           tinysh_puts(ANSI_ERASE_TO_EOL); /* Clear to end of line */
-          cur_index=tinysh_strlen(line);
-          cur_buf_index=prevline;
+          ls->cur_index=tinysh_strlen(line);
+          ls->cur_buf_index=prevline;
         }
     }
   else if(c==14) /* CTRL-N: next in history */
     {
-      int nextline=(cur_buf_index+1)%HISTORY_DEPTH;
+      int nextline=(ls->cur_buf_index+1)%HISTORY_DEPTH;
 
-      if(input_buffers[nextline][0])
+      if(ls->input_buffers[nextline][0])
         {
-          line=input_buffers[nextline];
+          line=ls->input_buffers[nextline];
           /* Go to start of line, reprint prompt, print new line, clear rest of line */
           tinysh_char_out('\r');
           start_of_line();
           tinysh_puts(line);
           tinysh_puts(ANSI_ERASE_TO_EOL); /* Clear to end of line */
-          cur_index=tinysh_strlen(line);
-          cur_buf_index=nextline;
+          ls->cur_index=tinysh_strlen(line);
+          ls->cur_buf_index=nextline;
         }
     }
 #endif
   else if(c=='?') /* display help */
     {
       tinysh_cmd_t *cmd;
-      cmd=cur_cmd_ctx?cur_cmd_ctx->child:root_cmd;
+      void (*leave)(tinysh_cmd_t *, int)=exec_leave;
+      int token=exec_enter?exec_enter(0):0;
+
+      cmd=ls->cur_cmd_ctx?ls->cur_cmd_ctx->child:root_cmd;
       help_command_line(cmd,line);
+      if(leave) leave(0,token);
       start_of_line();
       tinysh_puts(line);
-      cur_index=tinysh_strlen(line);
+      ls->cur_index=tinysh_strlen(line);
     }
 #if AUTOCOMPLATION > 0
   else if(c==9 || c=='!') /* TAB: autocompletion */
     {
       tinysh_cmd_t *cmd;
-      cmd=cur_cmd_ctx?cur_cmd_ctx->child:root_cmd;
+      void (*leave)(tinysh_cmd_t *, int)=exec_leave;
+      int token=exec_enter?exec_enter(0):0;
+
+      cmd=ls->cur_cmd_ctx?ls->cur_cmd_ctx->child:root_cmd;
       if(complete_command_line(cmd,line))
         {
           start_of_line();
           tinysh_puts(line);
         }
-      cur_index=tinysh_strlen(line);
+      if(leave) leave(0,token);
+      ls->cur_index=tinysh_strlen(line);
     }
 #endif //AUTOCOMPLATION > 0
   else if(c==4) /* CTRL-D: exit */
@@ -727,18 +966,18 @@ void tinysh_char_in(char c)
       {
         tinysh_puts("\r\nQuit shell...\r\n");
       } 
-      tinyshell_active = 0;
+      ls->active = 0;
       // Signal the main loop to exit
       return;  // Let main.c detect this and clean up
     }
   else /* any input character */
     {
-      if(cur_index<BUFFER_SIZE)
+      if(ls->cur_index<BUFFER_SIZE)
         {
-          if(ECHO_INPUT)
+          if(ECHO_INPUT && !ls->local_echo)
             tinysh_char_out((unsigned char)c);
-          line[cur_index++]=c;
-          line[cur_index]=0;
+          line[ls->cur_index++]=c;
+          line[ls->cur_index]=0;
         }
     }
 }
@@ -748,6 +987,8 @@ void tinysh_add_command(tinysh_cmd_t *cmd)
 {
   tinysh_cmd_t *cm;
 
+  tree_generation++;  /* resolved command lines may now resolve differently */
+
   if(cmd->parent)
     {
       cm=cmd->parent->child;
@@ -847,6 +1088,92 @@ unsigned long tinysh_atoxi(char *s)
   return res;
 }
 
+/* parse len bytes of s (len < 0: up to the terminating 0) as a signed
+ * decimal or 0x hexadecimal number. Works on a slice of a larger string,
+ * so "name=10" needs no copy. returns 0 on success, -1 if the text is not
+ * a number or does not fit
+ */
+int tinysh_parse_long(const char *s, int len, long *value)
+{
+  const char *end;
+  unsigned long res=0, limit;
+  int neg=0, base=10, digits=0;
+
+  if(!s || !value) return -1;
+  if(len<0) len=tinysh_strlen(s);
+  end=s+len;
+
+  if(s<end && (*s=='-' || *s=='+'))
+    {
+      neg=(*s=='-');
+      s++;
+    }
+  if(end-s>2 && s[0]=='0' && (s[1]=='x' || s[1]=='X'))
+    {
+      base=16;
+      s+=2;
+    }
+  limit=neg ? (unsigned long)LONG_MAX+1UL : (unsigned long)LONG_MAX;
+
+  for(;s<end;s++,digits++)
+    {
+      unsigned long digit;
+
+      if(*s>='0' && *s<='9')
+        digit=(unsigned long)(*s-'0');
+      else if(base==16 && *s>='a' && *s<='f')
+        digit=(unsigned long)(*s+10-'a');
+      else if(base==16 && *s>='A' && *s<='F')
+        digit=(unsigned long)(*s+10-'A');
+      else
+        return -1;
+      if(res>(limit-digit)/(unsigned long)base)
+        return -1;
+      res=res*(unsigned long)base+digit;
+    }
+  if(!digits) return -1;
+
+  *value=neg ? -(long)(res-1)-1 : (long)res;
+  return 0;
+}
+
+/* same for a decimal fraction ("-1.25"), no exponent
+ */
+int tinysh_parse_float(const char *s, int len, float *value)
+{
+  const char *end;
+  float res=0.0f, scale=1.0f;
+  int neg=0, digits=0, point=0;
+
+  if(!s || !value) return -1;
+  if(len<0) len=tinysh_strlen(s);
+  end=s+len;
+
+  if(s<end && (*s=='-' || *s=='+'))
+    {
+      neg=(*s=='-');
+      s++;
+    }
+  for(;s<end;s++)
+    {
+      if(*s=='.' && !point)
+        {
+          point=1;
+          continue;
+        }
+      if(*s<'0' || *s>'9')
+        return -1;
+      if(point)
+        scale/=10.0f;
+      res=res*10.0f+(float)(*s-'0');
+      digits++;
+    }
+  if(!digits) return -1;
+
+  *value=(neg ? -res : res)*scale;
+  return 0;
+}
+
 static char* tinysh__strtok_r(char* s, const char* delim, char** last)
 {
     char *spanp, *tok;
@@ -1036,9 +1363,178 @@ void tinysh_float2str(float f, char *str, int len, int precision)
  * This can be used to recover from broken command contexts
  */
 void tinysh_reset_context(void) {
-    cur_context = 0;
-    cur_cmd_ctx = 0;
-    context_buffer[0] = 0;
+    ls->cur_context = 0;
+    ls->cur_cmd_ctx = 0;
+    ls->context_buffer[0] = 0;
+}
+
+/* set up the line editor state of a new session
+ */
+void tinysh_line_init(tinysh_line_t *line)
+{
+  memset(line,0,sizeof(*line));
+  line->auth_level=TINYSH_AUTH_NONE;
+  line->active=1;
+}
+
+/* make line the current line editor state of this thread, 0 for the
+ * console's, and return the one that was current
+ */
+tinysh_line_t *tinysh_line_select(tinysh_line_t *line)
+{
+  tinysh_line_t *prev=ls;
+
+  ls=line?line:&console_line;
+  return prev;
+}
+
+/* line editor state of the session running on this thread
+ */
+tinysh_line_t *tinysh_line_current(void)
+{
+  return ls;
+}
+
+/* claim size bytes of every line's extension area, aligned for any
+ * member, and return their offset, -1 if the area is used up
+ */
+int tinysh_line_ext_claim(int size)
+{
+  int off=ext_used;
+
+  size=(size+(int)sizeof(long)-1)&~((int)sizeof(long)-1);
+  if(size<=0 || off+size>LINE_EXT_SIZE)
+    return -1;
+  ext_used+=size;
+  return off;
+}
+
+/* bytes claimed at off in a line's extension area
+ */
+void *tinysh_line_ext(tinysh_line_t *line, int off)
+{
+  return line->ext.bytes+off;
+}
+
+/* run one command line in the current session's context, as if typed,
+ * but without echo, prompt or history. returns 0 if a handler ran, -1
+ * otherwise (no match, ambiguous, admin only, or it entered a context)
+ */
+int tinysh_exec_line(const char *line)
+{
+  char buf[BUFFER_SIZE+1];
+  unsigned long runs=handler_runs;
+  int i;
+
+  while(*line==' ') line++;
+  for(i=0;i<BUFFER_SIZE && line[i] && line[i]!='\r' && line[i]!='\n';i++)
+    buf[i]=line[i];
+  buf[i]=0;
+  if(!i)
+    return -1;
+
+#if DISPATCH_CACHE
+  if(!exec_cached_line(buf))
+    {
+      dispatch_cache.len=0;
+      dispatch_line=buf;
+      exec_command_line(ls->cur_cmd_ctx?ls->cur_cmd_ctx->child:root_cmd,buf);
+      dispatch_line=0;
+    }
+#else
+  exec_command_line(ls->cur_cmd_ctx?ls->cur_cmd_ctx->child:root_cmd,buf);
+#endif
+  return handler_runs!=runs?0:-1;
+}
+
+/* resolve a command line, as typed in the current session's context, to
+ * the command it would run and where its arguments start, without
+ * running it. returns 0, or -1 if the line names no single command with
+ * a handler (no match, ambiguous, or a context)
+ */
+int tinysh_resolve_line(const char *line, tinysh_cmd_t **cmd, const char **args)
+{
+  tinysh_cmd_t *c=ls->cur_cmd_ctx?ls->cur_cmd_ctx->child:root_cmd;
+  char *str=(char *)line;   /* parse_command() only reads it */
+
+  while(parse_command(&c,&str)==MATCH && c)
+    {
+      if(!c->child)
+        {
+          if(!c->function)
+            return -1;
+          *cmd=c;
+          *args=str;
+          return 0;
+        }
+      if(!*str) /* a context */
+        return -1;
+      c=c->child;
+    }
+  return -1;
+}
+
+/* where the password starts in a command line that gives one: the
+ * arguments of auth, once a blank separates them from the command.
+ * returns -1 for other lines
+ */
+int tinysh_secret_at(const char *line)
+{
+#if AUTHENTICATION_ENABLED
+  tinysh_cmd_t *cmd;
+  const char *args;
+
+  if(!strchr(line,' ') || tinysh_resolve_line(line,&cmd,&args)<0 || cmd!=&auth_cmd)
+    return -1;
+  while(*args==' ')
+    args++;
+  if(args==line || args[-1]!=' ')
+    return -1;
+  return (int)(args-line);
+#else
+  (void)line;
+  return -1;
+#endif
+}
+
+/* would c, typed into the current line now, be a character of a
+ * password. line ends and editing keys are not
+ */
+int tinysh_secret_char(char c)
+{
+  int at;
+
+  if((unsigned char)c<' ' || c==127)
+    return 0;
+  at=tinysh_secret_at(ls->input_buffers[ls->cur_buf_index]);
+  return at>=0 && ls->cur_index>=at;
+}
+
+/* run a resolved command as if typed: admin check, hooks and memo
+ * included. returns 0 if its handler ran, -1 otherwise
+ */
+int tinysh_run_command(tinysh_cmd_t *cmd, int argc, const char **argv)
+{
+  unsigned long runs=handler_runs;
+
+  run_command(cmd,argc,argv);
+  return handler_runs!=runs?0:-1;
+}
+
+/* hooks called around handlers (cmd) and around help and completion (0);
+ * leave gets what enter returned, and the leave hook set at that time
+ */
+void tinysh_exec_hooks(int (*enter)(tinysh_cmd_t *cmd), void (*leave)(tinysh_cmd_t *cmd, int token))
+{
+  exec_enter=enter;
+  exec_leave=leave;
+}
+
+/**
+ * Get the current context path ("" at top level)
+ */
+const char *tinysh_get_context(void) {
+    return ls->context_buffer;
 }
 
 /**
@@ -1048,6 +1544,13 @@ tinysh_cmd_t *tinysh_get_root_cmd(void) {
     return root_cmd;
 }
 
+/**
+ * Changes whenever a command is added to the tree
+ */
+unsigned long tinysh_tree_generation(void) {
+    return tree_generation;
+}
+
 #if !AUTHENTICATION_ENABLED
 // Stub functions when authentication is disabled
 unsigned char tinysh_verify_password(const char *password) {
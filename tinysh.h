@@ -64,6 +64,12 @@
 #define MAX_ARGS                8
 #endif
 
+/* Bytes of each line's extension area, where other modules keep their
+   per-session settings (tinysh_line_ext_claim()) */
+#ifndef LINE_EXT_SIZE
+#define LINE_EXT_SIZE           320
+#endif
+
 #ifndef TOPCHAR
 #define TOPCHAR                 '/'
 #endif
@@ -88,6 +94,23 @@
   #define AUTHENTICATION_ENABLED  0
 #endif
 
+/* Remember how the last command line resolved, so sending the same
+   line again skips the tree walk and argument split */
+#ifndef DISPATCH_CACHE
+#define DISPATCH_CACHE            1
+#endif
+
+/* Per-thread shell state (current session, output functions), for
+   ports that run sessions on several threads; see tiny_server.h */
+#ifndef TINYSH_THREADS
+#define TINYSH_THREADS            0
+#endif
+#if TINYSH_THREADS
+#define TINYSH_TLS                _Thread_local
+#else
+#define TINYSH_TLS
+#endif
+
 #define _NOARG_		                "[no-arg]"
 
 /* Command structure definition - MOVED UP to fix dependency issues */
@@ -103,6 +126,28 @@ typedef struct tinysh_cmd_t {
   struct tinysh_cmd_t *child;  /* must be set to 0 at init */
 } tinysh_cmd_t;
 
+/* Line editor state of one session: input line and history, context,
+   auth level, and the session's settings of other modules. The console
+   has its own; other sessions (tinysh_session.h) select theirs with
+   tinysh_line_select() while their input runs. */
+typedef struct {
+  char input_buffers[HISTORY_DEPTH > 0 ? HISTORY_DEPTH : 1][BUFFER_SIZE+1];
+  int cur_buf_index;           /* history entry being edited */
+  int cur_index;               /* cursor in it */
+  char context_buffer[BUFFER_SIZE+1];
+  int cur_context;             /* length of context_buffer */
+  tinysh_cmd_t *cur_cmd_ctx;   /* 0 at top level */
+  unsigned char auth_level;
+  char active;                 /* cleared by quit and CTRL-D */
+  char local_echo;             /* the other end echoes input itself (set by
+                                  the transport, e.g. telnet line mode) */
+  union {                      /* claimed by modules, zeroed by */
+    long align;                /*   tinysh_line_init() */
+    void *align_ptr;
+    unsigned char bytes[LINE_EXT_SIZE];
+  } ext;
+} tinysh_line_t;
+
 
 #if AUTHENTICATION_ENABLED
 /* Authentication defines and structures */
@@ -114,9 +159,6 @@ typedef struct tinysh_cmd_t {
 #define TINYSH_AUTH_NONE          0  // Not authenticated
 #define TINYSH_AUTH_ADMIN         1  // Admin authenticated
 
-/* Authentication session state */
-extern unsigned char tinysh_auth_level;
-
 /* Authentication command */
 extern tinysh_cmd_t auth_cmd;
 
@@ -169,12 +211,19 @@ static inline void* tinysh_get_real_arg(tinysh_cmd_t *cmd) {
 
 #define tinysh_out(func)            tinysh_char_out = (void(*)(unsigned char))(func)
 #define tinysh_print_out(func)      tinysh_printf = (int(*)(const char * fmt, ...))(func)
+#define tinysh_time_source(func)    tinysh_millis = (unsigned long(*)(void))(func)
+#define tinysh_write_out(func)      tinysh_block_out = (void(*)(const char *, int))(func)
 
-extern void (*tinysh_char_out)(unsigned char);
-extern int (*tinysh_printf)(const char *, ...);
+/* Output functions of the session running on this thread */
+extern TINYSH_TLS void (*tinysh_char_out)(unsigned char);
+extern TINYSH_TLS int (*tinysh_printf)(const char *, ...);
+/* Optional millisecond clock used by periodic features, can be 0 */
+extern unsigned long (*tinysh_millis)(void);
+/* Optional block output, used by tinysh_write(); can be 0 */
+extern TINYSH_TLS void (*tinysh_block_out)(const char *, int);
 
-/* Flag to indicate if TinyShell is active */
-extern char tinyshell_active;
+/* Flag to indicate if the current session is active, cleared by quit */
+#define tinyshell_active          (tinysh_line_current()->active)
 
 /* Built-in commands */
 extern tinysh_cmd_t help_cmd;
@@ -190,10 +239,53 @@ void tinysh_add_command(tinysh_cmd_t *cmd);
 void tinysh_set_prompt(const char *str);
 void *tinysh_get_arg(void);
 
+/* Sessions: set up a line state, and make one current on this thread
+   (0 selects the console's); returns the previously current one */
+void tinysh_line_init(tinysh_line_t *line);
+tinysh_line_t *tinysh_line_select(tinysh_line_t *line);
+tinysh_line_t *tinysh_line_current(void);
+
+/* Per-session module state: claim bytes of every line's extension area
+   once at init (offset, or -1 when LINE_EXT_SIZE is used up), then find
+   them in a line */
+int tinysh_line_ext_claim(int size);
+void *tinysh_line_ext(tinysh_line_t *line, int off);
+
+/* Run a command line in the current session's context without echo,
+   prompt or history; 0 if a handler ran, -1 otherwise */
+int tinysh_exec_line(const char *line);
+
+/* Resolve a command line, as typed in the current session's context, to
+   its command and the start of its arguments without running it; 0, or
+   -1 if it names no single command with a handler */
+int tinysh_resolve_line(const char *line, tinysh_cmd_t **cmd, const char **args);
+
+/* Where the password starts in a command line that gives one (auth),
+   -1 for other lines; such text must not be kept or recorded */
+int tinysh_secret_at(const char *line);
+
+/* Would c, typed into the current line now, be a character of a password */
+int tinysh_secret_char(char c);
+
+/* Run a resolved command (argv[0] is its name) with the admin check and
+   hooks a typed line gets; 0 if its handler ran, -1 otherwise */
+int tinysh_run_command(tinysh_cmd_t *cmd, int argc, const char **argv);
+
+/* Optional hooks around each handler call (cmd) and around help and
+   completion (cmd 0), so threaded ports can serialize what is not
+   thread-safe. leave gets the token enter returned, e.g. whether it took
+   a lock, so the two never disagree */
+void tinysh_exec_hooks(int (*enter)(tinysh_cmd_t *cmd), void (*leave)(tinysh_cmd_t *cmd, int token));
+
 /* Reset shell context to top level */
 void tinysh_reset_context(void);
 
+/* Current context path, "" at top level */
+const char *tinysh_get_context(void);
+
 unsigned long tinysh_atoxi(char *s);
+int tinysh_parse_long(const char *s, int len, long *value);
+int tinysh_parse_float(const char *s, int len, float *value);
 void tinysh_bin8_print(unsigned char v);
 void tinysh_bin16_print(unsigned short v);
 void tinysh_bin32_print(int v);
@@ -201,11 +293,20 @@ char *tinysh_strtok(char *s, const char *delim);
 int tinysh_tokenize(char *str, char token, char **vector, int max_arg);
 void tinysh_float2str(float f, char *str, int len, int precision);
 int tinysh_strlen(const char *s);
+void tinysh_puts(const char *s);
+void tinysh_write(const char *buf, int len);
+unsigned long tinysh_time_ms(void);
+uint32_t tinysh_hash(const char *s, int len);
+uint32_t tinysh_crc32(uint32_t crc, const void *buf, int len);
+unsigned long tinysh_dispatch_hits(void);
 
 char is_tinyshell_active(void);
 
 tinysh_cmd_t *tinysh_get_root_cmd(void);
 
+/* Changes whenever a command is added, for caches built from the tree */
+unsigned long tinysh_tree_generation(void);
+
 /* Exposed for testing */
 int help_command_line(tinysh_cmd_t *cmd, char *_str);
 
@@ -0,0 +1,353 @@
+#include "tinysh_apropos.h"
+#include "tinysh_table.h"
+#include "tinysh.h"
+#include <string.h>
+
+/* Where a word appears in a command, one bit per field */
+#define FIELD_NAME   0x04
+#define FIELD_HELP   0x02
+#define FIELD_USAGE  0x01
+
+/* Distinct words considered per command */
+#define DOC_TERMS    32
+
+/* Index: words hashed into an open-addressing table, each owning a run
+   of postings in one shared array */
+typedef struct {
+    uint32_t hash;                   /* 0 = free */
+    unsigned short first;            /* first posting */
+    unsigned short count;            /* postings */
+} apropos_term_t;
+
+typedef struct {
+    unsigned short doc;              /* index into docs[] */
+    unsigned char fields;            /* FIELD_* bits */
+} apropos_posting_t;
+
+static tinysh_cmd_t *docs[APROPOS_MAX_COMMANDS];
+static int ndocs = 0;
+static apropos_term_t terms[APROPOS_MAX_TERMS];
+static apropos_posting_t postings[APROPOS_MAX_POSTINGS];
+static int npostings = 0;
+static char built = 0;
+static char truncated = 0;          /* some commands or words did not fit */
+static int tree_size = 0;            /* commands in the tree, indexed or not */
+static unsigned long built_generation = 0;
+
+/* Search scratch, per command */
+static unsigned char matched[APROPOS_MAX_COMMANDS];
+static unsigned char mark[APROPOS_MAX_COMMANDS];
+static unsigned short score[APROPOS_MAX_COMMANDS];
+
+/* Forward declarations */
+static const char *next_word(const char *s, uint32_t *hash, const char **word, int *len);
+static int doc_terms(const tinysh_cmd_t *cmd, uint32_t *hashes, unsigned char *fields);
+static apropos_term_t *find_term(uint32_t hash, int insert);
+static void build_index(void);
+static int name_contains(const char *name, const char *word, int len);
+static int better(int a, int b);
+void apropos_cmd_handler(int argc, const char **argv);
+
+/* Apropos command */
+tinysh_cmd_t apropos_cmd = {
+    0, "apropos", "search commands by keyword", "<words...>",
+    apropos_cmd_handler, 0, 0, 0
+};
+
+/**
+ * Next word of s (letters and digits, lowercased into the hash)
+ * Returns the position after the word, NULL when there is none.
+ */
+static const char *next_word(const char *s, uint32_t *hash, const char **word, int *len) {
+    uint32_t h;
+    int n;
+
+    if (!s) return NULL;
+    for (;;) {
+        while (*s && !((*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z') ||
+                       (*s >= '0' && *s <= '9'))) {
+            s++;
+        }
+        if (!*s) return NULL;
+
+        h = 2166136261U;
+        *word = s;
+        for (n = 0; (*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z') ||
+                    (*s >= '0' && *s <= '9'); s++, n++) {
+            char c = (*s >= 'A' && *s <= 'Z') ? (char)(*s - 'A' + 'a') : *s;
+            h ^= (unsigned char)c;
+            h *= 16777619U;
+        }
+        if (n < 2) continue;        /* single letters only add noise */
+
+        *hash = h ? h : 1;
+        *len = n;
+        return s;
+    }
+}
+
+/**
+ * Distinct words of a command and the fields they appear in
+ */
+static int doc_terms(const tinysh_cmd_t *cmd, uint32_t *hashes, unsigned char *fields) {
+    const char *text[3] = {cmd->name, cmd->help, cmd->usage};
+    static const unsigned char bit[3] = {FIELD_NAME, FIELD_HELP, FIELD_USAGE};
+    const char *s, *word;
+    uint32_t h;
+    int f, i, len, n = 0;
+
+    for (f = 0; f < 3; f++) {
+        s = text[f];
+        while ((s = next_word(s, &h, &word, &len)) != NULL) {
+            for (i = 0; i < n && hashes[i] != h; i++);
+            if (i == n) {
+                if (n == DOC_TERMS) continue;  /* a wordy command still found by its first words */
+                hashes[n] = h;
+                fields[n++] = 0;
+            }
+            fields[i] |= bit[f];
+        }
+    }
+    return n;
+}
+
+/**
+ * Term slot for a word hash, NULL if absent (or the table is full)
+ */
+static apropos_term_t *find_term(uint32_t hash, int insert) {
+    unsigned i, slot = hash & (APROPOS_MAX_TERMS - 1);
+
+    for (i = 0; i < APROPOS_MAX_TERMS; i++) {
+        apropos_term_t *t = &terms[(slot + i) & (APROPOS_MAX_TERMS - 1)];
+        if (t->hash == hash) return t;
+        if (!t->hash) {
+            if (!insert) return NULL;
+            t->hash = hash;
+            return t;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Build the index from the command tree
+ * Pass 1 counts postings per word, pass 2 fills each word's run.
+ */
+static void build_index(void) {
+    uint32_t hashes[DOC_TERMS];
+    unsigned char fields[DOC_TERMS];
+    tinysh_cmd_t *cmd = tinysh_get_root_cmd();
+    apropos_term_t *t;
+    int d, i, n, total = 0;
+
+    memset(terms, 0, sizeof(terms));
+    ndocs = 0;
+    tree_size = 0;
+    truncated = 0;
+
+    /* Depth-first walk of the tree, counting what does not fit */
+    while (cmd) {
+        if (ndocs < APROPOS_MAX_COMMANDS) {
+            docs[ndocs++] = cmd;
+        } else {
+            truncated = 1;
+        }
+        tree_size++;
+        if (cmd->child) {
+            cmd = cmd->child;
+        } else {
+            while (cmd && !cmd->next) cmd = cmd->parent;
+            if (cmd) cmd = cmd->next;
+        }
+    }
+
+    /* Pass 1: count; stop at the first command that no longer fits */
+    for (d = 0; d < ndocs; d++) {
+        n = doc_terms(docs[d], hashes, fields);
+        if (total + n > APROPOS_MAX_POSTINGS) {
+            ndocs = d;
+            truncated = 1;
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            t = find_term(hashes[i], 1);
+            if (!t) {
+                truncated = 1;
+                continue;
+            }
+            t->count++;
+            total++;
+        }
+    }
+
+    /* Runs laid out back to back; first points past the end for now */
+    total = 0;
+    for (i = 0; i < APROPOS_MAX_TERMS; i++) {
+        total += terms[i].count;
+        terms[i].first = (unsigned short)total;
+    }
+    npostings = total;
+
+    /* Pass 2: fill each run from its end */
+    for (d = 0; d < ndocs; d++) {
+        n = doc_terms(docs[d], hashes, fields);
+        for (i = 0; i < n; i++) {
+            t = find_term(hashes[i], 0);
+            if (!t) continue;
+            t->first--;
+            postings[t->first].doc = (unsigned short)d;
+            postings[t->first].fields = fields[i];
+        }
+    }
+
+    built = 1;
+    built_generation = tinysh_tree_generation();
+}
+
+/**
+ * Does a command name contain a word (ignoring case)
+ */
+static int name_contains(const char *name, const char *word, int len) {
+    int i;
+
+    for (; *name; name++) {
+        for (i = 0; i < len && name[i]; i++) {
+            char a = name[i], b = word[i];
+            if (a >= 'A' && a <= 'Z') a = (char)(a - 'A' + 'a');
+            if (b >= 'A' && b <= 'Z') b = (char)(b - 'A' + 'a');
+            if (a != b) break;
+        }
+        if (i == len) return 1;
+    }
+    return 0;
+}
+
+/**
+ * Ranking: more words matched, then higher score, then tree order
+ */
+static int better(int a, int b) {
+    if (matched[a] != matched[b]) return matched[a] > matched[b];
+    if (score[a] != score[b]) return score[a] > score[b];
+    return a < b;
+}
+
+/**
+ * Search the command tree
+ */
+int tinysh_apropos_search(const char *const *words, int nwords, tinysh_cmd_t **out, int max) {
+    static const unsigned char weight[8] = {0, 1, 3, 4, 8, 9, 11, 12};
+    int picked[APROPOS_MAX_RESULTS];
+    int w, d, i, j, len, found = 0, query = 0;
+    const char *s, *word;
+    uint32_t h;
+
+    if (!built || built_generation != tinysh_tree_generation()) build_index();
+    if (truncated) return -1;
+
+    memset(matched, 0, sizeof(matched));
+    memset(mark, 0, sizeof(mark));
+    memset(score, 0, sizeof(score));
+
+    for (w = 0; w < nwords; w++) {
+        s = words[w];
+        while ((s = next_word(s, &h, &word, &len)) != NULL) {
+            apropos_term_t *t = find_term(h, 0);
+
+            if (++query > 255) break;
+            if (t) {
+                for (i = t->first; i < t->first + t->count; i++) {
+                    d = postings[i].doc;
+                    if (mark[d] != query) {
+                        mark[d] = (unsigned char)query;
+                        matched[d]++;
+                    }
+                    score[d] += weight[postings[i].fields & 7];
+                }
+            }
+
+            /* Part of a name: weaker than a whole word */
+            for (d = 0; d < ndocs; d++) {
+                if (mark[d] != query && name_contains(docs[d]->name, word, len)) {
+                    mark[d] = (unsigned char)query;
+                    matched[d]++;
+                    score[d] += 2;
+                }
+            }
+        }
+    }
+
+    /* Keep the best max, in order */
+    if (max > APROPOS_MAX_RESULTS) max = APROPOS_MAX_RESULTS;
+    for (d = 0; d < ndocs; d++) {
+        if (!matched[d]) continue;
+        for (i = found; i > 0 && better(d, picked[i - 1]); i--);
+        if (i >= max) continue;
+        if (found < max) found++;
+        for (j = found - 1; j > i; j--) picked[j] = picked[j - 1];
+        picked[i] = d;
+    }
+
+    for (i = 0; i < found; i++) out[i] = docs[picked[i]];
+    return found;
+}
+
+/**
+ * Full path of a command
+ */
+int tinysh_apropos_path(const tinysh_cmd_t *cmd, char *buf, int size) {
+    const tinysh_cmd_t *chain[16];
+    int depth = 0, len = 0, n;
+
+    if (size <= 0) return 0;
+    buf[0] = 0;
+    for (; cmd && depth < 16; cmd = cmd->parent) chain[depth++] = cmd;
+
+    while (depth-- > 0) {
+        n = (int)strlen(chain[depth]->name);
+        if (len + n + 2 > size) break;
+        if (len) buf[len++] = ' ';
+        memcpy(buf + len, chain[depth]->name, (size_t)n);
+        len += n;
+        buf[len] = 0;
+    }
+    return len;
+}
+
+/**
+ * Apropos command handler
+ */
+void apropos_cmd_handler(int argc, const char **argv) {
+    static const tinysh_table_col_t cols[] = {
+        {"Command", 0, 0},
+        {"Description", 0, 0}
+    };
+    tinysh_cmd_t *found[APROPOS_MAX_RESULTS];
+    char path[BUFFER_SIZE];
+    int i, n;
+
+    if (argc < 2) {
+        tinysh_printf("Usage: apropos <words...>\r\n");
+        return;
+    }
+
+    n = tinysh_apropos_search(argv + 1, argc - 1, found, APROPOS_MAX_RESULTS);
+    if (n < 0) {
+        tinysh_printf("Index too small for %d commands: raise the APROPOS_MAX_* limits\r\n", tree_size);
+    } else if (!n) {
+        tinysh_puts("Nothing appropriate\r\n");
+    } else {
+        tinysh_table_begin(cols, 2);
+        for (i = 0; i < n; i++) {
+            tinysh_apropos_path(found[i], path, sizeof(path));
+            tinysh_table_add(path, found[i]->help ? found[i]->help : "");
+        }
+        tinysh_table_end();
+    }
+}
+
+/**
+ * Register the apropos command
+ */
+void tinysh_apropos_init(void) {
+    tinysh_add_command(&apropos_cmd);
+}
@@ -0,0 +1,91 @@
+/**
+ * TinyShell Command Search
+ * ----------------------
+ * "apropos <words>" finds commands anywhere in the tree by the words in
+ * their name, help and usage strings, for when nobody remembers where a
+ * command lives.
+ *
+ * Features:
+ * - Inverted index from word to the commands using it, so a search only
+ *   touches the commands that match
+ * - Index built on the first search after commands were added, into
+ *   fixed-size tables (no heap)
+ * - Postings stored as (command, fields) byte pairs, one contiguous run
+ *   per word
+ * - Results ranked by how many words matched and where (name before help
+ *   before usage), printed with the full command path
+ * - Words not in the index are also looked for inside command names, so
+ *   "apropos sys" finds "sysinfo"
+ *
+ * Example Usage:
+ *
+ * tinysh_apropos_init();
+ *
+ * tinysh> apropos metric
+ * Command  Description
+ * chart    show metric trends
+ */
+
+#ifndef TINYSH_APROPOS_H
+#define TINYSH_APROPOS_H
+
+#include "tinysh.h"
+
+/* Commands indexed, at most 65535; a bigger tree is not searched at all */
+#ifndef APROPOS_MAX_COMMANDS
+#define APROPOS_MAX_COMMANDS      96
+#endif
+#if APROPOS_MAX_COMMANDS > 65535
+#error "APROPOS_MAX_COMMANDS must be at most 65535"
+#endif
+
+/* Distinct words indexed, a power of two */
+#ifndef APROPOS_MAX_TERMS
+#define APROPOS_MAX_TERMS         256
+#endif
+
+/* Postings (one per word per command), at most 65535 */
+#ifndef APROPOS_MAX_POSTINGS
+#define APROPOS_MAX_POSTINGS      1024
+#endif
+#if APROPOS_MAX_POSTINGS > 65535
+#error "APROPOS_MAX_POSTINGS must be at most 65535"
+#endif
+
+/* Results shown by the apropos command */
+#ifndef APROPOS_MAX_RESULTS
+#define APROPOS_MAX_RESULTS       10
+#endif
+
+/**
+ * Search the command tree
+ * A tree that does not fit the index is refused rather than searched in
+ * part, so a missing answer is never mistaken for no answer.
+ *
+ * @param words  Search words
+ * @param nwords Number of words
+ * @param out    Receives matching commands, best first
+ * @param max    Size of out
+ * @return Number of commands stored in out, or -1 if the tree does not
+ *         fit the APROPOS_MAX_* limits
+ */
+int tinysh_apropos_search(const char *const *words, int nwords, tinysh_cmd_t **out, int max);
+
+/**
+ * Full path of a command, e.g. "test run"
+ *
+ * @param buf  Output buffer, always terminated
+ * @param size Size of buf
+ * @return Length of the path
+ */
+int tinysh_apropos_path(const tinysh_cmd_t *cmd, char *buf, int size);
+
+/**
+ * Register the apropos command
+ */
+void tinysh_apropos_init(void);
+
+/* Apropos command */
+extern tinysh_cmd_t apropos_cmd;
+
+#endif /* TINYSH_APROPOS_H */
@@ -0,0 +1,212 @@
+#include "tinysh_build.h"
+#include "tinysh_table.h"
+#include "tinysh.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#if BUILD_INTERN_BUCKETS & (BUILD_INTERN_BUCKETS - 1)
+#error "BUILD_INTERN_BUCKETS must be a power of two"
+#endif
+
+#define ALIGN           sizeof(void *)
+
+/* An interned string */
+typedef struct build_str_t {
+    struct build_str_t *next;        /* in its bucket */
+    uint32_t hash;
+    char s[];
+} build_str_t;
+
+static tinysh_arena_t *arenas = NULL;
+
+/* Forward declarations */
+static int name_of(char *buf, int size, const char *fmt, int n);
+void arenas_cmd_handler(int argc, const char **argv);
+
+/* Arenas command */
+tinysh_cmd_t arenas_cmd = {
+    0, "arenas", "show memory of commands built at run time", 0,
+    arenas_cmd_handler, 0, 0, 0
+};
+
+/**
+ * Set up an arena on a buffer
+ */
+int tinysh_arena_init(tinysh_arena_t *a, const char *name, void *mem, unsigned long size) {
+    tinysh_arena_t *it, *next;
+
+    // Set up again: keep its place in the list, unless its commands are in use
+    for (it = arenas; it && it != a; it = it->next);
+    if (it && a->commands > 0) return -1;
+    next = it ? a->next : arenas;
+    memset(a, 0, sizeof(*a));
+    a->name = name;
+    a->base = (unsigned char *)mem;
+    a->size = size;
+    a->next = next;
+    if (!it) arenas = a;
+    a->buckets = (build_str_t **)tinysh_arena_alloc(a, BUILD_INTERN_BUCKETS * sizeof(build_str_t *));
+    return a->buckets ? 0 : -1;
+}
+
+/**
+ * Take an arena off the list
+ */
+void tinysh_arena_remove(tinysh_arena_t *a) {
+    tinysh_arena_t **it;
+
+    for (it = &arenas; *it && *it != a; it = &(*it)->next);
+    if (*it) *it = a->next;
+    memset(a, 0, sizeof(*a));
+}
+
+/**
+ * Take zeroed, pointer-aligned bytes from an arena
+ */
+void *tinysh_arena_alloc(tinysh_arena_t *a, unsigned long size) {
+    unsigned long pad = (unsigned long)(-(uintptr_t)(a->base + a->used) & (ALIGN - 1));
+    void *p;
+
+    if (pad + size > a->size - a->used) return NULL;
+    p = a->base + a->used + pad;
+    a->used += pad + size;
+    memset(p, 0, size);
+    return p;
+}
+
+/**
+ * Copy of a string in the arena, shared with any equal string there
+ */
+const char *tinysh_arena_intern(tinysh_arena_t *a, const char *s) {
+    build_str_t *e;
+    uint32_t h;
+    unsigned long used;
+    int len;
+
+    if (!s || !a->buckets) return NULL;
+    len = tinysh_strlen(s);
+    h = tinysh_hash(s, len);
+    for (e = a->buckets[h & (BUILD_INTERN_BUCKETS - 1)]; e; e = e->next) {
+        if (e->hash == h && strcmp(e->s, s) == 0) {
+            a->reused++;
+            a->saved_bytes += offsetof(build_str_t, s) + (unsigned long)len + 1;
+            return e->s;
+        }
+    }
+
+    used = a->used;
+    e = (build_str_t *)tinysh_arena_alloc(a, offsetof(build_str_t, s) + (unsigned long)len + 1);
+    if (!e) return NULL;
+    e->hash = h;
+    memcpy(e->s, s, (size_t)len + 1);
+    e->next = a->buckets[h & (BUILD_INTERN_BUCKETS - 1)];
+    a->buckets[h & (BUILD_INTERN_BUCKETS - 1)] = e;
+    a->strings++;
+    a->string_bytes += a->used - used;
+    return e->s;
+}
+
+/**
+ * Build a command and add it to the tree
+ * Nothing is added if the arena fills up; the bytes taken so far stay taken.
+ */
+tinysh_cmd_t *tinysh_build_command(tinysh_arena_t *a, tinysh_cmd_t *parent, const char *name,
+                                   const char *help, const char *usage,
+                                   tinysh_fnt_t fn, void *arg) {
+    tinysh_cmd_t *cmd;
+
+    if (!name || !*name) return NULL;
+    cmd = (tinysh_cmd_t *)tinysh_arena_alloc(a, sizeof(tinysh_cmd_t));
+    if (!cmd) return NULL;
+    cmd->parent = parent;
+    cmd->function = fn;
+    cmd->arg = arg;
+    cmd->name = tinysh_arena_intern(a, name);
+    cmd->help = tinysh_arena_intern(a, help);
+    cmd->usage = tinysh_arena_intern(a, usage);
+    if (!cmd->name || (help && !cmd->help) || (usage && !cmd->usage)) return NULL;
+
+    tinysh_add_command(cmd);
+    a->commands++;
+    return cmd;
+}
+
+/**
+ * Name with the first "%d" replaced by a number
+ *
+ * @return 0, or -1 if it does not fit
+ */
+static int name_of(char *buf, int size, const char *fmt, int n) {
+    const char *d = strstr(fmt, "%d");
+    int len, pre;
+
+    if (!d) return -1;
+    pre = (int)(d - fmt);
+    if (pre >= size) return -1;
+    memcpy(buf, fmt, (size_t)pre);
+    len = snprintf(buf + pre, (size_t)(size - pre), "%d%s", n, d + 2);
+    return len < 0 || len >= size - pre ? -1 : 0;
+}
+
+/**
+ * Build a numbered family of commands
+ */
+int tinysh_build_family(tinysh_arena_t *a, tinysh_cmd_t *parent, const char *name_fmt,
+                        int first, int count, const char *help, const char *usage,
+                        tinysh_fnt_t fn) {
+    char name[BUILD_NAME_SIZE];
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (name_of(name, sizeof(name), name_fmt, first + i) < 0) break;
+        if (!tinysh_build_command(a, parent, name, help, usage, fn, (void *)(intptr_t)(first + i))) break;
+    }
+    return i;
+}
+
+/**
+ * Bytes an arena spends per command built, everything included
+ */
+unsigned long tinysh_arena_per_command(const tinysh_arena_t *a) {
+    return a->commands ? (a->used + (unsigned long)a->commands / 2) / (unsigned long)a->commands : 0;
+}
+
+/**
+ * Arenas command handler
+ */
+void arenas_cmd_handler(int argc, const char **argv) {
+    static const tinysh_table_col_t cols[] = {
+        {"Arena", 0, 0},
+        {"Used", 0, TABLE_ALIGN_RIGHT},
+        {"Size", 0, TABLE_ALIGN_RIGHT},
+        {"Commands", 0, TABLE_ALIGN_RIGHT},
+        {"Strings", 0, TABLE_ALIGN_RIGHT},
+        {"Shared", 0, TABLE_ALIGN_RIGHT},
+        {"Saved", 0, TABLE_ALIGN_RIGHT},
+        {"Per command", 0, TABLE_ALIGN_RIGHT}
+    };
+    tinysh_arena_t *a;
+    char used[24], size[24], cmds[12], strs[12], shared[12], saved[24], per[24];
+    (void)argc;
+    (void)argv;
+
+    if (!arenas) {
+        tinysh_puts("No arenas\r\n");
+        return;
+    }
+    tinysh_table_begin(cols, 8);
+    for (a = arenas; a; a = a->next) {
+        snprintf(used, sizeof(used), "%lu", a->used);
+        snprintf(size, sizeof(size), "%lu", a->size);
+        snprintf(cmds, sizeof(cmds), "%d", a->commands);
+        snprintf(strs, sizeof(strs), "%d", a->strings);
+        snprintf(shared, sizeof(shared), "%d", a->reused);
+        snprintf(saved, sizeof(saved), "%lu", a->saved_bytes);
+        snprintf(per, sizeof(per), "%lu", tinysh_arena_per_command(a));
+        tinysh_table_add(a->name, used, size, cmds, strs, shared, saved, per);
+    }
+    tinysh_table_end();
+    tinysh_printf("Node %u bytes; strings include a %u-byte header\r\n",
+                  (unsigned)sizeof(tinysh_cmd_t), (unsigned)offsetof(build_str_t, s));
+}
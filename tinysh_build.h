@@ -0,0 +1,148 @@
+/**
+ * TinyShell Command Builder
+ * ------------------------
+ * Creates commands at run time, e.g. one per channel found in the
+ * configuration, where the tree otherwise needs every tinysh_cmd_t and
+ * its strings in static storage.
+ *
+ * Features:
+ * - Nodes and strings come from an arena the caller supplies: no heap,
+ *   nothing freed, the cost fixed by the buffer size
+ * - Names, help and usage are interned: a string already in the arena is
+ *   not stored again, so a family of commands shares one help text
+ * - Numbered families in one call: "ch%d" from 0 to 63 makes ch0..ch63,
+ *   each handler told its number through tinysh_get_arg()
+ * - Strings are copied, so names can be built in a stack buffer
+ * - "arenas" command: bytes used, commands, strings and the cost of each
+ *   generated command
+ *
+ * Commands cannot be removed from the tree, so neither can an arena that
+ * holds any be reused.
+ *
+ * Example Usage:
+ *
+ * static unsigned char chan_mem[4096];
+ * static tinysh_arena_t chan_arena;
+ *
+ * static void chan_fn(int argc, const char **argv) {
+ *     int ch = (int)(intptr_t)tinysh_get_arg();
+ *     ...
+ * }
+ *
+ * tinysh_arena_init(&chan_arena, "channels", chan_mem, sizeof(chan_mem));
+ * tinysh_cmd_t *ch = tinysh_build_command(&chan_arena, 0, "ch", "channels", 0, 0, 0);
+ * tinysh_build_family(&chan_arena, ch, "%d", 0, channels, "channel state", "[on|off]", chan_fn);
+ *
+ * tinysh> ch 12 on
+ */
+
+#ifndef TINYSH_BUILD_H
+#define TINYSH_BUILD_H
+
+#include "tinysh.h"
+
+/* Hash buckets for interned strings, a power of two; taken from the arena */
+#ifndef BUILD_INTERN_BUCKETS
+#define BUILD_INTERN_BUCKETS      32
+#endif
+
+/* Longest generated name */
+#ifndef BUILD_NAME_SIZE
+#define BUILD_NAME_SIZE           32
+#endif
+
+/**
+ * Arena
+ * Set up with tinysh_arena_init(); the fields are the builder's.
+ */
+typedef struct tinysh_arena_t {
+    const char *name;                // Shown by "arenas"
+    unsigned char *base;
+    unsigned long size;
+    unsigned long used;
+    struct build_str_t **buckets;    // Interned strings by hash
+    int commands;                    // Commands built
+    int strings;                     // Distinct strings stored
+    int reused;                      // Strings found already interned
+    unsigned long string_bytes;      // Bytes the distinct strings take, headers included
+    unsigned long saved_bytes;       // Bytes interning did not have to store
+    struct tinysh_arena_t *next;     // Arenas list
+} tinysh_arena_t;
+
+/**
+ * Set up an arena on a buffer
+ * The intern table is taken from the buffer first. An arena already set
+ * up can be set up again only while it holds no commands.
+ *
+ * @param a    Arena, must stay valid
+ * @param name Shown by "arenas", must stay valid
+ * @param mem  Buffer, must stay valid
+ * @param size Bytes in mem
+ * @return 0, or -1 if the buffer is too small for the intern table or
+ *         the arena holds commands
+ */
+int tinysh_arena_init(tinysh_arena_t *a, const char *name, void *mem, unsigned long size);
+
+/**
+ * Take an arena off the list "arenas" shows
+ * Only for an arena whose commands are not in the tree, e.g. built under
+ * a parent that was never added; the arena can be set up again after.
+ */
+void tinysh_arena_remove(tinysh_arena_t *a);
+
+/**
+ * Take zeroed, pointer-aligned bytes from an arena
+ *
+ * @return Memory, or NULL if the arena is full
+ */
+void *tinysh_arena_alloc(tinysh_arena_t *a, unsigned long size);
+
+/**
+ * Copy of a string in the arena, shared with any equal string there
+ *
+ * @param s String, NULL gives NULL
+ * @return Interned string, or NULL if the arena is full
+ */
+const char *tinysh_arena_intern(tinysh_arena_t *a, const char *s);
+
+/**
+ * Build a command and add it to the tree
+ *
+ * @param parent Parent command, 0 for top level
+ * @param name   Name, copied
+ * @param help   Help text, copied, can be 0
+ * @param usage  Usage text, copied, can be 0
+ * @param fn     Handler, 0 for a context of its own children
+ * @param arg    Returned by tinysh_get_arg() in the handler
+ * @return Command, or NULL if the arena is full
+ */
+tinysh_cmd_t *tinysh_build_command(tinysh_arena_t *a, tinysh_cmd_t *parent, const char *name,
+                                   const char *help, const char *usage,
+                                   tinysh_fnt_t fn, void *arg);
+
+/**
+ * Build a numbered family of commands
+ * Each is named by replacing "%d" in name_fmt with its number, and gets
+ * its number as the handler's argument. Help and usage are shared.
+ *
+ * @param name_fmt Name with one "%d", e.g. "ch%d"
+ * @param first    Number of the first command
+ * @param count    Commands to build
+ * @return Commands built; fewer than count if the arena filled up or a
+ *         name does not fit BUILD_NAME_SIZE
+ */
+int tinysh_build_family(tinysh_arena_t *a, tinysh_cmd_t *parent, const char *name_fmt,
+                        int first, int count, const char *help, const char *usage,
+                        tinysh_fnt_t fn);
+
+/**
+ * Bytes an arena spends per command built, everything included
+ *
+ * @return Bytes, 0 if it has no commands
+ */
+unsigned long tinysh_arena_per_command(const tinysh_arena_t *a);
+
+/* Arenas command */
+extern tinysh_cmd_t arenas_cmd;
+
+#endif /* TINYSH_BUILD_H */
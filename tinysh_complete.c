@@ -0,0 +1,315 @@
+#include "tinysh_complete.h"
+#include "tinysh_term.h"
+#include "tinysh.h"
+#include <string.h>
+
+/* Registered completers */
+static struct {
+    tinysh_cmd_t *cmd;
+    tinysh_completer_t fn;
+    void *arg;
+} completers[COMPLETE_MAX_COMMANDS];
+
+/* Cached results: candidates sorted, packed as NUL-terminated strings */
+typedef struct {
+    tinysh_cmd_t *cmd;               /* NULL = free */
+    uint32_t key;                    /* argument index and partial word */
+    unsigned long stamp;             /* tinysh_time_ms() when filled */
+    unsigned long last_used;         /* use sequence number */
+    unsigned short count;
+    unsigned short len;
+    unsigned char truncated;         /* some candidates did not fit */
+    unsigned short off[COMPLETE_MAX_CANDIDATES];
+    char text[COMPLETE_CACHE_SIZE];
+} complete_entry_t;
+
+static complete_entry_t complete_cache[COMPLETE_CACHE_ENTRIES];
+static unsigned long use_seq = 0;
+static unsigned long complete_hits = 0;
+static unsigned long complete_misses = 0;
+
+/* Entry being filled by a completer */
+static complete_entry_t *filling = NULL;
+static const char *fill_prefix = NULL;
+static int fill_prefix_len = 0;
+
+/* Listing being paged through: same command and line, next candidate */
+static tinysh_cmd_t *page_cmd = NULL;
+static uint32_t page_line = 0;
+static int page_next = 0;
+
+/* Forward declarations */
+static int find_completer(tinysh_cmd_t *cmd);
+static complete_entry_t *lookup(tinysh_cmd_t *cmd, int argi, const char *prefix);
+static const char *display_name(const char *s, int *len);
+static void list_page(complete_entry_t *e, tinysh_cmd_t *cmd, const char *args);
+
+/**
+ * Index of a command's completer, -1 if it has none
+ */
+static int find_completer(tinysh_cmd_t *cmd) {
+    int i;
+
+    for (i = 0; i < COMPLETE_MAX_COMMANDS; i++) {
+        if (completers[i].cmd == cmd && completers[i].fn) return i;
+    }
+    return -1;
+}
+
+/**
+ * Cached result for a word, calling the completer on a miss
+ */
+static complete_entry_t *lookup(tinysh_cmd_t *cmd, int argi, const char *prefix) {
+    uint32_t key = (tinysh_hash(prefix, -1) * 16777619U) ^ (uint32_t)argi;
+    unsigned long now = tinysh_time_ms();
+    complete_entry_t *e = NULL;
+    int i, c;
+
+    for (i = 0; i < COMPLETE_CACHE_ENTRIES; i++) {
+        if (complete_cache[i].cmd == cmd && complete_cache[i].key == key) {
+            e = &complete_cache[i];
+            break;
+        }
+    }
+    if (e && (!tinysh_millis || now - e->stamp < COMPLETE_CACHE_MS)) {
+        complete_hits++;
+        e->last_used = ++use_seq;
+        return e;
+    }
+
+    /* Stale entry, free entry, or the least recently used one */
+    if (!e) {
+        e = &complete_cache[0];
+        for (i = 0; i < COMPLETE_CACHE_ENTRIES; i++) {
+            if (!complete_cache[i].cmd) {
+                e = &complete_cache[i];
+                break;
+            }
+            if (complete_cache[i].last_used < e->last_used) e = &complete_cache[i];
+        }
+    }
+
+    complete_misses++;
+    e->cmd = NULL;
+    e->count = 0;
+    e->len = 0;
+    e->truncated = 0;
+
+    c = find_completer(cmd);
+    filling = e;
+    fill_prefix = prefix;
+    fill_prefix_len = (int)strlen(prefix);
+    completers[c].fn(argi, prefix, completers[c].arg);
+    filling = NULL;
+
+    e->cmd = cmd;
+    e->key = key;
+    e->stamp = now;
+    e->last_used = ++use_seq;
+    return e;
+}
+
+/**
+ * Part of a candidate shown in listings: paths show their last component
+ */
+static const char *display_name(const char *s, int *len) {
+    const char *name = s;
+    int i, n = (int)strlen(s);
+
+    for (i = 0; i < n - 1; i++) {
+        if (s[i] == '/') name = s + i + 1;
+    }
+    *len = n - (int)(name - s);
+    return name;
+}
+
+/**
+ * List one screen of candidates in columns
+ */
+static void list_page(complete_entry_t *e, tinysh_cmd_t *cmd, const char *args) {
+    uint32_t line = tinysh_hash(args, -1);
+    int i, len, width = 0, cols, per_page, end;
+
+    if (page_cmd != cmd || page_line != line) page_next = 0;
+    if (page_next >= e->count) page_next = 0;
+
+    for (i = 0; i < e->count; i++) {
+        display_name(e->text + e->off[i], &len);
+        if (len > width) width = len;
+    }
+    width += 2;
+    cols = tinysh_term_cols() / width;
+    if (cols < 1) cols = 1;
+    per_page = tinysh_term_text_rows() - 2;
+    if (per_page < 1) per_page = 1;
+    per_page *= cols;
+
+    end = page_next + per_page;
+    if (end > e->count) end = e->count;
+
+    tinysh_puts("\n\r");
+    for (i = page_next; i < end; i++) {
+        const char *name = display_name(e->text + e->off[i], &len);
+        int col = (i - page_next) % cols;
+
+        tinysh_puts(name);
+        if (col == cols - 1 || i == end - 1) {
+            tinysh_puts("\n\r");
+        } else {
+            tinysh_term_pad(width - len);
+        }
+    }
+
+    page_next = end;
+    if (page_next < e->count) {
+        tinysh_puts("--More-- (TAB)\n\r");
+        page_cmd = cmd;
+        page_line = line;
+    } else {
+        if (e->truncated) tinysh_puts("...\n\r");
+        page_cmd = NULL;
+    }
+}
+
+/**
+ * Attach a completer to a command
+ */
+int tinysh_complete_register(tinysh_cmd_t *cmd, tinysh_completer_t fn, void *arg) {
+    int i, free_slot = -1;
+
+    tinysh_complete_invalidate(cmd);
+    for (i = 0; i < COMPLETE_MAX_COMMANDS; i++) {
+        if (completers[i].cmd == cmd) {
+            completers[i].fn = fn;
+            completers[i].arg = arg;
+            if (!fn) completers[i].cmd = NULL;
+            return 0;
+        }
+        if (!completers[i].cmd && free_slot < 0) free_slot = i;
+    }
+    if (!fn) return 0;
+    if (free_slot < 0) return -1;
+
+    completers[free_slot].cmd = cmd;
+    completers[free_slot].fn = fn;
+    completers[free_slot].arg = arg;
+    return 0;
+}
+
+/**
+ * Offer one candidate, kept in sorted order
+ */
+void tinysh_complete_add(const char *candidate) {
+    complete_entry_t *e = filling;
+    int i, n, pos;
+
+    if (!e || !candidate) return;
+    if (strncmp(candidate, fill_prefix, (size_t)fill_prefix_len) != 0) return;
+
+    /* Sorted position, dropping duplicates */
+    for (pos = 0; pos < e->count; pos++) {
+        int r = strcmp(candidate, e->text + e->off[pos]);
+        if (r == 0) return;
+        if (r < 0) break;
+    }
+
+    /* When full, keep the candidates that sort first: drop the last ones */
+    n = (int)strlen(candidate) + 1;
+    while (e->count >= COMPLETE_MAX_CANDIDATES || e->len + n > COMPLETE_CACHE_SIZE) {
+        int last, last_len;
+
+        e->truncated = 1;
+        if (pos >= e->count) return;
+        last = e->off[--e->count];
+        last_len = (int)strlen(e->text + last) + 1;
+        memmove(e->text + last, e->text + last + last_len, (size_t)(e->len - last - last_len));
+        e->len -= (unsigned short)last_len;
+        for (i = 0; i < e->count; i++) {
+            if (e->off[i] > last) e->off[i] -= (unsigned short)last_len;
+        }
+    }
+
+    memcpy(e->text + e->len, candidate, (size_t)n);
+    for (i = e->count; i > pos; i--) e->off[i] = e->off[i - 1];
+    e->off[pos] = e->len;
+    e->len += (unsigned short)n;
+    e->count++;
+}
+
+/**
+ * Word list completer
+ */
+void tinysh_complete_words(int argi, const char *prefix, void *arg) {
+    const char *const *w = (const char *const *)arg;
+    (void)prefix;
+
+    if (argi != 1) return;
+    while (w && *w) tinysh_complete_add(*w++);
+}
+
+/**
+ * Drop cached results
+ */
+void tinysh_complete_invalidate(tinysh_cmd_t *cmd) {
+    int i;
+
+    for (i = 0; i < COMPLETE_CACHE_ENTRIES; i++) {
+        if (!cmd || complete_cache[i].cmd == cmd) complete_cache[i].cmd = NULL;
+    }
+    page_cmd = NULL;
+}
+
+/**
+ * Complete the word being typed after a command
+ */
+int tinysh_complete_args(tinysh_cmd_t *cmd, const char *args, char *insert, int size) {
+    complete_entry_t *e;
+    const char *word, *first, *last, *p = args;
+    int argi = 0, plen, common;
+
+    if (size > 0) insert[0] = 0;
+    if (find_completer(cmd) < 0) return -1;
+
+    /* Index and start of the last, partial word */
+    do {
+        while (*p == ' ') p++;
+        word = p;
+        while (*p && *p != ' ') p++;
+        argi++;
+    } while (*p);
+
+    e = lookup(cmd, argi, word);
+    if (!e->count) return 0;
+
+    /* Candidates are sorted: the first and last bound the common prefix */
+    first = e->text + e->off[0];
+    last = e->text + e->off[e->count - 1];
+    for (common = 0; first[common] && first[common] == last[common]; common++);
+
+    plen = (int)strlen(word);
+    if (!e->truncated && (common > plen || e->count == 1)) {
+        int n = 0;
+
+        while (plen + n < common && n < size - 2) {
+            insert[n] = first[plen + n];
+            n++;
+        }
+        if (e->count == 1 && common > 0 &&
+            first[common - 1] != '/' && first[common - 1] != '=') {
+            insert[n++] = ' ';
+        }
+        if (size > 0) insert[n] = 0;
+        return 0;
+    }
+
+    list_page(e, cmd, args);
+    return 1;
+}
+
+/**
+ * Cache counters
+ */
+void tinysh_complete_stats(unsigned long *hits, unsigned long *misses) {
+    if (hits) *hits = complete_hits;
+    if (misses) *misses = complete_misses;
+}
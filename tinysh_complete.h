@@ -0,0 +1,122 @@
+/**
+ * TinyShell Argument Completion
+ * ---------------------------
+ * Lets TAB complete the arguments of a command, not only its name.
+ *
+ * A command registers a completer. On TAB after the command name the
+ * shell calls it with the index of the argument being typed and the
+ * partial word; the completer offers candidates with
+ * tinysh_complete_add() and the shell does the rest:
+ *
+ * - Candidates not starting with the partial word are dropped
+ * - The word is extended to the longest common prefix
+ * - When that does not help, the candidates are listed in columns,
+ *   a screen at a time; TAB again shows the next page
+ * - Results are cached per command, argument index and partial word,
+ *   so repeated TABs do not call the completer again
+ *
+ * Candidates ending in '/' or '=' are not followed by a space once
+ * complete, so paths and key=value words can go on being completed.
+ *
+ * Example Usage:
+ *
+ * static const char *const modes[] = {"off", "slow", "fast", NULL};
+ * tinysh_complete_register(&fan_cmd, tinysh_complete_words, (void *)modes);
+ *
+ * static void complete_regs(int argi, const char *prefix, void *arg) {
+ *     for (int i = 0; i < REG_COUNT; i++)
+ *         tinysh_complete_add(reg_names[i]);
+ * }
+ * tinysh_complete_register(&peek_cmd, complete_regs, NULL);
+ */
+
+#ifndef TINYSH_COMPLETE_H
+#define TINYSH_COMPLETE_H
+
+#include "tinysh.h"
+
+/* Commands that can have a completer */
+#ifndef COMPLETE_MAX_COMMANDS
+#define COMPLETE_MAX_COMMANDS     16
+#endif
+
+/* Cached results kept at once (least recently used is replaced) */
+#ifndef COMPLETE_CACHE_ENTRIES
+#define COMPLETE_CACHE_ENTRIES    2
+#endif
+
+/* Candidate text kept per cached result, in bytes */
+#ifndef COMPLETE_CACHE_SIZE
+#define COMPLETE_CACHE_SIZE       512
+#endif
+
+/* Candidates kept per cached result */
+#ifndef COMPLETE_MAX_CANDIDATES
+#define COMPLETE_MAX_CANDIDATES   48
+#endif
+
+/* How long a cached result stays valid when a clock is set;
+   without a clock only tinysh_complete_invalidate() drops it */
+#ifndef COMPLETE_CACHE_MS
+#define COMPLETE_CACHE_MS         5000
+#endif
+
+/**
+ * Completer callback
+ *
+ * @param argi   Index of the argument being completed, 1 for the first
+ * @param prefix Partial word typed so far, "" if none
+ * @param arg    Value given to tinysh_complete_register()
+ */
+typedef void (*tinysh_completer_t)(int argi, const char *prefix, void *arg);
+
+/**
+ * Attach a completer to a command
+ *
+ * @param cmd Command (leaf)
+ * @param fn  Completer, NULL to remove it
+ * @param arg Passed to the completer
+ * @return 0 on success, -1 if the table is full
+ */
+int tinysh_complete_register(tinysh_cmd_t *cmd, tinysh_completer_t fn, void *arg);
+
+/**
+ * Offer one candidate, called by completers
+ * Candidates that do not match the partial word are ignored.
+ */
+void tinysh_complete_add(const char *candidate);
+
+/**
+ * Ready-made completer offering a fixed word list for the first argument
+ * arg is a NULL-terminated array of strings.
+ */
+void tinysh_complete_words(int argi, const char *prefix, void *arg);
+
+/**
+ * Drop cached results
+ *
+ * @param cmd Command whose results to drop, NULL for all
+ */
+void tinysh_complete_invalidate(tinysh_cmd_t *cmd);
+
+/**
+ * Complete the arguments of a command, called by the shell on TAB
+ *
+ * @param cmd    Command whose arguments are being typed
+ * @param args   Input line after the command name
+ * @param insert Receives the text to append to the line, always terminated
+ * @param size   Size of insert
+ * @return 1 if candidates were listed and the line must be redrawn,
+ *         0 if not, -1 if the command has no completer
+ */
+int tinysh_complete_args(tinysh_cmd_t *cmd, const char *args, char *insert, int size);
+
+/**
+ * Cache counters
+ *
+ * @param hits   TABs answered from the cache (may be 0)
+ * @param misses TABs that called the completer (may be 0)
+ */
+void tinysh_complete_stats(unsigned long *hits, unsigned long *misses);
+
+#endif /* TINYSH_COMPLETE_H */
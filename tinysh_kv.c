@@ -0,0 +1,640 @@
+#include "tinysh_kv.h"
+#include "tinysh_param.h"
+#include "tinysh_progress.h"
+#include "tinysh.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Sector header */
+#define KV_MAGIC        0x31564B54U  /* "TKV1" */
+#define KV_SEQ_FREE     0xFFFFFFFFU  /* erased, not part of the log */
+#define KV_SEQ_BAD      0            /* no valid header: format when mounting */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t erase_count;
+    uint32_t seq;                    /* position in the log */
+} kv_sector_t;
+
+/* Record header, followed by key and value */
+#define KV_REC_VALUE    0x56         /* 'V' */
+#define KV_REC_DELETE   0x44         /* 'D': the key was removed */
+
+typedef struct {
+    uint16_t vlen;
+    uint8_t klen;
+    uint8_t kind;
+    uint32_t crc;                    /* of the fields above, key and value */
+} kv_record_t;
+
+/* A record with room for its key and value */
+typedef struct {
+    kv_record_t h;
+    char data[KV_MAX_KEY + KV_MAX_VALUE];
+} kv_buf_t;
+
+#define ALIGN4(n)       (((n) + 3UL) & ~3UL)
+#define REC_SIZE(h)     ALIGN4(sizeof(kv_record_t) + (h)->klen + (h)->vlen)
+#define NO_ADDR         0xFFFFFFFFU
+
+/* Index: address of the newest record of each key, linear probing.
+   A removed key keeps its slot, pointing at the removal record, until
+   compaction drops that record. */
+typedef struct {
+    uint32_t hash;
+    uint32_t addr;                   /* NO_ADDR = empty */
+} kv_slot_t;
+
+static const tinysh_flash_t *device = NULL;  /* last device given to mount */
+static char mounted = 0;
+static struct {
+    uint32_t erase_count;
+    uint32_t seq;
+    unsigned long used;              /* bytes written, header included */
+} sectors[KV_MAX_SECTORS];
+static kv_slot_t slots[KV_INDEX_SIZE];
+static int slots_used = 0;
+static int head = -1;                /* sector new records go to */
+static uint32_t next_seq = 1;
+static unsigned long compactions = 0;
+
+/* Forward declarations */
+static unsigned long sector_base(int s);
+static uint32_t record_crc(const kv_buf_t *r);
+static int read_record(unsigned long addr, unsigned long end, kv_buf_t *r);
+static int key_matches(uint32_t addr, const char *key, int klen);
+static int index_find(const char *key, int klen, uint32_t hash);
+static void index_remove(int i);
+static int index_set(const char *key, int klen, uint32_t addr);
+static int format_sector(int s, uint32_t erase_count);
+static int open_head(void);
+static int write_record(kv_buf_t *r, uint32_t *addr);
+static int compact(void);
+static int append(kv_buf_t *r, uint32_t *addr);
+static int put_record(const char *key, int kind, const void *value, int len);
+static void persist_commit(void);
+void save_cmd_handler(int argc, const char **argv);
+void load_cmd_handler(int argc, const char **argv);
+void erase_cmd_handler(int argc, const char **argv);
+
+/* Settings commands */
+tinysh_cmd_t save_cmd = {
+    0, "save", "save parameters to flash", 0,
+    save_cmd_handler, 0, 0, 0
+};
+
+tinysh_cmd_t load_cmd = {
+    0, "load", "load parameters from flash", 0,
+    load_cmd_handler, 0, 0, 0
+};
+
+tinysh_cmd_t erase_cmd = {
+    0, "erase", "erase the settings flash", 0,
+    erase_cmd_handler, 0, 0, 0
+};
+
+/**
+ * Address of a sector
+ */
+static unsigned long sector_base(int s) {
+    return (unsigned long)s * device->sector_size;
+}
+
+/**
+ * CRC of a record
+ */
+static uint32_t record_crc(const kv_buf_t *r) {
+    uint32_t crc = tinysh_crc32(0, &r->h, (int)offsetof(kv_record_t, crc));
+    return tinysh_crc32(crc, r->data, r->h.klen + r->h.vlen);
+}
+
+/**
+ * Read the record at addr, which must end before end
+ * Returns 1 for a valid record, 0 for erased space, -1 if it is damaged.
+ */
+static int read_record(unsigned long addr, unsigned long end, kv_buf_t *r) {
+    if (addr + sizeof(kv_record_t) > end) return 0;
+    if (device->read(addr, &r->h, sizeof(r->h)) < 0) return -1;
+
+    if (r->h.vlen == 0xFFFF && r->h.klen == 0xFF && r->h.kind == 0xFF &&
+        r->h.crc == 0xFFFFFFFFU) {
+        return 0;
+    }
+    if ((r->h.kind != KV_REC_VALUE && r->h.kind != KV_REC_DELETE) ||
+        r->h.klen == 0 || r->h.klen > KV_MAX_KEY || r->h.vlen > KV_MAX_VALUE ||
+        addr + REC_SIZE(&r->h) > end) {
+        return -1;
+    }
+    if (device->read(addr + sizeof(r->h), r->data, r->h.klen + r->h.vlen) < 0) return -1;
+    return record_crc(r) == r->h.crc ? 1 : -1;
+}
+
+/**
+ * Does the record at addr have this key
+ */
+static int key_matches(uint32_t addr, const char *key, int klen) {
+    kv_record_t h;
+    char k[KV_MAX_KEY];
+
+    if (device->read(addr, &h, sizeof(h)) < 0 || h.klen != klen) return 0;
+    if (device->read(addr + sizeof(h), k, klen) < 0) return 0;
+    return memcmp(k, key, (size_t)klen) == 0;
+}
+
+/**
+ * Slot of a key, or the empty slot where it would go
+ * One slot is always empty, so this always finds one.
+ */
+static int index_find(const char *key, int klen, uint32_t hash) {
+    int i, slot = 0;
+
+    for (i = 0; i < KV_INDEX_SIZE; i++) {
+        slot = (int)((hash + (uint32_t)i) & (KV_INDEX_SIZE - 1));
+        if (slots[slot].addr == NO_ADDR) break;
+        if (slots[slot].hash == hash && key_matches(slots[slot].addr, key, klen)) break;
+    }
+    return slot;
+}
+
+/**
+ * Empty a slot, moving later entries of the probe run back into the gap
+ */
+static void index_remove(int i) {
+    int j = i, home;
+
+    slots_used--;
+    for (;;) {
+        slots[i].addr = NO_ADDR;
+        for (;;) {
+            j = (j + 1) & (KV_INDEX_SIZE - 1);
+            if (slots[j].addr == NO_ADDR) return;
+            home = (int)(slots[j].hash & (KV_INDEX_SIZE - 1));
+            /* Entries whose home lies in (i, j] are still reachable */
+            if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) continue;
+            break;
+        }
+        slots[i] = slots[j];
+        i = j;
+    }
+}
+
+/**
+ * Point a key at its newest record
+ */
+static int index_set(const char *key, int klen, uint32_t addr) {
+    uint32_t hash = tinysh_hash(key, klen);
+    int slot = index_find(key, klen, hash);
+
+    if (slots[slot].addr == NO_ADDR) {
+        if (slots_used == KV_INDEX_SIZE - 1) return KV_ERR_FULL;
+        slots[slot].hash = hash;
+        slots_used++;
+    }
+    slots[slot].addr = addr;
+    return KV_OK;
+}
+
+/**
+ * Erase a sector and give it a header
+ */
+static int format_sector(int s, uint32_t erase_count) {
+    kv_sector_t h;
+
+    h.magic = KV_MAGIC;
+    h.erase_count = erase_count;
+    h.seq = KV_SEQ_FREE;
+    sectors[s].erase_count = erase_count;
+    sectors[s].seq = KV_SEQ_BAD;
+    if (device->erase((unsigned short)s) < 0 ||
+        device->write(sector_base(s), &h, sizeof(h)) < 0) {
+        return KV_ERR_IO;
+    }
+    sectors[s].seq = KV_SEQ_FREE;
+    sectors[s].used = sizeof(h);
+    return KV_OK;
+}
+
+/**
+ * Make the least worn free sector the head of the log
+ */
+static int open_head(void) {
+    uint32_t seq = next_seq;
+    int s, best = -1;
+
+    for (s = 0; s < device->sector_count; s++) {
+        if (sectors[s].seq == KV_SEQ_FREE &&
+            (best < 0 || sectors[s].erase_count < sectors[best].erase_count)) {
+            best = s;
+        }
+    }
+    if (best < 0) return KV_ERR_FULL;
+
+    /* The sequence field is still erased, so it can be written once */
+    if (device->write(sector_base(best) + offsetof(kv_sector_t, seq), &seq, sizeof(seq)) < 0) {
+        return KV_ERR_IO;
+    }
+    sectors[best].seq = next_seq++;
+    head = best;
+    return KV_OK;
+}
+
+/**
+ * Write a record at the end of the head sector, which must have room
+ */
+static int write_record(kv_buf_t *r, uint32_t *addr) {
+    *addr = (uint32_t)(sector_base(head) + sectors[head].used);
+    if (device->write(*addr, r, (int)sizeof(r->h) + r->h.klen + r->h.vlen) < 0) {
+        /* Part of the space may be written now: leave the sector alone */
+        sectors[head].used = device->sector_size;
+        return KV_ERR_IO;
+    }
+    sectors[head].used += REC_SIZE(&r->h);
+    return KV_OK;
+}
+
+/**
+ * Reclaim the oldest sector
+ * Its live records are copied to a new head, removal records are dropped
+ * (nothing older can exist), then it is erased and becomes free.
+ */
+static int compact(void) {
+    unsigned long addr, end;
+    uint32_t to;
+    kv_buf_t r;
+    int s, oldest = -1, slot, err;
+
+    for (s = 0; s < device->sector_count; s++) {
+        if (sectors[s].seq != KV_SEQ_FREE && sectors[s].seq != KV_SEQ_BAD &&
+            (oldest < 0 || sectors[s].seq < sectors[oldest].seq)) {
+            oldest = s;
+        }
+    }
+    if (oldest < 0) return KV_ERR_FULL;
+    err = open_head();
+    if (err) return err;
+
+    addr = sector_base(oldest) + sizeof(kv_sector_t);
+    end = sector_base(oldest) + sectors[oldest].used;
+    while (read_record(addr, end, &r) > 0) {
+        slot = index_find(r.data, r.h.klen, tinysh_hash(r.data, r.h.klen));
+        if (slots[slot].addr == addr) {
+            if (r.h.kind == KV_REC_DELETE) {
+                index_remove(slot);
+            } else {
+                err = write_record(&r, &to);
+                if (err) return err;
+                slots[slot].addr = to;
+            }
+        }
+        addr += REC_SIZE(&r.h);
+    }
+
+    compactions++;
+    return format_sector(oldest, sectors[oldest].erase_count + 1);
+}
+
+/**
+ * Append a record to the log, reclaiming space as needed
+ * The last free sector is kept for compaction, so there is always
+ * somewhere to copy live records to.
+ */
+static int append(kv_buf_t *r, uint32_t *addr) {
+    unsigned long size = REC_SIZE(&r->h);
+    int s, tries, nfree, err;
+
+    r->h.crc = record_crc(r);
+    for (tries = 0; tries <= device->sector_count + 1; tries++) {
+        if (head >= 0 && sectors[head].used + size <= device->sector_size) {
+            err = write_record(r, addr);
+            if (err != KV_ERR_IO) return err;
+            continue;                /* try once more in a fresh sector */
+        }
+        for (nfree = 0, s = 0; s < device->sector_count; s++) {
+            nfree += sectors[s].seq == KV_SEQ_FREE;
+        }
+        err = nfree > 1 ? open_head() : compact();
+        if (err) return err;
+    }
+    return KV_ERR_FULL;
+}
+
+/**
+ * Append a value or removal record and index it
+ */
+static int put_record(const char *key, int kind, const void *value, int len) {
+    kv_buf_t r;
+    uint32_t addr;
+    int klen = (int)strlen(key), slot, err;
+
+    if (!mounted) return KV_ERR_NOT_MOUNTED;
+    if (klen == 0 || klen > KV_MAX_KEY || len < 0 || len > KV_MAX_VALUE) return KV_ERR_TOO_LONG;
+
+    /* A new key needs an index slot: check before writing anything */
+    slot = index_find(key, klen, tinysh_hash(key, klen));
+    if (slots[slot].addr == NO_ADDR && slots_used == KV_INDEX_SIZE - 1) return KV_ERR_FULL;
+
+    r.h.vlen = (uint16_t)len;
+    r.h.klen = (uint8_t)klen;
+    r.h.kind = (uint8_t)kind;
+    memcpy(r.data, key, (size_t)klen);
+    if (len) memcpy(r.data + klen, value, (size_t)len);
+
+    err = append(&r, &addr);
+    if (err) return err;
+
+    /* Compaction may have moved slots: look the key up again */
+    return index_set(key, klen, addr);
+}
+
+/**
+ * Mount the store
+ */
+int tinysh_kv_mount(const tinysh_flash_t *flash) {
+    unsigned short order[KV_MAX_SECTORS];
+    unsigned long addr, end;
+    uint32_t max_erase = 0;
+    kv_sector_t h;
+    kv_buf_t r;
+    int s, i, n = 0, rc, err;
+
+    mounted = 0;
+    head = -1;
+    device = NULL;
+    if (!flash) return KV_OK;
+    if (flash->sector_count < 2 || flash->sector_count > KV_MAX_SECTORS ||
+        flash->sector_size % 4 ||
+        flash->sector_size < sizeof(kv_sector_t) + ALIGN4(sizeof(kv_record_t) + KV_MAX_KEY + KV_MAX_VALUE)) {
+        return KV_ERR_GEOMETRY;
+    }
+    device = flash;
+
+    memset(slots, 0xFF, sizeof(slots));
+    slots_used = 0;
+    next_seq = 1;
+    compactions = 0;
+
+    /* Sector headers; sectors in the log sorted by sequence number */
+    for (s = 0; s < flash->sector_count; s++) {
+        if (flash->read(sector_base(s), &h, sizeof(h)) < 0) return KV_ERR_IO;
+        sectors[s].used = sizeof(h);
+        if (h.magic != KV_MAGIC || h.seq == KV_SEQ_BAD) {
+            sectors[s].seq = KV_SEQ_BAD;
+            continue;
+        }
+        sectors[s].seq = h.seq;
+        sectors[s].erase_count = h.erase_count;
+        if (h.erase_count > max_erase) max_erase = h.erase_count;
+        if (h.seq == KV_SEQ_FREE) continue;
+
+        for (i = n++; i > 0 && sectors[order[i - 1]].seq > h.seq; i--) order[i] = order[i - 1];
+        order[i] = (unsigned short)s;
+    }
+
+    /* Sectors without a header: their erase count is lost, assume the worst */
+    for (s = 0; s < flash->sector_count; s++) {
+        if (sectors[s].seq == KV_SEQ_BAD) {
+            err = format_sector(s, max_erase);
+            if (err) return err;
+        }
+    }
+
+    /* Replay the log, oldest first; a damaged record ends its sector */
+    for (i = 0; i < n; i++) {
+        s = order[i];
+        addr = sector_base(s) + sizeof(kv_sector_t);
+        end = sector_base(s) + flash->sector_size;
+        while ((rc = read_record(addr, end, &r)) > 0) {
+            if (index_set(r.data, r.h.klen, (uint32_t)addr) != KV_OK) return KV_ERR_FULL;
+            addr += REC_SIZE(&r.h);
+        }
+        sectors[s].used = rc < 0 ? flash->sector_size : addr - sector_base(s);
+        head = s;
+        next_seq = sectors[s].seq + 1;
+    }
+
+    mounted = 1;
+    return KV_OK;
+}
+
+/**
+ * Device last given to mount
+ */
+const tinysh_flash_t *tinysh_kv_device(void) {
+    return device;
+}
+
+/**
+ * Read a value
+ */
+int tinysh_kv_get(const char *key, void *value, int size) {
+    int klen = (int)strlen(key), slot;
+    unsigned long addr;
+    kv_buf_t r;
+
+    if (!mounted) return KV_ERR_NOT_MOUNTED;
+    if (klen == 0 || klen > KV_MAX_KEY) return KV_ERR_NOT_FOUND;
+
+    slot = index_find(key, klen, tinysh_hash(key, klen));
+    if (slots[slot].addr == NO_ADDR) return KV_ERR_NOT_FOUND;
+
+    addr = slots[slot].addr;
+    if (read_record(addr, addr - addr % device->sector_size + device->sector_size, &r) <= 0) {
+        return KV_ERR_IO;
+    }
+    if (r.h.kind == KV_REC_DELETE) return KV_ERR_NOT_FOUND;
+
+    if (size > 0) memcpy(value, r.data + klen, (size_t)(size < r.h.vlen ? size : r.h.vlen));
+    return r.h.vlen;
+}
+
+/**
+ * Store a value
+ */
+int tinysh_kv_put(const char *key, const void *value, int len) {
+    return put_record(key, KV_REC_VALUE, value, len);
+}
+
+/**
+ * Remove a key
+ */
+int tinysh_kv_delete(const char *key) {
+    int err = tinysh_kv_get(key, NULL, 0);
+
+    if (err < 0) return err;
+    return put_record(key, KV_REC_DELETE, NULL, 0);
+}
+
+/**
+ * Store usage
+ */
+void tinysh_kv_stats(tinysh_kv_stats_t *stats) {
+    kv_record_t h;
+    int s, i;
+
+    memset(stats, 0, sizeof(*stats));
+    if (!mounted) return;
+
+    stats->sectors = device->sector_count;
+    stats->total_bytes = device->sector_size * device->sector_count;
+    stats->erase_min = 0xFFFFFFFFUL;
+    stats->compactions = compactions;
+    for (s = 0; s < device->sector_count; s++) {
+        if (sectors[s].seq == KV_SEQ_FREE) stats->free_sectors++;
+        stats->used_bytes += sectors[s].used;
+        if (sectors[s].erase_count < stats->erase_min) stats->erase_min = sectors[s].erase_count;
+        if (sectors[s].erase_count > stats->erase_max) stats->erase_max = sectors[s].erase_count;
+    }
+    for (i = 0; i < KV_INDEX_SIZE; i++) {
+        if (slots[i].addr != NO_ADDR && device->read(slots[i].addr, &h, sizeof(h)) == 0 &&
+            h.kind == KV_REC_VALUE) {
+            stats->keys++;
+        }
+    }
+}
+
+/**
+ * Write changed parameters
+ */
+int tinysh_kv_save_params(int *unchanged) {
+    char text[24], stored[24];
+    tinysh_param_t *p;
+    int i, len, n, err, saved = 0, same = 0;
+
+    if (unchanged) *unchanged = 0;
+    if (!mounted) return KV_ERR_NOT_MOUNTED;
+
+    for (i = 0; (p = tinysh_param_at(i)) != NULL; i++) {
+        len = tinysh_param_format(p, text, sizeof(text));
+        if (len >= (int)sizeof(text)) len = (int)sizeof(text) - 1;
+
+        n = tinysh_kv_get(p->name, stored, sizeof(stored));
+        if (n == len && memcmp(stored, text, (size_t)len) == 0) {
+            same++;
+            continue;
+        }
+        err = tinysh_kv_put(p->name, text, len);
+        if (err) return err;
+        saved++;
+    }
+    if (unchanged) *unchanged = same;
+    return saved;
+}
+
+/**
+ * Set parameters from stored values
+ */
+int tinysh_kv_load_params(void) {
+    char text[24];
+    tinysh_param_t *p;
+    int i, n, loaded = 0;
+
+    if (!mounted) return KV_ERR_NOT_MOUNTED;
+
+    for (i = 0; (p = tinysh_param_at(i)) != NULL; i++) {
+        n = tinysh_kv_get(p->name, text, sizeof(text));
+        if (n == KV_ERR_NOT_FOUND || n > (int)sizeof(text)) continue;
+        if (n < 0) return n;
+        if (tinysh_param_set(p, text, n) == PARAM_OK) loaded++;
+    }
+    return loaded;
+}
+
+/**
+ * Error message for a KV_ERR_* code
+ */
+const char *tinysh_kv_error(int err) {
+    switch (err) {
+    case KV_OK:              return "ok";
+    case KV_ERR_NOT_FOUND:   return "not found";
+    case KV_ERR_FULL:        return "store full";
+    case KV_ERR_IO:          return "flash error";
+    case KV_ERR_NOT_MOUNTED: return "store not mounted";
+    case KV_ERR_TOO_LONG:    return "key or value too long";
+    case KV_ERR_GEOMETRY:    return "unusable flash geometry";
+    default:                 return "error";
+    }
+}
+
+/**
+ * Commit hook: a committed transaction is saved in one go
+ */
+static void persist_commit(void) {
+    int n;
+
+    if (!mounted) return;
+    n = tinysh_kv_save_params(NULL);
+    if (n < 0) tinysh_printf("Not saved: %s\r\n", tinysh_kv_error(n));
+}
+
+/**
+ * Save command handler
+ */
+void save_cmd_handler(int argc, const char **argv) {
+    tinysh_kv_stats_t st;
+    int n, same;
+    (void)argc;
+    (void)argv;
+
+    n = tinysh_kv_save_params(&same);
+    if (n < 0) {
+        tinysh_printf("save: %s\r\n", tinysh_kv_error(n));
+        return;
+    }
+    tinysh_kv_stats(&st);
+    tinysh_printf("Saved %d parameter%s, %d unchanged\r\n", n, n == 1 ? "" : "s", same);
+    tinysh_printf("Flash: %lu of %lu bytes used, %u sectors free, erased %lu..%lu times\r\n",
+                  st.used_bytes, st.total_bytes, st.free_sectors, st.erase_min, st.erase_max);
+}
+
+/**
+ * Load command handler
+ */
+void load_cmd_handler(int argc, const char **argv) {
+    int n;
+    (void)argc;
+    (void)argv;
+
+    n = tinysh_kv_load_params();
+    if (n < 0) {
+        tinysh_printf("load: %s\r\n", tinysh_kv_error(n));
+        return;
+    }
+    tinysh_printf("Loaded %d parameter%s\r\n", n, n == 1 ? "" : "s");
+}
+
+/**
+ * Erase command handler
+ * Works on a store that failed to mount, to recover from a full index.
+ */
+void erase_cmd_handler(int argc, const char **argv) {
+    const tinysh_flash_t *flash = device;
+    int s, err = KV_OK;
+    (void)argc;
+    (void)argv;
+
+    if (!flash) {
+        tinysh_printf("erase: %s\r\n", tinysh_kv_error(KV_ERR_NOT_MOUNTED));
+        return;
+    }
+
+    mounted = 0;
+    tinysh_progress_begin("Erasing", flash->sector_count);
+    for (s = 0; s < flash->sector_count && err == KV_OK; s++) {
+        err = format_sector(s, sectors[s].erase_count + 1);
+        tinysh_progress_update((unsigned long)s + 1);
+    }
+    tinysh_progress_end();
+
+    if (err == KV_OK) err = tinysh_kv_mount(flash);
+    if (err != KV_OK) tinysh_printf("erase: %s\r\n", tinysh_kv_error(err));
+}
+
+/**
+ * Register the settings commands and save committed transactions
+ */
+void tinysh_kv_init(void) {
+    tinysh_add_command(&save_cmd);
+    tinysh_add_command(&load_cmd);
+    tinysh_add_command(&erase_cmd);
+    tinysh_param_on_commit(persist_commit);
+}
@@ -0,0 +1,176 @@
+/**
+ * TinyShell Settings Store
+ * -----------------------
+ * Key/value store on raw flash, so settings changed from the shell survive
+ * a reset without every handler inventing its own flash layout.
+ *
+ * Features:
+ * - Append-only log: a change adds a record, nothing is rewritten in
+ *   place, so a sector is only erased when its space is reclaimed
+ * - CRC per record; a torn write loses that record, never older ones
+ * - Compaction copies the live records out of the oldest sector into a
+ *   spare one, then erases the old sector
+ * - Wear levelling: the log rotates through every sector, and a new head
+ *   sector is the free one erased the fewest times
+ * - RAM hash index built once when mounting; lookups read one record
+ * - "save", "load" and "erase" commands to keep parameters (tinysh_param.h)
+ *   in the store; a committed parameter transaction is saved at once
+ *
+ * Flash layout: each sector starts with a header (magic, erase count,
+ * sequence number), followed by records of a header (lengths, kind,
+ * CRC), the key and the value, padded to 4 bytes. The sector with the
+ * highest sequence number is the head that new records go to.
+ *
+ * Example Usage:
+ *
+ * static const tinysh_flash_t flash = {
+ *     4096, 4, flash_read, flash_write, flash_erase
+ * };
+ *
+ * tinysh_kv_init();
+ * if (tinysh_kv_mount(&flash) == KV_OK) tinysh_kv_load_params();
+ *
+ * tinysh> set fan=75
+ * tinysh> save
+ * Saved 1 parameter, 3 unchanged
+ */
+
+#ifndef TINYSH_KV_H
+#define TINYSH_KV_H
+
+#include "tinysh.h"
+
+/* Longest key and value */
+#ifndef KV_MAX_KEY
+#define KV_MAX_KEY                32
+#endif
+#ifndef KV_MAX_VALUE
+#define KV_MAX_VALUE              64
+#endif
+
+/* Keys that can be stored, a power of two; one slot is always left free */
+#ifndef KV_INDEX_SIZE
+#define KV_INDEX_SIZE             64
+#endif
+
+/* Most sectors a flash device may have */
+#ifndef KV_MAX_SECTORS
+#define KV_MAX_SECTORS            16
+#endif
+
+/* Results */
+#define KV_OK                     0
+#define KV_ERR_NOT_FOUND          -1    // No such key
+#define KV_ERR_FULL               -2    // Live data fills the flash, or the index
+#define KV_ERR_IO                 -3    // Flash driver failed
+#define KV_ERR_NOT_MOUNTED        -4    // tinysh_kv_mount() not called or failed
+#define KV_ERR_TOO_LONG           -5    // Key or value too long
+#define KV_ERR_GEOMETRY           -6    // Sector size or count not usable
+
+/**
+ * Flash device
+ * Erased bytes read as 0xFF; a write may only clear bits, as on NOR
+ * flash. Driver functions return 0 on success, -1 on failure.
+ */
+typedef struct {
+    unsigned long sector_size;       // Bytes, a multiple of 4
+    unsigned short sector_count;     // 2..KV_MAX_SECTORS
+    int (*read)(unsigned long addr, void *buf, int len);
+    int (*write)(unsigned long addr, const void *buf, int len);
+    int (*erase)(unsigned short sector);
+} tinysh_flash_t;
+
+/* Store usage */
+typedef struct {
+    unsigned short sectors;          // Sectors in the device
+    unsigned short free_sectors;     // Erased and unused
+    unsigned long used_bytes;        // Written, live or not
+    unsigned long total_bytes;       // Size of the device
+    unsigned short keys;             // Live keys
+    unsigned long erase_min;         // Fewest and most erases of any sector
+    unsigned long erase_max;
+    unsigned long compactions;       // Since mounting
+} tinysh_kv_stats_t;
+
+/**
+ * Mount the store: check every sector and build the index
+ * Sectors that were never formatted (or lost their header in a
+ * power cut during an erase) are erased.
+ *
+ * @param flash Device, must stay valid; NULL unmounts
+ * @return KV_OK, KV_ERR_GEOMETRY, KV_ERR_FULL (index) or KV_ERR_IO
+ */
+int tinysh_kv_mount(const tinysh_flash_t *flash);
+
+/**
+ * Device last given to tinysh_kv_mount(), mounted or not
+ *
+ * @return Device, NULL if none
+ */
+const tinysh_flash_t *tinysh_kv_device(void);
+
+/**
+ * Read a value
+ *
+ * @param key   Key, terminated
+ * @param value Receives the value, not terminated
+ * @param size  Size of value
+ * @return Length of the value (which may exceed size), or KV_ERR_*
+ */
+int tinysh_kv_get(const char *key, void *value, int size);
+
+/**
+ * Store a value, replacing any older one
+ *
+ * @param key   Key, terminated, 1..KV_MAX_KEY characters
+ * @param value Value bytes
+ * @param len   Length of value, 0..KV_MAX_VALUE
+ * @return KV_OK or KV_ERR_*
+ */
+int tinysh_kv_put(const char *key, const void *value, int len);
+
+/**
+ * Remove a key
+ *
+ * @return KV_OK, KV_ERR_NOT_FOUND or another KV_ERR_*
+ */
+int tinysh_kv_delete(const char *key);
+
+/**
+ * Store usage
+ */
+void tinysh_kv_stats(tinysh_kv_stats_t *stats);
+
+/**
+ * Write every parameter whose stored value differs, as text
+ *
+ * @param unchanged Receives the number already up to date, can be NULL
+ * @return Number written, or KV_ERR_*
+ */
+int tinysh_kv_save_params(int *unchanged);
+
+/**
+ * Set every parameter that has a stored value, through tinysh_param_set()
+ * Stored values that no longer parse (range changed) are skipped.
+ *
+ * @return Number of parameters set, or KV_ERR_*
+ */
+int tinysh_kv_load_params(void);
+
+/**
+ * Error message for a KV_ERR_* code
+ */
+const char *tinysh_kv_error(int err);
+
+/**
+ * Register the save, load and erase commands, and save parameters
+ * after each committed transaction
+ */
+void tinysh_kv_init(void);
+
+/* Settings commands */
+extern tinysh_cmd_t save_cmd;
+extern tinysh_cmd_t load_cmd;
+extern tinysh_cmd_t erase_cmd;
+
+#endif /* TINYSH_KV_H */
@@ -0,0 +1,334 @@
+#include "tinysh_memo.h"
+#include "tinysh_term.h"
+#include "tinysh_table.h"
+#include "tinysh_complete.h"
+#include "tinysh.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Room for one printf while recording; longer ones are formatted twice */
+#define MEMO_PRINTF_SIZE BUFFER_SIZE
+
+/* Opted-in commands */
+static struct {
+    tinysh_cmd_t *cmd;
+    unsigned short ttl_ms;
+} memo_rules[MEMO_MAX_COMMANDS];
+
+/* What a call's output depends on besides the command */
+typedef struct {
+    uint32_t hash;                   /* of all below, to skip most compares */
+    unsigned char auth;
+    unsigned char profile;
+    unsigned char format;
+    unsigned short len;
+    char args[MEMO_ARGS_SIZE];       /* argv[1..], each terminated */
+} memo_key_t;
+
+/* Cached outputs */
+static struct {
+    tinysh_cmd_t *cmd;               /* NULL = free */
+    memo_key_t key;
+    unsigned long expires;
+    unsigned long last_used;
+    unsigned short len;
+    char out[MEMO_OUTPUT_SIZE];
+} memo_cache[MEMO_CACHE_ENTRIES];
+
+static unsigned long memo_hits = 0;
+static unsigned long memo_misses = 0;
+static unsigned long memo_generation = 0;   /* bumped by invalidation */
+
+/* Recording state */
+static char recording = 0;
+static char rec_overflow = 0;
+static char *rec_buf = NULL;
+static int rec_len = 0;
+static void (*fwd_char_out)(unsigned char);
+static int (*fwd_printf)(const char *, ...);
+static void (*fwd_block_out)(const char *, int);
+
+/* Forward declarations */
+static int find_rule(tinysh_cmd_t *cmd);
+static int make_key(int argc, const char **argv, memo_key_t *key);
+static int same_key(const memo_key_t *a, const memo_key_t *b);
+static void record(const char *s, int len);
+static void rec_char_out(unsigned char c);
+static int rec_printf(const char *fmt, ...);
+static void rec_block_out(const char *buf, int len);
+void memo_cmd_handler(int argc, const char **argv);
+
+/* Memo command */
+static const char *const memo_words[] = {"flush", NULL};
+tinysh_cmd_t memo_cmd = {
+    0, "memo", "show or flush cached command output", "[flush]",
+    memo_cmd_handler, 0, 0, 0
+};
+
+/**
+ * Index of a command's rule, -1 if it did not opt in
+ */
+static int find_rule(tinysh_cmd_t *cmd) {
+    int i;
+
+    for (i = 0; i < MEMO_MAX_COMMANDS; i++) {
+        if (memo_rules[i].cmd == cmd && memo_rules[i].ttl_ms) return i;
+    }
+    return -1;
+}
+
+/**
+ * Is a command cached
+ */
+int tinysh_memo_enabled(tinysh_cmd_t *cmd) {
+    return find_rule(cmd) >= 0;
+}
+
+/**
+ * Cache key: arguments plus everything else that changes the output
+ *
+ * @return 0, or -1 if the arguments do not fit MEMO_ARGS_SIZE
+ */
+static int make_key(int argc, const char **argv, memo_key_t *key) {
+    uint32_t hash = 2166136261U;
+    int i, n;
+
+    key->len = 0;
+    for (i = 1; i < argc; i++) {
+        n = tinysh_strlen(argv[i]) + 1;
+        if (key->len + n > MEMO_ARGS_SIZE) return -1;
+        memcpy(key->args + key->len, argv[i], (size_t)n);
+        key->len += (unsigned short)n;
+        hash = (hash * 16777619U) ^ tinysh_hash(argv[i], n - 1);
+    }
+    key->auth = tinysh_get_auth_level();
+    key->profile = (unsigned char)tinysh_term_profile_id();
+    key->format = (unsigned char)tinysh_table_format();
+    hash = (hash * 16777619U) ^ key->auth;
+    hash = (hash * 16777619U) ^ key->profile;
+    hash = (hash * 16777619U) ^ key->format;
+    key->hash = hash;
+    return 0;
+}
+
+/**
+ * Do two keys stand for the same call
+ */
+static int same_key(const memo_key_t *a, const memo_key_t *b) {
+    return a->hash == b->hash && a->auth == b->auth && a->profile == b->profile &&
+           a->format == b->format && a->len == b->len &&
+           memcmp(a->args, b->args, a->len) == 0;
+}
+
+/**
+ * Append output to the recording
+ */
+static void record(const char *s, int len) {
+    if (rec_overflow) return;
+    if (rec_len + len > MEMO_OUTPUT_SIZE) {
+        rec_overflow = 1;
+        return;
+    }
+    memcpy(rec_buf + rec_len, s, (size_t)len);
+    rec_len += len;
+}
+
+/**
+ * Recording output hooks: record, then pass on to the port
+ */
+static void rec_char_out(unsigned char c) {
+    char ch = (char)c;
+    record(&ch, 1);
+    fwd_char_out(c);
+}
+
+static int rec_printf(const char *fmt, ...) {
+    char buf[MEMO_PRINTF_SIZE];
+    va_list ap, again;
+    int n;
+
+    va_start(ap, fmt);
+    va_copy(again, ap);
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    if (n < 0) {
+        va_end(again);
+        return n;
+    }
+    if (n < (int)sizeof(buf)) {
+        record(buf, n);
+        va_end(again);
+        return fwd_printf("%s", buf);
+    }
+
+    /* Too long to record anyway; format it once more in full */
+    rec_overflow = 1;
+    {
+        char big[n + 1];
+        vsnprintf(big, sizeof(big), fmt, again);
+        va_end(again);
+        return fwd_printf("%s", big);
+    }
+}
+
+static void rec_block_out(const char *buf, int len) {
+    record(buf, len);
+    fwd_block_out(buf, len);
+}
+
+/**
+ * Opt a command in or out
+ */
+int tinysh_memo_enable(tinysh_cmd_t *cmd, unsigned short ttl_ms) {
+    int i, free_slot = -1;
+
+    tinysh_memo_invalidate(cmd);
+    for (i = 0; i < MEMO_MAX_COMMANDS; i++) {
+        if (memo_rules[i].cmd == cmd) {
+            memo_rules[i].ttl_ms = ttl_ms;
+            if (!ttl_ms) memo_rules[i].cmd = NULL;
+            return 0;
+        }
+        if (!memo_rules[i].cmd && free_slot < 0) free_slot = i;
+    }
+    if (!ttl_ms) return 0;
+    if (free_slot < 0) return -1;
+
+    memo_rules[free_slot].cmd = cmd;
+    memo_rules[free_slot].ttl_ms = ttl_ms;
+    return 0;
+}
+
+/**
+ * Drop cached outputs
+ */
+void tinysh_memo_invalidate(tinysh_cmd_t *cmd) {
+    int i;
+
+    memo_generation++;
+    for (i = 0; i < MEMO_CACHE_ENTRIES; i++) {
+        if (!cmd || memo_cache[i].cmd == cmd) memo_cache[i].cmd = NULL;
+    }
+}
+
+/**
+ * Run a handler or replay its output
+ */
+void tinysh_memo_call(tinysh_cmd_t *cmd, int argc, const char **argv) {
+    unsigned long now, generation;
+    memo_key_t key;
+    int rule, i, plain, slot = -1;
+
+    rule = find_rule(cmd);
+    if (rule < 0 || recording || !tinysh_millis || !tinysh_char_out || !tinysh_printf ||
+        make_key(argc, argv, &key) < 0) {
+        cmd->function(argc, argv);
+        return;
+    }
+
+    now = tinysh_time_ms();
+
+    for (i = 0; i < MEMO_CACHE_ENTRIES; i++) {
+        if (memo_cache[i].cmd == cmd && same_key(&memo_cache[i].key, &key)) {
+            if ((long)(now - memo_cache[i].expires) < 0) {
+                memo_hits++;
+                memo_cache[i].last_used = now;
+                tinysh_write(memo_cache[i].out, memo_cache[i].len);
+                return;
+            }
+            slot = i;   /* stale: refresh in place */
+            break;
+        }
+    }
+
+    /* Free entry, or the least recently used one */
+    if (slot < 0) {
+        slot = 0;
+        for (i = 0; i < MEMO_CACHE_ENTRIES; i++) {
+            if (!memo_cache[i].cmd) {
+                slot = i;
+                break;
+            }
+            if ((long)(memo_cache[i].last_used - memo_cache[slot].last_used) < 0) slot = i;
+        }
+    }
+
+    memo_misses++;
+    memo_cache[slot].cmd = NULL;
+
+    /* Run the handler with output recorded into the entry */
+    recording = 1;
+    rec_overflow = 0;
+    rec_buf = memo_cache[slot].out;
+    rec_len = 0;
+    generation = memo_generation;
+    fwd_char_out = tinysh_char_out;
+    fwd_printf = tinysh_printf;
+    fwd_block_out = tinysh_block_out;
+    tinysh_out(rec_char_out);
+    tinysh_print_out(rec_printf);
+    if (fwd_block_out) tinysh_write_out(rec_block_out);
+    plain = tinysh_term_plain(1);  /* replayed to whoever asks next */
+
+    cmd->function(argc, argv);
+
+    tinysh_term_plain(plain);
+    tinysh_char_out = fwd_char_out;
+    tinysh_printf = fwd_printf;
+    tinysh_block_out = fwd_block_out;
+    recording = 0;
+
+    /* Keep it unless it did not fit or the handler invalidated meanwhile */
+    if (rec_overflow || generation != memo_generation) return;
+
+    now = tinysh_time_ms();
+    memo_cache[slot].cmd = cmd;
+    memo_cache[slot].key = key;
+    memo_cache[slot].len = (unsigned short)rec_len;
+    memo_cache[slot].expires = now + memo_rules[rule].ttl_ms;
+    memo_cache[slot].last_used = now;
+}
+
+/**
+ * Cache counters
+ */
+void tinysh_memo_stats(unsigned long *hits, unsigned long *misses) {
+    if (hits) *hits = memo_hits;
+    if (misses) *misses = memo_misses;
+}
+
+/**
+ * Memo command handler
+ */
+void memo_cmd_handler(int argc, const char **argv) {
+    int i, cached;
+
+    if (argc > 1) {
+        if (strcmp(argv[1], "flush") != 0) {
+            tinysh_printf("Usage: memo [flush]\r\n");
+            return;
+        }
+        tinysh_memo_invalidate(NULL);
+    }
+
+    for (i = 0; i < MEMO_MAX_COMMANDS; i++) {
+        if (!memo_rules[i].cmd) continue;
+        cached = 0;
+        for (int j = 0; j < MEMO_CACHE_ENTRIES; j++) {
+            if (memo_cache[j].cmd == memo_rules[i].cmd) cached++;
+        }
+        tinysh_printf("%-12s ttl %u ms, %d cached\r\n", memo_rules[i].cmd->name,
+                      (unsigned)memo_rules[i].ttl_ms, cached);
+    }
+    tinysh_printf("Hits: %lu  Misses: %lu\r\n", memo_hits, memo_misses);
+}
+
+/**
+ * Register the memo command
+ */
+void tinysh_memo_init(void) {
+    tinysh_add_command(&memo_cmd);
+    tinysh_complete_register(&memo_cmd, tinysh_complete_words, (void *)memo_words);
+}
@@ -0,0 +1,99 @@
+/**
+ * TinyShell Command Memoization
+ * ---------------------------
+ * Replays the last output of idempotent commands instead of running them
+ * again, for automation that polls the same command many times a second.
+ *
+ * A command opts in with a time-to-live. While an entry for the same
+ * command, arguments, auth level and output format is younger than the
+ * TTL, the shell sends the recorded output with a single
+ * tinysh_write() and does not call the handler. Outputs larger than
+ * MEMO_OUTPUT_SIZE are never cached, nor are calls whose arguments take
+ * more than MEMO_ARGS_SIZE bytes: each entry keeps its arguments to
+ * compare in full, so two calls never share an entry by hash alone.
+ *
+ * Handlers whose state changed call tinysh_memo_invalidate() so the next
+ * call runs the handler again.
+ *
+ * Example Usage:
+ *
+ * tinysh_add_command(&sysinfo_cmd);
+ * tinysh_memo_enable(&sysinfo_cmd, 1000);     // cacheable for 1 s
+ *
+ * void set_led(int argc, const char **argv) {
+ *     ...
+ *     tinysh_memo_invalidate(&status_cmd);     // status output changed
+ * }
+ */
+
+#ifndef TINYSH_MEMO_H
+#define TINYSH_MEMO_H
+
+#include "tinysh.h"
+
+/* Commands that can opt in */
+#ifndef MEMO_MAX_COMMANDS
+#define MEMO_MAX_COMMANDS         8
+#endif
+
+/* Cached outputs kept at once (least recently used is replaced) */
+#ifndef MEMO_CACHE_ENTRIES
+#define MEMO_CACHE_ENTRIES        4
+#endif
+
+/* Largest output that is cached, in bytes */
+#ifndef MEMO_OUTPUT_SIZE
+#define MEMO_OUTPUT_SIZE          512
+#endif
+
+/* Argument bytes kept per entry, one terminator each included */
+#ifndef MEMO_ARGS_SIZE
+#define MEMO_ARGS_SIZE            64
+#endif
+
+/**
+ * Mark a command as idempotent and cacheable
+ *
+ * @param cmd    Command
+ * @param ttl_ms How long an output stays valid, 0 to opt out again
+ * @return 0 on success, -1 if the table is full
+ */
+int tinysh_memo_enable(tinysh_cmd_t *cmd, unsigned short ttl_ms);
+
+/**
+ * Is a command cached
+ *
+ * @return 1 if tinysh_memo_enable() opted it in, 0 otherwise
+ */
+int tinysh_memo_enabled(tinysh_cmd_t *cmd);
+
+/**
+ * Drop cached outputs
+ *
+ * @param cmd Command whose outputs to drop, NULL for all
+ */
+void tinysh_memo_invalidate(tinysh_cmd_t *cmd);
+
+/**
+ * Run a command's handler, or replay its cached output
+ * Called by the shell for every command it executes.
+ */
+void tinysh_memo_call(tinysh_cmd_t *cmd, int argc, const char **argv);
+
+/**
+ * Cache counters
+ *
+ * @param hits   Calls answered from the cache (may be 0)
+ * @param misses Calls of opted-in commands that ran the handler (may be 0)
+ */
+void tinysh_memo_stats(unsigned long *hits, unsigned long *misses);
+
+/**
+ * Register the memo command
+ */
+void tinysh_memo_init(void);
+
+/* Memo command */
+extern tinysh_cmd_t memo_cmd;
+
+#endif /* TINYSH_MEMO_H */
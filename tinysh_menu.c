@@ -1,5 +1,7 @@
 #include "tinysh_menu.h"
 #include "tinysh.h"
+#include "tinysh_term.h"
+#include "tinysh_param.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -16,6 +18,27 @@ static int arg_buffer_index = 0;  /* Keep as int for potential large buffers */
 static const char *arg_title = NULL;
 static const char *arg_param_desc = NULL;
 
+/* Screen rows used by display_menu_header(): blank, title, help, separator */
+#define MENU_HEADER_ROWS 4
+
+/* Live item bookkeeping for the menu on screen, indexed by item. Only a
+   hash of the value text is kept: a refresh redraws the field when the
+   hash differs, so an unchanged dashboard costs no output at all. */
+static struct {
+    uint32_t hash;                /* hash of the value text on screen */
+    unsigned long next_refresh;   /* tinysh_time_ms() of next render */
+    unsigned char col;            /* 1-based screen column of the value */
+} live_state[MENU_MAX_ITEMS];
+static unsigned char visible_count = 0;  /* items drawn by last display */
+
+/* Footer rows: separator, pagination line and separator, cursor line */
+#define MENU_FOOTER_ROWS 4
+
+/* Layout of the last full display, compared on resize */
+static unsigned char drawn_count = 0;
+static int drawn_width = 0;
+static int drawn_profile = 0;
+
 /* Forward declarations */
 static void navigate_menu(int direction);
 static void display_menu_header(void);
@@ -27,6 +50,12 @@ static void clear_screen(void);
 static void prompt_for_arguments(const char *title, const char *param_desc, void (*function_arg)(int argc, const char **argv));
 static void start_argument_collection(const char *title, const char *param_desc, void (*function_arg)(int argc, const char **argv));
 static int handle_argument_input(char c); /* Keep return as int for compatibility */
+static int live_render(tinysh_menu_item_t *item, char *buf);
+static int refresh_live_items(char force);
+static unsigned char menu_viewport_items(void);
+static int menu_width(void);
+static void print_separator(void);
+static void menu_on_term_change(int reason);
 
 /* Storage for the dynamic command menu. The full definition lives up
    here so menu functions defined further down the file can see it
@@ -51,26 +80,36 @@ tinysh_cmd_t menu_cmd = {
     menu_cmd_handler, 0, 0, 0
 };
 
+/* Set while a style from the active profile is in effect */
+static char theme_active = 0;
+
 /**
- * Apply a color theme and return to previous position
- * Memory-efficient approach: doesn't allocate any memory
+ * Apply a theme role from the active rendering profile
+ * Memory-efficient approach: the escape strings are const tables
  */
-static void apply_theme(const char* color_code) {
+static void apply_theme(int role) {
 #if MENU_COLOR_ENABLED
-    if (color_code && *color_code) {
-        tinysh_printf("%s", color_code);
+    const char *sgr = tinysh_term_profile()->sgr[role];
+
+    if (*sgr) {
+        tinysh_printf("%s", sgr);
+        theme_active = 1;
     }
 #else
-    (void)color_code; // Prevent unused parameter warning
+    (void)role; // Prevent unused parameter warning
 #endif
 }
 
 /**
  * Reset colors to default terminal colors
+ * Nothing is sent when no style was applied since the last reset.
  */
 static void reset_theme(void) {
 #if MENU_COLOR_ENABLED
-    tinysh_printf("%s", COLOR_RESET);
+    if (theme_active) {
+        tinysh_printf("%s", tinysh_term_profile()->sgr[TERM_ROLE_RESET]);
+        theme_active = 0;
+    }
 #endif
 }
 
@@ -88,6 +127,9 @@ void tinysh_menu_init(tinysh_menu_t *root_menu) {
     
     /* Register the menu command */
     tinysh_add_command(&menu_cmd);
+
+    /* Follow terminal size and rendering profile changes */
+    tinysh_term_on_change(menu_on_term_change);
 }
 
 /**
@@ -124,14 +166,23 @@ void tinysh_menu_enter(void) {
 void tinysh_menu_exit(void) {
     if (!in_menu_mode) return;
     
-    in_menu_mode = 0;
-    tinysh_printf("\r\n");
-    tinysh_reset_context();  /* Reset shell context */
+    tinysh_menu_leave();
     
     /* Restore shell prompt */
     tinysh_char_in('\r');
 }
 
+/**
+ * Leave menu mode without a new shell prompt
+ */
+void tinysh_menu_leave(void) {
+    if (!in_menu_mode) return;
+    
+    in_menu_mode = 0;
+    tinysh_printf("\r\n");
+    tinysh_reset_context();  /* Reset shell context */
+}
+
 /**
  * Process character input in menu mode
  */
@@ -239,9 +290,12 @@ void tinysh_menu_display(void) {
     
     /* Calculate visible items */
     display_count = menu->item_count;
-    if (display_count > MENU_DISPLAY_ITEMS) {
-        display_count = MENU_DISPLAY_ITEMS;
+    if (display_count > menu_viewport_items()) {
+        display_count = menu_viewport_items();
     }
+    drawn_count = display_count;
+    drawn_width = menu_width();
+    drawn_profile = tinysh_term_profile_id();
     
     /* Adjust scroll offset if needed */
     if (menu_state.current_index >= menu_state.scroll_offset + display_count) {
@@ -251,11 +305,13 @@ void tinysh_menu_display(void) {
     }
     
     /* Display menu items */
+    visible_count = 0;
     for (i = 0; i < display_count; i++) {
         unsigned char item_index = i + menu_state.scroll_offset;  /* Changed from uint8_t */
         if (item_index >= menu->item_count) break;
         
         display_menu_item(item_index, item_index == menu_state.current_index);
+        visible_count++;
     }
     
     /* Display footer */
@@ -316,7 +372,7 @@ static void display_menu_header(void) {
     tinysh_menu_t *menu = menu_state.current_menu;
     
     // Define the display width
-    int menu_separator_len = strlen(MENU_SEPARATOR);
+    int menu_separator_len = menu_width();
 
     // Calculate the full title text width
     int title_len = (int)(strlen(MENU_TITLE_PREFIX) + strlen(menu->title) + strlen(MENU_TITLE_SUFFIX));
@@ -327,30 +383,34 @@ static void display_menu_header(void) {
     
     // Print the centered title with padding
     tinysh_printf("\r\n");
-    for (int i = 0; i < padding; i++) {
-        tinysh_printf(" ");
-    }
+    tinysh_term_pad(padding);
     
     // Apply title theme
-    apply_theme(THEME_TITLE);
+    apply_theme(TERM_ROLE_TITLE);
     tinysh_printf("%s%s%s", MENU_TITLE_PREFIX, menu->title, MENU_TITLE_SUFFIX);
     reset_theme();
     tinysh_printf("\r\n");
 
     // Center the navigation help
-    const char *nav_help = "[↑/↓] Select  [Enter/→] Execute  [q/←] Back";
-    int nav_padding = (menu_separator_len - (int)strlen(nav_help)) / 2;
+    const char *nav_help = tinysh_term_profile()->nav_help;
+    int nav_len = 0;
+    const char *p;
+
+    // Count columns, not bytes: the arrows are multi-byte UTF-8
+    for (p = nav_help; *p; p++) {
+        if (((unsigned char)*p & 0xC0) != 0x80) nav_len++;
+    }
+    int nav_padding = (menu_separator_len - nav_len) / 2;
     if (nav_padding < 0) nav_padding = 0;
     
-    for (int i = 0; i < nav_padding; i++) {
-        tinysh_printf(" ");
-    }
+    tinysh_term_pad(nav_padding);
     
     // Apply header theme to navigation help
-    apply_theme(THEME_HEADER);
+    apply_theme(TERM_ROLE_HEADER);
     tinysh_printf("%s", nav_help);
     reset_theme();
-    tinysh_printf("\r\n%s\r\n", MENU_SEPARATOR);
+    tinysh_printf("\r\n");
+    print_separator();
 }
 
 /**
@@ -359,6 +419,7 @@ static void display_menu_header(void) {
 static void display_menu_item(unsigned char index, char is_selected) {
     tinysh_menu_t *menu = menu_state.current_menu;
     tinysh_menu_item_t *item;
+    int width;  /* columns printed so far, needed to address live values */
     
     if (index >= menu->item_count) return;
     
@@ -366,58 +427,77 @@ static void display_menu_item(unsigned char index, char is_selected) {
     
     // Apply selection theme if this is the selected item
     if (is_selected) {
-        apply_theme(THEME_SELECTED);
+        apply_theme(TERM_ROLE_SELECTED);
     } else {
-        apply_theme(THEME_NORMAL);
+        apply_theme(TERM_ROLE_NORMAL);
     }
 
     /* Display selector or index */
     if (is_selected) {
         tinysh_printf("%s ", MENU_SELECTOR);
+        width = (int)strlen(MENU_SELECTOR) + 1;
     } else {
         tinysh_printf("%d ", index);
+        width = (index >= 100) ? 4 : (index >= 10) ? 3 : 2;
     }
 
     /* Display submenu indicator if needed */
     if (item->type & MENU_ITEM_SUBMENU) {
         // Temporarily switch to submenu theme
         reset_theme();
-        apply_theme(THEME_SUBMENU);
+        apply_theme(TERM_ROLE_SUBMENU);
         tinysh_printf("%s", MENU_SUBMENU_INDICATOR);
         reset_theme();
         
         // Return to original theme
         if (is_selected) {
-            apply_theme(THEME_SELECTED);
+            apply_theme(TERM_ROLE_SELECTED);
         } else {
-            apply_theme(THEME_NORMAL);
+            apply_theme(TERM_ROLE_NORMAL);
         }
         tinysh_printf(" ");
+        width += (int)strlen(MENU_SUBMENU_INDICATOR) + 1;
     } else {
         tinysh_printf("%s ", MENU_INDENT);
+        width += (int)strlen(MENU_INDENT) + 1;
     }
     
     /* Display admin indicator if needed */
     if (item->type & MENU_ITEM_ADMIN) {
         // Temporarily switch to admin theme
         reset_theme();
-        apply_theme(THEME_ADMIN);
+        apply_theme(TERM_ROLE_ADMIN);
         tinysh_printf("%s", MENU_ADMIN_INDICATOR);
         reset_theme();
 
         // Return to original theme
         if (is_selected) {
-            apply_theme(THEME_SELECTED);
+            apply_theme(TERM_ROLE_SELECTED);
         } else {
-            apply_theme(THEME_NORMAL);
+            apply_theme(TERM_ROLE_NORMAL);
         }
         tinysh_printf(" ");
+        width += (int)strlen(MENU_ADMIN_INDICATOR) + 1;
     } else {
         tinysh_printf("  ");
+        width += 2;
     }
     
     /* Display item title */
     tinysh_printf("%s", item->title);
+
+    /* Live items: value follows the label, remember where it went */
+    if (item->type & MENU_ITEM_LIVE) {
+        char value[MENU_LIVE_VALUE_SIZE];
+        int len = live_render(item, value);
+
+        width += (int)strlen(item->title);
+        live_state[index].col = (unsigned char)(width < 255 ? width + 1 : 255);
+        live_state[index].hash = tinysh_hash(value, len);
+        live_state[index].next_refresh = tinysh_time_ms() +
+            (item->refresh_ms ? item->refresh_ms : MENU_LIVE_REFRESH_MS);
+        tinysh_printf("%s", value);
+    }
     
     // Reset colors at end of line
     reset_theme();
@@ -429,19 +509,82 @@ static void display_menu_item(unsigned char index, char is_selected) {
  */
 static void display_menu_footer(void) {
     tinysh_menu_t *menu = menu_state.current_menu;
+    int viewport = menu_viewport_items();
     
-    tinysh_printf("%s\r\n", MENU_SEPARATOR);
+    print_separator();
 
     /* Show pagination info if needed */
-    if (menu->item_count > MENU_DISPLAY_ITEMS) {
-        apply_theme(THEME_FOOTER);
+    if (menu->item_count > viewport) {
+        apply_theme(TERM_ROLE_FOOTER);
         tinysh_printf("Showing items %d-%d of %d",
                      menu_state.scroll_offset + 1,
-                     menu_state.scroll_offset + MENU_DISPLAY_ITEMS > menu->item_count ?
-                         menu->item_count : menu_state.scroll_offset + MENU_DISPLAY_ITEMS,
+                     menu_state.scroll_offset + viewport > menu->item_count ?
+                         menu->item_count : menu_state.scroll_offset + viewport,
                      menu->item_count);
         reset_theme();
-        tinysh_printf("\r\n%s\r\n", MENU_SEPARATOR);
+        tinysh_printf("\r\n");
+        print_separator();
+    }
+}
+
+/**
+ * Number of items that fit on the terminal between header and footer
+ * MENU_DISPLAY_ITEMS is used until the terminal size is known.
+ */
+static unsigned char menu_viewport_items(void) {
+    int rows;
+
+    if (!tinysh_term_size_known()) {
+        return MENU_DISPLAY_ITEMS;
+    }
+
+    rows = (int)tinysh_term_text_rows() - MENU_HEADER_ROWS - MENU_FOOTER_ROWS;
+    if (rows < 1) rows = 1;
+    if (rows > 255) rows = 255;
+    return (unsigned char)rows;
+}
+
+/**
+ * Width of separators and the area titles are centred in
+ */
+static int menu_width(void) {
+    int width = (int)strlen(MENU_SEPARATOR);
+
+    if (tinysh_term_size_known()) {
+        /* Stay clear of the last column to avoid auto-wrap */
+        width = (int)tinysh_term_cols() - 1;
+        if (width > MENU_MAX_WIDTH) width = MENU_MAX_WIDTH;
+        if (width < MENU_MIN_WIDTH) width = MENU_MIN_WIDTH;
+    }
+    return width;
+}
+
+/**
+ * Draw a separator line across the menu width
+ */
+static void print_separator(void) {
+    tinysh_term_repeat('-', menu_width());
+    tinysh_printf("\r\n");
+}
+
+/**
+ * Terminal resized or restyled: redraw only if what is on screen changes
+ */
+static void menu_on_term_change(int reason) {
+    tinysh_menu_t *menu = menu_state.current_menu;
+    unsigned char count;
+
+    if (reason == TERM_CHANGE_CLEAR || !menu || !in_menu_mode || waiting_for_keypress || collecting_arguments) {
+        return;
+    }
+
+    count = menu->item_count;
+    if (count > menu_viewport_items()) {
+        count = menu_viewport_items();
+    }
+    if (count != drawn_count || menu_width() != drawn_width ||
+        tinysh_term_profile_id() != drawn_profile) {
+        tinysh_menu_display();
     }
 }
 
@@ -458,19 +601,19 @@ static void start_argument_collection(const char *title, const char *param_desc,
     
     // Display the prompt with colors
     clear_screen();
-    apply_theme(THEME_TITLE);
+    apply_theme(TERM_ROLE_TITLE);
     tinysh_printf("Function: %s", title);
     reset_theme();
     tinysh_printf("\r\n\n");
 
     if (param_desc && *param_desc) {
-        apply_theme(THEME_HEADER);
+        apply_theme(TERM_ROLE_HEADER);
         tinysh_printf("Parameters: %s", param_desc);
         reset_theme();
         tinysh_printf("\r\n\n");
     }
 
-    apply_theme(THEME_PROMPT);
+    apply_theme(TERM_ROLE_PROMPT);
     tinysh_printf("Enter arguments: ");
     reset_theme();
 }
@@ -557,6 +700,12 @@ static void execute_menu_item(tinysh_menu_item_t *item) {
         tinysh_menu_exit();
         return;
     }
+
+    // Live items have no action, Enter just refreshes the values now
+    if (item->type & MENU_ITEM_LIVE) {
+        refresh_live_items(1);
+        return;
+    }
     
     // Handle direct command references
     if (item->type & MENU_ITEM_CMD_REF) {
@@ -749,8 +898,94 @@ static void menu_select_item(unsigned char index) {
  * Clear the screen
  */
 static void clear_screen(void) {
-    /* ANSI escape sequence to clear screen and position cursor at top left */
-    tinysh_printf("\033[2J\033[H");
+    /* Clear screen and home the cursor through the terminal layer so
+       fixed screen content (status line) is put back */
+    tinysh_term_clear_screen();
+}
+
+/**
+ * Render a live item's value into buf (MENU_LIVE_VALUE_SIZE bytes)
+ */
+static int live_render(tinysh_menu_item_t *item, char *buf) {
+    int len = 0;
+
+    buf[0] = 0;
+    if (item->render) {
+        len = item->render(buf, MENU_LIVE_VALUE_SIZE, item->render_arg);
+    }
+    buf[MENU_LIVE_VALUE_SIZE - 1] = 0;
+    if (len < 0 || len >= MENU_LIVE_VALUE_SIZE) {
+        len = (int)strlen(buf);
+    }
+    return len;
+}
+
+/**
+ * Redraw the value field of visible live items whose text changed
+ * Cursor is saved, moved onto the field and restored, so the rest of
+ * the menu (and whatever the user is doing) is left alone.
+ */
+static int refresh_live_items(char force) {
+    tinysh_menu_t *menu = menu_state.current_menu;
+    unsigned long now = tinysh_time_ms();
+    int redrawn = 0;
+    unsigned char i;
+
+    if (!menu || !in_menu_mode || waiting_for_keypress || collecting_arguments) {
+        return 0;
+    }
+
+    for (i = 0; i < visible_count; i++) {
+        unsigned char index = (unsigned char)(i + menu_state.scroll_offset);
+        tinysh_menu_item_t *item;
+        char value[MENU_LIVE_VALUE_SIZE];
+        uint32_t hash;
+        int len;
+
+        if (index >= menu->item_count) break;
+        item = &menu->items[index];
+        if (!(item->type & MENU_ITEM_LIVE)) continue;
+        if (!force && (long)(now - live_state[index].next_refresh) < 0) continue;
+
+        live_state[index].next_refresh = now +
+            (item->refresh_ms ? item->refresh_ms : MENU_LIVE_REFRESH_MS);
+
+        len = live_render(item, value);
+        hash = tinysh_hash(value, len);
+        if (hash == live_state[index].hash) continue;
+        live_state[index].hash = hash;
+
+        /* Save cursor, address the field, rewrite it, restore cursor */
+        tinysh_printf("\0337\033[%d;%dH", MENU_HEADER_ROWS + 1 + i, live_state[index].col);
+        apply_theme(index == menu_state.current_index ? TERM_ROLE_SELECTED : TERM_ROLE_NORMAL);
+        tinysh_printf("%s", value);
+        reset_theme();
+        tinysh_printf("\033[K\0338");
+        redrawn++;
+    }
+
+    return redrawn;
+}
+
+/**
+ * Periodic menu work
+ */
+void tinysh_menu_tick(void) {
+    refresh_live_items(0);
+}
+
+/**
+ * Re-render visible live items now
+ */
+int tinysh_menu_refresh_live(void) {
+    return refresh_live_items(1);
+}
+
+/**
+ * Get the root menu
+ */
+tinysh_menu_t *tinysh_menu_get_root(void) {
+    return menu_state.menu_stack[0];
 }
 
 /**
@@ -827,3 +1062,68 @@ tinysh_menu_t* tinysh_generate_cmd_menu(void) {
 }
 
 /* cmd_menu definition lives at the top of the file. */
+
+/* Storage for the generated parameter menu: one item per parameter plus
+   Back, each with its range as the prompt's parameter description */
+static tinysh_menu_t param_menu;
+static char param_descs[MENU_MAX_ITEMS - 1][32];
+
+/**
+ * Set a parameter from the menu prompt; argv[0] is the item title,
+ * which is the parameter name
+ */
+static void param_menu_set(int argc, const char **argv) {
+    tinysh_param_t *p = tinysh_param_find(argv[0], -1);
+    char value[24];
+    int err, staged;
+
+    if (!p) return;
+    if (argc > 1) {
+        err = tinysh_param_write(p, argv[1], -1);
+        if (err != PARAM_OK) {
+            tinysh_printf("%s: %s\r\n", argv[1], tinysh_param_error(err));
+        }
+    }
+    staged = tinysh_param_staged(p, value, sizeof(value)) >= 0;
+    if (!staged) {
+        tinysh_param_format(p, value, sizeof(value));
+    }
+    tinysh_printf("%s = %s%s%s%s\r\n", p->name, value,
+                  p->unit ? " " : "", p->unit ? p->unit : "", staged ? " (staged)" : "");
+}
+
+/**
+ * Generate a menu of the registered parameters
+ */
+tinysh_menu_t *tinysh_generate_param_menu(void) {
+    int count = 0;
+    tinysh_param_t *p;
+
+    memset(&param_menu, 0, sizeof(param_menu));
+    param_menu.title = "Parameters";
+
+    while (count < MENU_MAX_ITEMS - 1 && (p = tinysh_param_at(count)) != NULL) {
+        const char *unit = p->unit ? p->unit : "";
+
+        if (p->type == PARAM_BOOL) {
+            snprintf(param_descs[count], sizeof(param_descs[0]), "on/off");
+        } else if (p->min != p->max) {
+            snprintf(param_descs[count], sizeof(param_descs[0]), "%ld..%ld %s",
+                     p->min, p->max, unit);
+        } else {
+            snprintf(param_descs[count], sizeof(param_descs[0]), "value %s", unit);
+        }
+
+        param_menu.items[count].title = p->name;
+        param_menu.items[count].type = MENU_ITEM_FUNCTION_ARG;
+        param_menu.items[count].function_arg = param_menu_set;
+        param_menu.items[count].params = param_descs[count];
+        count++;
+    }
+
+    param_menu.items[count].title = "Back to Main Menu";
+    param_menu.items[count].type = MENU_ITEM_BACK;
+    param_menu.item_count = (unsigned char)(count + 1);
+
+    return &param_menu;
+}
@@ -11,6 +11,8 @@
  * - Support for admin-restricted menu items
  * - Function argument collection through interactive prompts
  * - Navigation using arrow keys, numeric shortcuts, or ESC/Enter
+ * - Live-value items whose value field is refreshed in place on change
+ * - Metric items showing a sparkline of recent samples
  *
  * Example Usage:
  * 
@@ -38,6 +40,15 @@
  *     2, 0
  * };
  * 
+ * // Live value: "LED: " label followed by whatever render() writes
+ * static int led_value(char *buf, int size, void *arg) {
+ *     return snprintf(buf, size, "%s", led_on ? "ON" : "OFF");
+ * }
+ * {"LED: ", MENU_ITEM_LIVE, .render = led_value, .refresh_ms = 250}
+ * 
+ * // Metric ring as a sparkline (see tinysh_metric.h)
+ * MENU_METRIC("Load: ", load_metric)
+ * 
  * // Initialize and activate menu
  * tinysh_menu_init(&main_menu);
  * tinysh_menu_enter();
@@ -47,6 +58,7 @@
 #define TINYSH_MENU_H
 
 #include "tinysh.h"
+#include "tinysh_metric.h"
 
 /* Menu-based UI Configuration */
 #ifndef MENU_MAX_DEPTH
@@ -58,7 +70,26 @@
 #endif
 
 #ifndef MENU_DISPLAY_ITEMS
-#define MENU_DISPLAY_ITEMS    5      // Number of items to display at once
+#define MENU_DISPLAY_ITEMS    5      // Items to display until the terminal size is known
+#endif
+
+/* Bounds for the menu width derived from the terminal width */
+#ifndef MENU_MAX_WIDTH
+#define MENU_MAX_WIDTH        78
+#endif
+
+#ifndef MENU_MIN_WIDTH
+#define MENU_MIN_WIDTH        20
+#endif
+
+/* Largest value text a live item may render (including terminator) */
+#ifndef MENU_LIVE_VALUE_SIZE
+#define MENU_LIVE_VALUE_SIZE  32
+#endif
+
+/* Default refresh period for live items that leave refresh_ms at 0 */
+#ifndef MENU_LIVE_REFRESH_MS
+#define MENU_LIVE_REFRESH_MS  500
 #endif
 
 /* Color support configuration */
@@ -83,32 +114,15 @@
 #define COLOR_BG_CYAN     "\033[46m"
 #define COLOR_DIM         "\033[2m"
 #define COLOR_BG_RED      "\033[41m"
-
-/* Theme definitions - single place to customize */
-/* Sunset Theme - Warm colors with orange and red accents */
-#define THEME_TITLE       COLOR_BOLD COLOR_YELLOW        /* Bold yellow for titles */
-#define THEME_HEADER      COLOR_RED                      /* Red for headers */
-#define THEME_SELECTED    COLOR_BLACK COLOR_BG_RED       /* Black on red for selection */
-#define THEME_NORMAL      COLOR_WHITE                    /* White for normal text */
-#define THEME_ADMIN       COLOR_MAGENTA                  /* Magenta for admin items */
-#define THEME_SUBMENU     COLOR_YELLOW                   /* Yellow for submenu indicators */
-#define THEME_FOOTER      COLOR_DIM COLOR_WHITE          /* Dimmed white for footer */
-#define THEME_ERROR       COLOR_BOLD COLOR_RED           /* Bold red for errors */
-#define THEME_PROMPT      COLOR_RED                      /* Red for prompts */
 #else
 /* Non-color terminal support */
 #define COLOR_RESET       ""
-#define THEME_TITLE       ""
-#define THEME_HEADER      ""
-#define THEME_SELECTED    ""
-#define THEME_NORMAL      ""
-#define THEME_ADMIN       ""
-#define THEME_SUBMENU     ""
-#define THEME_FOOTER      ""
-#define THEME_ERROR       ""
-#define THEME_PROMPT      ""
 #endif
 
+/* Menu styling comes from the active rendering profile of the terminal
+   layer (see tinysh_term.h). MENU_COLOR_ENABLED 0 drops styling from the
+   menu at compile time; the COLOR_* codes above remain for handlers. */
+
 /* Menu item type flags */
 #define MENU_ITEM_NORMAL      0x00   // Regular menu item
 #define MENU_ITEM_SUBMENU     0x01   // Has submenu
@@ -119,6 +133,11 @@
 #define MENU_ITEM_EXIT        0x20   // Exit menu mode
 #define MENU_ITEM_FUNCTION_ARG 0x40  // Function with arguments
 #define MENU_ITEM_CMD_REF     0x80   // Direct reference to tinysh_cmd_t
+#define MENU_ITEM_LIVE        0x100  // Label followed by a live rendered value
+
+/* Live item showing a metric ring as sparkline and last value */
+#define MENU_METRIC(label, metric) \
+    {label, MENU_ITEM_LIVE, .render = tinysh_metric_render, .render_arg = &(metric)}
 
 /* Menu navigation keys */
 #define MENU_KEY_UP           'A'    // Up arrow (ANSI escape sequence)
@@ -133,15 +152,15 @@
 #define MENU_ADMIN_INDICATOR  "*"
 #define MENU_SUBMENU_INDICATOR "..."
 #define MENU_TITLE_PREFIX     "=== "
-#define MENU_SEPARATOR        "----------------------------------------------"
+#define MENU_SEPARATOR        "----------------------------------------------" // width until the terminal size is known
 #define MENU_TITLE_SUFFIX     " ==="
 
 /**
  * Menu item structure
  */
 typedef struct {
-    const char *title;               // Display title
-    unsigned char type;              // Item type flags
+    const char *title;               // Display title (label for live items)
+    unsigned short type;             // Item type flags
     
     union {
         // For submenu items (MENU_ITEM_SUBMENU)
@@ -170,6 +189,13 @@ typedef struct {
         struct {
             tinysh_cmd_t *cmd;         // Direct reference to command
         };
+
+        // For live-value items (MENU_ITEM_LIVE)
+        struct {
+            int (*render)(char *buf, int size, void *arg); // Writes value text, returns length
+            void *render_arg;        // Passed back to render()
+            unsigned short refresh_ms; // Minimum time between renders, 0 = default
+        };
     };
 } tinysh_menu_item_t;
 
@@ -214,6 +240,13 @@ void tinysh_menu_enter(void);
  */
 void tinysh_menu_exit(void);
 
+/**
+ * Leave menu mode without a new shell prompt
+ * For code running inside a command: the shell prompts once it returns,
+ * whereas tinysh_menu_exit() enters an empty line to get the prompt
+ */
+void tinysh_menu_leave(void);
+
 /**
  * Process input character in menu mode
  * 
@@ -240,6 +273,25 @@ void tinysh_menu_execute_selection(void);
  */
 int tinysh_menu_go_back(void);
 
+/**
+ * Periodic menu work, call from the main loop
+ * Re-renders visible live items whose refresh period has elapsed
+ */
+void tinysh_menu_tick(void);
+
+/**
+ * Re-render visible live items now, ignoring their refresh periods
+ * Only value fields whose text changed are redrawn, in place.
+ *
+ * @return Number of fields redrawn
+ */
+int tinysh_menu_refresh_live(void);
+
+/**
+ * Get the root menu passed to tinysh_menu_init()
+ */
+tinysh_menu_t *tinysh_menu_get_root(void);
+
 /**
  * Command handler for entering menu mode
  */
@@ -271,4 +323,12 @@ tinysh_menu_t* tinysh_generate_cmd_menu(void);
  */
 void tinysh_menu_execute_command(int argc, const char **argv);
 
+/**
+ * Generate a menu of the registered parameters (see tinysh_param.h)
+ * Each item prompts for a new value and shows the result.
+ *
+ * @return Pointer to the generated parameter menu
+ */
+tinysh_menu_t *tinysh_generate_param_menu(void);
+
 #endif /* TINYSH_MENU_H */
\ No newline at end of file
@@ -57,6 +57,40 @@ static tinysh_menu_t test_menu = {
     2, 0
 };
 
+/* Live item test fixtures */
+static int live_value = 0;
+static unsigned long fake_now = 0;
+
+static int render_live_value(char *buf, int size, void *arg) {
+    (void)arg;
+    if (size < 4) return 0;
+    buf[0] = (char)('0' + live_value % 10);
+    buf[1] = 0;
+    return 1;
+}
+
+static unsigned long fake_clock(void) {
+    return fake_now;
+}
+
+static int quiet_printf(const char *fmt, ...) {
+    (void)fmt;
+    return 0;
+}
+
+static void quiet_char_out(unsigned char c) {
+    (void)c;
+}
+
+static tinysh_menu_t live_menu = {
+    "Live Menu",
+    {
+        {"Value: ", MENU_ITEM_LIVE, .render = render_live_value, .refresh_ms = 100},
+        {"Exit", MENU_ITEM_EXIT, {{NULL}}}
+    },
+    2, 0
+};
+
 /* Helper to assert conditions */
 static void menu_test_assert(const char *name, int condition, const char *message) {
     tests_run++;
@@ -107,6 +141,56 @@ int tinysh_menu_run_tests(void) {
                     (moved == -1 && state.current_index == 0),
                     "Menu navigation failed");
     
+    // Test live item refresh: drive the menu with output muted and a
+    // fake clock, and count in-place redraws of the value field
+    {
+        tinysh_menu_t *saved_root = tinysh_menu_get_root();
+        int (*saved_printf)(const char *, ...) = tinysh_printf;
+        void (*saved_char_out)(unsigned char) = tinysh_char_out;
+        unsigned long (*saved_clock)(void) = tinysh_millis;
+        int unchanged, changed, again, early, due;
+
+        tinysh_print_out(quiet_printf);
+        tinysh_out(quiet_char_out);
+        tinysh_time_source(fake_clock);
+
+        fake_now = 1000;
+        live_value = 1;
+        tinysh_menu_init(&live_menu);
+        tinysh_menu_enter();
+
+        unchanged = tinysh_menu_refresh_live();
+        live_value = 2;
+        changed = tinysh_menu_refresh_live();
+        again = tinysh_menu_refresh_live();
+
+        live_value = 3;
+        fake_now += 50;
+        tinysh_menu_tick();
+        early = tinysh_menu_refresh_live() == 1;  /* tick was too early */
+        live_value = 4;
+        fake_now += 100;
+        tinysh_menu_tick();
+        due = tinysh_menu_refresh_live() == 0;    /* tick already redrew */
+
+        tinysh_menu_leave();   /* exit() would enter the running line again */
+        if (saved_root) {
+            tinysh_menu_init(saved_root);
+        }
+        tinysh_time_source(saved_clock);
+        tinysh_out(saved_char_out);
+        tinysh_print_out(saved_printf);
+
+        menu_test_assert("Live item unchanged", unchanged == 0,
+                        "Unchanged value should not be redrawn");
+        menu_test_assert("Live item changed", changed == 1,
+                        "Changed value should be redrawn once");
+        menu_test_assert("Live item settled", again == 0,
+                        "Value should not be redrawn twice");
+        menu_test_assert("Live refresh period", early && due,
+                        "Tick should honour the refresh period");
+    }
+    
     // Report results
     tinysh_printf("\r\n=== Menu Test Results ===\r\n");
     tinysh_printf("Total tests: %d\r\n", tests_run);
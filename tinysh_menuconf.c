@@ -13,9 +13,12 @@
  *   ├── Tools Menu
  *   │   ├── Run Echo Test
  *   │   ├── Toggle LED
+ *   │   ├── LED: <live state>
+ *   │   ├── Uptime: <live seconds>
+ *   │   ├── Load: <sparkline of the last samples>
  *   │   └── Back
  *   ├── Commands Menu
- *   ├── Set Parameter (with arguments)
+ *   ├── Parameters (one item per registered parameter)
  *   └── Exit Menu Mode
  *
  * To customize:
@@ -26,10 +29,16 @@
 
 #include "tinysh_menu.h"
 #include "tinysh.h"
+#include "tiny_port.h"
+#include <stdio.h>
 
 /* Forward declarations of menu functions */
 static void show_system_info(void);
 static void toggle_led(void);
+static int render_led_state(char *buf, int size, void *arg);
+static int render_uptime(char *buf, int size, void *arg);
+
+static int led_state = 0;
 
 /* Define the menu structures */
 
@@ -50,9 +59,12 @@ tinysh_menu_t tools_menu = {
     {
         {"Run Echo Test", MENU_ITEM_COMMAND, .command = "echo Hello from menu!"},
         {"Toggle LED", MENU_ITEM_FUNCTION, .function = toggle_led},
+        {"LED: ", MENU_ITEM_LIVE, .render = render_led_state, .refresh_ms = 250},
+        {"Uptime: ", MENU_ITEM_LIVE, .render = render_uptime, .refresh_ms = 1000},
+        MENU_METRIC("Load: ", load_metric),
         {"Back to Main Menu", MENU_ITEM_BACK, {.submenu = NULL}}
     },
-    3,  /* item_count */
+    6,  /* item_count */
     0   /* parent_index */
 };
 
@@ -63,9 +75,10 @@ tinysh_menu_t main_menu = {
         {"System", MENU_ITEM_SUBMENU, .submenu = &system_menu},
         {"Tools", MENU_ITEM_SUBMENU, .submenu = &tools_menu},
         {"Commands", MENU_ITEM_SUBMENU, .submenu = NULL}, /* set in init */
+        {"Parameters", MENU_ITEM_SUBMENU, .submenu = NULL}, /* set in init */
         {"Exit Menu Mode", MENU_ITEM_EXIT, {.submenu = NULL}}
     },
-    4,  /* item_count */
+    5,  /* item_count */
     0   /* parent_index */
 };
 
@@ -80,17 +93,28 @@ static void show_system_info(void) {
 }
 
 static void toggle_led(void) {
-    static int led_state = 0;
     led_state = !led_state;
     tinysh_printf("LED is now %s\r\n", led_state ? "ON" : "OFF");
 }
 
+/* Live value renderers */
+static int render_led_state(char *buf, int size, void *arg) {
+    (void)arg;
+    return snprintf(buf, (size_t)size, "%s", led_state ? "ON" : "OFF");
+}
+
+static int render_uptime(char *buf, int size, void *arg) {
+    (void)arg;
+    return snprintf(buf, (size_t)size, "%lus", tinysh_time_ms() / 1000UL);
+}
+
 void tinysh_menuconf_init(void);
 /* Function to initialize the menu system */
 void tinysh_menuconf_init(void) {
     // Generate command menu and link it to main menu
     tinysh_menu_t *cmd_menu = tinysh_generate_cmd_menu();
     main_menu.items[2].submenu = cmd_menu;
+    main_menu.items[3].submenu = tinysh_generate_param_menu();
 
     // Initialize the menu system with the main menu
     tinysh_menu_init(&main_menu);
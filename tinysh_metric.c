@@ -0,0 +1,304 @@
+#include "tinysh_metric.h"
+#include "tinysh_term.h"
+#include "tinysh_complete.h"
+#include "tinysh.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Width of the value labels left of a plot */
+#define METRIC_LABEL_WIDTH 8
+
+/* Registered metrics */
+static tinysh_metric_t *metric_list = NULL;
+
+/* Sparkline glyphs, lowest to highest */
+#define SPARK_LEVELS 8
+static const char *const spark_unicode[SPARK_LEVELS] = {
+    "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"
+};
+static const char spark_ascii[SPARK_LEVELS + 1] = "_.-~=+*#";
+
+/* Forward declarations */
+static void rescan(tinysh_metric_t *m);
+static int scale(const tinysh_metric_t *m, long v, int levels);
+static void complete_metric(int argi, const char *prefix, void *arg);
+void chart_cmd_handler(int argc, const char **argv);
+
+/* Chart command */
+tinysh_cmd_t chart_cmd = {
+    0, "chart", "show metric trends", "[metric [rows]]",
+    chart_cmd_handler, 0, 0, 0
+};
+
+/**
+ * Register a metric
+ */
+int tinysh_metric_register(tinysh_metric_t *m) {
+    tinysh_metric_t *p;
+
+    for (p = metric_list; p; p = p->next) {
+        if (p == m) return 0;
+        if (strcmp(p->name, m->name) == 0) return -1;
+    }
+    m->next = metric_list;
+    metric_list = m;
+    tinysh_complete_invalidate(&chart_cmd);
+    return 0;
+}
+
+/**
+ * Remove a metric
+ */
+void tinysh_metric_unregister(tinysh_metric_t *m) {
+    tinysh_metric_t **p;
+
+    for (p = &metric_list; *p; p = &(*p)->next) {
+        if (*p == m) {
+            *p = m->next;
+            m->next = NULL;
+            tinysh_complete_invalidate(&chart_cmd);
+            return;
+        }
+    }
+}
+
+/**
+ * Find a metric by name
+ */
+tinysh_metric_t *tinysh_metric_find(const char *name) {
+    tinysh_metric_t *p;
+
+    for (p = metric_list; p; p = p->next) {
+        if (strcmp(p->name, name) == 0) return p;
+    }
+    return NULL;
+}
+
+/**
+ * Recompute min/max from scratch
+ */
+static void rescan(tinysh_metric_t *m) {
+    int i;
+
+    m->min = m->max = tinysh_metric_at(m, 0);
+    for (i = 1; i < m->count; i++) {
+        long v = tinysh_metric_at(m, i);
+        if (v < m->min) m->min = v;
+        if (v > m->max) m->max = v;
+    }
+}
+
+/**
+ * Add a sample
+ */
+void tinysh_metric_push(tinysh_metric_t *m, long value) {
+    char extreme_lost = 0;
+
+    if (!m->capacity) return;
+
+    if (m->count == m->capacity) {
+        long old = m->samples[m->head];
+        m->sum -= old;
+        extreme_lost = (old == m->min || old == m->max);
+    } else {
+        m->count++;
+    }
+
+    m->samples[m->head] = value;
+    m->sum += value;
+    m->head = (unsigned short)((m->head + 1) % m->capacity);
+
+    if (m->count == 1) {
+        m->min = m->max = value;
+    } else if (extreme_lost) {
+        rescan(m);
+    } else {
+        if (value < m->min) m->min = value;
+        if (value > m->max) m->max = value;
+    }
+}
+
+/**
+ * Get a sample by age
+ */
+long tinysh_metric_at(const tinysh_metric_t *m, int i) {
+    int start = (m->head + m->capacity - m->count) % m->capacity;
+    return m->samples[(start + i) % m->capacity];
+}
+
+/**
+ * Average of the ring
+ */
+long tinysh_metric_avg(const tinysh_metric_t *m) {
+    return m->count ? (long)(m->sum / m->count) : 0;
+}
+
+/**
+ * Map a sample onto 0..levels-1 between the ring's min and max
+ */
+static int scale(const tinysh_metric_t *m, long v, int levels) {
+    long long span = (long long)m->max - m->min;
+
+    if (span <= 0) return levels / 2;
+    return (int)(((long long)v - m->min) * (levels - 1) / span);
+}
+
+/**
+ * Render a sparkline
+ */
+int tinysh_metric_sparkline(const tinysh_metric_t *m, char *buf, int size, int width) {
+    int ascii = (tinysh_term_profile_id() == TERM_PROFILE_ASCII);
+    int glyph = ascii ? 1 : 3;
+    int len = 0, i, first;
+
+    if (size <= 0) return 0;
+    if (width > m->count) width = m->count;
+    if (width > (size - 1) / glyph) width = (size - 1) / glyph;
+
+    first = m->count - width;
+    for (i = first; i < m->count; i++) {
+        int level = scale(m, tinysh_metric_at(m, i), SPARK_LEVELS);
+        if (ascii) {
+            buf[len++] = spark_ascii[level];
+        } else {
+            memcpy(buf + len, spark_unicode[level], 3);
+            len += 3;
+        }
+    }
+    buf[len] = 0;
+    return len;
+}
+
+/**
+ * Live menu render callback
+ */
+int tinysh_metric_render(char *buf, int size, void *arg) {
+    const tinysh_metric_t *m = (const tinysh_metric_t *)arg;
+    char last[24];
+    int len = 0, lastlen;
+
+    if (size <= 0) return 0;
+    if (!m->count) {
+        snprintf(buf, (size_t)size, "-");
+        return (int)strlen(buf);
+    }
+
+    /* Sparkline in whatever room the last value leaves, if any; the
+       value itself is cut short when even it does not fit */
+    lastlen = snprintf(last, sizeof(last), " %ld", tinysh_metric_at(m, m->count - 1));
+    if (size > lastlen + 1) {
+        len = tinysh_metric_sparkline(m, buf, size - lastlen, METRIC_SPARK_WIDTH);
+    }
+    snprintf(buf + len, (size_t)(size - len), "%s", last);
+    return len + (int)strlen(buf + len);
+}
+
+/**
+ * Print an ASCII plot
+ */
+void tinysh_metric_plot(const tinysh_metric_t *m, int rows) {
+    int width = tinysh_term_cols() - METRIC_LABEL_WIDTH - 3;
+    int first, r, i, end;
+    char line[80];
+
+    if (!m->count) {
+        tinysh_printf("%s: no samples\r\n", m->name);
+        return;
+    }
+    if (rows < 2) rows = 2;
+    if (width > m->count) width = m->count;
+    if (width < 1) width = 1;
+    first = m->count - width;
+
+    for (r = rows - 1; r >= 0; r--) {
+        if (r == rows - 1 || r == 0) {
+            snprintf(line, sizeof(line), "%*ld |", METRIC_LABEL_WIDTH, r ? m->max : m->min);
+            tinysh_puts(line);
+        } else {
+            tinysh_term_pad(METRIC_LABEL_WIDTH + 1);
+            tinysh_char_out('|');
+        }
+
+        /* Columns reaching this row; stop at the last one to skip trailing blanks */
+        end = -1;
+        for (i = first; i < m->count; i++) {
+            if (scale(m, tinysh_metric_at(m, i), rows) >= r) end = i;
+        }
+        for (i = first; i <= end; i++) {
+            tinysh_char_out(scale(m, tinysh_metric_at(m, i), rows) >= r ? '#' : ' ');
+        }
+        tinysh_puts("\r\n");
+    }
+
+    tinysh_term_pad(METRIC_LABEL_WIDTH + 1);
+    tinysh_char_out('+');
+    tinysh_term_repeat('-', width);
+    tinysh_puts("\r\n");
+    snprintf(line, sizeof(line), "min %ld  max %ld  avg %ld  last %ld  (%u samples)\r\n",
+             m->min, m->max, tinysh_metric_avg(m),
+             tinysh_metric_at(m, m->count - 1), (unsigned)m->count);
+    tinysh_puts(line);
+}
+
+/**
+ * Periodic metric work
+ */
+void tinysh_metric_tick(void) {
+    unsigned long now = tinysh_time_ms();
+    tinysh_metric_t *m;
+
+    for (m = metric_list; m; m = m->next) {
+        if (!m->sampler) continue;
+        if ((long)(now - m->next_sample) < 0) continue;
+        m->next_sample = now + m->period_ms;
+        tinysh_metric_push(m, m->sampler());
+    }
+}
+
+/**
+ * Chart argument completion: metric names
+ */
+static void complete_metric(int argi, const char *prefix, void *arg) {
+    tinysh_metric_t *m;
+    (void)prefix;
+    (void)arg;
+
+    if (argi != 1) return;
+    for (m = metric_list; m; m = m->next) tinysh_complete_add(m->name);
+}
+
+/**
+ * Chart command handler
+ */
+void chart_cmd_handler(int argc, const char **argv) {
+    char spark[METRIC_SPARK_WIDTH * 3 + 1];
+    tinysh_metric_t *m;
+
+    if (argc > 1) {
+        m = tinysh_metric_find(argv[1]);
+        if (!m) {
+            tinysh_printf("Unknown metric: %s\r\n", argv[1]);
+            return;
+        }
+        tinysh_metric_plot(m, argc > 2 ? (int)tinysh_atoxi((char *)argv[2]) : METRIC_PLOT_ROWS);
+        return;
+    }
+
+    if (!metric_list) {
+        tinysh_printf("No metrics registered\r\n");
+        return;
+    }
+    for (m = metric_list; m; m = m->next) {
+        tinysh_metric_sparkline(m, spark, sizeof(spark), METRIC_SPARK_WIDTH);
+        tinysh_printf("%-12s %s  min %ld max %ld avg %ld\r\n", m->name, spark,
+                      m->min, m->max, tinysh_metric_avg(m));
+    }
+}
+
+/**
+ * Register the chart command
+ */
+void tinysh_metric_init(void) {
+    tinysh_add_command(&chart_cmd);
+    tinysh_complete_register(&chart_cmd, complete_metric, NULL);
+}
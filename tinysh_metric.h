@@ -0,0 +1,147 @@
+/**
+ * TinyShell Metric Rings
+ * --------------------
+ * Named, fixed-capacity rings of integer samples, for seeing how a value
+ * trended over the last minute rather than only its current value.
+ *
+ * Features:
+ * - Samples pushed by handlers, or taken by a sampler function from the
+ *   main loop at a fixed period
+ * - Min/max/average kept up to date on every push (min/max are rescanned
+ *   only when the evicted sample was the extreme)
+ * - Sparklines (Unicode blocks, or an ASCII ramp with the ascii profile)
+ * - "chart" command: sparklines of all metrics, or a small plot of one
+ * - MENU_METRIC() menu items, redrawn in place when new samples arrive
+ *
+ * Example Usage:
+ *
+ * static long read_temp(void) { return adc_read(0); }
+ *
+ * // 60 samples, one a second: the last minute
+ * TINYSH_METRIC(temp_metric, "temp", 60, read_temp, 1000);
+ *
+ * tinysh_metric_register(&temp_metric);
+ * while (1) {
+ *     ...
+ *     tinysh_metric_tick();
+ * }
+ */
+
+#ifndef TINYSH_METRIC_H
+#define TINYSH_METRIC_H
+
+#include "tinysh.h"
+
+/* Sparkline width used by the chart list and menu items */
+#ifndef METRIC_SPARK_WIDTH
+#define METRIC_SPARK_WIDTH        20
+#endif
+
+/* Plot height used by "chart <metric>" */
+#ifndef METRIC_PLOT_ROWS
+#define METRIC_PLOT_ROWS          8
+#endif
+
+/**
+ * Metric ring
+ * Declare with TINYSH_METRIC() so the sample storage comes with it.
+ */
+typedef struct tinysh_metric_t {
+    const char *name;                // Name used by the chart command
+    long *samples;                   // Ring storage, capacity entries
+    unsigned short capacity;         // Ring size in samples
+    long (*sampler)(void);           // Called by tinysh_metric_tick(), or NULL
+    unsigned short period_ms;        // Time between sampler calls
+
+    /* Maintained by the metric module */
+    unsigned short head;             // Next slot to write
+    unsigned short count;            // Valid samples
+    long min;                        // Smallest sample in the ring
+    long max;                        // Largest sample in the ring
+    long long sum;                   // Sum of samples in the ring
+    unsigned long next_sample;       // tinysh_time_ms() of next sampler call
+    struct tinysh_metric_t *next;    // Registered metrics list
+} tinysh_metric_t;
+
+/* Declare a metric together with its sample storage */
+#define TINYSH_METRIC(var, metric_name, cap, sampler_fn, period) \
+    static long var##_samples[cap]; \
+    tinysh_metric_t var = { .name = (metric_name), .samples = var##_samples, \
+                            .capacity = (cap), .sampler = (sampler_fn), \
+                            .period_ms = (period) }
+
+/**
+ * Make a metric visible to the chart command and the tick loop
+ *
+ * @param m Metric, must stay valid
+ * @return 0 on success, -1 if a metric with that name exists
+ */
+int tinysh_metric_register(tinysh_metric_t *m);
+
+/**
+ * Remove a metric from the chart command and the tick loop
+ */
+void tinysh_metric_unregister(tinysh_metric_t *m);
+
+/**
+ * Find a registered metric by name
+ *
+ * @return Metric, or NULL
+ */
+tinysh_metric_t *tinysh_metric_find(const char *name);
+
+/**
+ * Add a sample, evicting the oldest when the ring is full
+ */
+void tinysh_metric_push(tinysh_metric_t *m, long value);
+
+/**
+ * Get a sample by age
+ *
+ * @param i 0 for the oldest, count - 1 for the newest
+ */
+long tinysh_metric_at(const tinysh_metric_t *m, int i);
+
+/**
+ * Average of the samples in the ring, 0 when empty
+ */
+long tinysh_metric_avg(const tinysh_metric_t *m);
+
+/**
+ * Render the newest samples as a sparkline
+ *
+ * @param buf   Output buffer, always terminated
+ * @param size  Size of buf
+ * @param width Most samples to show
+ * @return Bytes written
+ */
+int tinysh_metric_sparkline(const tinysh_metric_t *m, char *buf, int size, int width);
+
+/**
+ * Live menu render callback: sparkline and last value of the metric
+ * passed as arg (see MENU_METRIC in tinysh_menu.h)
+ */
+int tinysh_metric_render(char *buf, int size, void *arg);
+
+/**
+ * Print a small ASCII plot of the newest samples
+ *
+ * @param rows Plot height
+ */
+void tinysh_metric_plot(const tinysh_metric_t *m, int rows);
+
+/**
+ * Periodic metric work, call from the main loop
+ * Calls the sampler of each metric whose period elapsed.
+ */
+void tinysh_metric_tick(void);
+
+/**
+ * Register the chart command
+ */
+void tinysh_metric_init(void);
+
+/* Chart command */
+extern tinysh_cmd_t chart_cmd;
+
+#endif /* TINYSH_METRIC_H */
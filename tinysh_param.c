@@ -0,0 +1,603 @@
+#include "tinysh_param.h"
+#include "tinysh_table.h"
+#include "tinysh_complete.h"
+#include "tinysh.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Registered parameters, in registration order and hashed by name */
+static tinysh_param_t *param_list[PARAM_MAX_PARAMS];
+static int param_count = 0;
+static tinysh_param_t *param_hash[PARAM_HASH_BUCKETS];
+
+/* Open transaction of a session, as [parameter index, text length, text] entries */
+typedef struct {
+    char in_transaction;
+    int stage_used;
+    unsigned char stage[PARAM_STAGE_SIZE];
+} param_txn_t;
+
+/* Each session's is in its line extension; one for all if none was claimed */
+static int txn_ext = -1;
+static param_txn_t shared_txn;
+static tinysh_param_commit_t commit_hook = NULL;
+
+/* Forward declarations */
+static int slice_is(const char *s, int len, const char *word);
+static void complete_name(int argi, const char *prefix, void *arg);
+static int param_index(const tinysh_param_t *p);
+static param_txn_t *session_txn(void);
+static int stage_find(const param_txn_t *t, int idx);
+static int stage_put(param_txn_t *t, int idx, const char *s, int len);
+void get_cmd_handler(int argc, const char **argv);
+void set_cmd_handler(int argc, const char **argv);
+void list_cmd_handler(int argc, const char **argv);
+void begin_cmd_handler(int argc, const char **argv);
+void commit_cmd_handler(int argc, const char **argv);
+void abort_cmd_handler(int argc, const char **argv);
+
+/* Parameter commands */
+tinysh_cmd_t get_cmd = {
+    0, "get", "show parameters", "[name...]",
+    get_cmd_handler, 0, 0, 0
+};
+
+tinysh_cmd_t set_cmd = {
+    0, "set", "change parameters", "<name> <value> | <name=value...>",
+    set_cmd_handler, 0, 0, 0
+};
+
+tinysh_cmd_t list_cmd = {
+    0, "list", "list parameters with ranges", 0,
+    list_cmd_handler, 0, 0, 0
+};
+
+tinysh_cmd_t begin_cmd = {
+    0, "begin", "stage parameter changes until commit", 0,
+    begin_cmd_handler, 0, 0, 0
+};
+
+tinysh_cmd_t commit_cmd = {
+    0, "commit", "apply staged parameter changes", 0,
+    commit_cmd_handler, 0, 0, 0
+};
+
+tinysh_cmd_t abort_cmd = {
+    0, "abort", "drop staged parameter changes", 0,
+    abort_cmd_handler, 0, 0, 0
+};
+
+/**
+ * Does a slice hold exactly word
+ */
+static int slice_is(const char *s, int len, const char *word) {
+    return (int)strlen(word) == len && strncmp(s, word, (size_t)len) == 0;
+}
+
+/**
+ * Register a parameter
+ */
+int tinysh_param_register(tinysh_param_t *p) {
+    unsigned bucket;
+
+    if (tinysh_param_find(p->name, -1)) return -1;
+    if (param_count == PARAM_MAX_PARAMS) return -1;
+
+    bucket = tinysh_hash(p->name, -1) & (PARAM_HASH_BUCKETS - 1);
+    p->hash_next = param_hash[bucket];
+    param_hash[bucket] = p;
+    param_list[param_count++] = p;
+    tinysh_complete_invalidate(&get_cmd);
+    tinysh_complete_invalidate(&set_cmd);
+    return 0;
+}
+
+/**
+ * Take back the parameter registered last
+ */
+int tinysh_param_unregister(tinysh_param_t *p) {
+    tinysh_param_t **it;
+
+    if (param_count == 0 || param_list[param_count - 1] != p) return -1;
+
+    it = &param_hash[tinysh_hash(p->name, -1) & (PARAM_HASH_BUCKETS - 1)];
+    while (*it != p) it = &(*it)->hash_next;
+    *it = p->hash_next;
+    p->hash_next = NULL;
+    param_list[--param_count] = NULL;
+    tinysh_complete_invalidate(&get_cmd);
+    tinysh_complete_invalidate(&set_cmd);
+    return 0;
+}
+
+/**
+ * Find a parameter by name
+ */
+tinysh_param_t *tinysh_param_find(const char *name, int len) {
+    tinysh_param_t *p;
+
+    if (len < 0) len = (int)strlen(name);
+    p = param_hash[tinysh_hash(name, len) & (PARAM_HASH_BUCKETS - 1)];
+    for (; p; p = p->hash_next) {
+        if (strncmp(p->name, name, (size_t)len) == 0 && p->name[len] == 0) return p;
+    }
+    return NULL;
+}
+
+/**
+ * Number of registered parameters
+ */
+int tinysh_param_count(void) {
+    return param_count;
+}
+
+/**
+ * Registered parameter by index
+ */
+tinysh_param_t *tinysh_param_at(int i) {
+    return (i >= 0 && i < param_count) ? param_list[i] : NULL;
+}
+
+/**
+ * Parse and check a value
+ */
+int tinysh_param_parse(const tinysh_param_t *p, const char *s, int len,
+                       tinysh_param_value_t *out) {
+    int ranged = p->min != p->max;
+
+    if (len < 0) len = (int)strlen(s);
+
+    switch (p->type) {
+    case PARAM_BOOL:
+        if (slice_is(s, len, "1") || slice_is(s, len, "on") || slice_is(s, len, "true")) {
+            out->i = 1;
+        } else if (slice_is(s, len, "0") || slice_is(s, len, "off") || slice_is(s, len, "false")) {
+            out->i = 0;
+        } else {
+            return PARAM_ERR_SYNTAX;
+        }
+        return PARAM_OK;
+
+    case PARAM_FLOAT:
+        if (tinysh_parse_float(s, len, &out->f) < 0) return PARAM_ERR_SYNTAX;
+        if (ranged && (out->f < (float)p->min || out->f > (float)p->max)) return PARAM_ERR_RANGE;
+        return PARAM_OK;
+
+    case PARAM_UINT:
+        if (tinysh_parse_long(s, len, &out->i) < 0) return PARAM_ERR_SYNTAX;
+        if (out->i < 0 || (unsigned long)out->i > 0xFFFFFFFFUL) return PARAM_ERR_RANGE;
+        break;
+
+    default:
+        if (tinysh_parse_long(s, len, &out->i) < 0) return PARAM_ERR_SYNTAX;
+        if (out->i < -2147483647L - 1 || out->i > 2147483647L) return PARAM_ERR_RANGE;
+        break;
+    }
+
+    if (ranged && (out->i < p->min || out->i > p->max)) return PARAM_ERR_RANGE;
+    return PARAM_OK;
+}
+
+/**
+ * Store a parsed value
+ */
+void tinysh_param_store(tinysh_param_t *p, tinysh_param_value_t v) {
+    switch (p->type) {
+    case PARAM_BOOL:  *(uint8_t *)p->value = (uint8_t)(v.i != 0); break;
+    case PARAM_FLOAT: *(float *)p->value = v.f; break;
+    case PARAM_UINT:  *(uint32_t *)p->value = (uint32_t)v.i; break;
+    default:          *(int32_t *)p->value = (int32_t)v.i; break;
+    }
+}
+
+/**
+ * Parse, store, and notify
+ */
+int tinysh_param_set(tinysh_param_t *p, const char *s, int len) {
+    tinysh_param_value_t v;
+    int err = tinysh_param_parse(p, s, len, &v);
+
+    if (err != PARAM_OK) return err;
+    tinysh_param_store(p, v);
+    if (p->on_change) p->on_change(p);
+    return PARAM_OK;
+}
+
+/**
+ * Position of a registered parameter in param_list
+ */
+static int param_index(const tinysh_param_t *p) {
+    int i;
+
+    for (i = 0; i < param_count && param_list[i] != p; i++);
+    return i;
+}
+
+/**
+ * The current session's transaction
+ */
+static param_txn_t *session_txn(void) {
+    if (txn_ext < 0) return &shared_txn;
+    return tinysh_line_ext(tinysh_line_current(), txn_ext);
+}
+
+/**
+ * Offset of a parameter's staged entry, -1 if it has none
+ */
+static int stage_find(const param_txn_t *t, int idx) {
+    int off;
+
+    for (off = 0; off < t->stage_used; off += 2 + t->stage[off + 1]) {
+        if (t->stage[off] == idx) return off;
+    }
+    return -1;
+}
+
+/**
+ * Stage value text, replacing what was staged for the parameter before
+ */
+static int stage_put(param_txn_t *t, int idx, const char *s, int len) {
+    int off = stage_find(t, idx);
+    int old = off >= 0 ? 2 + t->stage[off + 1] : 0;
+
+    if (len > 255 || t->stage_used - old + 2 + len > PARAM_STAGE_SIZE) return PARAM_ERR_FULL;
+
+    if (off >= 0) {
+        memmove(t->stage + off, t->stage + off + old, (size_t)(t->stage_used - off - old));
+        t->stage_used -= old;
+    }
+    t->stage[t->stage_used] = (unsigned char)idx;
+    t->stage[t->stage_used + 1] = (unsigned char)len;
+    memcpy(t->stage + t->stage_used + 2, s, (size_t)len);
+    t->stage_used += 2 + len;
+    return PARAM_OK;
+}
+
+/**
+ * Write from the shell, staged inside the session's transaction
+ */
+int tinysh_param_write(tinysh_param_t *p, const char *s, int len) {
+    param_txn_t *t = session_txn();
+    tinysh_param_value_t v;
+    int err;
+
+    if (!t->in_transaction) return tinysh_param_set(p, s, len);
+
+    if (len < 0) len = (int)strlen(s);
+    err = tinysh_param_parse(p, s, len, &v);
+    if (err != PARAM_OK) return err;
+    return stage_put(t, param_index(p), s, len);
+}
+
+/**
+ * Open a transaction in the current session
+ */
+int tinysh_param_begin(void) {
+    param_txn_t *t = session_txn();
+
+    if (t->in_transaction) return -1;
+    t->in_transaction = 1;
+    t->stage_used = 0;
+    return 0;
+}
+
+/**
+ * Apply the staged values
+ * Checked all first, then stored all, then each hook called once.
+ */
+int tinysh_param_commit(tinysh_param_t **failed) {
+    param_txn_t *t = session_txn();
+    const unsigned char *stage = t->stage;
+    tinysh_param_value_t values[PARAM_MAX_PARAMS];
+    tinysh_param_t *p;
+    int off, err, n = 0;
+
+    if (!t->in_transaction) return 0;
+
+    for (off = 0; off < t->stage_used; off += 2 + stage[off + 1]) {
+        p = param_list[stage[off]];
+        err = tinysh_param_parse(p, (const char *)stage + off + 2, stage[off + 1], &values[n++]);
+        if (err != PARAM_OK) {
+            if (failed) *failed = p;
+            return err;
+        }
+    }
+
+    n = 0;
+    for (off = 0; off < t->stage_used; off += 2 + stage[off + 1]) {
+        tinysh_param_store(param_list[stage[off]], values[n++]);
+    }
+
+    /* Closed before the hooks run, so a hook writing a parameter is not staged */
+    t->in_transaction = 0;
+    for (off = 0; off < t->stage_used; off += 2 + stage[off + 1]) {
+        p = param_list[stage[off]];
+        if (p->on_change) p->on_change(p);
+    }
+    t->stage_used = 0;
+
+    if (n && commit_hook) commit_hook();
+    return n;
+}
+
+/**
+ * Drop the staged values
+ */
+int tinysh_param_abort(void) {
+    param_txn_t *t = session_txn();
+    int off, n = 0;
+
+    for (off = 0; off < t->stage_used; off += 2 + t->stage[off + 1]) n++;
+    t->in_transaction = 0;
+    t->stage_used = 0;
+    return n;
+}
+
+/**
+ * Is a transaction open in the current session
+ */
+int tinysh_param_in_transaction(void) {
+    return session_txn()->in_transaction;
+}
+
+/**
+ * Staged value text of a parameter
+ */
+int tinysh_param_staged(const tinysh_param_t *p, char *buf, int size) {
+    const param_txn_t *t = session_txn();
+    int off = stage_find(t, param_index(p));
+    int len;
+
+    if (off < 0 || size <= 0) return -1;
+    len = t->stage[off + 1] < size ? t->stage[off + 1] : size - 1;
+    memcpy(buf, t->stage + off + 2, (size_t)len);
+    buf[len] = 0;
+    return len;
+}
+
+/**
+ * Set the function called after each commit
+ */
+tinysh_param_commit_t tinysh_param_on_commit(tinysh_param_commit_t fn) {
+    tinysh_param_commit_t prev = commit_hook;
+
+    commit_hook = fn;
+    return prev;
+}
+
+/**
+ * Current value as text
+ */
+int tinysh_param_format(const tinysh_param_t *p, char *buf, int size) {
+    if (size <= 0) return 0;
+
+    switch (p->type) {
+    case PARAM_BOOL:
+        return snprintf(buf, (size_t)size, "%s", *(uint8_t *)p->value ? "on" : "off");
+    case PARAM_FLOAT:
+        tinysh_float2str(*(float *)p->value, buf, size, 3);
+        return (int)strlen(buf);
+    case PARAM_UINT:
+        return snprintf(buf, (size_t)size, "%lu", (unsigned long)*(uint32_t *)p->value);
+    default:
+        return snprintf(buf, (size_t)size, "%ld", (long)*(int32_t *)p->value);
+    }
+}
+
+/**
+ * Error message for a PARAM_ERR_* code
+ */
+const char *tinysh_param_error(int err) {
+    switch (err) {
+    case PARAM_OK:          return "ok";
+    case PARAM_ERR_UNKNOWN: return "unknown parameter";
+    case PARAM_ERR_SYNTAX:  return "invalid value";
+    case PARAM_ERR_RANGE:   return "out of range";
+    case PARAM_ERR_FULL:    return "staging area full";
+    default:                return "error";
+    }
+}
+
+/**
+ * Name completion, arg is a suffix: "" for get, "=" for set
+ */
+static void complete_name(int argi, const char *prefix, void *arg) {
+    char word[64];
+    int i;
+    (void)argi;
+    (void)prefix;
+
+    for (i = 0; i < param_count; i++) {
+        snprintf(word, sizeof(word), "%s%s", param_list[i]->name, (const char *)arg);
+        tinysh_complete_add(word);
+    }
+}
+
+/**
+ * Get command handler
+ */
+void get_cmd_handler(int argc, const char **argv) {
+    char value[24];
+    tinysh_param_t *p;
+    int i;
+
+    for (i = 0; i < (argc > 1 ? argc - 1 : param_count); i++) {
+        p = argc > 1 ? tinysh_param_find(argv[i + 1], -1) : param_list[i];
+        if (!p) {
+            tinysh_printf("%s: %s\r\n", argv[i + 1], tinysh_param_error(PARAM_ERR_UNKNOWN));
+            continue;
+        }
+        tinysh_param_format(p, value, sizeof(value));
+        tinysh_printf("%s = %s%s%s", p->name, value,
+                      p->unit ? " " : "", p->unit ? p->unit : "");
+        if (tinysh_param_staged(p, value, sizeof(value)) >= 0) {
+            tinysh_printf(", staged %s", value);
+        }
+        tinysh_puts("\r\n");
+    }
+}
+
+/**
+ * Set command handler
+ * Every assignment is checked before any is stored, so a typo in the
+ * last one leaves all parameters unchanged. Inside a transaction the
+ * values are staged instead.
+ */
+void set_cmd_handler(int argc, const char **argv) {
+    tinysh_param_t *params[MAX_ARGS];
+    tinysh_param_value_t values[MAX_ARGS];
+    const char *texts[MAX_ARGS];
+    const char *name, *value;
+    int i, j, name_len, err, n = 0;
+
+    if (argc < 2) {
+        tinysh_printf("Usage: set <name> <value> | set <name=value...>\r\n");
+        return;
+    }
+
+    for (i = 1; i < argc; i++) {
+        const char *eq = strchr(argv[i], '=');
+
+        name = argv[i];
+        if (eq) {
+            name_len = (int)(eq - name);
+            value = eq + 1;
+        } else if (argc == 3 && i == 1) {
+            name_len = (int)strlen(name);
+            value = argv[++i];
+        } else {
+            tinysh_printf("%s: expected name=value\r\n", name);
+            return;
+        }
+
+        params[n] = tinysh_param_find(name, name_len);
+        texts[n] = value;
+        err = params[n] ? tinysh_param_parse(params[n], value, -1, &values[n])
+                        : PARAM_ERR_UNKNOWN;
+        if (err != PARAM_OK) {
+            tinysh_printf("%.*s: %s\r\n", name_len, name, tinysh_param_error(err));
+            if (err == PARAM_ERR_RANGE) {
+                tinysh_printf("  range %ld..%ld\r\n", params[n]->min, params[n]->max);
+            }
+            return;
+        }
+        n++;
+    }
+
+    if (tinysh_param_in_transaction()) {
+        for (i = 0; i < n; i++) {
+            err = tinysh_param_write(params[i], texts[i], -1);
+            if (err != PARAM_OK) {
+                tinysh_printf("%s: %s\r\n", params[i]->name, tinysh_param_error(err));
+                return;
+            }
+        }
+        return;
+    }
+
+    /* All valid: store them, then let each parameter react once */
+    for (i = 0; i < n; i++) tinysh_param_store(params[i], values[i]);
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < i && params[j] != params[i]; j++);
+        if (j == i && params[i]->on_change) params[i]->on_change(params[i]);
+    }
+}
+
+/**
+ * List command handler
+ */
+void list_cmd_handler(int argc, const char **argv) {
+    static const tinysh_table_col_t cols[] = {
+        {"Name", 0, 0},
+        {"Value", 0, TABLE_ALIGN_RIGHT},
+        {"Range", 0, 0},
+        {"Unit", 0, 0}
+    };
+    char value[24], range[32];
+    tinysh_param_t *p;
+    int i;
+    (void)argc;
+    (void)argv;
+
+    tinysh_table_begin(cols, 4);
+    for (i = 0; i < param_count; i++) {
+        p = param_list[i];
+        tinysh_param_format(p, value, sizeof(value));
+        if (p->type == PARAM_BOOL) {
+            snprintf(range, sizeof(range), "on/off");
+        } else if (p->min != p->max) {
+            snprintf(range, sizeof(range), "%ld..%ld", p->min, p->max);
+        } else {
+            range[0] = 0;
+        }
+        tinysh_table_add(p->name, value, range, p->unit ? p->unit : "");
+    }
+    tinysh_table_end();
+}
+
+/**
+ * Begin command handler
+ */
+void begin_cmd_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    if (tinysh_param_begin() < 0) {
+        tinysh_puts("Transaction already open\r\n");
+    } else {
+        tinysh_puts("Changes are staged until commit or abort\r\n");
+    }
+}
+
+/**
+ * Commit command handler
+ */
+void commit_cmd_handler(int argc, const char **argv) {
+    tinysh_param_t *failed = NULL;
+    int n;
+    (void)argc;
+    (void)argv;
+
+    if (!tinysh_param_in_transaction()) {
+        tinysh_puts("No transaction open\r\n");
+        return;
+    }
+    n = tinysh_param_commit(&failed);
+    if (n < 0) {
+        tinysh_printf("%s: %s\r\n", failed ? failed->name : "commit", tinysh_param_error(n));
+        tinysh_puts("Nothing applied; fix it with set, or abort\r\n");
+        return;
+    }
+    tinysh_printf("Committed %d parameter%s\r\n", n, n == 1 ? "" : "s");
+}
+
+/**
+ * Abort command handler
+ */
+void abort_cmd_handler(int argc, const char **argv) {
+    int n;
+    (void)argc;
+    (void)argv;
+
+    if (!tinysh_param_in_transaction()) {
+        tinysh_puts("No transaction open\r\n");
+        return;
+    }
+    n = tinysh_param_abort();
+    tinysh_printf("Dropped %d staged change%s\r\n", n, n == 1 ? "" : "s");
+}
+
+/**
+ * Register the parameter commands
+ */
+void tinysh_param_init(void) {
+    if (txn_ext < 0) txn_ext = tinysh_line_ext_claim((int)sizeof(param_txn_t));
+    tinysh_add_command(&get_cmd);
+    tinysh_add_command(&set_cmd);
+    tinysh_add_command(&list_cmd);
+    tinysh_add_command(&begin_cmd);
+    tinysh_add_command(&commit_cmd);
+    tinysh_add_command(&abort_cmd);
+    tinysh_complete_register(&get_cmd, complete_name, (void *)"");
+    tinysh_complete_register(&set_cmd, complete_name, (void *)"=");
+}
@@ -0,0 +1,247 @@
+/**
+ * TinyShell Parameter Registry
+ * --------------------------
+ * Typed variables that the shell can read and write by name, so a
+ * setting needs one declaration instead of a handler full of parsing.
+ *
+ * Features:
+ * - Integer, unsigned, boolean and float parameters with range and unit
+ * - Optional change hook called after a new value was stored
+ * - Name lookup through a hash index
+ * - "get", "set" and "list" commands, with completion of names
+ * - "set a=1 b=2 ..." checks every assignment before applying any
+ * - Values parsed in place from the command line, without copies
+ * - Transactions: after "begin", writes from the shell are staged in a
+ *   fixed arena; "commit" checks them all, applies them in one batch
+ *   (one change hook call each) and persists once; "abort" drops them.
+ *   Each session has its own, in its line state
+ * - tinysh_generate_param_menu() (tinysh_menu.h) builds a menu with one
+ *   entry per parameter
+ *
+ * Example Usage:
+ *
+ * static int32_t fan_speed = 50;
+ * static void fan_changed(tinysh_param_t *p) { pwm_set(fan_speed); }
+ *
+ * TINYSH_PARAM(fan_param, "fan", PARAM_INT, &fan_speed, 0, 100, "%", fan_changed);
+ *
+ * tinysh_param_register(&fan_param);
+ *
+ * tinysh> set fan=75
+ * tinysh> get fan
+ * fan = 75 %
+ * tinysh> begin
+ * tinysh> set fan=20
+ * tinysh> commit
+ * Committed 1 parameter
+ */
+
+#ifndef TINYSH_PARAM_H
+#define TINYSH_PARAM_H
+
+#include "tinysh.h"
+
+/* Parameters that can be registered */
+#ifndef PARAM_MAX_PARAMS
+#define PARAM_MAX_PARAMS          32
+#endif
+
+/* Hash index buckets, a power of two */
+#ifndef PARAM_HASH_BUCKETS
+#define PARAM_HASH_BUCKETS        16
+#endif
+
+/* Bytes of staged value text a transaction can hold; each session's is
+   kept in its line extension (LINE_EXT_SIZE, tinysh.h) */
+#ifndef PARAM_STAGE_SIZE
+#define PARAM_STAGE_SIZE          256
+#endif
+
+/* Parameter types: what value points to */
+#define PARAM_INT                 0     // int32_t
+#define PARAM_UINT                1     // uint32_t
+#define PARAM_BOOL                2     // uint8_t, 0 or 1
+#define PARAM_FLOAT               3     // float
+
+/* Results of parsing and setting */
+#define PARAM_OK                  0
+#define PARAM_ERR_UNKNOWN         -1    // No parameter with that name
+#define PARAM_ERR_SYNTAX          -2    // Value is not of the parameter's type
+#define PARAM_ERR_RANGE           -3    // Value outside min..max
+#define PARAM_ERR_FULL            -4    // Staging area full
+
+/* A parsed value, ready to be stored */
+typedef union {
+    long i;                          // PARAM_INT, PARAM_UINT, PARAM_BOOL
+    float f;                         // PARAM_FLOAT
+} tinysh_param_value_t;
+
+/* Called after each commit */
+typedef void (*tinysh_param_commit_t)(void);
+
+/**
+ * Parameter
+ * Declare with TINYSH_PARAM().
+ */
+typedef struct tinysh_param_t {
+    const char *name;                // Name used by get/set
+    unsigned char type;              // PARAM_*
+    void *value;                     // Variable of the matching C type
+    long min;                        // Inclusive range, not checked
+    long max;                        //   when min == max
+    const char *unit;                // Shown after the value, can be NULL
+    void (*on_change)(struct tinysh_param_t *p); // Called after a set, can be NULL
+
+    /* Maintained by the parameter module */
+    struct tinysh_param_t *hash_next;
+} tinysh_param_t;
+
+/* Declare a parameter */
+#define TINYSH_PARAM(var, pname, ptype, pvalue, pmin, pmax, punit, hook) \
+    tinysh_param_t var = { .name = (pname), .type = (ptype), .value = (pvalue), \
+                           .min = (pmin), .max = (pmax), .unit = (punit), \
+                           .on_change = (hook) }
+
+/**
+ * Make a parameter visible to get/set/list and the menu
+ *
+ * @param p Parameter, must stay valid
+ * @return 0 on success, -1 if the name is taken or the table is full
+ */
+int tinysh_param_register(tinysh_param_t *p);
+
+/**
+ * Take back the parameter registered last
+ * Only the last one, so no other parameter's place changes; meant for
+ * code undoing its own registration before any session could stage it.
+ *
+ * @return 0 on success, -1 if p is not the last registered
+ */
+int tinysh_param_unregister(tinysh_param_t *p);
+
+/**
+ * Find a parameter by name
+ *
+ * @param name Name, need not be terminated
+ * @param len  Length of name, -1 if it is terminated
+ * @return Parameter, or NULL
+ */
+tinysh_param_t *tinysh_param_find(const char *name, int len);
+
+/**
+ * Number of registered parameters
+ */
+int tinysh_param_count(void);
+
+/**
+ * Registered parameter by index, in registration order
+ */
+tinysh_param_t *tinysh_param_at(int i);
+
+/**
+ * Parse and check a value without storing it
+ *
+ * @param s   Value text, need not be terminated
+ * @param len Length of s, -1 if it is terminated
+ * @param out Parsed value
+ * @return PARAM_OK, PARAM_ERR_SYNTAX or PARAM_ERR_RANGE
+ */
+int tinysh_param_parse(const tinysh_param_t *p, const char *s, int len,
+                       tinysh_param_value_t *out);
+
+/**
+ * Store a parsed value; does not call the change hook
+ */
+void tinysh_param_store(tinysh_param_t *p, tinysh_param_value_t v);
+
+/**
+ * Parse, store, and call the change hook
+ *
+ * @return PARAM_OK, PARAM_ERR_SYNTAX or PARAM_ERR_RANGE
+ */
+int tinysh_param_set(tinysh_param_t *p, const char *s, int len);
+
+/**
+ * Write from the shell: staged while a transaction is open, otherwise
+ * the same as tinysh_param_set()
+ * Staged values are checked now and again when committing.
+ *
+ * @return PARAM_OK, PARAM_ERR_SYNTAX, PARAM_ERR_RANGE or PARAM_ERR_FULL
+ */
+int tinysh_param_write(tinysh_param_t *p, const char *s, int len);
+
+/**
+ * Open a transaction
+ *
+ * @return 0, or -1 if one is already open
+ */
+int tinysh_param_begin(void);
+
+/**
+ * Apply the staged values and close the transaction
+ * Nothing is stored unless every staged value is valid. Each change hook
+ * is called once after all values are stored, then the commit hook.
+ *
+ * @param failed Receives the parameter that failed to validate, can be NULL
+ * @return Number of parameters applied, or PARAM_ERR_* (the transaction
+ *         stays open)
+ */
+int tinysh_param_commit(tinysh_param_t **failed);
+
+/**
+ * Drop the staged values and close the transaction
+ *
+ * @return Number of values dropped
+ */
+int tinysh_param_abort(void);
+
+/**
+ * Is a transaction open
+ */
+int tinysh_param_in_transaction(void);
+
+/**
+ * Staged value text of a parameter
+ *
+ * @param buf  Output buffer, always terminated
+ * @param size Size of buf
+ * @return Length of the text, -1 if nothing is staged for p
+ */
+int tinysh_param_staged(const tinysh_param_t *p, char *buf, int size);
+
+/**
+ * Set the function called after each commit, e.g. to save to flash
+ *
+ * @param fn Called once per commit, NULL for none
+ * @return The function set before, NULL if none
+ */
+tinysh_param_commit_t tinysh_param_on_commit(tinysh_param_commit_t fn);
+
+/**
+ * Current value as text
+ *
+ * @param buf  Output buffer, always terminated
+ * @param size Size of buf
+ * @return Length of the text
+ */
+int tinysh_param_format(const tinysh_param_t *p, char *buf, int size);
+
+/**
+ * Error message for a PARAM_ERR_* code
+ */
+const char *tinysh_param_error(int err);
+
+/**
+ * Register the get, set, list, begin, commit and abort commands
+ */
+void tinysh_param_init(void);
+
+/* Parameter commands */
+extern tinysh_cmd_t get_cmd;
+extern tinysh_cmd_t set_cmd;
+extern tinysh_cmd_t list_cmd;
+extern tinysh_cmd_t begin_cmd;
+extern tinysh_cmd_t commit_cmd;
+extern tinysh_cmd_t abort_cmd;
+
+#endif /* TINYSH_PARAM_H */
@@ -0,0 +1,155 @@
+#include "tinysh_progress.h"
+#include "tinysh_term.h"
+#include "tinysh.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Progress line state */
+static const char *prog_label = "";
+static unsigned long prog_total = 0;
+static unsigned long prog_done = 0;
+static unsigned long prog_check_at = 0;   /* next count worth a clock read */
+static unsigned long prog_start = 0;
+static unsigned long prog_next_draw = 0;
+static unsigned long prog_redraws = 0;
+static char prog_active = 0;
+static char prog_shown[PROGRESS_LINE_SIZE];
+
+/* Forward declarations */
+static void format_count(char *buf, int size, unsigned long n);
+static void format_line(char *buf, unsigned long now);
+static void draw(unsigned long now, int force);
+
+/**
+ * Short human-readable count: 1234, 12k, 3M
+ */
+static void format_count(char *buf, int size, unsigned long n) {
+    if (n < 10000UL) {
+        snprintf(buf, (size_t)size, "%lu", n);
+    } else if (n < 10000000UL) {
+        snprintf(buf, (size_t)size, "%luk", n / 1000UL);
+    } else {
+        snprintf(buf, (size_t)size, "%luM", n / 1000000UL);
+    }
+}
+
+/**
+ * Build the progress line for the current state
+ */
+static void format_line(char *buf, unsigned long now) {
+    char stats[64];
+    char rate[12];
+    unsigned long elapsed = now - prog_start;
+    int width, bar, fill, len, i;
+
+    if (elapsed > 0) {
+        format_count(rate, sizeof(rate),
+                     (unsigned long)((unsigned long long)prog_done * 1000ULL / elapsed));
+    } else {
+        strcpy(rate, "-");
+    }
+
+    if (prog_total) {
+        unsigned long pct = (unsigned long)((unsigned long long)prog_done * 100ULL / prog_total);
+        if (prog_done > 0 && elapsed > 0 && prog_done < prog_total) {
+            /* Rounded up, so it only reads 0:00 when done */
+            unsigned long long per = (unsigned long long)prog_done * 1000ULL;
+            unsigned long eta = (unsigned long)(((unsigned long long)(prog_total - prog_done) *
+                                                 elapsed + per - 1) / per);
+            snprintf(stats, sizeof(stats), "%3lu%% %5s/s ETA %2lu:%02lu",
+                     pct, rate, eta / 60, eta % 60);
+        } else {
+            snprintf(stats, sizeof(stats), "%3lu%% %5s/s ETA --:--", pct, rate);
+        }
+    } else {
+        char count[12];
+        format_count(count, sizeof(count), prog_done);
+        snprintf(stats, sizeof(stats), "%s %5s/s", count, rate);
+    }
+
+    width = tinysh_term_cols() - 1;
+    if (width > PROGRESS_LINE_SIZE - 1) width = PROGRESS_LINE_SIZE - 1;
+
+    bar = width - (int)strlen(prog_label) - (int)strlen(stats) - 4;
+    if (!prog_total || bar < PROGRESS_MIN_BAR) {
+        snprintf(buf, PROGRESS_LINE_SIZE, "%s %s", prog_label, stats);
+        return;
+    }
+
+    fill = (int)((unsigned long long)bar * prog_done / prog_total);
+    if (fill > bar) fill = bar;
+
+    len = snprintf(buf, PROGRESS_LINE_SIZE, "%s [", prog_label);
+    for (i = 0; i < bar; i++) {
+        buf[len++] = (i < fill) ? '#' : '-';
+    }
+    snprintf(buf + len, (size_t)(PROGRESS_LINE_SIZE - len), "] %s", stats);
+}
+
+/**
+ * Redraw the line if its text changed
+ */
+static void draw(unsigned long now, int force) {
+    char text[PROGRESS_LINE_SIZE];
+
+    if (!force && tinysh_millis && (long)(now - prog_next_draw) < 0) return;
+    prog_next_draw = now + 1000 / PROGRESS_MAX_FPS;
+
+    format_line(text, now);
+    if (strcmp(text, prog_shown) == 0) return;
+
+    tinysh_char_out('\r');
+    tinysh_term_rewrite(prog_shown, text);
+    strcpy(prog_shown, text);
+    prog_redraws++;
+}
+
+/**
+ * Start a progress line
+ */
+void tinysh_progress_begin(const char *label, unsigned long total) {
+    prog_label = label ? label : "";
+    prog_total = total;
+    prog_done = 0;
+    prog_check_at = 0;
+    prog_redraws = 0;
+    prog_shown[0] = 0;
+    prog_start = tinysh_time_ms();
+    prog_active = 1;
+
+    draw(prog_start, 1);
+}
+
+/**
+ * Report progress
+ */
+void tinysh_progress_update(unsigned long done) {
+    unsigned long step;
+
+    prog_done = done;
+
+    /* Cheap path: only look at the clock every ~0.1% of the work */
+    if (!prog_active || done < prog_check_at) return;
+    step = (prog_total ? prog_total : done) / 1000UL;
+    prog_check_at = done + (step ? step : 1);
+
+    draw(tinysh_time_ms(), 0);
+}
+
+/**
+ * End the progress line
+ */
+void tinysh_progress_end(void) {
+    if (!prog_active) return;
+
+    draw(tinysh_time_ms(), 1);
+    tinysh_puts("\r\n");
+    prog_active = 0;
+}
+
+/**
+ * Number of redraws since begin
+ */
+unsigned long tinysh_progress_redraws(void) {
+    return prog_redraws;
+}
@@ -0,0 +1,69 @@
+/**
+ * TinyShell Progress Reporting
+ * --------------------------
+ * A single progress line for long-running handlers (erase, transfer,
+ * calibration), redrawn in place instead of printing a line per step.
+ *
+ * Features:
+ * - Bar, percentage, rate and ETA on one line sized to the terminal
+ * - Redrawn at most PROGRESS_MAX_FPS times per second, and only when the
+ *   visible text changed; unchanged parts are skipped by the encoder
+ * - tinysh_progress_update() is cheap enough for a tight loop: it reads
+ *   the clock only when the count moved by about 0.1% of the total
+ *
+ * Example Usage:
+ *
+ * tinysh_progress_begin("Erasing", sectors);
+ * for (i = 0; i < sectors; i++) {
+ *     erase_sector(i);
+ *     tinysh_progress_update(i + 1);
+ * }
+ * tinysh_progress_end();
+ */
+
+#ifndef TINYSH_PROGRESS_H
+#define TINYSH_PROGRESS_H
+
+#include "tinysh.h"
+
+/* Most redraws per second */
+#ifndef PROGRESS_MAX_FPS
+#define PROGRESS_MAX_FPS          4
+#endif
+
+/* Longest progress line, including terminator */
+#ifndef PROGRESS_LINE_SIZE
+#define PROGRESS_LINE_SIZE        80
+#endif
+
+/* Narrowest bar worth drawing; below this only the numbers are shown */
+#ifndef PROGRESS_MIN_BAR
+#define PROGRESS_MIN_BAR          8
+#endif
+
+/**
+ * Start a progress line
+ *
+ * @param label Text shown in front of the bar (kept by reference)
+ * @param total Number of steps, 0 if unknown (no bar, percentage or ETA)
+ */
+void tinysh_progress_begin(const char *label, unsigned long total);
+
+/**
+ * Report how many steps are done
+ *
+ * @param done Steps completed so far
+ */
+void tinysh_progress_update(unsigned long done);
+
+/**
+ * Draw the final state and end the progress line
+ */
+void tinysh_progress_end(void);
+
+/**
+ * Number of times the line was actually redrawn since begin
+ */
+unsigned long tinysh_progress_redraws(void);
+
+#endif /* TINYSH_PROGRESS_H */
@@ -0,0 +1,326 @@
+#include "tinysh_retain.h"
+#include "tinysh_param.h"
+#include "tinysh.h"
+#include <string.h>
+
+#define DEPTH           (HISTORY_DEPTH > 0 ? HISTORY_DEPTH : 1)
+
+static tinysh_retain_t *block = NULL;
+static char ready = 0;               /* restore ran: the block may be updated */
+static char pending = 0;             /* context and staged changes still to restore */
+static tinysh_retain_stats_t stats = { RETAIN_NONE, 0, 0, 0, 0, 0, 0 };
+
+/* Forward declarations */
+static uint32_t body_crc(void);
+static void start_over(void);
+static int put(void *dst, const void *src, int len);
+static int put_str(char *dst, const char *src, int size);
+static int path_of(const tinysh_cmd_t *cmd, char *buf, int size);
+static tinysh_cmd_t *resolve(const char *path);
+static void finish(tinysh_line_t *console);
+void retain_cmd_handler(int argc, const char **argv);
+
+/* Retain command */
+tinysh_cmd_t retain_cmd = {
+    0, "retain", "show state kept across resets", 0,
+    retain_cmd_handler, 0, 0, 0
+};
+
+/**
+ * CRC of the block's body
+ */
+static uint32_t body_crc(void) {
+    return tinysh_crc32(0, &block->body, (int)sizeof(block->body));
+}
+
+/**
+ * Make the block valid and empty
+ */
+static void start_over(void) {
+    memset(block, 0, sizeof(*block));
+    block->magic = RETAIN_MAGIC;
+    block->version = RETAIN_VERSION;
+    block->size = (uint16_t)sizeof(tinysh_retain_t);
+    block->crc = body_crc();
+}
+
+/**
+ * Copy len bytes unless they are the same already
+ *
+ * @return 1 if dst changed
+ */
+static int put(void *dst, const void *src, int len) {
+    if (memcmp(dst, src, (size_t)len) == 0) return 0;
+    memcpy(dst, src, (size_t)len);
+    return 1;
+}
+
+/**
+ * Copy a string, cut to size, unless it is the same already
+ *
+ * @return 1 if dst changed
+ */
+static int put_str(char *dst, const char *src, int size) {
+    int len = tinysh_strlen(src);
+
+    if (len > size - 1) len = size - 1;
+    if (strncmp(dst, src, (size_t)len) == 0 && dst[len] == 0) return 0;
+    memcpy(dst, src, (size_t)len);
+    dst[len] = 0;
+    return 1;
+}
+
+/**
+ * Names of cmd and its parents, outermost first
+ *
+ * @return Length, or -1 if they do not fit
+ */
+static int path_of(const tinysh_cmd_t *cmd, char *buf, int size) {
+    int n = cmd->parent ? path_of(cmd->parent, buf, size) : 0;
+    int len = tinysh_strlen(cmd->name);
+
+    if (n < 0 || n + (n > 0) + len + 1 > size) return -1;
+    if (n) buf[n++] = ' ';
+    memcpy(buf + n, cmd->name, (size_t)len + 1);
+    return n + len;
+}
+
+/**
+ * Find the context a path of names leads to
+ *
+ * @return The innermost command, or NULL if a name is missing or is not
+ *         a context any more
+ */
+static tinysh_cmd_t *resolve(const char *path) {
+    tinysh_cmd_t *list = tinysh_get_root_cmd(), *cmd = NULL;
+    const char *name = path, *end;
+    int len;
+
+    while (*name) {
+        for (end = name; *end && *end != ' '; end++);
+        len = (int)(end - name);
+        for (cmd = list; cmd; cmd = cmd->next) {
+            if (strncmp(cmd->name, name, (size_t)len) == 0 && cmd->name[len] == 0) break;
+        }
+        if (!cmd || !cmd->child) return NULL;
+        list = cmd->child;
+        name = *end ? end + 1 : end;
+    }
+    return cmd;
+}
+
+/**
+ * Use a block
+ */
+void tinysh_retain_attach(tinysh_retain_t *b) {
+    block = b;
+    ready = 0;
+    pending = 0;
+}
+
+/**
+ * Stop using the block for a while
+ */
+void tinysh_retain_suspend(tinysh_retain_saved_t *saved) {
+    saved->block = block;
+    saved->ready = ready;
+    saved->pending = pending;
+    saved->stats = stats;
+    tinysh_retain_attach(NULL);
+}
+
+/**
+ * Go back to a suspended block
+ */
+void tinysh_retain_resume(const tinysh_retain_saved_t *saved) {
+    block = saved->block;
+    ready = saved->ready;
+    pending = saved->pending;
+    stats = saved->stats;
+}
+
+/**
+ * Check the block and restore the history
+ */
+int tinysh_retain_restore(void) {
+    tinysh_line_t *line, *console;
+    int i, err = RETAIN_OK;
+
+    memset(&stats, 0, sizeof(stats));
+    if (!block) return stats.result = RETAIN_NONE;
+
+    if (block->magic != RETAIN_MAGIC) {
+        err = RETAIN_EMPTY;
+    } else if (block->version != RETAIN_VERSION || block->size != (uint16_t)sizeof(tinysh_retain_t)) {
+        err = RETAIN_STALE;
+    } else if (block->crc != body_crc()) {
+        err = RETAIN_CORRUPT;
+    }
+    ready = 1;
+    stats.result = err;
+    if (err != RETAIN_OK) {
+        start_over();
+        return err;
+    }
+
+    line = tinysh_line_select(0);
+    console = tinysh_line_current();
+    block->body.history_index %= DEPTH;
+    for (i = 0; i < DEPTH; i++) {
+        block->body.history[i][BUFFER_SIZE] = 0;
+        if (i == block->body.history_index) block->body.history[i][0] = 0;
+        memcpy(console->input_buffers[i], block->body.history[i], BUFFER_SIZE + 1);
+        if (block->body.history[i][0]) stats.history++;
+    }
+    console->cur_buf_index = block->body.history_index;
+    console->cur_index = 0;
+    tinysh_line_select(line);
+
+    stats.resets = ++block->body.resets;
+    block->crc = body_crc();
+    pending = 1;
+    return RETAIN_OK;
+}
+
+/**
+ * Restore the context and staged changes, by name
+ */
+static void finish(tinysh_line_t *console) {
+    tinysh_retain_t *b = block;
+    tinysh_param_t *p;
+    const char *entry, *eq;
+    tinysh_cmd_t *cmd;
+    int off, used = b->body.stage_used < RETAIN_STAGE_SIZE ? b->body.stage_used : RETAIN_STAGE_SIZE;
+
+    pending = 0;
+    b->body.path[RETAIN_PATH_SIZE - 1] = 0;
+    b->body.context[BUFFER_SIZE] = 0;
+    if (b->body.path[0]) {
+        cmd = resolve(b->body.path);
+        if (cmd) {
+            console->cur_cmd_ctx = cmd;
+            memcpy(console->context_buffer, b->body.context, BUFFER_SIZE + 1);
+            console->cur_context = tinysh_strlen(console->context_buffer);
+            stats.context = 1;
+        } else {
+            stats.dropped++;
+        }
+    }
+
+    if (!b->body.in_transaction || tinysh_param_begin() < 0) return;
+    b->body.stage[RETAIN_STAGE_SIZE - 1] = 0;
+    for (off = 0; off < used; off += tinysh_strlen(entry) + 1) {
+        entry = b->body.stage + off;
+        eq = strchr(entry, '=');
+        p = eq ? tinysh_param_find(entry, (int)(eq - entry)) : NULL;
+        if (p && tinysh_param_write(p, eq + 1, -1) == PARAM_OK) {
+            stats.staged++;
+        } else {
+            stats.dropped++;
+        }
+    }
+}
+
+/**
+ * Finish restoring, then update the block with what changed
+ * The line being edited is kept empty, so typing changes nothing.
+ */
+int tinysh_retain_tick(void) {
+    tinysh_retain_t *b = block;
+    tinysh_line_t *line, *console;
+    char path[RETAIN_PATH_SIZE];
+    char stage[RETAIN_STAGE_SIZE];
+    char value[BUFFER_SIZE + 1];
+    uint8_t in_transaction;
+    uint8_t index;
+    uint16_t used = 0;
+    tinysh_param_t *p;
+    int i, n, secret, dirty = 0;
+
+    if (!b || !ready) return 0;
+    line = tinysh_line_select(0);
+    console = tinysh_line_current();
+    if (pending) finish(console);
+
+    // History, but no line that gives a password: the block outlives the session
+    index = (uint8_t)(console->cur_buf_index % DEPTH);
+    for (i = 0; i < DEPTH; i++) {
+        secret = i != index && tinysh_secret_at(console->input_buffers[i]) >= 0;
+        dirty |= put_str(b->body.history[i], i == index || secret ? "" : console->input_buffers[i],
+                         BUFFER_SIZE + 1);
+    }
+    dirty |= put(&b->body.history_index, &index, (int)sizeof(index));
+    dirty |= put_str(b->body.context, console->context_buffer, BUFFER_SIZE + 1);
+    if (!console->cur_cmd_ctx || path_of(console->cur_cmd_ctx, path, sizeof(path)) < 0) path[0] = 0;
+    dirty |= put_str(b->body.path, path, RETAIN_PATH_SIZE);
+
+    // The console's staged changes by name; one that does not fit is not kept
+    in_transaction = (uint8_t)tinysh_param_in_transaction();
+    for (i = 0; in_transaction && i < tinysh_param_count(); i++) {
+        p = tinysh_param_at(i);
+        if (tinysh_param_staged(p, value, sizeof(value)) < 0) continue;
+        n = tinysh_strlen(p->name);
+        if (used + n + 1 + tinysh_strlen(value) + 1 > RETAIN_STAGE_SIZE) continue;
+        memcpy(stage + used, p->name, (size_t)n);
+        stage[used + n] = '=';
+        used = (uint16_t)(used + n + 1);
+        n = tinysh_strlen(value);
+        memcpy(stage + used, value, (size_t)n + 1);
+        used = (uint16_t)(used + n + 1);
+    }
+    tinysh_line_select(line);
+    dirty |= put(&b->body.in_transaction, &in_transaction, (int)sizeof(in_transaction));
+    dirty |= put(&b->body.stage_used, &used, (int)sizeof(used));
+    if (used) dirty |= put(b->body.stage, stage, used);
+
+    if (!dirty) return 0;
+    b->crc = body_crc();
+    stats.saves++;
+    return 1;
+}
+
+/**
+ * What restoring found, and counters
+ */
+void tinysh_retain_stats(tinysh_retain_stats_t *st) {
+    *st = stats;
+}
+
+/**
+ * Message for a RETAIN_* result
+ */
+const char *tinysh_retain_error(int err) {
+    switch (err) {
+    case RETAIN_OK:          return "ok";
+    case RETAIN_EMPTY:       return "nothing retained";
+    case RETAIN_STALE:       return "layout of another firmware";
+    case RETAIN_CORRUPT:     return "checksum mismatch";
+    case RETAIN_NONE:        return "no retained memory";
+    default:                 return "error";
+    }
+}
+
+/**
+ * Retain command handler
+ */
+void retain_cmd_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    if (stats.result == RETAIN_NONE) {
+        tinysh_puts("No retained memory\r\n");
+        return;
+    }
+    if (stats.result == RETAIN_OK) {
+        tinysh_printf("Restored after reset %lu: %d history line%s, %s, %d staged change%s",
+                      stats.resets, stats.history, stats.history == 1 ? "" : "s",
+                      stats.context ? "context" : "no context",
+                      stats.staged, stats.staged == 1 ? "" : "s");
+        if (stats.dropped) tinysh_printf(", %d dropped", stats.dropped);
+        tinysh_puts("\r\n");
+    } else {
+        tinysh_printf("Started over: %s\r\n", tinysh_retain_error(stats.result));
+    }
+    tinysh_printf("Block %u bytes, updated %lu time%s since\r\n", (unsigned)sizeof(tinysh_retain_t),
+                  stats.saves, stats.saves == 1 ? "" : "s");
+}
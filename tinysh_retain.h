@@ -0,0 +1,164 @@
+/**
+ * TinyShell Retained State
+ * -----------------------
+ * Keeps the console's history, context and staged parameter changes in
+ * RAM that a reset does not clear, so a watchdog reset or a firmware
+ * update does not throw the operator back to an empty prompt.
+ *
+ * Features:
+ * - One block with a header (magic, layout version and size, CRC-32 of
+ *   the rest); a cold boot, another firmware's layout or a torn update
+ *   all fail the check, and the block starts over empty
+ * - The block lives in a ".noinit" section that startup code leaves
+ *   alone (TINYSH_RETAIN_BLOCK), or wherever the port maps it; on Linux
+ *   it is a file mapped into memory (tiny_port.h), so a restart of the
+ *   process plays the part of a reset
+ * - Context and staged changes are kept by name, not by pointer or
+ *   index, so they survive a firmware update that moved things around;
+ *   names the new firmware lacks are dropped
+ * - Updated from the main loop only when something changed: unchanged
+ *   fields cost a compare, and the CRC is computed once per change. The
+ *   line being typed is not kept, so typing writes nothing
+ * - The auth level is not kept: a reset always logs the admin out, and
+ *   history lines that give a password (auth) are left out
+ * - "retain" command: what was restored, how often the block was saved
+ *
+ * Restoring takes two steps: tinysh_retain_restore() checks the block and
+ * restores the history when the port is set up; the context and staged
+ * changes need the command tree and parameters, and are restored by the
+ * first tinysh_retain_tick().
+ *
+ * Example Usage:
+ *
+ * TINYSH_RETAIN_BLOCK(retained);          // in the port, one per image
+ *
+ * tinysh_retain_attach(&retained);
+ * tinysh_retain_restore();                // in tiny_port_setup()
+ * ...
+ * tinysh_retain_tick();                   // main loop, each pass
+ */
+
+#ifndef TINYSH_RETAIN_H
+#define TINYSH_RETAIN_H
+
+#include "tinysh.h"
+
+/* Section the block goes in; the linker script must not load or zero it */
+#ifndef RETAIN_SECTION
+#define RETAIN_SECTION            ".noinit"
+#endif
+
+/* Bytes of context command names, separated by spaces */
+#ifndef RETAIN_PATH_SIZE
+#define RETAIN_PATH_SIZE          64
+#endif
+
+/* Bytes of staged changes, as "name=value" strings */
+#ifndef RETAIN_STAGE_SIZE
+#define RETAIN_STAGE_SIZE         384
+#endif
+
+/* Block header */
+#define RETAIN_MAGIC              0x31525354U  // "TSR1"
+#define RETAIN_VERSION            1           // Bump when the body changes meaning
+
+/* Results of restoring */
+#define RETAIN_OK                 0
+#define RETAIN_EMPTY              -1    // No block there: cold boot
+#define RETAIN_STALE              -2    // Written by a firmware with another layout
+#define RETAIN_CORRUPT            -3    // Checksum mismatch, e.g. reset during an update
+#define RETAIN_NONE               -4    // No block attached
+
+/**
+ * Retained block
+ * Only the header is read before the CRC has been checked.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;                   // sizeof(tinysh_retain_t)
+    uint32_t crc;                    // Of body
+    struct {
+        uint32_t resets;             // Resets the block survived
+        char history[HISTORY_DEPTH > 0 ? HISTORY_DEPTH : 1][BUFFER_SIZE + 1];
+        uint8_t history_index;       // Entry being edited, kept empty
+        char context[BUFFER_SIZE + 1];   // Context as shown in the prompt
+        char path[RETAIN_PATH_SIZE];     // Names of the context commands, outermost first
+        uint8_t in_transaction;
+        uint16_t stage_used;
+        char stage[RETAIN_STAGE_SIZE];   // "name=value\0" per staged change
+    } body;
+} tinysh_retain_t;
+
+/* Define the block in the no-init section */
+#define TINYSH_RETAIN_BLOCK(var) \
+    tinysh_retain_t var __attribute__((section(RETAIN_SECTION)))
+
+/* What restoring found and did */
+typedef struct {
+    int result;                      // RETAIN_*
+    unsigned long resets;            // Resets survived
+    int history;                     // History lines restored
+    int context;                     // 1 if the context was restored
+    int staged;                      // Staged changes restored
+    int dropped;                     // Context or changes the firmware no longer has
+    unsigned long saves;             // Updates of the block since restoring
+} tinysh_retain_stats_t;
+
+/* The block in use and how far restoring got, kept by tinysh_retain_suspend() */
+typedef struct {
+    tinysh_retain_t *block;
+    char ready;
+    char pending;
+    tinysh_retain_stats_t stats;
+} tinysh_retain_saved_t;
+
+/**
+ * Use a block; NULL stops keeping state
+ * Nothing is read or written until tinysh_retain_restore().
+ */
+void tinysh_retain_attach(tinysh_retain_t *block);
+
+/**
+ * Stop using the block for a while, e.g. while a test attaches its own
+ * The block is not written until tinysh_retain_resume().
+ *
+ * @param saved Receives the block, restore progress and counters
+ */
+void tinysh_retain_suspend(tinysh_retain_saved_t *saved);
+
+/**
+ * Go back to the block tinysh_retain_suspend() left, as it was then
+ */
+void tinysh_retain_resume(const tinysh_retain_saved_t *saved);
+
+/**
+ * Check the block and restore the console's history from it
+ * A block that fails the check is started over empty.
+ *
+ * @return RETAIN_OK, RETAIN_EMPTY, RETAIN_STALE, RETAIN_CORRUPT or RETAIN_NONE
+ */
+int tinysh_retain_restore(void);
+
+/**
+ * Finish restoring, then bring the block up to date if the state changed
+ * Call from the main loop once the command tree and parameters are set up.
+ *
+ * @return 1 if the block was updated, 0 otherwise
+ */
+int tinysh_retain_tick(void);
+
+/**
+ * What restoring found, and counters
+ */
+void tinysh_retain_stats(tinysh_retain_stats_t *st);
+
+/**
+ * Message for a RETAIN_* result
+ */
+const char *tinysh_retain_error(int err);
+
+/* Retain command */
+extern tinysh_cmd_t retain_cmd;
+
+#endif /* TINYSH_RETAIN_H */
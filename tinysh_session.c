@@ -0,0 +1,927 @@
+#include "tinysh_session.h"
+#include "tinysh.h"
+#include "tinysh_term.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Scrollback block */
+struct tinysh_sb_block_t {
+    tinysh_sb_block_t *next;
+    char data[SCROLLBACK_BLOCK_SIZE];
+};
+
+/* Blocks shared by all sessions; taken and given back under pool_lock */
+static tinysh_sb_block_t pool[SCROLLBACK_POOL_BLOCKS > 0 ? SCROLLBACK_POOL_BLOCKS : 1];
+static tinysh_sb_block_t *pool_free = NULL;
+static int pool_count = 0;              /* blocks in pool_free */
+static char pool_ready = 0;
+
+#if TINYSH_THREADS
+static char pool_lock = 0;
+#define POOL_LOCK()    while (__atomic_test_and_set(&pool_lock, __ATOMIC_ACQUIRE))
+#define POOL_UNLOCK()  __atomic_clear(&pool_lock, __ATOMIC_RELEASE)
+#else
+#define POOL_LOCK()
+#define POOL_UNLOCK()
+#endif
+
+/* Longest line "scrollback search" shows */
+#define SEARCH_LINE    128
+
+/* Session whose input this thread is processing */
+static TINYSH_TLS tinysh_session_t *current = NULL;
+
+/* Sees all input and output, if set */
+static void (*tap)(const tinysh_session_t *s, int what, const char *buf, int len) = NULL;
+
+/* Output being written is the echo of a password character: the tap
+   sees it starred */
+static TINYSH_TLS char echo_secret = 0;
+
+/* What a session replaces on its thread while its input runs */
+typedef struct {
+    tinysh_session_t *session;
+    tinysh_line_t *line;
+    tinysh_term_size_t *size;
+    void (*char_out)(unsigned char);
+    int (*printf)(const char *, ...);
+    void (*block_out)(const char *, int);
+} session_saved_t;
+
+/* Forward declarations */
+static void session_write(const char *buf, int len);
+static void session_char_out(unsigned char c);
+static int session_printf(const char *fmt, ...);
+static void session_enter(tinysh_session_t *s, session_saved_t *saved);
+static void session_leave(const session_saved_t *saved);
+static void session_char(tinysh_session_t *s, char c);
+static void tap_starred(const tinysh_session_t *s, int what, const char *buf, int len);
+static void tap_input(tinysh_session_t *s, const char *queued, int nqueued,
+                      const char *buf, int len);
+static int is_line_end(const tinysh_session_t *s, char c);
+static int rank(const tinysh_session_t *s);
+static int session_run(tinysh_sched_t *sched, tinysh_session_t *s);
+static tinysh_sb_block_t *pool_take(void);
+static void pool_give(tinysh_sb_block_t *first, tinysh_sb_block_t *last, int n);
+static void sb_append(tinysh_session_t *s, const char *buf, int len);
+static const char *sb_at(const tinysh_session_t *s, unsigned long pos, int *len);
+static unsigned long sb_end(const tinysh_session_t *s);
+static void sb_mask(tinysh_session_t *s, unsigned long from, unsigned long to);
+static int is_secret(const tinysh_session_t *s);
+static unsigned long undelivered(const tinysh_session_t *s);
+static int search_line(const tinysh_session_t *s, unsigned long *pos, unsigned long end, char *line);
+void quota_cmd_handler(int argc, const char **argv);
+void scrollback_cmd_handler(int argc, const char **argv);
+
+/* Quota command */
+tinysh_cmd_t quota_cmd = {
+    0, "quota", "show or set this session's scheduling quota",
+    "[bytes=N] [lines=N] [out=N] [priority=N]",
+    quota_cmd_handler, 0, 0, 0
+};
+
+/* Scrollback command */
+tinysh_cmd_t scrollback_cmd = {
+    0, "scrollback", "show or search this session's scrollback", "[search TEXT]",
+    scrollback_cmd_handler, 0, 0, 0
+};
+
+/**
+ * Append output to the current session's buffer
+ * It goes to the scrollback first, whole, even what the buffer drops.
+ */
+static void session_write(const char *buf, int len) {
+    tinysh_session_t *s = current;
+    int room;
+
+    if (!s || len <= 0) return;
+
+    if (tap) {
+        if (echo_secret) {
+            tap_starred(s, SESSION_TAP_OUT, buf, len);
+        } else {
+            tap(s, SESSION_TAP_OUT, buf, len);
+        }
+    }
+    if (s->sb_on) sb_append(s, buf, len);
+    if (s->detached) {
+        s->written += (unsigned long)len;
+        return;
+    }
+
+    while (len > 0) {
+        /* Move unsent output to the front when the tail is too short */
+        if (s->out_head && s->out_head + s->out_len + len > SESSION_OUT_SIZE) {
+            memmove(s->out, s->out + s->out_head, (size_t)s->out_len);
+            s->out_head = 0;
+        }
+        room = SESSION_OUT_SIZE - s->out_head - s->out_len;
+        if (room == 0 && s->flush) {
+            s->flush(s);
+            if (s->out_head) continue;
+            room = SESSION_OUT_SIZE - s->out_len;
+        }
+        if (room == 0) {
+            if (!s->gap) {
+                s->gap = 1;
+                s->gap_pos = s->written;
+            }
+            s->dropped += (unsigned long)len;
+            s->written += (unsigned long)len;
+            return;
+        }
+        if (room > len) room = len;
+        if (!s->out_len) s->head_pos = s->written;
+        memcpy(s->out + s->out_head + s->out_len, buf, (size_t)room);
+        s->out_len += room;
+        s->bytes_out += (unsigned long)room;
+        s->written += (unsigned long)room;
+        buf += room;
+        len -= room;
+    }
+}
+
+/**
+ * Character output of the current session
+ */
+static void session_char_out(unsigned char c) {
+    char ch = (char)c;
+    session_write(&ch, 1);
+}
+
+/**
+ * Formatted output of the current session
+ */
+static int session_printf(const char *fmt, ...) {
+    char buf[BUFFER_SIZE * 2];
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (len < 0) return len;
+    session_write(buf, len < (int)sizeof(buf) ? len : (int)sizeof(buf) - 1);
+    return len;
+}
+
+/**
+ * Make a session current on this thread
+ */
+static void session_enter(tinysh_session_t *s, session_saved_t *saved) {
+    saved->session = current;
+    saved->char_out = tinysh_char_out;
+    saved->printf = tinysh_printf;
+    saved->block_out = tinysh_block_out;
+    saved->line = tinysh_line_select(&s->line);
+    saved->size = tinysh_term_select_size(&s->size);
+
+    current = s;
+    tinysh_char_out = session_char_out;
+    tinysh_printf = session_printf;
+    tinysh_block_out = session_write;
+}
+
+/**
+ * Put back what session_enter() replaced
+ */
+static void session_leave(const session_saved_t *saved) {
+    if (tap) tap(current, SESSION_TAP_END, NULL, 0);
+    tinysh_block_out = saved->block_out;
+    tinysh_printf = saved->printf;
+    tinysh_char_out = saved->char_out;
+    tinysh_term_select_size(saved->size);
+    tinysh_line_select(saved->line);
+    current = saved->session;
+}
+
+/**
+ * Does c end a line (the LF of a CR LF does not)
+ */
+static int is_line_end(const tinysh_session_t *s, char c) {
+    return c == '\r' || (c == '\n' && !s->last_cr);
+}
+
+/**
+ * Give the tap a copy with all but line ends starred
+ */
+static void tap_starred(const tinysh_session_t *s, int what, const char *buf, int len) {
+    char stars[64];
+    int i, n;
+
+    while (len > 0) {
+        n = len < (int)sizeof(stars) ? len : (int)sizeof(stars);
+        for (i = 0; i < n; i++) stars[i] = (buf[i] == '\r' || buf[i] == '\n') ? buf[i] : '*';
+        tap(s, what, stars, n);
+        buf += n;
+        len -= n;
+    }
+}
+
+/**
+ * Give the tap input as received, the characters of a password starred
+ * What the line holds when each byte is processed follows from the line
+ * as it stands and the input queued before this.
+ */
+static void tap_input(tinysh_session_t *s, const char *queued, int nqueued,
+                      const char *buf, int len) {
+    char text[BUFFER_SIZE + 1], out[64];
+    tinysh_line_t *prev = tinysh_line_select(&s->line);
+    int i, at, n, k = 0;
+    char c;
+
+    n = tinysh_strlen(s->line.input_buffers[s->line.cur_buf_index]);
+    memcpy(text, s->line.input_buffers[s->line.cur_buf_index], (size_t)n);
+    for (i = 0; i < nqueued + len; i++) {
+        c = i < nqueued ? queued[i] : buf[i - nqueued];
+        if (c == '\r' || c == '\n') {
+            n = 0;
+        } else if (c == 8 || c == 127) {
+            if (n > 0) n--;
+        } else if ((unsigned char)c >= ' ') {
+            text[n] = 0;
+            at = tinysh_secret_at(text);
+            if (n < BUFFER_SIZE) text[n++] = c;
+            if (at >= 0 && n > at) c = '*';
+        }
+        if (i < nqueued) continue;
+        out[k++] = c;
+        if (k == (int)sizeof(out)) {
+            tap(s, SESSION_TAP_IN, out, k);
+            k = 0;
+        }
+    }
+    if (k) tap(s, SESSION_TAP_IN, out, k);
+    tinysh_line_select(prev);
+}
+
+/**
+ * Process one input character of the current session
+ */
+static void session_char(tinysh_session_t *s, char c) {
+    s->bytes_in++;
+    echo_secret = tap && tinysh_secret_char(c);
+    if (c == '\n' && s->last_cr) {
+        s->last_cr = 0;
+        echo_secret = 0;
+        return;
+    }
+    s->last_cr = (c == '\r');
+    if (!s->line.input_buffers[s->line.cur_buf_index][0]) s->line_pos = s->written;
+    if (c == '\r' || c == '\n') {
+        s->lines++;
+        if (s->sb_on && is_secret(s)) sb_mask(s, s->line_pos, s->written);
+    }
+    tinysh_char_in(c);
+    echo_secret = 0;
+}
+
+/**
+ * Whether the line being entered holds a password: its echo must not
+ * stay in the scrollback
+ */
+static int is_secret(const tinysh_session_t *s) {
+    return tinysh_secret_at(s->line.input_buffers[s->line.cur_buf_index]) >= 0;
+}
+
+/**
+ * Set up a session
+ */
+void tinysh_session_init(tinysh_session_t *s, void (*flush)(tinysh_session_t *s), void *user) {
+    memset(s, 0, sizeof(*s));
+    tinysh_line_init(&s->line);
+    s->flush = flush;
+    s->user = user;
+    s->quota.quantum = SESSION_QUANTUM;
+    s->quota.max_lines = SESSION_MAX_LINES;
+    s->quota.max_out = SESSION_MAX_OUT;
+    s->size.rows = TERM_DEFAULT_ROWS;
+    s->size.cols = TERM_DEFAULT_COLS;
+}
+
+/**
+ * Show the first prompt
+ */
+void tinysh_session_start(tinysh_session_t *s) {
+    char cr = '\r';
+
+    tinysh_session_input(s, &cr, 1);
+    s->lines = 0;
+    s->bytes_in = 0;
+}
+
+/**
+ * Process input received for a session
+ * The session's line state and output functions replace whatever was
+ * current on this thread, and are put back afterwards.
+ */
+int tinysh_session_input(tinysh_session_t *s, const char *buf, int len) {
+    session_saved_t saved;
+    int i;
+
+    if (tap && len > 0) tap_input(s, NULL, 0, buf, len);
+    session_enter(s, &saved);
+    for (i = 0; i < len && s->line.active; i++) session_char(s, buf[i]);
+    session_leave(&saved);
+    return i;
+}
+
+/**
+ * Queue received input for the scheduler
+ */
+int tinysh_session_queue(tinysh_session_t *s, const char *buf, int len) {
+    int room;
+
+    if (s->in_head && s->in_head + s->in_len + len > SESSION_IN_SIZE) {
+        memmove(s->in, s->in + s->in_head, (size_t)s->in_len);
+        s->in_head = 0;
+    }
+    room = SESSION_IN_SIZE - s->in_head - s->in_len;
+    if (len > room) len = room;
+    if (len <= 0) return 0;
+    memcpy(s->in + s->in_head + s->in_len, buf, (size_t)len);
+    s->in_len += len;
+    if (tap) {
+        tap_input(s, s->in + s->in_head, s->in_len - len, buf, len);
+        tap(s, SESSION_TAP_END, NULL, 0);
+    }
+    return len;
+}
+
+/**
+ * Free space in the input queue
+ */
+int tinysh_session_queue_room(const tinysh_session_t *s) {
+    return SESSION_IN_SIZE - s->in_len;
+}
+
+/**
+ * Output waiting to be sent
+ * A replay comes first, straight from the scrollback blocks.
+ */
+const char *tinysh_session_pending(tinysh_session_t *s, int *len) {
+    const char *p;
+
+    if (s->replay_pos < s->replay_end) {
+        if (s->replay_pos < s->sb_start) s->replay_pos = s->sb_start;
+        p = sb_at(s, s->replay_pos, len);
+        if (p) {
+            if ((unsigned long)*len > s->replay_end - s->replay_pos) {
+                *len = (int)(s->replay_end - s->replay_pos);
+            }
+            return p;
+        }
+        s->replay_pos = s->replay_end;
+    }
+    *len = s->detached ? 0 : s->out_len;
+    return s->out + s->out_head;
+}
+
+/**
+ * Remove sent output
+ */
+void tinysh_session_consume(tinysh_session_t *s, int n) {
+    if (n <= 0) return;
+    if (s->replay_pos < s->replay_end) {
+        s->replay_pos += (unsigned long)n;
+        return;
+    }
+    if (n > s->out_len) n = s->out_len;
+    s->out_head += n;
+    s->out_len -= n;
+    s->head_pos += (unsigned long)n;
+    if (!s->out_len) s->out_head = 0;
+}
+
+/**
+ * Record the size of the session's terminal
+ */
+void tinysh_session_set_size(tinysh_session_t *s, unsigned short rows, unsigned short cols) {
+    if (rows == 0 || cols == 0) return;
+    s->size.rows = rows;
+    s->size.cols = cols;
+    s->size.known = 1;
+}
+
+/**
+ * Take a block from the pool
+ */
+static tinysh_sb_block_t *pool_take(void) {
+    tinysh_sb_block_t *b;
+    int i;
+
+    POOL_LOCK();
+    if (!pool_ready) {
+        for (i = 0; i < SCROLLBACK_POOL_BLOCKS; i++) {
+            pool[i].next = pool_free;
+            pool_free = &pool[i];
+        }
+        pool_count = SCROLLBACK_POOL_BLOCKS;
+        pool_ready = 1;
+    }
+    b = pool_free;
+    if (b) {
+        pool_free = b->next;
+        pool_count--;
+    }
+    POOL_UNLOCK();
+    return b;
+}
+
+/**
+ * Give a chain of n blocks back to the pool
+ */
+static void pool_give(tinysh_sb_block_t *first, tinysh_sb_block_t *last, int n) {
+    if (!first) return;
+    POOL_LOCK();
+    last->next = pool_free;
+    pool_free = first;
+    pool_count += n;
+    POOL_UNLOCK();
+}
+
+/**
+ * Position after the newest byte kept
+ */
+static unsigned long sb_end(const tinysh_session_t *s) {
+    if (!s->sb_blocks) return s->sb_start;
+    return s->sb_start + (unsigned long)(s->sb_blocks - 1) * SCROLLBACK_BLOCK_SIZE +
+           (unsigned long)s->sb_fill;
+}
+
+/**
+ * Keep output in the scrollback
+ * A new block comes from the pool while the session is under its share;
+ * otherwise, or when the pool is empty, its own oldest block is reused.
+ */
+static void sb_append(tinysh_session_t *s, const char *buf, int len) {
+    tinysh_sb_block_t *b;
+    int n;
+
+    while (len > 0) {
+        if (!s->sb_last || s->sb_fill == SCROLLBACK_BLOCK_SIZE) {
+            b = s->sb_blocks < SCROLLBACK_SESSION_BLOCKS ? pool_take() : NULL;
+            if (!b && s->sb_first) {
+                b = s->sb_first;
+                s->sb_first = b->next;
+                if (!s->sb_first) s->sb_last = NULL;
+                s->sb_blocks--;
+                s->sb_start += SCROLLBACK_BLOCK_SIZE;
+            }
+            if (!b) {
+                s->sb_lost += (unsigned long)len;
+                s->sb_start += (unsigned long)len;
+                return;
+            }
+            b->next = NULL;
+            if (s->sb_last) s->sb_last->next = b;
+            else s->sb_first = b;
+            s->sb_last = b;
+            s->sb_blocks++;
+            s->sb_fill = 0;
+        }
+        n = SCROLLBACK_BLOCK_SIZE - s->sb_fill;
+        if (n > len) n = len;
+        memcpy(s->sb_last->data + s->sb_fill, buf, (size_t)n);
+        s->sb_fill += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+/**
+ * Overwrite kept output between two positions, line ends excepted
+ */
+static void sb_mask(tinysh_session_t *s, unsigned long from, unsigned long to) {
+    tinysh_sb_block_t *b = s->sb_first;
+    unsigned long pos = s->sb_start, end = sb_end(s);
+    char *p;
+    int i, n;
+
+    if (from < pos) from = pos;
+    if (to > end) to = end;
+    for (; b && pos < to; pos += SCROLLBACK_BLOCK_SIZE, b = b->next) {
+        n = b == s->sb_last ? s->sb_fill : SCROLLBACK_BLOCK_SIZE;
+        for (i = 0; i < n; i++) {
+            p = b->data + i;
+            if (pos + (unsigned long)i >= from && pos + (unsigned long)i < to && *p != '\r' && *p != '\n') *p = '*';
+        }
+    }
+}
+
+/**
+ * Kept bytes from a position to the end of its block
+ *
+ * @return First byte, or NULL if nothing is kept from pos on
+ */
+static const char *sb_at(const tinysh_session_t *s, unsigned long pos, int *len) {
+    const tinysh_sb_block_t *b = s->sb_first;
+    unsigned long end = sb_end(s), off, i;
+
+    if (pos < s->sb_start || pos >= end) return NULL;
+    off = pos - s->sb_start;
+    for (i = off / SCROLLBACK_BLOCK_SIZE; i; i--) b = b->next;
+    off %= SCROLLBACK_BLOCK_SIZE;
+    *len = (b == s->sb_last ? s->sb_fill : SCROLLBACK_BLOCK_SIZE) - (int)off;
+    return b->data + off;
+}
+
+/**
+ * Keep a scrollback, or stop and free it
+ */
+int tinysh_session_scrollback(tinysh_session_t *s, int on) {
+    if (SCROLLBACK_POOL_BLOCKS == 0) return -1;
+    if (on && !s->sb_on) {
+        s->sb_start = s->written;
+    } else if (!on && s->sb_on) {
+        pool_give(s->sb_first, s->sb_last, s->sb_blocks);
+        s->sb_first = s->sb_last = NULL;
+        s->sb_blocks = 0;
+        s->sb_fill = 0;
+        s->replay_pos = s->replay_end = 0;
+    }
+    s->sb_on = (char)(on != 0);
+    return 0;
+}
+
+/**
+ * Copy kept output from a position on
+ */
+int tinysh_session_scrollback_read(const tinysh_session_t *s, unsigned long *pos, char *buf, int size) {
+    const char *p;
+    int n, done = 0;
+
+    if (*pos < s->sb_start) *pos = s->sb_start;
+    while (done < size && (p = sb_at(s, *pos, &n)) != NULL) {
+        if (n > size - done) n = size - done;
+        memcpy(buf + done, p, (size_t)n);
+        done += n;
+        *pos += (unsigned long)n;
+    }
+    return done;
+}
+
+/**
+ * Scrollback blocks left in the shared pool
+ */
+int tinysh_scrollback_free(void) {
+    int n;
+
+    POOL_LOCK();
+    n = pool_ready ? pool_count : SCROLLBACK_POOL_BLOCKS;
+    POOL_UNLOCK();
+    return n;
+}
+
+/**
+ * First output byte the transport may not have sent: the unsent buffer,
+ * an earlier drop, or a replay not finished
+ */
+static unsigned long undelivered(const tinysh_session_t *s) {
+    unsigned long pos = s->out_len ? s->head_pos : s->written;
+
+    if (s->gap && s->gap_pos < pos) pos = s->gap_pos;
+    if (s->replay_pos < s->replay_end && s->replay_pos < pos) pos = s->replay_pos;
+    return pos;
+}
+
+/**
+ * The transport is gone
+ */
+void tinysh_session_detach(tinysh_session_t *s) {
+    if (s->detached) return;
+    s->resume_pos = undelivered(s);
+    s->detached = 1;
+    s->out_head = s->out_len = 0;
+    s->replay_pos = s->replay_end = 0;
+}
+
+/**
+ * A transport takes over the session
+ * Replay starts at the older of what was never sent and the start of
+ * the current line, within what the scrollback still holds.
+ */
+int tinysh_session_replay(tinysh_session_t *s) {
+    unsigned long pos = s->detached ? s->resume_pos : undelivered(s);
+    unsigned long line = s->written;
+    const char *p;
+    int n;
+
+    s->detached = 0;
+    s->gap = 0;
+    if (!s->sb_on) return 0;
+
+    /* Back to the last line end, within one line's worth */
+    while (line > s->sb_start && s->written - line < BUFFER_SIZE * 2) {
+        p = sb_at(s, line - 1, &n);
+        if (!p || *p == '\n') break;
+        line--;
+    }
+    if (line < pos) pos = line;
+    if (pos < s->sb_start) pos = s->sb_start;
+
+    s->out_head = s->out_len = 0;
+    s->replay_pos = pos;
+    s->replay_end = s->written;
+    return (int)(s->replay_end - pos);
+}
+
+/**
+ * Is the session still open
+ */
+int tinysh_session_active(const tinysh_session_t *s) {
+    return s->line.active;
+}
+
+/**
+ * Give every session's input and output to a function
+ */
+void tinysh_session_tap(void (*fn)(const tinysh_session_t *s, int what, const char *buf, int len)) {
+    tap = fn;
+}
+
+/**
+ * Session whose input this thread is processing
+ */
+tinysh_session_t *tinysh_session_current(void) {
+    return current;
+}
+
+/**
+ * Scheduling rank: admins first, then by priority
+ */
+static int rank(const tinysh_session_t *s) {
+    return (s->line.auth_level == TINYSH_AUTH_ADMIN ? 256 : 0) + s->quota.priority;
+}
+
+/**
+ * Add a session to a scheduler
+ */
+int tinysh_sched_add(tinysh_sched_t *sched, tinysh_session_t *s) {
+    if (sched->count == SESSION_SCHED_MAX) return -1;
+    s->deficit = 0;
+    sched->sessions[sched->count++] = s;
+    return 0;
+}
+
+/**
+ * Remove a session from a scheduler
+ */
+void tinysh_sched_remove(tinysh_sched_t *sched, tinysh_session_t *s) {
+    int i;
+
+    for (i = 0; i < sched->count; i++) {
+        if (sched->sessions[i] == s) {
+            sched->sessions[i] = sched->sessions[--sched->count];
+            if (sched->next >= sched->count) sched->next = 0;
+            return;
+        }
+    }
+}
+
+/**
+ * Serve one session for one round
+ * Its deficit grows by the quantum and each byte consumed costs one; a
+ * line end, which may run a handler, also needs a line left in this
+ * round and output below max_out. An emptied queue forfeits the
+ * deficit, as deficit round-robin requires.
+ */
+static int session_run(tinysh_sched_t *sched, tinysh_session_t *s) {
+    session_saved_t saved;
+    int n = 0, lines = 0;
+    char c;
+
+    s->deficit += s->quota.quantum;
+    session_enter(s, &saved);
+    while (s->in_len && s->line.active) {
+        c = s->in[s->in_head];
+        if (s->deficit <= 0) {
+            sched->throttled_bytes++;
+            s->throttled++;
+            break;
+        }
+        if (is_line_end(s, c)) {
+            if (lines >= s->quota.max_lines) {
+                sched->throttled_lines++;
+                s->throttled++;
+                break;
+            }
+            if (s->out_len >= s->quota.max_out) {
+                sched->throttled_out++;
+                s->throttled++;
+                break;
+            }
+            lines++;
+        }
+        s->in_head++;
+        s->in_len--;
+        s->deficit--;
+        n++;
+        session_char(s, c);
+    }
+    session_leave(&saved);
+
+    if (!s->in_len) {
+        s->in_head = 0;
+        s->deficit = 0;
+    }
+    return n;
+}
+
+/**
+ * Run one round
+ */
+int tinysh_sched_run(tinysh_sched_t *sched) {
+    tinysh_session_t *order[SESSION_SCHED_MAX];
+    tinysh_session_t *s;
+    int i, j, n = 0, done = 0;
+
+    /* Sessions with input, by rank; equals keep the rotated order */
+    for (i = 0; i < sched->count; i++) {
+        s = sched->sessions[(sched->next + i) % sched->count];
+        if (!s->in_len || !s->line.active) continue;
+        for (j = n; j > 0 && rank(order[j - 1]) < rank(s); j--) order[j] = order[j - 1];
+        order[j] = s;
+        n++;
+    }
+    if (sched->count) sched->next = (sched->next + 1) % sched->count;
+    sched->rounds++;
+
+    for (i = 0; i < n; i++) {
+        s = order[i];
+        if (s->out_len >= s->quota.max_out) {
+            sched->throttled_out++;   /* transport must drain it first */
+            s->throttled++;
+            continue;
+        }
+        done += session_run(sched, s);
+    }
+    return done;
+}
+
+/**
+ * Sessions the next round would serve
+ */
+int tinysh_sched_ready(const tinysh_sched_t *sched) {
+    const tinysh_session_t *s;
+    int i, n = 0;
+
+    for (i = 0; i < sched->count; i++) {
+        s = sched->sessions[i];
+        if (s->in_len && s->line.active && s->out_len < s->quota.max_out) n++;
+    }
+    return n;
+}
+
+/**
+ * Queue depth and throttling counters
+ */
+void tinysh_sched_stats(const tinysh_sched_t *sched, tinysh_sched_stats_t *stats) {
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->sessions = (unsigned short)sched->count;
+    for (i = 0; i < sched->count; i++) {
+        if (sched->sessions[i]->in_len) stats->backlogged++;
+        stats->queued += (unsigned long)sched->sessions[i]->in_len;
+    }
+    stats->rounds = sched->rounds;
+    stats->throttled_bytes = sched->throttled_bytes;
+    stats->throttled_lines = sched->throttled_lines;
+    stats->throttled_out = sched->throttled_out;
+}
+
+/**
+ * Quota command handler
+ * Anyone can look; changing a quota takes admin rights, since it takes
+ * time away from the other sessions.
+ */
+void quota_cmd_handler(int argc, const char **argv) {
+    tinysh_session_t *s = current;
+    tinysh_quota_t q;
+    const char *eq;
+    long v;
+    int i;
+
+    if (!s) {
+        tinysh_puts("The console is not scheduled\r\n");
+        return;
+    }
+    if (argc > 1 && tinysh_get_auth_level() != TINYSH_AUTH_ADMIN) {
+        tinysh_puts("Changing quotas requires admin privileges\r\n");
+        return;
+    }
+
+    q = s->quota;
+    for (i = 1; i < argc; i++) {
+        eq = strchr(argv[i], '=');
+        if (!eq || tinysh_parse_long(eq + 1, -1, &v) < 0 || v < 0 || v > 65535) {
+            tinysh_printf("Bad quota: %s\r\n", argv[i]);
+            return;
+        }
+        if (strncmp(argv[i], "bytes=", 6) == 0 && v > 0) q.quantum = (unsigned short)v;
+        else if (strncmp(argv[i], "lines=", 6) == 0 && v > 0) q.max_lines = (unsigned short)v;
+        else if (strncmp(argv[i], "out=", 4) == 0 && v > 0 && v <= SESSION_OUT_SIZE) q.max_out = (unsigned short)v;
+        else if (strncmp(argv[i], "priority=", 9) == 0 && v <= 255) q.priority = (unsigned char)v;
+        else {
+            tinysh_printf("Bad quota: %s\r\n", argv[i]);
+            return;
+        }
+    }
+    s->quota = q;
+
+    tinysh_printf("bytes=%u lines=%u out=%u priority=%u%s\r\n",
+                  q.quantum, q.max_lines, q.max_out, q.priority,
+                  rank(s) >= 256 ? " (admin: served first)" : "");
+    tinysh_printf("queued %d, throttled %lu, dropped %lu\r\n",
+                  s->in_len, s->throttled, s->dropped);
+}
+
+/**
+ * Next kept line from pos, before end: escape sequences and CRs
+ * removed, backspaces applied, cut at SEARCH_LINE characters
+ *
+ * @return 1 if a line was read, 0 at end
+ */
+static int search_line(const tinysh_session_t *s, unsigned long *pos, unsigned long end, char *line) {
+    char buf[256];
+    int i, n, len = 0, esc = 0, got = 0;
+
+    while (*pos < end) {
+        n = (int)(end - *pos < sizeof(buf) ? end - *pos : sizeof(buf));
+        n = tinysh_session_scrollback_read(s, pos, buf, n);
+        if (!n) break;
+        for (i = 0; i < n; i++) {
+            char c = buf[i];
+
+            got = 1;
+            if (esc) {
+                /* ESC x, or ESC [ ... final byte */
+                if (esc == 1 && c == '[') esc = 2;
+                else if (esc == 1 || (c >= 0x40 && c <= 0x7e)) esc = 0;
+            } else if (c == 27) {
+                esc = 1;
+            } else if (c == '\n') {
+                *pos -= (unsigned long)(n - i - 1);
+                line[len] = 0;
+                return 1;
+            } else if (c == 8) {
+                if (len) len--;
+            } else if ((unsigned char)c >= ' ' && len < SEARCH_LINE) {
+                line[len++] = c;
+            }
+        }
+    }
+    line[len] = 0;
+    return got;
+}
+
+/**
+ * Scrollback command handler
+ * A search covers the lines before the one it was typed on, and
+ * numbers them back from it.
+ */
+void scrollback_cmd_handler(int argc, const char **argv) {
+    tinysh_session_t *s = current;
+    char line[SEARCH_LINE + 1], text[BUFFER_SIZE + 1];
+    unsigned long pos, end, start;
+    int i, len = 0, lines = 0, matches = 0, k;
+    const char *p;
+
+    if (!s || !s->sb_on) {
+        tinysh_puts("No scrollback here\r\n");
+        return;
+    }
+    if (argc == 1) {
+        tinysh_printf("Kept %lu of %lu bytes in %d blocks, %lu not kept\r\n",
+                      sb_end(s) - s->sb_start, s->written, s->sb_blocks, s->sb_lost);
+        tinysh_printf("Pool %d of %d blocks free (%d B each, %d per session)\r\n",
+                      tinysh_scrollback_free(), SCROLLBACK_POOL_BLOCKS,
+                      SCROLLBACK_BLOCK_SIZE, SCROLLBACK_SESSION_BLOCKS);
+        return;
+    }
+    if (argc < 3 || strcmp(argv[1], "search") != 0) {
+        tinysh_puts("Usage: scrollback [search TEXT]\r\n");
+        return;
+    }
+    text[0] = 0;
+    for (i = 2; i < argc && len < BUFFER_SIZE; i++) {
+        len += snprintf(text + len, sizeof(text) - (size_t)len, "%s%s", i > 2 ? " " : "", argv[i]);
+    }
+
+    /* Up to the start of the line holding this command */
+    end = s->written;
+    while ((p = sb_at(s, end - 1, &k)) != NULL && (*p == '\n' || *p == '\r')) end--;
+    while ((p = sb_at(s, end - 1, &k)) != NULL && *p != '\n') end--;
+
+    /* Count lines first, so matches can say how far back they are */
+    start = pos = s->sb_start;
+    while (search_line(s, &pos, end, line)) lines++;
+    for (pos = start, i = 0; search_line(s, &pos, end, line); i++) {
+        if (!strstr(line, text)) continue;
+        tinysh_printf("%5d  %s\r\n", i - lines, line);
+        matches++;
+    }
+    tinysh_printf("%d match%s in %d lines\r\n", matches, matches == 1 ? "" : "es", lines);
+}
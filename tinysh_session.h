@@ -0,0 +1,357 @@
+/**
+ * TinyShell Sessions
+ * -----------------
+ * Independent shells sharing one command tree, for transports that serve
+ * several users at once (sockets, telnet) next to the console.
+ *
+ * Features:
+ * - Each session keeps its own input line, history, context and auth
+ *   level (tinysh_line_t), selected while its input is processed
+ * - Output goes to a bounded per-session buffer that the transport drains;
+ *   when it fills, the flush callback gets a chance to send, and whatever
+ *   still does not fit is dropped and counted
+ * - Output functions are per thread (TINYSH_THREADS), so sessions on
+ *   different threads never mix output
+ * - Terminal size per session (tinysh_term.h), set by the transport,
+ *   e.g. from telnet NAWS
+ * - CR LF from network clients counts as one line end
+ * - "quit" and CTRL-D end only the session they were typed in
+ * - Fair scheduling (tinysh_sched_t): received input is queued per
+ *   session and served by deficit round-robin, so one client pasting a
+ *   long script or flooding output cannot starve the others. Each round
+ *   bounds, per session, the input bytes consumed, the handlers run, and
+ *   the output left unsent; admin sessions and higher priorities go first
+ * - "quota" command: show the session's quota and counters; admins can
+ *   change them
+ * - Optional scrollback: everything a session prints is also kept in a
+ *   ring of blocks taken from one shared pool, so all sessions together
+ *   never hold more than SCROLLBACK_POOL_BLOCKS blocks. A session reuses
+ *   its own oldest block once it has SCROLLBACK_SESSION_BLOCKS, or when
+ *   the pool is empty
+ * - Detach and replay: a transport that loses its connection detaches
+ *   the session, which keeps running; output then goes to the scrollback
+ *   only. A later transport replays what the old one never sent, then
+ *   carries on with the same context, history and auth level
+ * - "scrollback" command: ring and pool usage; "scrollback search TEXT"
+ *   lists the kept lines that contain TEXT
+ * - Tap (tinysh_session_tap()): one function sees every session's input
+ *   as received and its output as written, e.g. for transcripts; the
+ *   characters of a password (auth) and their echo reach it starred
+ *
+ * Example Usage:
+ *
+ * static void flush(tinysh_session_t *s) {
+ *     int len;
+ *     const char *p = tinysh_session_pending(s, &len);
+ *     tinysh_session_consume(s, send(sock, p, len, 0));
+ * }
+ *
+ * tinysh_session_init(&s, flush, NULL);
+ * tinysh_session_start(&s);                  // sends the prompt
+ * n = recv(sock, buf, sizeof(buf), 0);
+ * tinysh_session_input(&s, buf, n);
+ * flush(&s);
+ * if (!tinysh_session_active(&s)) close(sock);
+ *
+ * Surviving a dropped connection:
+ *
+ * tinysh_session_scrollback(&s, 1);
+ * tinysh_session_detach(&s);                 // connection lost
+ * ...
+ * tinysh_session_replay(&s);                 // new connection: the missed
+ * flush(&s);                                 //   tail comes out first
+ *
+ * Scheduled instead of direct:
+ *
+ * tinysh_sched_add(&sched, &s);
+ * tinysh_session_queue(&s, buf, n);          // as input arrives
+ * tinysh_sched_run(&sched);                  // once per loop iteration
+ */
+
+#ifndef TINYSH_SESSION_H
+#define TINYSH_SESSION_H
+
+#include "tinysh.h"
+#include "tinysh_term.h"
+
+/* Bytes of output a session buffers before its transport drains them */
+#ifndef SESSION_OUT_SIZE
+#define SESSION_OUT_SIZE          4096
+#endif
+
+/* Bytes of received input a session queues for the scheduler */
+#ifndef SESSION_IN_SIZE
+#define SESSION_IN_SIZE           1024
+#endif
+
+/* Sessions one scheduler serves */
+#ifndef SESSION_SCHED_MAX
+#define SESSION_SCHED_MAX         64
+#endif
+
+/* Default quota per round: input bytes (quantum), handler calls, and
+   unsent output above which a session waits for its transport */
+#ifndef SESSION_QUANTUM
+#define SESSION_QUANTUM           256
+#endif
+#ifndef SESSION_MAX_LINES
+#define SESSION_MAX_LINES         4
+#endif
+#ifndef SESSION_MAX_OUT
+#define SESSION_MAX_OUT           (SESSION_OUT_SIZE / 2)
+#endif
+
+/* Scrollback block size, and blocks shared by all sessions (the global cap) */
+#ifndef SCROLLBACK_BLOCK_SIZE
+#define SCROLLBACK_BLOCK_SIZE     1024
+#endif
+#ifndef SCROLLBACK_POOL_BLOCKS
+#define SCROLLBACK_POOL_BLOCKS    64
+#endif
+
+/* Most blocks one session keeps */
+#ifndef SCROLLBACK_SESSION_BLOCKS
+#define SCROLLBACK_SESSION_BLOCKS 16
+#endif
+
+/* What a tap is told */
+#define SESSION_TAP_IN            0     // Input received
+#define SESSION_TAP_OUT           1     // Output written
+#define SESSION_TAP_END           2     // End of a batch: nothing more from it for now
+
+/* Scrollback block, owned by the pool or by one session's ring */
+typedef struct tinysh_sb_block_t tinysh_sb_block_t;
+
+/* Scheduling quota of a session */
+typedef struct {
+    unsigned short quantum;          // Input bytes credited per round
+    unsigned short max_lines;        // Lines (handler calls) per round
+    unsigned short max_out;          // Not served while this much output is unsent
+    unsigned char priority;          // Higher is served first; admins before all
+} tinysh_quota_t;
+
+/**
+ * Session
+ * Fields below line are read-only outside the session module.
+ */
+typedef struct tinysh_session_t {
+    tinysh_line_t line;              // Line editor state
+    tinysh_term_size_t size;         // Terminal size, defaults until the transport knows
+    void (*flush)(struct tinysh_session_t *s); // Drains output when full, can be NULL
+    void *user;                      // Owned by the transport
+    unsigned id;                     // Set by the transport; names it in attach and transcripts
+
+    char out[SESSION_OUT_SIZE];      // Output not yet sent
+    int out_head;                    //   first unsent byte
+    int out_len;                     //   unsent bytes
+    char last_cr;                    // Last input was CR, ignore a following LF
+
+    unsigned long bytes_in;          // Input bytes processed
+    unsigned long bytes_out;         // Output bytes buffered
+    unsigned long lines;             // Lines entered
+    unsigned long dropped;           // Output bytes lost to a full buffer
+
+    /* Output positions: bytes written before a given byte */
+    unsigned long written;           // Position of the next output byte
+    unsigned long head_pos;          //   of out[out_head]
+    unsigned long gap_pos;           //   of the first byte dropped, if gap
+    char gap;
+    char detached;                   // No transport: output goes to scrollback only
+    unsigned long resume_pos;        //   first byte the lost transport did not send
+    unsigned long line_pos;          //   where the echo of the line being typed starts
+
+    /* Scrollback */
+    char sb_on;
+    tinysh_sb_block_t *sb_first;     // Ring, oldest block first
+    tinysh_sb_block_t *sb_last;
+    int sb_blocks;
+    int sb_fill;                     //   bytes used in the newest block
+    unsigned long sb_start;          //   position of the oldest byte kept
+    unsigned long sb_lost;           // Output bytes not kept: no block to hold them
+    unsigned long replay_pos;        // Replay in progress, up to replay_end
+    unsigned long replay_end;
+
+    /* Scheduling */
+    tinysh_quota_t quota;            // Set freely; defaults from SESSION_*
+    char in[SESSION_IN_SIZE];        // Input not yet processed
+    int in_head;                     //   first byte
+    int in_len;                      //   queued bytes
+    long deficit;                    // Input bytes it may still consume
+    unsigned long throttled;         // Rounds in which a quota stopped it
+} tinysh_session_t;
+
+/* Fair scheduler over sessions; zero-initialize before use */
+typedef struct {
+    tinysh_session_t *sessions[SESSION_SCHED_MAX];
+    int count;
+    int next;                        // Rotates the order among equals
+
+    /* Counters */
+    unsigned long rounds;
+    unsigned long throttled_bytes;   // Stopped by the quantum
+    unsigned long throttled_lines;   // Stopped by max_lines
+    unsigned long throttled_out;     // Skipped or stopped by max_out
+} tinysh_sched_t;
+
+/* Scheduler state */
+typedef struct {
+    unsigned short sessions;         // In the scheduler
+    unsigned short backlogged;       // With queued input
+    unsigned long queued;            // Queued input bytes, all sessions
+    unsigned long rounds;
+    unsigned long throttled_bytes;
+    unsigned long throttled_lines;
+    unsigned long throttled_out;
+} tinysh_sched_stats_t;
+
+/**
+ * Set up a session
+ *
+ * @param flush Called when the output buffer is full, can be NULL
+ * @param user  Transport data, stored in s->user
+ */
+void tinysh_session_init(tinysh_session_t *s, void (*flush)(tinysh_session_t *s), void *user);
+
+/**
+ * Show the first prompt
+ */
+void tinysh_session_start(tinysh_session_t *s);
+
+/**
+ * Process input received for a session, on the calling thread
+ * Stops early when the session ends (quit, CTRL-D).
+ *
+ * @return Number of bytes processed
+ */
+int tinysh_session_input(tinysh_session_t *s, const char *buf, int len);
+
+/**
+ * Queue received input for the scheduler
+ *
+ * @return Bytes queued; fewer than len when the queue is full, and the
+ *         transport should stop reading until it drains
+ */
+int tinysh_session_queue(tinysh_session_t *s, const char *buf, int len);
+
+/**
+ * Free space in the input queue
+ */
+int tinysh_session_queue_room(const tinysh_session_t *s);
+
+/**
+ * Output waiting to be sent, in one contiguous block
+ *
+ * @param len Receives its length
+ * @return First byte
+ */
+const char *tinysh_session_pending(tinysh_session_t *s, int *len);
+
+/**
+ * Remove sent output
+ *
+ * @param n Bytes sent; negative values are ignored
+ */
+void tinysh_session_consume(tinysh_session_t *s, int n);
+
+/**
+ * Record the size of the session's terminal
+ */
+void tinysh_session_set_size(tinysh_session_t *s, unsigned short rows, unsigned short cols);
+
+/**
+ * Keep a scrollback of the session's output, or stop and free it
+ * Call with 0 before a session is discarded, so its blocks go back to
+ * the pool.
+ *
+ * @return 0, or -1 if scrollback is compiled out (SCROLLBACK_POOL_BLOCKS 0)
+ */
+int tinysh_session_scrollback(tinysh_session_t *s, int on);
+
+/**
+ * Copy kept output from a position on
+ * Positions older than the oldest byte kept start at that byte.
+ *
+ * @param pos  Position to read from; advanced past the bytes copied
+ * @return Bytes copied
+ */
+int tinysh_session_scrollback_read(const tinysh_session_t *s, unsigned long *pos, char *buf, int size);
+
+/**
+ * Scrollback blocks left in the shared pool
+ */
+int tinysh_scrollback_free(void);
+
+/**
+ * The transport is gone: unsent output is dropped, and further output
+ * only goes to the scrollback. The session keeps running its queued input.
+ */
+void tinysh_session_detach(tinysh_session_t *s);
+
+/**
+ * A transport takes over the session: what the last one did not send,
+ * from the scrollback, comes first in tinysh_session_pending()
+ * At least the current line is replayed, so the prompt and any partly
+ * typed input show again.
+ *
+ * @return Bytes to replay
+ */
+int tinysh_session_replay(tinysh_session_t *s);
+
+/**
+ * Is the session still open (no quit or CTRL-D yet)
+ */
+int tinysh_session_active(const tinysh_session_t *s);
+
+/**
+ * Give every session's input and output to a function, NULL for none
+ * Password characters in the input, and their echo, are given as '*'.
+ * It runs on the thread handling the session, for each write, so it must
+ * be quick; buf is only valid during the call. Set it before sessions
+ * start.
+ */
+void tinysh_session_tap(void (*tap)(const tinysh_session_t *s, int what, const char *buf, int len));
+
+/**
+ * Session whose input this thread is processing, NULL for the console
+ */
+tinysh_session_t *tinysh_session_current(void);
+
+/**
+ * Add a session to a scheduler
+ *
+ * @return 0 on success, -1 if the scheduler is full
+ */
+int tinysh_sched_add(tinysh_sched_t *sched, tinysh_session_t *s);
+
+/**
+ * Remove a session from a scheduler
+ */
+void tinysh_sched_remove(tinysh_sched_t *sched, tinysh_session_t *s);
+
+/**
+ * Run one round: every session with queued input, admins and higher
+ * priorities first, consumes input within its quota
+ *
+ * @return Input bytes processed
+ */
+int tinysh_sched_run(tinysh_sched_t *sched);
+
+/**
+ * Sessions the next round would serve: queued input, still open, and
+ * output below max_out
+ * Waiting for I/O is only right when this is 0.
+ */
+int tinysh_sched_ready(const tinysh_sched_t *sched);
+
+/**
+ * Queue depth and throttling counters
+ */
+void tinysh_sched_stats(const tinysh_sched_t *sched, tinysh_sched_stats_t *stats);
+
+/* Quota command */
+extern tinysh_cmd_t quota_cmd;
+
+/* Scrollback command */
+extern tinysh_cmd_t scrollback_cmd;
+
+#endif /* TINYSH_SESSION_H */
@@ -0,0 +1,329 @@
+#include "tinysh_status.h"
+#include "tinysh_term.h"
+#include "tinysh_complete.h"
+#include "tinysh.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Widest field, sizes the per-field buffers */
+#define STATUS_AUTH_WIDTH   5
+#define STATUS_LINK_WIDTH   14
+#define STATUS_CLOCK_WIDTH  8
+#define STATUS_FIELD_MAX \
+    (STATUS_CONTEXT_WIDTH > STATUS_USER_WIDTH ? \
+     (STATUS_CONTEXT_WIDTH > STATUS_LINK_WIDTH ? STATUS_CONTEXT_WIDTH : STATUS_LINK_WIDTH) : \
+     (STATUS_USER_WIDTH > STATUS_LINK_WIDTH ? STATUS_USER_WIDTH : STATUS_LINK_WIDTH))
+
+#define STATUS_SEPARATOR    " | "
+
+/* Status line state */
+static char enabled = 0;                /* switched on by the user */
+static char drawn = 0;                  /* region set and bar on screen */
+static unsigned short bar_row = 0;      /* row the bar was drawn on */
+static unsigned long next_refresh = 0;
+static char user_text[STATUS_USER_FIELDS][STATUS_USER_WIDTH + 1];
+
+/* What is on screen, per field; col 0 = field did not fit */
+static char shown[STATUS_FIELD_COUNT][STATUS_FIELD_MAX + 1];
+static unsigned short field_col[STATUS_FIELD_COUNT];
+
+/* Forward declarations */
+static int field_width(int field);
+static void format_field(int field, char *buf);
+static void set_region(void);
+static void draw_bar(void);
+static void hide_bar(void);
+static void on_term_change(int reason);
+void status_cmd_handler(int argc, const char **argv);
+
+/* Status command */
+static const char *const status_words[] = {"on", "off", NULL};
+tinysh_cmd_t status_cmd = {
+    0, "status", "show or hide the status line", "[on|off]",
+    status_cmd_handler, 0, 0, 0
+};
+
+/**
+ * Width of a field in columns
+ */
+static int field_width(int field) {
+    switch (field) {
+    case STATUS_FIELD_AUTH:    return STATUS_AUTH_WIDTH;
+    case STATUS_FIELD_CONTEXT: return STATUS_CONTEXT_WIDTH;
+    case STATUS_FIELD_LINK:    return STATUS_LINK_WIDTH;
+    case STATUS_FIELD_CLOCK:   return STATUS_CLOCK_WIDTH;
+    default:                   return STATUS_USER_WIDTH;
+    }
+}
+
+/**
+ * Build the text of a field, padded or cut to its width
+ */
+static void format_field(int field, char *buf) {
+    char text[STATUS_FIELD_MAX + 16];
+    int width = field_width(field);
+    int len;
+
+    switch (field) {
+    case STATUS_FIELD_AUTH:
+        strcpy(text, tinysh_get_auth_level() == TINYSH_AUTH_ADMIN ? "admin" : "user");
+        break;
+    case STATUS_FIELD_CONTEXT: {
+        const char *ctx = tinysh_get_context();
+        len = (int)strlen(ctx);
+        while (len > 0 && ctx[len - 1] == ' ') len--;
+        if (len == 0) {
+            strcpy(text, "/");
+        } else {
+            if (len > (int)sizeof(text) - 1) len = (int)sizeof(text) - 1;
+            memcpy(text, ctx, (size_t)len);
+            text[len] = 0;
+        }
+        break;
+    }
+    case STATUS_FIELD_LINK: {
+        unsigned long rate = tinysh_term_drain_rate();
+        if (rate) {
+            snprintf(text, sizeof(text), "%s %lukB/s",
+                     tinysh_term_profile()->name, (rate + 512) / 1024);
+        } else {
+            snprintf(text, sizeof(text), "%s", tinysh_term_profile()->name);
+        }
+        break;
+    }
+    case STATUS_FIELD_CLOCK: {
+        unsigned long s = tinysh_time_ms() / 1000;
+        snprintf(text, sizeof(text), "%02lu:%02lu:%02lu",
+                 (s / 3600) % 100, (s / 60) % 60, s % 60);
+        break;
+    }
+    default:
+        strcpy(text, user_text[field - STATUS_FIELD_USER]);
+        break;
+    }
+
+    len = (int)strlen(text);
+    if (len > width) len = width;
+    memcpy(buf, text, (size_t)len);
+    memset(buf + len, ' ', (size_t)(width - len));
+    buf[width] = 0;
+}
+
+/**
+ * Take the bottom row out of the scrolling area
+ */
+static void set_region(void) {
+    char seq[24];
+
+    /* Make sure the cursor is not on the row about to be taken away:
+       IND scrolls when on the last row, CUU steps back up */
+    tinysh_puts("\033D\033[A");
+    /* DECSTBM homes the cursor, so keep it where it was */
+    snprintf(seq, sizeof(seq), "\0337\033[1;%ur\0338",
+             (unsigned)(tinysh_term_rows() - 1));
+    tinysh_puts(seq);
+}
+
+/**
+ * Draw the whole bar on the bottom row
+ */
+static void draw_bar(void) {
+    const tinysh_term_profile_t *prof = tinysh_term_profile();
+    unsigned short cols = tinysh_term_cols();
+    unsigned short col = 2;
+    char seq[16];
+    int i, width;
+
+    bar_row = tinysh_term_rows();
+    snprintf(seq, sizeof(seq), "\0337\033[%u;1H", (unsigned)bar_row);
+    tinysh_puts(seq);
+    tinysh_puts(prof->sgr[TERM_ROLE_STATUS]);
+    tinysh_puts("\033[K ");
+
+    for (i = 0; i < STATUS_FIELD_COUNT; i++) {
+        width = field_width(i);
+        if (col + width > cols) {
+            field_col[i] = 0;
+            continue;
+        }
+        if (i > 0) {
+            tinysh_puts(STATUS_SEPARATOR);
+            col += (unsigned short)strlen(STATUS_SEPARATOR);
+            if (col + width > cols) {
+                field_col[i] = 0;
+                continue;
+            }
+        }
+        format_field(i, shown[i]);
+        field_col[i] = col;
+        tinysh_puts(shown[i]);
+        col += (unsigned short)width;
+    }
+
+    tinysh_puts(prof->sgr[TERM_ROLE_RESET]);
+    tinysh_puts("\0338");
+    drawn = 1;
+}
+
+/**
+ * Give the bottom row back to scrolling text
+ */
+static void hide_bar(void) {
+    char seq[24];
+
+    if (!drawn) return;
+    snprintf(seq, sizeof(seq), "\033[r\0337\033[%u;1H\033[2K\0338", (unsigned)bar_row);
+    tinysh_puts(seq);
+    drawn = 0;
+    tinysh_term_reserve_rows(0);
+}
+
+/**
+ * Show or hide the status line
+ */
+void tinysh_status_enable(int on) {
+    enabled = on ? 1 : 0;
+
+    if (enabled && (tinysh_term_profile()->flags & TERM_PF_CURSOR)) {
+        if (drawn) return;
+        set_region();
+        draw_bar();
+        tinysh_term_reserve_rows(1);
+    } else {
+        hide_bar();
+    }
+}
+
+/**
+ * Check whether the status line is switched on
+ */
+int tinysh_status_enabled(void) {
+    return enabled;
+}
+
+/**
+ * Set the text of an application field
+ */
+int tinysh_status_set_field(int field, const char *text) {
+    char *dst;
+
+    if (field < STATUS_FIELD_USER || field >= STATUS_FIELD_COUNT) return -1;
+
+    dst = user_text[field - STATUS_FIELD_USER];
+    if (!text) text = "";
+    strncpy(dst, text, STATUS_USER_WIDTH);
+    dst[STATUS_USER_WIDTH] = 0;
+    return 0;
+}
+
+/**
+ * Redraw changed fields
+ */
+int tinysh_status_refresh(void) {
+    const tinysh_term_profile_t *prof = tinysh_term_profile();
+    char text[STATUS_FIELD_MAX + 1];
+    char seq[16];
+    int i, count = 0;
+
+    if (!drawn) return 0;
+
+    for (i = 0; i < STATUS_FIELD_COUNT; i++) {
+        if (!field_col[i]) continue;
+
+        format_field(i, text);
+        if (strcmp(text, shown[i]) == 0) continue;
+
+        /* One save/restore around all the fields that changed */
+        if (count == 0) {
+            tinysh_puts("\0337");
+            tinysh_puts(prof->sgr[TERM_ROLE_STATUS]);
+        }
+        snprintf(seq, sizeof(seq), "\033[%u;%uH", (unsigned)bar_row, (unsigned)field_col[i]);
+        tinysh_puts(seq);
+        tinysh_term_rewrite(shown[i], text);
+        strcpy(shown[i], text);
+        count++;
+    }
+
+    if (count) {
+        tinysh_puts(prof->sgr[TERM_ROLE_RESET]);
+        tinysh_puts("\0338");
+    }
+    return count;
+}
+
+/**
+ * Periodic status work
+ */
+void tinysh_status_tick(void) {
+    unsigned long now;
+
+    if (!drawn) return;
+
+    now = tinysh_time_ms();
+    if ((long)(now - next_refresh) < 0) return;
+    next_refresh = now + STATUS_REFRESH_MS;
+
+    tinysh_status_refresh();
+}
+
+/**
+ * Follow terminal changes
+ */
+static void on_term_change(int reason) {
+    if (!enabled) return;
+
+    switch (reason) {
+    case TERM_CHANGE_SIZE:
+        /* Our own reserve_rows() call lands here too */
+        if (drawn && bar_row == tinysh_term_rows()) return;
+        if (drawn) {
+            /* Old region and bar are meaningless at the new size */
+            tinysh_puts("\033[r");
+            drawn = 0;
+        }
+        tinysh_status_enable(1);
+        break;
+    case TERM_CHANGE_PROFILE:
+        /* Switching to or from a profile without cursor movement */
+        if (!(tinysh_term_profile()->flags & TERM_PF_CURSOR)) {
+            hide_bar();
+        } else if (!drawn) {
+            tinysh_status_enable(1);
+        } else {
+            draw_bar();
+        }
+        break;
+    case TERM_CHANGE_CLEAR:
+        if (drawn) draw_bar();
+        break;
+    }
+}
+
+/**
+ * Status command handler
+ */
+void status_cmd_handler(int argc, const char **argv) {
+    if (argc > 1) {
+        if (strcmp(argv[1], "on") == 0) {
+            tinysh_status_enable(1);
+        } else if (strcmp(argv[1], "off") == 0) {
+            tinysh_status_enable(0);
+        } else {
+            tinysh_printf("Usage: status [on|off]\r\n");
+            return;
+        }
+    }
+
+    tinysh_printf("Status line: %s%s\r\n", enabled ? "on" : "off",
+                  (enabled && !drawn) ? " (hidden: profile has no cursor control)" : "");
+}
+
+/**
+ * Register the status command and change listener
+ */
+void tinysh_status_init(void) {
+    tinysh_add_command(&status_cmd);
+    tinysh_complete_register(&status_cmd, tinysh_complete_words, (void *)status_words);
+    tinysh_term_on_change(on_term_change);
+}
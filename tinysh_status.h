@@ -0,0 +1,102 @@
+/**
+ * TinyShell Status Line
+ * -------------------
+ * Keeps a status bar on the bottom row of the terminal. The row is taken
+ * out of the scrolling area with a DECSTBM scroll region, so command
+ * output, the line editor and the menu renderer scroll above it without
+ * ever touching it.
+ *
+ * Features:
+ * - Built-in fields: auth level, current context, link, uptime
+ * - User fields set by the application
+ * - Fixed-width fields rewritten in place, only when their text changed
+ * - Follows terminal resizes, profile switches and screen clears
+ *
+ * Example Usage:
+ *
+ * tinysh_status_init();              // registers the status command
+ * tinysh_status_enable(1);
+ * tinysh_status_set_field(STATUS_FIELD_USER, "pump: on");
+ * while (1) {
+ *     ...
+ *     tinysh_status_tick();          // redraws changed fields
+ * }
+ */
+
+#ifndef TINYSH_STATUS_H
+#define TINYSH_STATUS_H
+
+#include "tinysh.h"
+
+/* Minimum time between field updates */
+#ifndef STATUS_REFRESH_MS
+#define STATUS_REFRESH_MS         250
+#endif
+
+/* Number of application-defined fields */
+#ifndef STATUS_USER_FIELDS
+#define STATUS_USER_FIELDS        2
+#endif
+
+/* Field widths in columns; text is padded or cut to fit */
+#ifndef STATUS_CONTEXT_WIDTH
+#define STATUS_CONTEXT_WIDTH      16
+#endif
+
+#ifndef STATUS_USER_WIDTH
+#define STATUS_USER_WIDTH         12
+#endif
+
+/* Field ids */
+#define STATUS_FIELD_AUTH         0     // "admin" or "user"
+#define STATUS_FIELD_CONTEXT      1     // Current command context
+#define STATUS_FIELD_LINK         2     // Rendering profile and drain rate
+#define STATUS_FIELD_CLOCK        3     // Uptime hh:mm:ss
+#define STATUS_FIELD_USER         4     // First application field
+#define STATUS_FIELD_COUNT        (STATUS_FIELD_USER + STATUS_USER_FIELDS)
+
+/**
+ * Show or hide the status line
+ * Needs a profile with cursor movement; with the ASCII profile the line
+ * stays hidden until a richer profile is selected.
+ *
+ * @param on 1 to show, 0 to hide and give the row back
+ */
+void tinysh_status_enable(int on);
+
+/**
+ * Check whether the status line is switched on
+ */
+int tinysh_status_enabled(void);
+
+/**
+ * Set the text of an application field
+ *
+ * @param field STATUS_FIELD_USER + n
+ * @param text  New text, NULL clears the field
+ * @return 0 on success, -1 if field is not an application field
+ */
+int tinysh_status_set_field(int field, const char *text);
+
+/**
+ * Redraw the fields whose text changed, now
+ *
+ * @return Number of fields redrawn
+ */
+int tinysh_status_refresh(void);
+
+/**
+ * Periodic status work, call from the main loop
+ * Refreshes at most every STATUS_REFRESH_MS.
+ */
+void tinysh_status_tick(void);
+
+/**
+ * Register the status command and the terminal change listener
+ */
+void tinysh_status_init(void);
+
+/* Status command */
+extern tinysh_cmd_t status_cmd;
+
+#endif /* TINYSH_STATUS_H */
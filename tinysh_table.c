@@ -0,0 +1,335 @@
+#include "tinysh_table.h"
+#include "tinysh_term.h"
+#include "tinysh_complete.h"
+#include "tinysh.h"
+#include <stdarg.h>
+#include <string.h>
+
+/* Table state, one table at a time; its format is the session's when it began */
+static int table_format = TABLE_FORMAT_TEXT;
+static int format_ext = -1;             /* session format in the line extension */
+static unsigned char shared_format = TABLE_FORMAT_TEXT;  /* when there is none */
+static const tinysh_table_col_t *table_cols = NULL;
+static int table_ncols = 0;
+static int table_widths[TABLE_MAX_COLS];
+static char table_buffering = 0;        /* measuring auto-width columns */
+
+/* Window of buffered rows: cells stored back to back, NUL-terminated */
+static char window[TABLE_WINDOW_SIZE];
+static int window_used = 0;
+static int window_rows = 0;
+
+/* Format names, indexed by TABLE_FORMAT_*, NULL-terminated for completion */
+static const char *const format_names[TABLE_FORMAT_COUNT + 1] = {
+    "text", "csv", "bin", NULL
+};
+
+/* Forward declarations */
+static unsigned char *session_format(void);
+static void emit_header(void);
+static void emit_row(const char *const *cells);
+static void emit_text_row(const char *const *cells);
+static void emit_csv_row(const char *const *cells);
+static void emit_record(char type, const char *const *cells, int ncells);
+static void flush_window(void);
+void format_cmd_handler(int argc, const char **argv);
+
+/* Format command */
+tinysh_cmd_t format_cmd = {
+    0, "format", "show or set table output format", "[text|csv|bin]",
+    format_cmd_handler, 0, 0, 0
+};
+
+/**
+ * The current session's format, one for all sessions if no line extension was claimed
+ */
+static unsigned char *session_format(void) {
+    if (format_ext < 0) return &shared_format;
+    return tinysh_line_ext(tinysh_line_current(), format_ext);
+}
+
+/**
+ * Select the current session's output format
+ */
+int tinysh_table_set_format(int format) {
+    if (format < 0 || format >= TABLE_FORMAT_COUNT) return -1;
+    *session_format() = (unsigned char)format;
+    return 0;
+}
+
+/**
+ * Get the current session's output format
+ */
+int tinysh_table_format(void) {
+    return *session_format();
+}
+
+/**
+ * Header line (text and CSV) or header record (binary)
+ */
+static void emit_header(void) {
+    const char *titles[TABLE_MAX_COLS];
+    int i, total = 0;
+
+    for (i = 0; i < table_ncols; i++) {
+        titles[i] = table_cols[i].title;
+    }
+
+    if (table_format == TABLE_FORMAT_BINARY) {
+        emit_record('H', titles, table_ncols);
+        return;
+    }
+
+    emit_row(titles);
+    if (table_format == TABLE_FORMAT_TEXT) {
+        for (i = 0; i < table_ncols; i++) {
+            total += table_widths[i] + (i ? TABLE_GAP : 0);
+        }
+        tinysh_term_repeat('-', total);
+        tinysh_puts("\r\n");
+    }
+}
+
+/**
+ * One row in the current format
+ */
+static void emit_row(const char *const *cells) {
+    switch (table_format) {
+    case TABLE_FORMAT_CSV:
+        emit_csv_row(cells);
+        break;
+    case TABLE_FORMAT_BINARY:
+        emit_record('R', cells, table_ncols);
+        break;
+    default:
+        emit_text_row(cells);
+        break;
+    }
+}
+
+/**
+ * Aligned text row. Blanks between cells are merged into one pad so
+ * they can go out as a single cursor move.
+ */
+static void emit_text_row(const char *const *cells) {
+    int i, len, fill, pending = 0;
+
+    for (i = 0; i < table_ncols; i++) {
+        const char *cell = cells[i] ? cells[i] : "";
+
+        len = (int)strlen(cell);
+        fill = table_widths[i] > len ? table_widths[i] - len : 0;
+        if (i > 0) pending += TABLE_GAP;
+
+        if (table_cols[i].flags & TABLE_ALIGN_RIGHT) {
+            tinysh_term_pad(pending + fill);
+            tinysh_puts(cell);
+            pending = 0;
+        } else {
+            tinysh_term_pad(pending);
+            tinysh_puts(cell);
+            pending = fill;
+        }
+    }
+    tinysh_puts("\r\n");
+}
+
+/**
+ * CSV row, quoting cells that need it
+ */
+static void emit_csv_row(const char *const *cells) {
+    const char *p;
+    int i;
+
+    for (i = 0; i < table_ncols; i++) {
+        const char *cell = cells[i] ? cells[i] : "";
+
+        if (i > 0) tinysh_char_out(',');
+        if (strpbrk(cell, ",\"\r\n") || cell[0] == ' ' ||
+            (cell[0] && cell[strlen(cell) - 1] == ' ')) {
+            tinysh_char_out('"');
+            for (p = cell; *p; p++) {
+                if (*p == '"') tinysh_char_out('"');
+                tinysh_char_out((unsigned char)*p);
+            }
+            tinysh_char_out('"');
+        } else {
+            tinysh_puts(cell);
+        }
+    }
+    tinysh_puts("\r\n");
+}
+
+/**
+ * Binary record: type, cell count, then length-prefixed cells
+ */
+static void emit_record(char type, const char *const *cells, int ncells) {
+    int i, j, len;
+
+    tinysh_char_out((unsigned char)type);
+    tinysh_char_out((unsigned char)ncells);
+    for (i = 0; i < ncells; i++) {
+        const char *cell = cells[i] ? cells[i] : "";
+
+        len = (int)strlen(cell);
+        if (len > 255) len = 255;
+        tinysh_char_out((unsigned char)len);
+        for (j = 0; j < len; j++) {
+            tinysh_char_out((unsigned char)cell[j]);
+        }
+    }
+}
+
+/**
+ * Size auto-width columns from the window, then output it
+ */
+static void flush_window(void) {
+    const char *cells[TABLE_MAX_COLS];
+    const char *p;
+    int r, i, len;
+
+    /* First pass: widest cell per auto column */
+    p = window;
+    for (r = 0; r < window_rows; r++) {
+        for (i = 0; i < table_ncols; i++) {
+            len = (int)strlen(p);
+            if (table_cols[i].width == 0 && len > table_widths[i]) {
+                table_widths[i] = len;
+            }
+            p += len + 1;
+        }
+    }
+
+    emit_header();
+
+    /* Second pass: output */
+    p = window;
+    for (r = 0; r < window_rows; r++) {
+        for (i = 0; i < table_ncols; i++) {
+            cells[i] = p;
+            p += strlen(p) + 1;
+        }
+        emit_row(cells);
+    }
+
+    window_used = 0;
+    window_rows = 0;
+    table_buffering = 0;
+}
+
+/**
+ * Start a table
+ */
+void tinysh_table_begin(const tinysh_table_col_t *cols, int ncols) {
+    int i;
+
+    if (ncols > TABLE_MAX_COLS) ncols = TABLE_MAX_COLS;
+    table_format = tinysh_table_format();
+    table_cols = cols;
+    table_ncols = ncols;
+    table_buffering = 0;
+    window_used = 0;
+    window_rows = 0;
+
+    for (i = 0; i < ncols; i++) {
+        table_widths[i] = cols[i].width;
+        if (cols[i].width == 0) {
+            /* At least as wide as the title */
+            table_widths[i] = tinysh_strlen(cols[i].title);
+            if (table_format == TABLE_FORMAT_TEXT) table_buffering = 1;
+        }
+    }
+
+    if (!table_buffering) emit_header();
+}
+
+/**
+ * Output one row
+ */
+void tinysh_table_row(const char *const *cells) {
+    int i, need = 0;
+
+    if (!table_cols) return;
+
+    if (table_buffering) {
+        for (i = 0; i < table_ncols; i++) {
+            need += (cells[i] ? (int)strlen(cells[i]) : 0) + 1;
+        }
+
+        /* Window full: size columns from what we have, stream the rest */
+        if (window_rows == TABLE_WINDOW_ROWS || window_used + need > TABLE_WINDOW_SIZE) {
+            flush_window();
+        }
+    }
+
+    if (table_buffering) {
+        for (i = 0; i < table_ncols; i++) {
+            const char *cell = cells[i] ? cells[i] : "";
+            int len = (int)strlen(cell) + 1;
+            memcpy(window + window_used, cell, (size_t)len);
+            window_used += len;
+        }
+        window_rows++;
+        return;
+    }
+
+    emit_row(cells);
+}
+
+/**
+ * Output one row given as arguments
+ */
+void tinysh_table_add(const char *first, ...) {
+    const char *cells[TABLE_MAX_COLS];
+    va_list ap;
+    int i;
+
+    cells[0] = first;
+    va_start(ap, first);
+    for (i = 1; i < table_ncols; i++) {
+        cells[i] = va_arg(ap, const char *);
+    }
+    va_end(ap);
+
+    tinysh_table_row(cells);
+}
+
+/**
+ * Finish the table
+ */
+void tinysh_table_end(void) {
+    if (!table_cols) return;
+
+    if (table_buffering) flush_window();
+    if (table_format == TABLE_FORMAT_BINARY) emit_record('E', NULL, 0);
+    table_cols = NULL;
+}
+
+/**
+ * Format command handler
+ */
+void format_cmd_handler(int argc, const char **argv) {
+    int i;
+
+    if (argc > 1) {
+        for (i = 0; i < TABLE_FORMAT_COUNT; i++) {
+            if (strcmp(argv[1], format_names[i]) == 0) break;
+        }
+        if (i == TABLE_FORMAT_COUNT) {
+            tinysh_printf("Unknown format: %s\r\n", argv[1]);
+            return;
+        }
+        tinysh_table_set_format(i);
+    }
+
+    tinysh_printf("Table format: %s\r\n", format_names[tinysh_table_format()]);
+}
+
+/**
+ * Register the format command
+ */
+void tinysh_table_init(void) {
+    if (format_ext < 0) format_ext = tinysh_line_ext_claim((int)sizeof(unsigned char));
+    tinysh_add_command(&format_cmd);
+    tinysh_complete_register(&format_cmd, tinysh_complete_words, (void *)format_names);
+}
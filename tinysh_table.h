@@ -0,0 +1,125 @@
+/**
+ * TinyShell Table Output
+ * --------------------
+ * Lets handlers describe tabular output once (columns, then rows) and
+ * leaves the formatting to the shell, so the same handler serves people
+ * at a terminal and scripts parsing its output.
+ *
+ * Features:
+ * - Aligned text with a header, for interactive use
+ * - CSV (RFC 4180 quoting) or binary records, for scripts
+ * - Declared column widths stream row by row with no buffering
+ * - Auto-sized columns (width 0) are measured over a bounded window of
+ *   the first rows, which is then flushed and the rest streamed
+ *
+ * Binary record layout, one record per row:
+ *   type ('H' header, 'R' row, 'E' end), column count, then per cell
+ *   one length byte followed by that many bytes (cells cut to 255)
+ *
+ * Example Usage:
+ *
+ * static const tinysh_table_col_t cols[] = {
+ *     {"Sensor", 0, 0},
+ *     {"Value", 8, TABLE_ALIGN_RIGHT}
+ * };
+ *
+ * tinysh_table_begin(cols, 2);
+ * tinysh_table_add("temp", "21.5");
+ * tinysh_table_add("humidity", "40");
+ * tinysh_table_end();
+ */
+
+#ifndef TINYSH_TABLE_H
+#define TINYSH_TABLE_H
+
+#include "tinysh.h"
+
+/* Most columns per table */
+#ifndef TABLE_MAX_COLS
+#define TABLE_MAX_COLS            8
+#endif
+
+/* Bytes of cell text buffered to size auto-width columns */
+#ifndef TABLE_WINDOW_SIZE
+#define TABLE_WINDOW_SIZE         512
+#endif
+
+/* Most rows buffered to size auto-width columns */
+#ifndef TABLE_WINDOW_ROWS
+#define TABLE_WINDOW_ROWS         16
+#endif
+
+/* Blank columns between text cells */
+#ifndef TABLE_GAP
+#define TABLE_GAP                 2
+#endif
+
+/* Output formats */
+#define TABLE_FORMAT_TEXT         0     // Aligned text with header
+#define TABLE_FORMAT_CSV          1     // Comma-separated values
+#define TABLE_FORMAT_BINARY       2     // Length-prefixed records
+#define TABLE_FORMAT_COUNT        3
+
+/* Column flags */
+#define TABLE_ALIGN_RIGHT         0x01  // Right-align (numbers)
+
+/**
+ * Column description
+ */
+typedef struct {
+    const char *title;               // Header text
+    unsigned char width;             // Width in text mode, 0 = auto-size
+    unsigned char flags;             // TABLE_* column flags
+} tinysh_table_col_t;
+
+/**
+ * Select the output format of the current session's tables
+ * Each session has its own, so "format csv" in a script's session leaves
+ * the others alone.
+ *
+ * @param format TABLE_FORMAT_* value
+ * @return 0 on success, -1 if the format is unknown
+ */
+int tinysh_table_set_format(int format);
+
+/**
+ * Get the current session's output format
+ */
+int tinysh_table_format(void);
+
+/**
+ * Start a table
+ *
+ * @param cols  Column descriptions, kept by reference until the end
+ * @param ncols Number of columns (at most TABLE_MAX_COLS)
+ */
+void tinysh_table_begin(const tinysh_table_col_t *cols, int ncols);
+
+/**
+ * Output one row
+ *
+ * @param cells One string per column, NULL for an empty cell
+ */
+void tinysh_table_row(const char *const *cells);
+
+/**
+ * Output one row given as arguments
+ *
+ * @param first First cell, followed by one const char * per column
+ */
+void tinysh_table_add(const char *first, ...);
+
+/**
+ * Finish the table, flushing buffered rows
+ */
+void tinysh_table_end(void);
+
+/**
+ * Register the format command
+ */
+void tinysh_table_init(void);
+
+/* Format command */
+extern tinysh_cmd_t format_cmd;
+
+#endif /* TINYSH_TABLE_H */
@@ -0,0 +1,313 @@
+#include "tinysh_telnet.h"
+#include "tinysh.h"
+#include <string.h>
+
+/* Parser states */
+#define ST_DATA      0
+#define ST_IAC       1    /* after IAC */
+#define ST_CMD       2    /* after IAC WILL/WONT/DO/DONT */
+#define ST_SB_OPT    3    /* after IAC SB */
+#define ST_SB        4    /* in a subnegotiation */
+#define ST_SB_IAC    5    /* IAC in a subnegotiation */
+
+/* LINEMODE subnegotiation (RFC 1184) */
+#define LM_MODE          1
+#define LM_FORWARDMASK   2
+#define LM_MODE_EDIT     0x01
+
+/* Forward declarations */
+static void send_cmd(tinysh_telnet_t *t, unsigned char cmd, unsigned char opt);
+static void ask(tinysh_telnet_t *t, unsigned char *q, unsigned char yes, unsigned char no,
+                unsigned char opt, int on);
+static void got_yes(tinysh_telnet_t *t, unsigned char *q, unsigned char yes, unsigned char no,
+                    unsigned char opt, int wanted);
+static void got_no(tinysh_telnet_t *t, unsigned char *q, unsigned char no, unsigned char opt);
+static void negotiate(tinysh_telnet_t *t, unsigned char cmd, unsigned char opt);
+static void linemode_switched(tinysh_telnet_t *t);
+static void subnegotiate(tinysh_telnet_t *t);
+
+/**
+ * Queue IAC cmd opt
+ */
+static void send_cmd(tinysh_telnet_t *t, unsigned char cmd, unsigned char opt) {
+    char b[3];
+
+    b[0] = (char)TELNET_IAC;
+    b[1] = (char)cmd;
+    b[2] = (char)opt;
+    tinysh_telnet_queue(t, b, 3);
+}
+
+/**
+ * Ask for an option to be switched on or off (WILL/WONT on our side,
+ * DO/DONT on the client's), unless it already is or is about to be
+ */
+static void ask(tinysh_telnet_t *t, unsigned char *q, unsigned char yes, unsigned char no,
+                unsigned char opt, int on) {
+    if (on && *q == TELNET_Q_NO) {
+        *q = TELNET_Q_WANTYES;
+        send_cmd(t, yes, opt);
+    } else if (!on && *q == TELNET_Q_YES) {
+        *q = TELNET_Q_WANTNO;
+        send_cmd(t, no, opt);
+    }
+}
+
+/**
+ * The other side offers or asks for an option (WILL or DO)
+ * Only a change of state is answered, so nothing loops.
+ */
+static void got_yes(tinysh_telnet_t *t, unsigned char *q, unsigned char yes, unsigned char no,
+                    unsigned char opt, int wanted) {
+    switch (*q) {
+    case TELNET_Q_NO:
+        if (wanted) {
+            *q = TELNET_Q_YES;
+            send_cmd(t, yes, opt);
+        } else {
+            send_cmd(t, no, opt);
+        }
+        break;
+    case TELNET_Q_WANTYES:
+        *q = TELNET_Q_YES;
+        break;
+    case TELNET_Q_WANTNO:          /* refused what we took back */
+        *q = TELNET_Q_NO;
+        break;
+    }
+}
+
+/**
+ * The other side refuses or stops an option (WONT or DONT)
+ */
+static void got_no(tinysh_telnet_t *t, unsigned char *q, unsigned char no, unsigned char opt) {
+    if (*q == TELNET_Q_YES) send_cmd(t, no, opt);
+    *q = TELNET_Q_NO;
+}
+
+/**
+ * Handle IAC WILL/WONT/DO/DONT opt
+ */
+static void negotiate(tinysh_telnet_t *t, unsigned char cmd, unsigned char opt) {
+    int linemode = tinysh_telnet_linemode(t);
+    unsigned char *q = NULL;
+
+    if (cmd == TELNET_DO || cmd == TELNET_DONT) {
+        if (opt == TELNET_OPT_ECHO) q = &t->us_echo;
+        else if (opt == TELNET_OPT_SGA) q = &t->us_sga;
+
+        if (!q) {
+            if (cmd == TELNET_DO) send_cmd(t, TELNET_WONT, opt);
+        } else if (cmd == TELNET_DO) {
+            /* In line mode the client echoes */
+            got_yes(t, q, TELNET_WILL, TELNET_WONT, opt, opt != TELNET_OPT_ECHO || !linemode);
+        } else {
+            got_no(t, q, TELNET_WONT, opt);
+        }
+    } else {
+        if (opt == TELNET_OPT_SGA) q = &t->him_sga;
+        else if (opt == TELNET_OPT_NAWS) q = &t->him_naws;
+        else if (opt == TELNET_OPT_LINEMODE) q = &t->him_linemode;
+
+        if (!q) {
+            if (cmd == TELNET_WILL) send_cmd(t, TELNET_DONT, opt);
+        } else if (cmd == TELNET_WILL) {
+            got_yes(t, q, TELNET_DO, TELNET_DONT, opt, opt != TELNET_OPT_LINEMODE || t->want_linemode);
+        } else {
+            got_no(t, q, TELNET_DONT, opt);
+        }
+    }
+
+    if (tinysh_telnet_linemode(t) != linemode) linemode_switched(t);
+}
+
+/**
+ * Line mode came on or went off: set the client editing, and hand echo
+ * to whichever side now does it
+ */
+static void linemode_switched(tinysh_telnet_t *t) {
+    static const char mode_edit[] = {
+        (char)TELNET_IAC, (char)TELNET_SB, TELNET_OPT_LINEMODE, LM_MODE, LM_MODE_EDIT,
+        (char)TELNET_IAC, (char)TELNET_SE
+    };
+    int on = tinysh_telnet_linemode(t);
+
+    if (on) tinysh_telnet_queue(t, mode_edit, sizeof(mode_edit));
+    ask(t, &t->us_echo, TELNET_WILL, TELNET_WONT, TELNET_OPT_ECHO, !on);
+    if (t->event) t->event(t, TELNET_EV_MODE);
+}
+
+/**
+ * Handle a complete IAC SB ... IAC SE
+ */
+static void subnegotiate(tinysh_telnet_t *t) {
+    static const char wont_forwardmask[] = {
+        (char)TELNET_IAC, (char)TELNET_SB, TELNET_OPT_LINEMODE, (char)TELNET_WONT, LM_FORWARDMASK,
+        (char)TELNET_IAC, (char)TELNET_SE
+    };
+    unsigned short rows, cols;
+
+    if (t->sb_opt == TELNET_OPT_NAWS && t->sb_len >= 4) {
+        cols = (unsigned short)((t->sb[0] << 8) | t->sb[1]);
+        rows = (unsigned short)((t->sb[2] << 8) | t->sb[3]);
+        if (rows && cols && (rows != t->rows || cols != t->cols)) {
+            t->rows = rows;
+            t->cols = cols;
+            if (t->event) t->event(t, TELNET_EV_SIZE);
+        }
+    } else if (t->sb_opt == TELNET_OPT_LINEMODE && t->sb_len >= 2 &&
+               t->sb[0] == TELNET_DO && t->sb[1] == LM_FORWARDMASK) {
+        tinysh_telnet_queue(t, wont_forwardmask, sizeof(wont_forwardmask));
+    }
+    /* MODE acknowledgements and SLC need no answer: the client's own
+       editing characters are fine */
+}
+
+/**
+ * Set up protocol state
+ */
+void tinysh_telnet_init(tinysh_telnet_t *t, void (*event)(tinysh_telnet_t *t, int ev), void *user) {
+    memset(t, 0, sizeof(*t));
+    t->event = event;
+    t->user = user;
+}
+
+/**
+ * Queue the opening negotiation
+ */
+void tinysh_telnet_start(tinysh_telnet_t *t, int linemode) {
+    t->want_linemode = (char)(linemode != 0);
+    ask(t, &t->us_echo, TELNET_WILL, TELNET_WONT, TELNET_OPT_ECHO, 1);
+    ask(t, &t->us_sga, TELNET_WILL, TELNET_WONT, TELNET_OPT_SGA, 1);
+    ask(t, &t->him_sga, TELNET_DO, TELNET_DONT, TELNET_OPT_SGA, 1);
+    ask(t, &t->him_naws, TELNET_DO, TELNET_DONT, TELNET_OPT_NAWS, 1);
+    if (linemode) ask(t, &t->him_linemode, TELNET_DO, TELNET_DONT, TELNET_OPT_LINEMODE, 1);
+}
+
+/**
+ * Handle received bytes in place
+ * Data runs between commands are found first and moved down as a whole,
+ * only when a command before them was removed.
+ */
+int tinysh_telnet_input(tinysh_telnet_t *t, char *buf, int len) {
+    unsigned char *in = (unsigned char *)buf, *end = in + len, *out = in, *run;
+    unsigned char c;
+
+    while (in < end) {
+        if (t->state == ST_DATA) {
+            run = in;
+            while (in < end && *in != TELNET_IAC && *in != 0) in++;
+            if (out != run) memmove(out, run, (size_t)(in - run));
+            out += in - run;
+            if (in == end) break;
+            if (*in++ == TELNET_IAC) t->state = ST_IAC;
+            continue;
+        }
+
+        c = *in++;
+        switch (t->state) {
+        case ST_IAC:
+            t->state = ST_DATA;
+            if (c == TELNET_IAC) {
+                *out++ = c;             /* escaped data byte 255 */
+                break;
+            }
+            t->commands++;
+            if (c >= TELNET_WILL) {
+                t->cmd = c;
+                t->state = ST_CMD;
+            } else if (c == TELNET_SB) {
+                t->state = ST_SB_OPT;
+            } else if (c == TELNET_EC) {
+                *out++ = 8;             /* as backspace */
+            }
+            break;
+        case ST_CMD:
+            t->state = ST_DATA;
+            negotiate(t, t->cmd, c);
+            break;
+        case ST_SB_OPT:
+            t->sb_opt = c;
+            t->sb_len = 0;
+            t->state = ST_SB;
+            break;
+        case ST_SB:
+            if (c == TELNET_IAC) {
+                t->state = ST_SB_IAC;
+            } else if (t->sb_len < TELNET_SB_SIZE) {
+                t->sb[t->sb_len++] = c;
+            }
+            break;
+        case ST_SB_IAC:
+            if (c == TELNET_IAC) {
+                if (t->sb_len < TELNET_SB_SIZE) t->sb[t->sb_len++] = c;
+                t->state = ST_SB;
+            } else {
+                if (c == TELNET_SE) subnegotiate(t);
+                t->state = ST_DATA;
+            }
+            break;
+        default:
+            t->state = ST_DATA;
+            break;
+        }
+    }
+    return (int)(out - (unsigned char *)buf);
+}
+
+/**
+ * Protocol bytes waiting to be sent
+ */
+const char *tinysh_telnet_pending(tinysh_telnet_t *t, int *len) {
+    *len = t->reply_len;
+    return (const char *)t->reply;
+}
+
+/**
+ * Remove sent protocol bytes
+ */
+void tinysh_telnet_consume(tinysh_telnet_t *t, int n) {
+    if (n <= 0) return;
+    if (n > t->reply_len) n = t->reply_len;
+    t->reply_len -= n;
+    memmove(t->reply, t->reply + n, (size_t)t->reply_len);
+}
+
+/**
+ * Queue raw protocol bytes
+ */
+int tinysh_telnet_queue(tinysh_telnet_t *t, const char *bytes, int len) {
+    if (len > TELNET_REPLY_SIZE - t->reply_len) {
+        t->dropped += (unsigned long)len;
+        return -1;
+    }
+    memcpy(t->reply + t->reply_len, bytes, (size_t)len);
+    t->reply_len += len;
+    return 0;
+}
+
+/**
+ * Length of the leading output bytes that can be sent as they are
+ */
+int tinysh_telnet_plain(const char *buf, int len) {
+    const char *p = memchr(buf, TELNET_IAC, (size_t)len);
+    return p ? (int)(p - buf) : len;
+}
+
+/**
+ * Ask the client to switch line mode on or off
+ */
+void tinysh_telnet_set_linemode(tinysh_telnet_t *t, int on) {
+    int linemode = tinysh_telnet_linemode(t);
+
+    t->want_linemode = (char)(on != 0);
+    ask(t, &t->him_linemode, TELNET_DO, TELNET_DONT, TELNET_OPT_LINEMODE, on);
+    if (tinysh_telnet_linemode(t) != linemode) linemode_switched(t);
+}
+
+/**
+ * Is line mode in effect
+ */
+int tinysh_telnet_linemode(const tinysh_telnet_t *t) {
+    return t->him_linemode == TELNET_Q_YES;
+}
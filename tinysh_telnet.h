@@ -0,0 +1,170 @@
+/**
+ * TinyShell Telnet Protocol
+ * ------------------------
+ * RFC 854 protocol layer for transports that serve sessions over telnet
+ * (tiny_server.h, serial-over-IP bridges). Transport independent: it
+ * filters received bytes and queues protocol replies; the transport
+ * sends them.
+ *
+ * Features:
+ * - Option negotiation without loops (RFC 1143 states) for ECHO and SGA
+ *   (shell side), NAWS and LINEMODE (client side); anything else refused
+ * - IAC sequences are removed from the received chunk in place: plain
+ *   data runs are left where they are or moved down, never copied out
+ * - Sequences may be split across chunks
+ * - NAWS window size (RFC 1073), reported through the event callback so
+ *   the transport can size the session's terminal (tinysh_term.h)
+ * - Optional line mode (RFC 1184, EDIT): the client edits and echoes the
+ *   line and sends it whole, instead of one packet per keystroke. The
+ *   shell's TAB completion and history keys then do not reach it, so it
+ *   is only offered when asked for
+ * - NUL (a no-op in telnet) is dropped, so CR NUL reads as CR
+ *
+ * Example Usage:
+ *
+ * static void event(tinysh_telnet_t *t, int ev) {
+ *     if (ev == TELNET_EV_SIZE) resize(t->user, t->rows, t->cols);
+ * }
+ *
+ * tinysh_telnet_init(&t, event, conn);
+ * tinysh_telnet_start(&t, 0);           // offers ECHO, SGA; asks for NAWS
+ * n = recv(sock, buf, sizeof(buf), 0);
+ * n = tinysh_telnet_input(&t, buf, n);  // buf now holds only data
+ * p = tinysh_telnet_pending(&t, &len);  // replies to send first
+ */
+
+#ifndef TINYSH_TELNET_H
+#define TINYSH_TELNET_H
+
+#include "tinysh.h"
+
+/* Protocol bytes queued for sending */
+#ifndef TELNET_REPLY_SIZE
+#define TELNET_REPLY_SIZE         64
+#endif
+
+/* Longest subnegotiation kept; longer ones are cut */
+#ifndef TELNET_SB_SIZE
+#define TELNET_SB_SIZE            32
+#endif
+
+/* Commands (RFC 854) */
+#define TELNET_SE                 240
+#define TELNET_NOP                241
+#define TELNET_EC                 247   // Erase character
+#define TELNET_EL                 248   // Erase line
+#define TELNET_SB                 250
+#define TELNET_WILL               251
+#define TELNET_WONT               252
+#define TELNET_DO                 253
+#define TELNET_DONT               254
+#define TELNET_IAC                255
+
+/* Options */
+#define TELNET_OPT_ECHO           1
+#define TELNET_OPT_SGA            3
+#define TELNET_OPT_NAWS           31
+#define TELNET_OPT_LINEMODE       34
+
+/* Events */
+#define TELNET_EV_SIZE            1     // rows and cols changed
+#define TELNET_EV_MODE            2     // Line mode switched on or off
+
+/* Option state on one side (RFC 1143) */
+#define TELNET_Q_NO               0
+#define TELNET_Q_YES              1
+#define TELNET_Q_WANTNO           2
+#define TELNET_Q_WANTYES          3
+
+/* Protocol state of one connection */
+typedef struct tinysh_telnet_t {
+    void (*event)(struct tinysh_telnet_t *t, int ev); // Can be NULL
+    void *user;                      // Owned by the transport
+
+    /* Parser */
+    unsigned char state;
+    unsigned char cmd;               // WILL/WONT/DO/DONT being parsed
+    unsigned char sb_opt;            // Option of the subnegotiation
+    unsigned char sb[TELNET_SB_SIZE];
+    int sb_len;
+
+    /* Options (TELNET_Q_*): ECHO, SGA on the shell side; SGA, NAWS,
+       LINEMODE on the client's */
+    unsigned char us_echo;
+    unsigned char us_sga;
+    unsigned char him_sga;
+    unsigned char him_naws;
+    unsigned char him_linemode;
+    char want_linemode;              // Offer line mode when the client can
+
+    unsigned short rows;             // From NAWS, 0 until reported
+    unsigned short cols;
+
+    /* Replies not yet sent */
+    unsigned char reply[TELNET_REPLY_SIZE];
+    int reply_len;
+
+    /* Counters */
+    unsigned long commands;          // IAC sequences received
+    unsigned long dropped;           // Reply bytes lost to a full queue
+} tinysh_telnet_t;
+
+/**
+ * Set up protocol state
+ *
+ * @param event Called on TELNET_EV_*, can be NULL
+ * @param user  Transport data, stored in t->user
+ */
+void tinysh_telnet_init(tinysh_telnet_t *t, void (*event)(tinysh_telnet_t *t, int ev), void *user);
+
+/**
+ * Queue the opening negotiation: WILL ECHO, WILL SGA, DO SGA, DO NAWS,
+ * and DO LINEMODE when line mode is wanted
+ */
+void tinysh_telnet_start(tinysh_telnet_t *t, int linemode);
+
+/**
+ * Handle received bytes in place
+ *
+ * @return Number of data bytes now at the start of buf
+ */
+int tinysh_telnet_input(tinysh_telnet_t *t, char *buf, int len);
+
+/**
+ * Protocol bytes waiting to be sent, ahead of any session output
+ *
+ * @param len Receives their length
+ * @return First byte
+ */
+const char *tinysh_telnet_pending(tinysh_telnet_t *t, int *len);
+
+/**
+ * Remove sent protocol bytes
+ */
+void tinysh_telnet_consume(tinysh_telnet_t *t, int n);
+
+/**
+ * Queue raw protocol bytes
+ *
+ * @return 0, or -1 if they do not fit (nothing queued)
+ */
+int tinysh_telnet_queue(tinysh_telnet_t *t, const char *bytes, int len);
+
+/**
+ * Length of the leading output bytes that can be sent as they are
+ * A data byte 255 must go out as IAC IAC; when buf starts with it this
+ * returns 0.
+ */
+int tinysh_telnet_plain(const char *buf, int len);
+
+/**
+ * Ask the client to switch line mode on or off
+ */
+void tinysh_telnet_set_linemode(tinysh_telnet_t *t, int on);
+
+/**
+ * Is line mode in effect: the client edits and echoes lines itself
+ */
+int tinysh_telnet_linemode(const tinysh_telnet_t *t);
+
+#endif /* TINYSH_TELNET_H */
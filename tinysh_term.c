@@ -0,0 +1,651 @@
+#include "tinysh_term.h"
+#include "tinysh.h"
+#include <string.h>
+
+/* Longest report we accept: ESC [ 8 ; rrrrr ; ccccc t */
+#define TERM_REPORT_SIZE 16
+
+/* Held-back input is released if the rest of a report never arrives */
+#define TERM_HOLD_TIMEOUT_MS 100
+
+/* Terminal size state */
+static unsigned short term_rows = TERM_DEFAULT_ROWS;
+static unsigned short term_cols = TERM_DEFAULT_COLS;
+static char size_known = 0;
+static void (*change_listeners[TERM_MAX_LISTENERS])(int reason);
+static unsigned short reserved_rows = 0;
+
+/* Session size selected on this thread, NULL for the console's */
+static TINYSH_TLS tinysh_term_size_t *cur_size = NULL;
+
+/* Output on this thread is captured, not shown (tinysh_term_plain) */
+static TINYSH_TLS char plain_out = 0;
+
+/* Rendering profiles. Each SGR string is complete and pre-combined
+   (e.g. "\033[30;41m" rather than "\033[30m\033[41m") so styling a span
+   costs one short write. */
+static const tinysh_term_profile_t term_profiles[TERM_PROFILE_COUNT] = {
+    {
+        "full",
+        {
+            "\033[m",                     /* reset */
+            "\033[1;38;5;214m",           /* title: bold orange */
+            "\033[38;5;203m",             /* header: salmon */
+            "\033[38;5;16;48;5;160m",     /* selected: black on red */
+            "\033[38;5;252m",             /* normal: light grey */
+            "\033[38;5;170m",             /* admin: orchid */
+            "\033[38;5;220m",             /* submenu: gold */
+            "\033[2;38;5;250m",           /* footer: dim grey */
+            "\033[1;38;5;196m",           /* error: bold red */
+            "\033[38;5;203m",             /* prompt: salmon */
+            "\033[38;5;16;48;5;250m"      /* status: black on grey */
+        },
+        "[\xe2\x86\x91/\xe2\x86\x93] Select  [Enter/\xe2\x86\x92] Execute  [q/\xe2\x86\x90] Back",
+        TERM_PF_CURSOR
+    },
+    {
+        "16",
+        {
+            "\033[m",                     /* reset */
+            "\033[1;33m",                 /* title: bold yellow */
+            "\033[31m",                   /* header: red */
+            "\033[30;41m",                /* selected: black on red */
+            "\033[37m",                   /* normal: white */
+            "\033[35m",                   /* admin: magenta */
+            "\033[33m",                   /* submenu: yellow */
+            "\033[2;37m",                 /* footer: dim white */
+            "\033[1;31m",                 /* error: bold red */
+            "\033[31m",                   /* prompt: red */
+            "\033[30;47m"                 /* status: black on white */
+        },
+        "[\xe2\x86\x91/\xe2\x86\x93] Select  [Enter/\xe2\x86\x92] Execute  [q/\xe2\x86\x90] Back",
+        TERM_PF_CURSOR
+    },
+    {
+        "mono",
+        {
+            "\033[m",                     /* reset */
+            "\033[1m",                    /* title: bold */
+            "",                           /* header */
+            "\033[7m",                    /* selected: reverse */
+            "",                           /* normal */
+            "",                           /* admin */
+            "",                           /* submenu */
+            "\033[2m",                    /* footer: dim */
+            "\033[1m",                    /* error: bold */
+            "",                           /* prompt */
+            "\033[7m"                     /* status: reverse */
+        },
+        "[\xe2\x86\x91/\xe2\x86\x93] Select  [Enter/\xe2\x86\x92] Execute  [q/\xe2\x86\x90] Back",
+        TERM_PF_CURSOR
+    },
+    {
+        "ascii",
+        { "", "", "", "", "", "", "", "", "", "", "" },
+        "[^/v] Select  [Enter/>] Execute  [q/<] Back",
+        0
+    }
+};
+
+/* The console's profile selection; a session's is in its size */
+static tinysh_term_link_t console_link = {0, 0};
+
+/* Encoder state */
+static unsigned char term_caps = TERM_DEFAULT_CAPS;
+static unsigned long enc_plain = 0;     /* bytes a plain encoding takes */
+static unsigned long enc_emitted = 0;   /* bytes actually sent */
+
+/* Input filter state */
+static tinysh_input_fnt_t deliver_input = NULL;
+static char query_pending = 0;
+static unsigned long query_deadline = 0;
+static char report[TERM_REPORT_SIZE];
+static int report_len = 0;
+static unsigned long report_started = 0;
+
+/* Forward declarations */
+static void release_report(void);
+static int parse_report(void);
+static void notify_change(int reason);
+static int profile_for_rate(unsigned long rate);
+static tinysh_term_link_t *cur_link(void);
+static int link_profile(const tinysh_term_link_t *l);
+static int count_digits(int n);
+static void emit_char(char c, int n);
+static void emit_csi(int n, char final);
+void term_cmd_handler(int argc, const char **argv);
+
+/* Terminal command */
+tinysh_cmd_t term_cmd = {
+    0, "term", "show or set terminal settings",
+    "[size [query]|profile [auto|full|16|mono|ascii]|rep [on|off]]",
+    term_cmd_handler, 0, 0, 0
+};
+
+/**
+ * Get the terminal height
+ */
+unsigned short tinysh_term_rows(void) {
+    return cur_size ? cur_size->rows : term_rows;
+}
+
+/**
+ * Get the terminal width
+ */
+unsigned short tinysh_term_cols(void) {
+    return cur_size ? cur_size->cols : term_cols;
+}
+
+/**
+ * Check whether the size is known
+ */
+int tinysh_term_size_known(void) {
+    return cur_size ? cur_size->known : size_known;
+}
+
+/**
+ * Record a new terminal size
+ */
+void tinysh_term_set_size(unsigned short rows, unsigned short cols) {
+    if (rows == 0 || cols == 0) return;
+
+    if (cur_size) {
+        cur_size->rows = rows;
+        cur_size->cols = cols;
+        cur_size->known = 1;
+        return;
+    }
+    size_known = 1;
+    if (rows == term_rows && cols == term_cols) return;
+
+    term_rows = rows;
+    term_cols = cols;
+    notify_change(TERM_CHANGE_SIZE);
+}
+
+/**
+ * Select the size this thread reads and sets
+ */
+tinysh_term_size_t *tinysh_term_select_size(tinysh_term_size_t *size) {
+    tinysh_term_size_t *prev = cur_size;
+
+    cur_size = size;
+    return prev;
+}
+
+/**
+ * Register a change listener
+ */
+int tinysh_term_on_change(void (*callback)(int reason)) {
+    int i;
+
+    for (i = 0; i < TERM_MAX_LISTENERS; i++) {
+        if (change_listeners[i] == callback) return 0;
+    }
+    for (i = 0; i < TERM_MAX_LISTENERS; i++) {
+        if (!change_listeners[i]) {
+            change_listeners[i] = callback;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Tell listeners what changed
+ */
+static void notify_change(int reason) {
+    int i;
+
+    for (i = 0; i < TERM_MAX_LISTENERS; i++) {
+        if (change_listeners[i]) {
+            change_listeners[i](reason);
+        }
+    }
+}
+
+/**
+ * Clear the screen and home the cursor
+ */
+void tinysh_term_clear_screen(void) {
+    tinysh_printf("\033[2J\033[H");
+    notify_change(TERM_CHANGE_CLEAR);
+}
+
+/**
+ * Reserve rows at the bottom of the screen
+ */
+void tinysh_term_reserve_rows(unsigned short rows) {
+    if (rows == reserved_rows) return;
+    reserved_rows = rows;
+    notify_change(TERM_CHANGE_SIZE);
+}
+
+/**
+ * Rows available to scrolling text
+ */
+unsigned short tinysh_term_text_rows(void) {
+    if (cur_size) return cur_size->rows;
+    return (term_rows > reserved_rows) ? (unsigned short)(term_rows - reserved_rows) : 1;
+}
+
+/**
+ * Profile state of the output selected on this thread
+ */
+static tinysh_term_link_t *cur_link(void) {
+    return cur_size ? &cur_size->link : &console_link;
+}
+
+/**
+ * Profile in effect for an output
+ */
+static int link_profile(const tinysh_term_link_t *l) {
+    return l->fixed ? l->fixed - 1 : profile_for_rate(l->drain_rate);
+}
+
+/**
+ * Get the active rendering profile
+ */
+const tinysh_term_profile_t *tinysh_term_profile(void) {
+    return &term_profiles[link_profile(cur_link())];
+}
+
+/**
+ * Get the active profile id
+ */
+int tinysh_term_profile_id(void) {
+    return link_profile(cur_link());
+}
+
+/**
+ * Select a rendering profile
+ * Listeners draw on the console, so only the console's switch tells them.
+ */
+void tinysh_term_set_profile(int id) {
+    tinysh_term_link_t *l = cur_link();
+    int old_id;
+
+    if (id < TERM_PROFILE_AUTO || id >= TERM_PROFILE_COUNT) return;
+
+    old_id = link_profile(l);
+    l->fixed = (unsigned char)(id + 1);
+    if (!cur_size && link_profile(l) != old_id) notify_change(TERM_CHANGE_PROFILE);
+}
+
+/**
+ * Report how long the link took to drain a burst of output
+ */
+void tinysh_term_note_drain(unsigned long bytes, unsigned long usec) {
+    tinysh_term_link_t *l;
+    unsigned long rate;
+    int old_id;
+
+    if (bytes == 0) return;
+    if (usec == 0) usec = 1;
+
+    rate = (unsigned long)(((uint64_t)bytes * 1000000U) / usec);
+
+    /* Smooth over bursts so one odd sample does not flip the profile */
+    l = cur_link();
+    old_id = link_profile(l);
+    l->drain_rate = l->drain_rate ? (l->drain_rate * 3 + rate) / 4 : rate;
+    if (!cur_size && link_profile(l) != old_id) notify_change(TERM_CHANGE_PROFILE);
+}
+
+/**
+ * Get the estimated drain rate
+ */
+unsigned long tinysh_term_drain_rate(void) {
+    return cur_link()->drain_rate;
+}
+
+/**
+ * Cheapest profile that still looks right at the given drain rate
+ */
+static int profile_for_rate(unsigned long rate) {
+    if (rate == 0) return TERM_DEFAULT_PROFILE;
+    if (rate >= TERM_RATE_FULL) return TERM_PROFILE_FULL;
+    if (rate >= TERM_RATE_16) return TERM_PROFILE_16;
+    if (rate >= TERM_RATE_MONO) return TERM_PROFILE_MONO;
+    return TERM_PROFILE_ASCII;
+}
+
+/**
+ * Ask the terminal for its size
+ */
+void tinysh_term_query_size(void) {
+    /* xterm-style window size report, then the fallback for terminals
+       without it: park the cursor in the far corner (it is clamped to
+       the last row/column) and ask where it ended up */
+    tinysh_printf("\033[18t\0337\033[999;999H\033[6n\0338");
+    query_pending = 1;
+    query_deadline = tinysh_time_ms() + TERM_QUERY_TIMEOUT_MS;
+}
+
+/**
+ * Set the downstream input handler
+ */
+tinysh_input_fnt_t tinysh_term_set_input(tinysh_input_fnt_t deliver) {
+    tinysh_input_fnt_t previous = deliver_input;
+
+    deliver_input = deliver;
+    return previous;
+}
+
+/**
+ * Feed one input character through the terminal layer
+ */
+void tinysh_term_input(char c) {
+    /* Only look for reports while a query is outstanding, so ordinary
+       escape sequences (arrow keys) pass straight through otherwise */
+    if (report_len == 0) {
+        if (query_pending && c == 27) {
+            report[report_len++] = c;
+            report_started = tinysh_time_ms();
+            return;
+        }
+        if (deliver_input) deliver_input(c);
+        return;
+    }
+
+    report[report_len++] = c;
+
+    if (report_len == 2) {
+        if (c != '[') release_report();
+        return;
+    }
+
+    if ((c >= '0' && c <= '9') || c == ';') {
+        if (report_len >= TERM_REPORT_SIZE) release_report();
+        return;
+    }
+
+    if ((c == 't' || c == 'R') && parse_report()) {
+        report_len = 0;
+        return;
+    }
+
+    /* Not a report after all (e.g. an arrow key): hand it on */
+    release_report();
+}
+
+/**
+ * Periodic terminal work
+ */
+void tinysh_term_tick(void) {
+    unsigned long now = tinysh_time_ms();
+
+    if (report_len > 0 && (long)(now - report_started) >= TERM_HOLD_TIMEOUT_MS) {
+        release_report();
+    }
+    if (query_pending && report_len == 0 && (long)(now - query_deadline) >= 0) {
+        query_pending = 0;
+    }
+}
+
+/**
+ * Deliver held-back input unchanged
+ */
+static void release_report(void) {
+    int i, len = report_len;
+
+    report_len = 0;
+    for (i = 0; i < len; i++) {
+        if (deliver_input) deliver_input(report[i]);
+    }
+}
+
+/**
+ * Parse a complete report in report[]
+ * ESC [ 8 ; rows ; cols t   window size in characters
+ * ESC [ rows ; cols R       cursor position, after the move to 999;999
+ *
+ * @return 1 if it was a size report
+ */
+static int parse_report(void) {
+    unsigned long vals[3] = {0, 0, 0};
+    int nvals = 1;
+    int i;
+    char final = report[report_len - 1];
+
+    for (i = 2; i < report_len - 1; i++) {
+        if (report[i] == ';') {
+            if (nvals == 3) return 0;
+            nvals++;
+        } else {
+            vals[nvals - 1] = vals[nvals - 1] * 10 + (unsigned long)(report[i] - '0');
+            if (vals[nvals - 1] > 0xFFFF) return 0;
+        }
+    }
+
+    if (final == 't' && nvals == 3 && vals[0] == 8) {
+        tinysh_term_set_size((unsigned short)vals[1], (unsigned short)vals[2]);
+    } else if (final == 'R' && nvals == 2) {
+        tinysh_term_set_size((unsigned short)vals[0], (unsigned short)vals[1]);
+    } else {
+        return 0;
+    }
+    /* query_pending stays set until the deadline: a terminal that
+       supports both probes answers twice */
+    return 1;
+}
+
+/**
+ * Set the optional terminal capabilities
+ */
+void tinysh_term_set_caps(unsigned char caps) {
+    term_caps = caps;
+}
+
+/**
+ * Get the optional terminal capabilities
+ */
+unsigned char tinysh_term_caps(void) {
+    return term_caps;
+}
+
+/**
+ * Number of decimal digits in n (n >= 0)
+ */
+static int count_digits(int n) {
+    int d = 1;
+
+    while (n >= 10) {
+        n /= 10;
+        d++;
+    }
+    return d;
+}
+
+/**
+ * Send c n times, literally
+ */
+static void emit_char(char c, int n) {
+    if (!tinysh_char_out) return;
+    enc_emitted += (unsigned long)n;
+    while (n-- > 0) {
+        tinysh_char_out((unsigned char)c);
+    }
+}
+
+/**
+ * Send ESC [ n final through the character output
+ */
+static void emit_csi(int n, char final) {
+    char buf[16];
+    int i = (int)sizeof(buf) - 1;
+
+    buf[i] = 0;
+    buf[--i] = final;
+    do {
+        buf[--i] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n > 0 && i > 2);
+    buf[--i] = '[';
+    buf[--i] = 27;
+    tinysh_puts(&buf[i]);
+}
+
+/**
+ * Mark output on this thread as plain
+ */
+int tinysh_term_plain(int on) {
+    int prev = plain_out;
+
+    plain_out = (char)(on != 0);
+    return prev;
+}
+
+/**
+ * Does output on this thread reach an interactive terminal
+ */
+int tinysh_term_interactive(void) {
+    if (plain_out) return 0;
+    return cur_size ? cur_size->known : 1;
+}
+
+/**
+ * Move right over n blank columns
+ */
+void tinysh_term_pad(int n) {
+    int esc_len;
+
+    if (n <= 0) return;
+
+    enc_plain += (unsigned long)n;
+    esc_len = 3 + count_digits(n);  /* ESC [ n C */
+    if ((tinysh_term_profile()->flags & TERM_PF_CURSOR) && esc_len < n && tinysh_term_interactive()) {
+        emit_csi(n, 'C');
+        enc_emitted += (unsigned long)esc_len;
+    } else {
+        emit_char(' ', n);
+    }
+}
+
+/**
+ * Output c n times
+ */
+void tinysh_term_repeat(char c, int n) {
+    int esc_len;
+
+    if (n <= 0) return;
+
+    enc_plain += (unsigned long)n;
+    esc_len = 1 + 3 + count_digits(n - 1);  /* c ESC [ n-1 b */
+    if ((term_caps & TERM_CAP_REP) && (tinysh_term_profile()->flags & TERM_PF_CURSOR) &&
+        esc_len < n && tinysh_char_out && tinysh_term_interactive()) {
+        tinysh_char_out((unsigned char)c);
+        emit_csi(n - 1, 'b');
+        enc_emitted += (unsigned long)esc_len;
+    } else {
+        emit_char(c, n);
+    }
+}
+
+/**
+ * Rewrite a field in place
+ */
+void tinysh_term_rewrite(const char *old, const char *cur) {
+    int same = 0;
+    int old_len = (int)strlen(old);
+    int cur_len = (int)strlen(cur);
+    int esc_len;
+
+    /* A plain redraw writes the whole value and erases the rest */
+    enc_plain += (unsigned long)cur_len + 3;
+
+    if (!(tinysh_term_profile()->flags & TERM_PF_CURSOR)) {
+        /* No cursor movement: pad over leftovers with blanks instead */
+        tinysh_puts(cur);
+        enc_emitted += (unsigned long)cur_len;
+        if (old_len > cur_len) {
+            emit_char(' ', old_len - cur_len);
+            emit_char('\b', old_len - cur_len);
+        }
+        return;
+    }
+
+    while (old[same] && old[same] == cur[same]) same++;
+
+    /* Step over what is already right, unless retyping it is cheaper */
+    esc_len = 3 + count_digits(same);
+    if (same > esc_len) {
+        emit_csi(same, 'C');
+        enc_emitted += (unsigned long)esc_len;
+    } else {
+        same = 0;
+    }
+
+    tinysh_puts(cur + same);
+    enc_emitted += (unsigned long)(cur_len - same);
+
+    if (old_len > cur_len) {
+        tinysh_puts("\033[K");
+        enc_emitted += 3;
+    }
+}
+
+/**
+ * Encoder counters
+ */
+void tinysh_term_encoder_stats(unsigned long *plain, unsigned long *emitted) {
+    if (plain) *plain = enc_plain;
+    if (emitted) *emitted = enc_emitted;
+}
+
+/**
+ * Terminal command handler
+ */
+void term_cmd_handler(int argc, const char **argv) {
+    int i;
+
+    if (argc > 2 && strcmp(argv[1], "size") == 0 && strcmp(argv[2], "query") == 0) {
+        tinysh_term_query_size();
+        tinysh_printf("Size query sent\r\n");
+        return;
+    }
+
+    if (argc > 2 && strcmp(argv[1], "profile") == 0) {
+        if (strcmp(argv[2], "auto") == 0) {
+            tinysh_term_set_profile(TERM_PROFILE_AUTO);
+        } else {
+            for (i = 0; i < TERM_PROFILE_COUNT; i++) {
+                if (strcmp(argv[2], term_profiles[i].name) == 0) break;
+            }
+            if (i == TERM_PROFILE_COUNT) {
+                tinysh_printf("Unknown profile: %s\r\n", argv[2]);
+                return;
+            }
+            tinysh_term_set_profile(i);
+        }
+    }
+
+    if (argc > 2 && strcmp(argv[1], "rep") == 0) {
+        if (strcmp(argv[2], "on") == 0) {
+            term_caps |= TERM_CAP_REP;
+        } else {
+            term_caps &= (unsigned char)~TERM_CAP_REP;
+        }
+    }
+
+    tinysh_printf("Terminal size: %u x %u%s\r\n", tinysh_term_cols(), tinysh_term_rows(),
+                  tinysh_term_size_known() ? "" : " (default)");
+    tinysh_printf("Profile: %s%s\r\n", tinysh_term_profile()->name,
+                  cur_link()->fixed ? "" : " (auto)");
+    if (tinysh_term_drain_rate()) {
+        tinysh_printf("Drain rate: %lu bytes/s\r\n", tinysh_term_drain_rate());
+    } else {
+        tinysh_printf("Drain rate: not measured\r\n");
+    }
+    tinysh_printf("REP: %s\r\n", (term_caps & TERM_CAP_REP) ? "on" : "off");
+    tinysh_printf("Encoder: %lu bytes sent for %lu plain (%lu saved)\r\n",
+                  enc_emitted, enc_plain,
+                  enc_plain > enc_emitted ? enc_plain - enc_emitted : 0UL);
+}
+
+/**
+ * Register the terminal command
+ */
+void tinysh_term_init(void) {
+    tinysh_add_command(&term_cmd);
+}
@@ -0,0 +1,344 @@
+/**
+ * TinyShell Terminal Layer
+ * ----------------------
+ * Keeps track of what the terminal at the other end of the link looks
+ * like, so renderers can adapt at runtime instead of relying on
+ * compile-time constants.
+ *
+ * Features:
+ * - Window size from the platform (e.g. TIOCGWINSZ/SIGWINCH on Linux),
+ *   or per session from the transport (e.g. telnet NAWS)
+ * - Asynchronous size query for serial terminals (ESC[18t with a
+ *   cursor-position-report fallback), answered through the input stream
+ * - Rendering profiles (full colour, 16-colour, monochrome, plain ASCII)
+ *   as const tables of pre-built escape strings, picked from the
+ *   measured output drain rate or set explicitly
+ * - Change notification so renderers can redraw what changed
+ * - Byte-minimal encoding of padding, repeated characters and in-place
+ *   field rewrites, with counters of the bytes saved
+ *
+ * Example Usage:
+ *
+ * // Input flows through the terminal layer first, which swallows the
+ * // terminal's own reports and hands everything else on
+ * static void deliver(char c) { tinysh_char_in(c); }
+ *
+ * tinysh_term_set_input(deliver);
+ * tinysh_term_query_size();          // returns immediately
+ * while (1) {
+ *     tinysh_term_input(getchar());
+ *     tinysh_term_tick();
+ * }
+ */
+
+#ifndef TINYSH_TERM_H
+#define TINYSH_TERM_H
+
+#include "tinysh.h"
+
+/* Size assumed until the platform or the terminal tells us otherwise */
+#ifndef TERM_DEFAULT_ROWS
+#define TERM_DEFAULT_ROWS         24
+#endif
+
+#ifndef TERM_DEFAULT_COLS
+#define TERM_DEFAULT_COLS         80
+#endif
+
+/* How long a size query waits for the terminal to answer */
+#ifndef TERM_QUERY_TIMEOUT_MS
+#define TERM_QUERY_TIMEOUT_MS     500
+#endif
+
+/* Maximum number of change listeners */
+#ifndef TERM_MAX_LISTENERS
+#define TERM_MAX_LISTENERS        4
+#endif
+
+/* Profile picked until a drain rate has been measured */
+#ifndef TERM_DEFAULT_PROFILE
+#define TERM_DEFAULT_PROFILE      TERM_PROFILE_16
+#endif
+
+/* Drain rates (bytes/s) at which auto mode steps up to a richer profile.
+   Roughly 115200, 38400 and 9600 baud. */
+#ifndef TERM_RATE_FULL
+#define TERM_RATE_FULL            11000UL
+#endif
+
+#ifndef TERM_RATE_16
+#define TERM_RATE_16              3600UL
+#endif
+
+#ifndef TERM_RATE_MONO
+#define TERM_RATE_MONO            900UL
+#endif
+
+/* Optional terminal capabilities (tinysh_term_set_caps) */
+#define TERM_CAP_REP              0x01  // ECMA-48 REP: ESC [ n b repeats last char
+
+#ifndef TERM_DEFAULT_CAPS
+#define TERM_DEFAULT_CAPS         0
+#endif
+
+/* Rendering profile flags */
+#define TERM_PF_CURSOR            0x01  // Cursor movement escapes may be used
+
+/* Rendering profiles */
+#define TERM_PROFILE_AUTO         (-1)  // Follow the measured drain rate
+#define TERM_PROFILE_FULL         0     // 256-colour
+#define TERM_PROFILE_16           1     // 16-colour
+#define TERM_PROFILE_MONO         2     // Bold/reverse/dim only
+#define TERM_PROFILE_ASCII        3     // No escapes, ASCII glyphs
+#define TERM_PROFILE_COUNT        4
+
+/* Reasons passed to change listeners */
+#define TERM_CHANGE_SIZE          1     // Terminal or text area resized
+#define TERM_CHANGE_PROFILE       2     // Rendering profile switched
+#define TERM_CHANGE_CLEAR         3     // Screen was cleared
+
+/* Roles a renderer asks the active profile to style */
+#define TERM_ROLE_RESET           0
+#define TERM_ROLE_TITLE           1
+#define TERM_ROLE_HEADER          2
+#define TERM_ROLE_SELECTED        3
+#define TERM_ROLE_NORMAL          4
+#define TERM_ROLE_ADMIN           5
+#define TERM_ROLE_SUBMENU         6
+#define TERM_ROLE_FOOTER          7
+#define TERM_ROLE_ERROR           8
+#define TERM_ROLE_PROMPT          9
+#define TERM_ROLE_STATUS          10
+#define TERM_ROLE_COUNT           11
+
+/**
+ * Rendering profile: everything a renderer needs to style its output,
+ * prepared in advance so nothing is built at runtime
+ */
+typedef struct {
+    const char *name;                   // Name used by the term command
+    const char *sgr[TERM_ROLE_COUNT];   // Escape string per role, "" for none
+    const char *nav_help;               // Menu navigation hint line
+    unsigned char flags;                // TERM_PF_* flags
+} tinysh_term_profile_t;
+
+/* Rendering profile of one output: the console, or a session */
+typedef struct {
+    unsigned char fixed;                // TERM_PROFILE_* + 1, 0 to follow the drain rate
+    unsigned long drain_rate;           // Bytes/s measured, 0 if unknown
+} tinysh_term_link_t;
+
+/* Terminal of a session (tinysh_session.h), kept apart from the
+   console's: its size and its rendering profile */
+typedef struct {
+    unsigned short rows;
+    unsigned short cols;
+    char known;                         // Reported by the terminal (e.g. telnet NAWS)
+    tinysh_term_link_t link;
+} tinysh_term_size_t;
+
+/* Input handler the terminal layer delivers ordinary characters to */
+typedef void (*tinysh_input_fnt_t)(char c);
+
+/**
+ * Get the terminal height in rows
+ */
+unsigned short tinysh_term_rows(void);
+
+/**
+ * Get the terminal width in columns
+ */
+unsigned short tinysh_term_cols(void);
+
+/**
+ * Check whether the size came from the platform or the terminal
+ *
+ * @return 1 if known, 0 if the defaults are in use
+ */
+int tinysh_term_size_known(void);
+
+/**
+ * Record a new terminal size, notifying resize listeners on change
+ *
+ * @param rows Height in rows
+ * @param cols Width in columns
+ */
+void tinysh_term_set_size(unsigned short rows, unsigned short cols);
+
+/**
+ * Make a session's size the one this thread reads and sets
+ * Resizing a session does not notify listeners, which draw on the console.
+ *
+ * @param size Session size, or NULL for the console's
+ * @return Previously selected size, NULL for the console's
+ */
+tinysh_term_size_t *tinysh_term_select_size(tinysh_term_size_t *size);
+
+/**
+ * Register a function called after the terminal size, the active
+ * rendering profile or the rows available for text changed, or the
+ * screen was cleared
+ *
+ * @param callback Function to call with the TERM_CHANGE_* reason
+ * @return 0 on success, -1 if the listener table is full
+ */
+int tinysh_term_on_change(void (*callback)(int reason));
+
+/**
+ * Clear the screen and home the cursor
+ * Lets listeners restore what they keep on screen (e.g. a status line).
+ */
+void tinysh_term_clear_screen(void);
+
+/**
+ * Reserve rows at the bottom of the screen for fixed content
+ *
+ * @param rows Number of rows taken away from scrolling text
+ */
+void tinysh_term_reserve_rows(unsigned short rows);
+
+/**
+ * Rows available to scrolling text and full-screen renderers
+ * The terminal height minus reserved rows.
+ */
+unsigned short tinysh_term_text_rows(void);
+
+/**
+ * Get the active rendering profile
+ * Each output has its own: the console's, or the selected session's.
+ */
+const tinysh_term_profile_t *tinysh_term_profile(void);
+
+/**
+ * Get the active profile id (TERM_PROFILE_FULL..TERM_PROFILE_ASCII)
+ */
+int tinysh_term_profile_id(void);
+
+/**
+ * Select a rendering profile
+ *
+ * @param id TERM_PROFILE_* id, or TERM_PROFILE_AUTO to follow the link
+ */
+void tinysh_term_set_profile(int id);
+
+/**
+ * Report how long the link took to drain a burst of output
+ * Feeds the drain rate estimate used by TERM_PROFILE_AUTO, of the output
+ * selected on this thread.
+ *
+ * @param bytes Bytes that were still queued for the link
+ * @param usec  Microseconds the link took to send them
+ */
+void tinysh_term_note_drain(unsigned long bytes, unsigned long usec);
+
+/**
+ * Get the estimated drain rate
+ *
+ * @return Bytes per second, 0 if nothing was measured yet
+ */
+unsigned long tinysh_term_drain_rate(void);
+
+/**
+ * Ask the terminal for its size
+ * Sends ESC[18t and a cursor-position-report probe, then returns. The
+ * answer is picked out of the input stream by tinysh_term_input().
+ */
+void tinysh_term_query_size(void);
+
+/**
+ * Set where tinysh_term_input() delivers ordinary input characters
+ *
+ * @param deliver Downstream input handler
+ * @return Previous handler
+ */
+tinysh_input_fnt_t tinysh_term_set_input(tinysh_input_fnt_t deliver);
+
+/**
+ * Feed one input character through the terminal layer
+ * Terminal reports are consumed; everything else is delivered.
+ *
+ * @param c Input character
+ */
+void tinysh_term_input(char c);
+
+/**
+ * Periodic terminal work, call from the main loop
+ * Expires unanswered queries and releases held-back input.
+ */
+void tinysh_term_tick(void);
+
+/**
+ * Set the optional capabilities of the terminal
+ *
+ * @param caps TERM_CAP_* mask
+ */
+void tinysh_term_set_caps(unsigned char caps);
+
+/**
+ * Get the optional capabilities of the terminal
+ */
+unsigned char tinysh_term_caps(void);
+
+/**
+ * Mark output on this thread as not going to a terminal, e.g. while it
+ * is captured for a program or for replaying later
+ *
+ * @param on 1 for plain output, 0 to go back
+ * @return Previous setting
+ */
+int tinysh_term_plain(int on);
+
+/**
+ * Check whether output on this thread reaches an interactive terminal:
+ * the console, or a session whose terminal reported its size, and not
+ * marked plain
+ */
+int tinysh_term_interactive(void);
+
+/**
+ * Move right over n columns known to be blank
+ * Emits ESC[nC instead of n spaces when that is shorter and the output
+ * is an interactive terminal. Only use it where the screen is already
+ * clear (fresh line, cleared screen).
+ *
+ * @param n Number of columns
+ */
+void tinysh_term_pad(int n);
+
+/**
+ * Output c n times
+ * Uses REP (ESC[nb) when the terminal supports it, it is shorter and the
+ * output is an interactive terminal.
+ *
+ * @param c Character to repeat
+ * @param n Repeat count
+ */
+void tinysh_term_repeat(char c, int n);
+
+/**
+ * Rewrite a field in place, cursor at the start of the field
+ * Skips the part that is already on screen, writes the changed tail
+ * and erases what is left of a longer old value.
+ *
+ * @param old Text currently on screen in this field
+ * @param cur New text
+ */
+void tinysh_term_rewrite(const char *old, const char *cur);
+
+/**
+ * Encoder counters
+ *
+ * @param plain   Bytes the plain encoding would have taken (may be 0)
+ * @param emitted Bytes actually emitted (may be 0)
+ */
+void tinysh_term_encoder_stats(unsigned long *plain, unsigned long *emitted);
+
+/**
+ * Register the terminal command
+ */
+void tinysh_term_init(void);
+
+/* Terminal command */
+extern tinysh_cmd_t term_cmd;
+
+#endif /* TINYSH_TERM_H */
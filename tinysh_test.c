@@ -1,8 +1,33 @@
 #include "tinysh_test.h"
 #include "tinysh.h"
+#include "tinysh_term.h"
+#include "tinysh_status.h"
+#include "tinysh_progress.h"
+#include "tinysh_table.h"
+#include "tinysh_metric.h"
+#include "tinysh_memo.h"
+#include "tinysh_complete.h"
+#include "tinysh_apropos.h"
+#include "tinysh_param.h"
+#include "tinysh_kv.h"
+#include "tinysh_retain.h"
+#include "tinysh_timer.h"
+#include "tinysh_build.h"
+#include "tinysh_session.h"
+#include "tinysh_telnet.h"
+#include "tiny_ipc.h"
+#include "tiny_fanout.h"
+#include "tiny_transcript.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>  // For va_list
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 
 /* Test stats */
 static int tests_run = 0;
@@ -11,11 +36,12 @@ static int tests_failed = 0;
 static int verbose = 1;  // Default to verbose output
 
 /* Output Capture Buffer */
-#define CAPTURE_BUF_SIZE 1024
+#define CAPTURE_BUF_SIZE 8192    /* holds the root help, which every module adds to */
 static char capture_buffer[CAPTURE_BUF_SIZE];
 static int capture_index = 0;
 static int capture_enabled = 0;
 static void (*original_char_out)(unsigned char) = NULL;
+static void (*original_block_out)(const char *, int) = NULL;
 
 /* Forward declarations for test command handlers */
 void test_cmd_handler(int argc, const char **argv);
@@ -27,6 +53,28 @@ void test_tokenize_handler(int argc, const char **argv);
 void test_conversion_handler(int argc, const char **argv);
 void test_auth_handler(int argc, const char **argv);
 void test_help_handler(int argc, const char **argv);
+void test_term_handler(int argc, const char **argv);
+void test_status_handler(int argc, const char **argv);
+void test_progress_handler(int argc, const char **argv);
+void test_table_handler(int argc, const char **argv);
+void test_metric_handler(int argc, const char **argv);
+void test_memo_handler(int argc, const char **argv);
+void test_dispatch_handler(int argc, const char **argv);
+void test_complete_handler(int argc, const char **argv);
+void test_apropos_handler(int argc, const char **argv);
+void test_param_handler(int argc, const char **argv);
+void test_kv_handler(int argc, const char **argv);
+void test_txn_handler(int argc, const char **argv);
+void test_session_handler(int argc, const char **argv);
+void test_sched_handler(int argc, const char **argv);
+void test_ipc_handler(int argc, const char **argv);
+void test_telnet_handler(int argc, const char **argv);
+void test_fanout_handler(int argc, const char **argv);
+void test_scrollback_handler(int argc, const char **argv);
+void test_transcript_handler(int argc, const char **argv);
+void test_retain_handler(int argc, const char **argv);
+void test_timer_handler(int argc, const char **argv);
+void test_build_handler(int argc, const char **argv);
 
 /* Test helper functions */
 static void test_assert(const char *test_name, int condition, const char *message);
@@ -46,7 +94,9 @@ void test_capture_start(void) {
         capture_index = 0;
         capture_buffer[0] = 0;
         original_char_out = tinysh_char_out;
+        original_block_out = tinysh_block_out;
         tinysh_out(capture_char_out);
+        tinysh_block_out = 0;  // tinysh_write() falls back to char output
         capture_enabled = 1;
     }
 }
@@ -54,6 +104,7 @@ void test_capture_start(void) {
 void test_capture_stop(void) {
     if (capture_enabled) {
         tinysh_out(original_char_out);
+        tinysh_block_out = original_block_out;
         capture_enabled = 0;
     }
 }
@@ -73,7 +124,7 @@ void test_capture_clear(void) {
 
 /* Test command definitions */
 tinysh_cmd_t test_cmd = {
-    0, "test", "TinyShell unit tests", "[run|parser|history|commands|tokenize|conversion|auth]", 
+    0, "test", "TinyShell unit tests", "[run|parser|history|commands|tokenize|conversion|auth|help|term]", 
     test_cmd_handler, 0, 0, 0
 };
 
@@ -117,6 +168,116 @@ tinysh_cmd_t test_help_cmd = {
     test_help_handler, 0, 0, 0
 };
 
+tinysh_cmd_t test_term_cmd = {
+    &test_cmd, "term", "Test terminal layer", 0,
+    test_term_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_status_cmd = {
+    &test_cmd, "status", "Test status line", 0,
+    test_status_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_progress_cmd = {
+    &test_cmd, "progress", "Test progress line", 0,
+    test_progress_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_table_cmd = {
+    &test_cmd, "table", "Test table output", 0,
+    test_table_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_metric_cmd = {
+    &test_cmd, "metric", "Test metric rings", 0,
+    test_metric_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_memo_cmd = {
+    &test_cmd, "memo", "Test output memoization", 0,
+    test_memo_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_dispatch_cmd = {
+    &test_cmd, "dispatch", "Test dispatch cache", 0,
+    test_dispatch_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_complete_cmd = {
+    &test_cmd, "complete", "Test argument completion", 0,
+    test_complete_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_apropos_cmd = {
+    &test_cmd, "apropos", "Test command search", 0,
+    test_apropos_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_param_cmd = {
+    &test_cmd, "param", "Test parameter registry", 0,
+    test_param_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_kv_cmd = {
+    &test_cmd, "kv", "Test settings store", 0,
+    test_kv_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_txn_cmd = {
+    &test_cmd, "txn", "Test parameter transactions", 0,
+    test_txn_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_session_cmd = {
+    &test_cmd, "session", "Test sessions", 0,
+    test_session_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_sched_cmd = {
+    &test_cmd, "sched", "Test session scheduling", 0,
+    test_sched_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_ipc_cmd = {
+    &test_cmd, "ipc", "Test the shared-memory channel", 0,
+    test_ipc_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_telnet_cmd = {
+    &test_cmd, "telnet", "Test the telnet protocol", 0,
+    test_telnet_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_fanout_cmd = {
+    &test_cmd, "fanout", "Test fan-out across devices", 0,
+    test_fanout_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_scrollback_cmd = {
+    &test_cmd, "scrollback", "Test scrollback, detach and replay", 0,
+    test_scrollback_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_transcript_cmd = {
+    &test_cmd, "transcript", "Test session transcripts", 0,
+    test_transcript_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_retain_cmd = {
+    &test_cmd, "retain", "Test state retained across resets", 0,
+    test_retain_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_timer_cmd = {
+    &test_cmd, "timer", "Test the timer wheel and scheduled commands", 0,
+    test_timer_handler, 0, 0, 0
+};
+
+tinysh_cmd_t test_build_cmd = {
+    &test_cmd, "build", "Test commands built in an arena", 0,
+    test_build_handler, 0, 0, 0
+};
+
 /**
  * Initialize TinyShell test framework 
  */
@@ -133,6 +294,28 @@ void tinysh_test_init(void) {
     tinysh_add_command(&test_conversion_cmd);
     tinysh_add_command(&test_auth_cmd);
     tinysh_add_command(&test_help_cmd);
+    tinysh_add_command(&test_term_cmd);
+    tinysh_add_command(&test_status_cmd);
+    tinysh_add_command(&test_progress_cmd);
+    tinysh_add_command(&test_table_cmd);
+    tinysh_add_command(&test_metric_cmd);
+    tinysh_add_command(&test_memo_cmd);
+    tinysh_add_command(&test_dispatch_cmd);
+    tinysh_add_command(&test_complete_cmd);
+    tinysh_add_command(&test_apropos_cmd);
+    tinysh_add_command(&test_param_cmd);
+    tinysh_add_command(&test_kv_cmd);
+    tinysh_add_command(&test_txn_cmd);
+    tinysh_add_command(&test_session_cmd);
+    tinysh_add_command(&test_sched_cmd);
+    tinysh_add_command(&test_ipc_cmd);
+    tinysh_add_command(&test_telnet_cmd);
+    tinysh_add_command(&test_fanout_cmd);
+    tinysh_add_command(&test_scrollback_cmd);
+    tinysh_add_command(&test_transcript_cmd);
+    tinysh_add_command(&test_retain_cmd);
+    tinysh_add_command(&test_timer_cmd);
+    tinysh_add_command(&test_build_cmd);
     
     if (tinysh_printf) {
         tinysh_printf("TinyShell test framework initialized\r\n");
@@ -194,6 +377,28 @@ int tinysh_run_tests(void) {
     test_conversion_handler(0, NULL);
     test_auth_handler(0, NULL);  // This will handle both enabled and disabled authentication
     test_help_handler(0, NULL);
+    test_term_handler(0, NULL);
+    test_status_handler(0, NULL);
+    test_progress_handler(0, NULL);
+    test_table_handler(0, NULL);
+    test_metric_handler(0, NULL);
+    test_memo_handler(0, NULL);
+    test_dispatch_handler(0, NULL);
+    test_complete_handler(0, NULL);
+    test_apropos_handler(0, NULL);
+    test_param_handler(0, NULL);
+    test_kv_handler(0, NULL);
+    test_txn_handler(0, NULL);
+    test_session_handler(0, NULL);
+    test_sched_handler(0, NULL);
+    test_ipc_handler(0, NULL);
+    test_telnet_handler(0, NULL);
+    test_fanout_handler(0, NULL);
+    test_scrollback_handler(0, NULL);
+    test_transcript_handler(0, NULL);
+    test_retain_handler(0, NULL);
+    test_timer_handler(0, NULL);
+    test_build_handler(0, NULL);
     
     // Print summary
     test_result_summary();
@@ -220,6 +425,7 @@ void test_cmd_handler(int argc, const char **argv) {
     tinysh_printf("  test conversion - Test number conversion\r\n");
     tinysh_printf("  test auth       - Test authentication\r\n");
     tinysh_printf("  test help       - Test help output\r\n");
+    tinysh_printf("  test term       - Test terminal layer\r\n");
 }
 
 /**
@@ -516,3 +722,2133 @@ void test_help_handler(int argc, const char **argv) {
                 test_capture_contains("parser") && test_capture_contains("history"),
                 "Help output missing subcommands");
 }
+
+/* Characters the terminal layer passed on during the terminal tests */
+static char term_delivered[16];
+static int term_delivered_len = 0;
+
+static void term_collect(char c) {
+    if (term_delivered_len < (int)sizeof(term_delivered) - 1) {
+        term_delivered[term_delivered_len++] = c;
+        term_delivered[term_delivered_len] = 0;
+    }
+}
+
+static int quiet_printf(const char *fmt, ...) {
+    (void)fmt;
+    return 0;
+}
+
+static void term_feed(const char *s) {
+    while (*s) tinysh_term_input(*s++);
+}
+
+/**
+ * Terminal layer tests
+ */
+void test_term_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Terminal");
+
+    int (*saved_printf)(const char *, ...) = tinysh_printf;
+    tinysh_input_fnt_t saved_input = tinysh_term_set_input(term_collect);
+    unsigned short saved_rows = tinysh_term_rows();
+    unsigned short saved_cols = tinysh_term_cols();
+
+    // Window size report is consumed and applied
+    tinysh_print_out(quiet_printf);
+    tinysh_term_query_size();
+    tinysh_print_out(saved_printf);
+
+    term_delivered_len = 0;
+    term_feed("\033[8;40;120t");
+    test_assert("Size report parsed",
+                tinysh_term_rows() == 40 && tinysh_term_cols() == 120,
+                "ESC[8;rows;colst not applied");
+    test_assert("Size report consumed", term_delivered_len == 0,
+                "Report leaked into the input stream");
+
+    // Cursor position fallback
+    term_feed("\033[30;100R");
+    test_assert("Cursor report parsed",
+                tinysh_term_rows() == 30 && tinysh_term_cols() == 100,
+                "ESC[rows;colsR not applied");
+
+    // Arrow keys are handed on untouched while a query is pending
+    term_delivered_len = 0;
+    term_feed("\033[Ax");
+    test_assert("Arrow key passed on",
+                term_delivered_len == 4 && memcmp(term_delivered, "\033[Ax", 4) == 0,
+                "Arrow key sequence not delivered");
+
+    // Help text wraps to the terminal width
+    char help_buf[] = "";
+    tinysh_term_set_size(24, 30);
+    test_capture_start();
+    help_command_line(tinysh_get_root_cmd(), help_buf);
+    test_capture_stop();
+    int longest = 0, line = 0;
+    for (const char *p = test_capture_get(); *p; p++) {
+        if (*p == '\n' || *p == '\r') {
+            line = 0;
+        } else if (++line > longest) {
+            longest = line;
+        }
+    }
+    test_assert("Help wraps to width", longest < 30,
+                "Help line wider than the terminal");
+
+    tinysh_term_set_size(saved_rows, saved_cols);
+    tinysh_term_set_input(saved_input);
+
+    // Explicit profile selection
+    tinysh_term_set_profile(TERM_PROFILE_ASCII);
+    const tinysh_term_profile_t *prof = tinysh_term_profile();
+    int ascii_only = 1;
+    for (const char *p = prof->nav_help; *p; p++) {
+        if ((unsigned char)*p > 126) ascii_only = 0;
+    }
+    test_assert("ASCII profile",
+                prof->sgr[TERM_ROLE_SELECTED][0] == 0 && ascii_only,
+                "ASCII profile should emit no escapes or UTF-8");
+
+    // Auto selection follows the drain rate; measured on an output of its
+    // own, so drain history from the console's earlier output plays no part
+    tinysh_term_set_profile(TERM_PROFILE_AUTO);
+    tinysh_term_size_t link_out = {TERM_DEFAULT_ROWS, TERM_DEFAULT_COLS, 1, {0, 0}};
+    tinysh_term_size_t *console_size = tinysh_term_select_size(&link_out);
+    for (int i = 0; i < 16; i++) {
+        tinysh_term_note_drain(960, 1000000UL);   /* 9600 baud */
+    }
+    test_assert("Slow link profile",
+                tinysh_term_profile_id() == TERM_PROFILE_MONO,
+                "9600 baud link should get the monochrome profile");
+
+    for (int i = 0; i < 16; i++) {
+        tinysh_term_note_drain(4000, 10000UL);    /* pseudo-terminal */
+    }
+    test_assert("Fast link profile",
+                tinysh_term_profile_id() == TERM_PROFILE_FULL,
+                "Fast link should get the full colour profile");
+    tinysh_term_select_size(console_size);
+
+    // Encoder: runs collapse, short runs stay literal
+    unsigned long plain0, sent0, plain1, sent1;
+    unsigned char saved_caps = tinysh_term_caps();
+
+    tinysh_term_encoder_stats(&plain0, &sent0);
+    test_capture_clear();
+    test_capture_start();
+    tinysh_term_pad(3);
+    tinysh_term_pad(40);
+    test_capture_stop();
+    test_assert("Pad encoding", strcmp(test_capture_get(), "   \033[40C") == 0,
+                "Expected 3 literal blanks then ESC[40C");
+
+    tinysh_term_set_caps(TERM_CAP_REP);
+    test_capture_clear();
+    test_capture_start();
+    tinysh_term_repeat('-', 46);
+    test_capture_stop();
+    test_assert("REP encoding", strcmp(test_capture_get(), "-\033[45b") == 0,
+                "Expected one dash then ESC[45b");
+    tinysh_term_set_caps(saved_caps);
+
+    // In-place rewrite keeps the common prefix on screen
+    test_capture_clear();
+    test_capture_start();
+    tinysh_term_rewrite("Temperature 41.2C", "Temperature 41.7C");
+    test_capture_stop();
+    test_assert("Field rewrite", strcmp(test_capture_get(), "\033[15C7C") == 0,
+                "Expected a skip over the unchanged prefix");
+
+    tinysh_term_encoder_stats(&plain1, &sent1);
+    tinysh_printf("Encoder: %lu bytes sent for %lu plain\r\n",
+                  sent1 - sent0, plain1 - plain0);
+    test_assert("Encoder saves bytes", (sent1 - sent0) * 2 < (plain1 - plain0),
+                "Encoder should at least halve these runs");
+
+    // Plain ASCII profile never moves the cursor
+    tinysh_term_set_profile(TERM_PROFILE_ASCII);
+    test_capture_clear();
+    test_capture_start();
+    tinysh_term_pad(8);
+    test_capture_stop();
+    test_assert("ASCII pad", strcmp(test_capture_get(), "        ") == 0,
+                "ASCII profile should pad with blanks");
+    tinysh_term_set_profile(TERM_PROFILE_AUTO);
+
+    // Output that is not a terminal gets blanks, whatever the profile
+    tinysh_term_size_t raw = {TERM_DEFAULT_ROWS, TERM_DEFAULT_COLS, 0, {0, 0}};
+    tinysh_term_size_t *prev_size;
+    int plain = tinysh_term_plain(1);
+    test_capture_clear();
+    test_capture_start();
+    tinysh_term_pad(8);
+    tinysh_term_plain(plain);
+    prev_size = tinysh_term_select_size(&raw);
+    tinysh_term_pad(8);
+    tinysh_term_select_size(prev_size);
+    test_capture_stop();
+    test_assert("Plain output pad", strcmp(test_capture_get(), "                ") == 0,
+                "Captured output and unknown terminals should pad with blanks");
+
+    // A session's profile and drain rate are its own
+    int console_profile = tinysh_term_profile_id();
+    prev_size = tinysh_term_select_size(&raw);
+    tinysh_term_set_profile(TERM_PROFILE_MONO);
+    tinysh_term_note_drain(100, 1000000UL);
+    int ok = tinysh_term_profile_id() == TERM_PROFILE_MONO && tinysh_term_drain_rate() == 100;
+    tinysh_term_select_size(prev_size);
+    test_assert("Profile per output", ok && tinysh_term_profile_id() == console_profile &&
+                tinysh_term_drain_rate() != 100, "Setting a session's profile leaves the console's alone");
+}
+
+/* Fixed clock so the uptime field holds still during the status tests */
+static unsigned long status_clock(void) {
+    return 3723000UL;   /* 01:02:03 */
+}
+
+/**
+ * Test status line
+ */
+void test_status_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Status Line");
+
+    unsigned short saved_rows = tinysh_term_rows();
+    unsigned short saved_cols = tinysh_term_cols();
+    unsigned long (*saved_clock)(void) = tinysh_millis;
+
+    tinysh_status_init();
+    tinysh_time_source(status_clock);
+    tinysh_term_set_profile(TERM_PROFILE_16);
+    tinysh_term_set_size(24, 80);
+
+    // Bottom row is taken out of the scroll region and drawn once
+    test_capture_clear();
+    test_capture_start();
+    tinysh_status_enable(1);
+    test_capture_stop();
+    test_assert("Status region set",
+                test_capture_contains("\033[1;23r") && test_capture_contains("\033[24;1H"),
+                "Expected DECSTBM 1;23 and a draw on row 24");
+    test_assert("Status fields drawn",
+                test_capture_contains("user") && test_capture_contains("01:02:03"),
+                "Auth and clock fields missing");
+    test_assert("Status reserves row", tinysh_term_text_rows() == 23,
+                "Text area should shrink by one row");
+
+    // Nothing changed, nothing sent
+    test_capture_clear();
+    test_capture_start();
+    int redrawn = tinysh_status_refresh();
+    test_capture_stop();
+    test_assert("Status idle", redrawn == 0 && test_capture_get()[0] == 0,
+                "Unchanged fields should not be redrawn");
+
+    // A changed field is rewritten in place, nothing else
+    tinysh_status_set_field(STATUS_FIELD_USER, "pump: on");
+    test_capture_clear();
+    test_capture_start();
+    redrawn = tinysh_status_refresh();
+    test_capture_stop();
+    test_assert("Status field update",
+                redrawn == 1 && test_capture_contains("pump: on") &&
+                !test_capture_contains("user") && !test_capture_contains("r\0338"),
+                "Only the changed field should be sent");
+
+    tinysh_status_set_field(STATUS_FIELD_USER, "pump: off");
+    test_capture_clear();
+    test_capture_start();
+    tinysh_status_refresh();
+    test_capture_stop();
+    test_assert("Status field rewrite", test_capture_contains("\033[7Cff"),
+                "Common prefix should be skipped");
+
+    // Resize moves the region and the bar
+    test_capture_clear();
+    test_capture_start();
+    tinysh_term_set_size(30, 80);
+    test_capture_stop();
+    test_assert("Status follows resize",
+                test_capture_contains("\033[1;29r") && test_capture_contains("\033[30;1H") &&
+                tinysh_term_text_rows() == 29,
+                "Region and bar not moved to the new bottom row");
+
+    // Switching off gives the row back
+    test_capture_clear();
+    test_capture_start();
+    tinysh_status_enable(0);
+    test_capture_stop();
+    test_assert("Status off",
+                test_capture_contains("\033[r") && tinysh_term_text_rows() == 30,
+                "Scroll region not reset");
+
+    tinysh_status_set_field(STATUS_FIELD_USER, NULL);
+    tinysh_term_set_size(saved_rows, saved_cols);
+    tinysh_term_set_profile(TERM_PROFILE_AUTO);
+    tinysh_time_source(saved_clock);
+}
+
+/* Clock the progress tests advance by hand */
+static unsigned long progress_now = 0;
+
+static unsigned long progress_clock(void) {
+    return progress_now;
+}
+
+/**
+ * Test progress line
+ */
+void test_progress_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Progress");
+
+    unsigned long (*saved_clock)(void) = tinysh_millis;
+    unsigned short saved_rows = tinysh_term_rows();
+    unsigned short saved_cols = tinysh_term_cols();
+    unsigned long redraws;
+
+    tinysh_time_source(progress_clock);
+    tinysh_term_set_profile(TERM_PROFILE_16);
+    tinysh_term_set_size(24, 60);
+    progress_now = 1000;
+
+    test_capture_clear();
+    test_capture_start();
+    tinysh_progress_begin("Erasing", 1000);
+    test_capture_stop();
+    test_assert("Progress begin",
+                test_capture_contains("Erasing [") && test_capture_contains("  0%"),
+                "Initial bar not drawn");
+
+    // A tight loop without the clock moving draws nothing
+    test_capture_clear();
+    test_capture_start();
+    for (unsigned long i = 1; i <= 500; i++) {
+        tinysh_progress_update(i);
+    }
+    test_capture_stop();
+    test_assert("Progress rate limit",
+                tinysh_progress_redraws() == 1 && test_capture_get()[0] == 0,
+                "Updates within one frame should not redraw");
+
+    // Next frame: one redraw, unchanged prefix skipped
+    progress_now += 1000;
+    test_capture_clear();
+    test_capture_start();
+    tinysh_progress_update(501);
+    test_capture_stop();
+    test_assert("Progress redraw",
+                tinysh_progress_redraws() == 2 && test_capture_contains(" 50%") &&
+                test_capture_contains("\033[9C") && test_capture_contains("ETA  0:01"),
+                "Expected one in-place redraw with percentage and ETA");
+
+    test_capture_clear();
+    test_capture_start();
+    tinysh_progress_update(1000);
+    tinysh_progress_end();
+    test_capture_stop();
+    test_assert("Progress end",
+                test_capture_contains("100%") && test_capture_contains("\r\n"),
+                "Final state not drawn or line not ended");
+
+    // Past the next clock check with a frame due, but counts and rates
+    // round to the same text ("20M 20k/s"): nothing is sent
+    progress_now = 1000;
+    test_capture_clear();
+    test_capture_start();
+    tinysh_progress_begin("Scanning", 0);
+    progress_now += 1000000;
+    tinysh_progress_update(20000000);
+    redraws = tinysh_progress_redraws();
+    progress_now += 1000 / PROGRESS_MAX_FPS;
+    test_capture_stop();
+    test_capture_clear();
+    test_capture_start();
+    tinysh_progress_update(20020000);
+    test_capture_stop();
+    test_assert("Progress same text",
+                redraws == 2 && tinysh_progress_redraws() == 2 && test_capture_get()[0] == 0,
+                "Unchanged text should not be sent again");
+    test_capture_start();
+    tinysh_progress_end();
+    test_capture_stop();
+
+    tinysh_term_set_size(saved_rows, saved_cols);
+    tinysh_term_set_profile(TERM_PROFILE_AUTO);
+    tinysh_time_source(saved_clock);
+}
+
+/**
+ * Test table output
+ */
+void test_table_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Table");
+
+    static const tinysh_table_col_t auto_cols[] = {
+        {"Name", 0, 0},
+        {"Value", 0, TABLE_ALIGN_RIGHT}
+    };
+    static const tinysh_table_col_t fixed_cols[] = {
+        {"Id", 4, TABLE_ALIGN_RIGHT},
+        {"Name", 10, 0}
+    };
+    int saved_format = tinysh_table_format();
+
+    tinysh_term_set_profile(TERM_PROFILE_ASCII);   /* blanks, not cursor moves */
+    tinysh_table_set_format(TABLE_FORMAT_TEXT);
+
+    // Auto-sized columns: widths come from the buffered rows
+    test_capture_clear();
+    test_capture_start();
+    tinysh_table_begin(auto_cols, 2);
+    tinysh_table_add("temperature", "21");
+    tinysh_table_add("rh", "40.5");
+    tinysh_table_end();
+    test_capture_stop();
+    test_assert("Table auto width",
+                strcmp(test_capture_get(),
+                       "Name         Value\r\n"
+                       "------------------\r\n"
+                       "temperature     21\r\n"
+                       "rh            40.5\r\n") == 0,
+                "Columns not sized to the widest cell");
+
+    // Declared widths stream row by row
+    test_capture_clear();
+    test_capture_start();
+    tinysh_table_begin(fixed_cols, 2);
+    const char *row[] = {"7", "pump"};
+    tinysh_table_row(row);
+    test_capture_stop();
+    test_assert("Table streams",
+                test_capture_contains("   7  pump\r\n"),
+                "Row should be out before the table ends");
+    tinysh_table_end();
+
+    // CSV quoting
+    tinysh_table_set_format(TABLE_FORMAT_CSV);
+    test_capture_clear();
+    test_capture_start();
+    tinysh_table_begin(auto_cols, 2);
+    tinysh_table_add("say \"hi\"", "1,5");
+    tinysh_table_end();
+    test_capture_stop();
+    test_assert("Table CSV",
+                strcmp(test_capture_get(), "Name,Value\r\n\"say \"\"hi\"\"\",\"1,5\"\r\n") == 0,
+                "CSV cells not quoted per RFC 4180");
+
+    // Binary records
+    tinysh_table_set_format(TABLE_FORMAT_BINARY);
+    test_capture_clear();
+    test_capture_start();
+    tinysh_table_begin(fixed_cols, 2);
+    tinysh_table_add("7", "pump");
+    tinysh_table_end();
+    test_capture_stop();
+    test_assert("Table binary",
+                strcmp(test_capture_get(), "H\002\002Id\004NameR\002\0017\004pumpE") == 0,
+                "Unexpected record bytes");
+
+    tinysh_table_set_format(saved_format);
+    tinysh_term_set_profile(TERM_PROFILE_AUTO);
+}
+
+/* Sampler and ring for the metric tests */
+static long metric_sample_value = 0;
+
+static long metric_sampler(void) {
+    return metric_sample_value;
+}
+
+TINYSH_METRIC(test_ring, "test.ring", 4, metric_sampler, 100);
+
+/**
+ * Test metric rings
+ */
+void test_metric_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Metric");
+
+    tinysh_metric_t *ring = &test_ring;
+    unsigned long (*saved_clock)(void) = tinysh_millis;
+    char spark[32];
+
+    // Running stats, including after the extremes are evicted
+    tinysh_metric_push(ring, 5);
+    tinysh_metric_push(ring, 1);
+    tinysh_metric_push(ring, 9);
+    test_assert("Metric stats",
+                ring->min == 1 && ring->max == 9 && tinysh_metric_avg(ring) == 5,
+                "min/max/avg wrong");
+
+    tinysh_metric_push(ring, 3);
+    tinysh_metric_push(ring, 4);   /* evicts 5 */
+    tinysh_metric_push(ring, 2);   /* evicts 1, the minimum */
+    test_assert("Metric eviction",
+                ring->count == 4 && ring->min == 2 && ring->max == 9 &&
+                tinysh_metric_at(ring, 0) == 9 && tinysh_metric_avg(ring) == 4,
+                "Ring did not drop the oldest samples");
+
+    // Sparkline scales between min and max
+    tinysh_term_set_profile(TERM_PROFILE_ASCII);
+    tinysh_metric_sparkline(ring, spark, sizeof(spark), 10);
+    test_assert("Metric sparkline", strcmp(spark, "#.-_") == 0,
+                "Unexpected ASCII sparkline");
+    tinysh_metric_render(spark, sizeof(spark), ring);
+    test_assert("Metric menu value", strstr(spark, " 2") != NULL,
+                "Menu value should end with the last sample");
+    memset(spark, 'x', sizeof(spark));
+    test_assert("Metric menu value small",
+                tinysh_metric_render(spark, 3, ring) == 2 && strcmp(spark, " 2") == 0 &&
+                tinysh_metric_render(spark, 2, ring) == 1 && strcmp(spark, " ") == 0 &&
+                spark[3] == 'x',
+                "Render should fit the value, or as much of it as fits, in size");
+    tinysh_term_set_profile(TERM_PROFILE_AUTO);
+
+    // Plot has one line per row plus axis and summary
+    test_capture_clear();
+    test_capture_start();
+    tinysh_metric_plot(ring, 4);
+    test_capture_stop();
+    int lines = 0;
+    for (const char *p = test_capture_get(); *p; p++) {
+        if (*p == '\n') lines++;
+    }
+    test_assert("Metric plot", lines == 6 && test_capture_contains("min 2  max 9"),
+                "Plot shape wrong");
+
+    // Registered metrics are sampled from the tick loop at their period
+    metric_sample_value = 7;
+    tinysh_time_source(progress_clock);
+    progress_now = 5000;
+    tinysh_metric_register(ring);
+    tinysh_metric_tick();
+    tinysh_metric_tick();
+    progress_now += 100;
+    tinysh_metric_tick();
+    test_assert("Metric sampler",
+                tinysh_metric_find("test.ring") == ring &&
+                tinysh_metric_at(ring, 3) == 7 && tinysh_metric_at(ring, 2) == 7 &&
+                tinysh_metric_at(ring, 1) == 2,
+                "Sampler should run once per period");
+    tinysh_metric_unregister(ring);
+    tinysh_time_source(saved_clock);
+}
+
+/* Handler the memo tests count calls of */
+static int memo_calls = 0;
+
+static void memo_counted_handler(int argc, const char **argv) {
+    char line[32];
+    (void)argv;
+
+    memo_calls++;
+    snprintf(line, sizeof(line), "run %d args %d\r\n", memo_calls, argc);
+    tinysh_puts(line);
+}
+
+static tinysh_cmd_t memo_counted_cmd = {
+    0, "counted", "counts its calls", 0,
+    memo_counted_handler, 0, 0, 0
+};
+
+/**
+ * Test output memoization
+ */
+void test_memo_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Memo");
+
+    unsigned long (*saved_clock)(void) = tinysh_millis;
+    const char *args1[] = {"counted"};
+    const char *args2[] = {"counted", "x"};
+    const char *args3[] = {"counted", "ydtrd"};
+    const char *args4[] = {"counted", "gckxr"};
+
+    tinysh_time_source(progress_clock);
+    progress_now = 10000;
+    memo_calls = 0;
+
+    // Not opted in: the handler always runs
+    tinysh_memo_call(&memo_counted_cmd, 1, args1);
+    tinysh_memo_call(&memo_counted_cmd, 1, args1);
+    test_assert("Memo opt-in", memo_calls == 2, "Handler should run every time");
+
+    tinysh_memo_enable(&memo_counted_cmd, 500);
+    memo_calls = 0;
+
+    test_capture_clear();
+    test_capture_start();
+    tinysh_memo_call(&memo_counted_cmd, 1, args1);
+    tinysh_memo_call(&memo_counted_cmd, 1, args1);
+    test_capture_stop();
+    test_assert("Memo replay",
+                memo_calls == 1 &&
+                strcmp(test_capture_get(), "run 1 args 1\r\nrun 1 args 1\r\n") == 0,
+                "Second call should replay the first output");
+
+    tinysh_memo_call(&memo_counted_cmd, 2, args2);
+    test_assert("Memo keyed by arguments", memo_calls == 2,
+                "Different arguments must run the handler");
+
+    // "ydtrd" and "gckxr" hash alike: only the kept arguments tell them apart
+    tinysh_memo_call(&memo_counted_cmd, 2, args3);
+    tinysh_memo_call(&memo_counted_cmd, 2, args4);
+    test_assert("Memo hash collision",
+                tinysh_hash(args3[1], -1) == tinysh_hash(args4[1], -1) && memo_calls == 4,
+                "Arguments with the same hash must not share an entry");
+    memo_calls = 2;
+
+    progress_now += 500;
+    tinysh_memo_call(&memo_counted_cmd, 1, args1);
+    test_assert("Memo TTL", memo_calls == 3, "Expired output must not be replayed");
+
+    tinysh_memo_invalidate(&memo_counted_cmd);
+    tinysh_memo_call(&memo_counted_cmd, 1, args1);
+    test_assert("Memo invalidate", memo_calls == 4, "Invalidated output must not be replayed");
+
+    tinysh_memo_enable(&memo_counted_cmd, 0);
+    tinysh_time_source(saved_clock);
+}
+
+/* Command the dispatch tests type, records how it was called */
+static int probe_calls = 0;
+static int probe_argc = 0;
+static char probe_args[32];
+
+static void probe_handler(int argc, const char **argv) {
+    probe_calls++;
+    probe_argc = argc;
+    probe_args[0] = 0;
+    for (int i = 1; i < argc; i++) {
+        strncat(probe_args, argv[i], sizeof(probe_args) - strlen(probe_args) - 2);
+        strcat(probe_args, "|");
+    }
+}
+
+static tinysh_cmd_t probe_cmd = {
+    0, "dispatchprobe", "dispatch cache test command", 0,
+    probe_handler, 0, 0, 0
+};
+
+/* Type a line into the shell */
+static void type_line(const char *s) {
+    while (*s) tinysh_char_in(*s++);
+    tinysh_char_in('\r');
+}
+
+/**
+ * Test dispatch cache
+ */
+void test_dispatch_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Dispatch Cache");
+
+    int (*saved_printf)(const char *, ...) = tinysh_printf;
+    unsigned long hits;
+
+    tinysh_add_command(&probe_cmd);
+    probe_calls = 0;
+
+    // Run the lines directly: typed, they would land in the input of the
+    // command running this test
+    test_capture_start();
+    tinysh_print_out(quiet_printf);
+
+    tinysh_exec_line("dispatchprobe a  bb");
+    hits = tinysh_dispatch_hits();
+    tinysh_exec_line("dispatchprobe a  bb");
+    int repeat_hit = tinysh_dispatch_hits() == hits + 1;
+    int repeat_args = probe_calls == 2 && probe_argc == 3 && strcmp(probe_args, "a|bb|") == 0;
+
+    tinysh_exec_line("dispatchprobe c");
+    int other_line = tinysh_dispatch_hits() == hits + 1 && strcmp(probe_args, "c|") == 0;
+
+    // Adding a command may change how the line resolves
+    static tinysh_cmd_t extra_cmd = {
+        0, "dispatchextra", "dispatch cache test command", 0, 0, 0, 0, 0
+    };
+    tinysh_add_command(&extra_cmd);
+    tinysh_exec_line("dispatchprobe c");
+    int tree_change = tinysh_dispatch_hits() == hits + 1 && probe_calls == 4;
+
+    // So may a different auth level
+    tinysh_exec_line("dispatchprobe c");
+    hits = tinysh_dispatch_hits();
+    unsigned char saved_auth = tinysh_get_auth_level();
+    tinysh_set_auth_level(saved_auth == TINYSH_AUTH_ADMIN ? TINYSH_AUTH_NONE : TINYSH_AUTH_ADMIN);
+    tinysh_exec_line("dispatchprobe c");
+    int auth_change = tinysh_dispatch_hits() == hits;
+    tinysh_set_auth_level(saved_auth);
+
+    tinysh_print_out(saved_printf);
+    test_capture_stop();
+
+#if DISPATCH_CACHE
+    test_assert("Dispatch cache hit", repeat_hit, "Repeated line should skip the tree walk");
+    test_assert("Dispatch cached argv", repeat_args, "Cached arguments wrong");
+    test_assert("Dispatch other line", other_line, "Different line must not hit");
+    test_assert("Dispatch tree change", tree_change, "Adding a command must invalidate");
+#if AUTHENTICATION_ENABLED
+    test_assert("Dispatch auth change", auth_change, "Auth change must invalidate");
+#else
+    (void)auth_change;
+#endif
+#else
+    (void)repeat_hit; (void)other_line; (void)tree_change; (void)auth_change;
+    test_assert("Dispatch without cache", repeat_args, "Line not executed");
+#endif
+}
+
+/* Completer for the completion tests: fruit for the first argument,
+   colours for the second; counts its calls */
+static int fruit_calls = 0;
+
+static void complete_fruit(int argi, const char *prefix, void *arg) {
+    static const char *const fruit[] = {
+        "apple", "apricot", "banana", "blackberry", "blackcurrant", NULL
+    };
+    static const char *const colour[] = {"red", "green", NULL};
+    const char *const *w = argi == 1 ? fruit : colour;
+    (void)prefix;
+    (void)arg;
+
+    fruit_calls++;
+    while (*w) tinysh_complete_add(*w++);
+}
+
+static tinysh_cmd_t complete_probe_cmd = {
+    0, "completeprobe", "completion test command", 0,
+    probe_handler, 0, 0, 0
+};
+
+/* Type keys into the shell without ending the line */
+static void type_keys(const char *s) {
+    while (*s) tinysh_char_in(*s++);
+}
+
+/**
+ * Test argument completion
+ */
+void test_complete_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Completion");
+#if AUTOCOMPLATION == 0
+    return;  // TAB is an ordinary character
+#endif
+
+    int (*saved_printf)(const char *, ...) = tinysh_printf;
+    unsigned short rows = tinysh_term_rows(), cols = tinysh_term_cols();
+    unsigned long hits, misses;
+
+    tinysh_add_command(&complete_probe_cmd);
+    tinysh_complete_register(&complete_probe_cmd, complete_fruit, NULL);
+
+    test_capture_start();
+    tinysh_print_out(quiet_printf);
+
+    type_line("completeprobe ban\t");
+    test_assert("Complete unique", strcmp(probe_args, "banana|") == 0,
+                "Unique candidate should be completed");
+
+    type_line("completeprobe bla\t");
+    test_assert("Complete common prefix", strcmp(probe_args, "black|") == 0,
+                "Word should grow to the common prefix");
+
+    type_line("completeprobe apple g\t");
+    test_assert("Complete second argument", strcmp(probe_args, "apple|green|") == 0,
+                "Completer should see the argument index");
+
+    test_capture_clear();
+    type_keys("completeprobe b\t");
+    int listed = test_capture_contains("banana") && test_capture_contains("blackcurrant") &&
+                 !test_capture_contains("apple");
+    fruit_calls = 0;
+    tinysh_complete_stats(&hits, &misses);
+    type_keys("\t");
+    unsigned long hits2, misses2;
+    tinysh_complete_stats(&hits2, &misses2);
+    type_line("");
+    test_assert("Complete listing", listed, "Matching candidates should be listed");
+    test_assert("Complete cache", fruit_calls == 0 && hits2 == hits + 1 && misses2 == misses,
+                "Repeated TAB should not call the completer");
+
+    // One candidate per row, two rows per page
+    tinysh_term_set_size(4, 16);
+    test_capture_clear();
+    type_keys("completeprobe \t");
+    int first_page = test_capture_contains("apricot") && test_capture_contains("--More--") &&
+                     !test_capture_contains("banana");
+    test_capture_clear();
+    type_keys("\t");
+    int next_page = test_capture_contains("banana") && !test_capture_contains("apricot");
+    type_line("");
+    tinysh_term_set_size(rows, cols);
+    test_assert("Complete paging", first_page && next_page,
+                "Long lists should be shown a page at a time");
+
+    tinysh_print_out(saved_printf);
+    test_capture_stop();
+    tinysh_complete_register(&complete_probe_cmd, NULL, NULL);
+}
+
+/* Commands the search tests look for */
+static tinysh_cmd_t apropos_group_cmd = {
+    0, "aproposgrp", "search test group", 0, 0, 0, 0, 0
+};
+
+static tinysh_cmd_t apropos_leaf_cmd = {
+    &apropos_group_cmd, "frobnicate", "adjust the widget gain", "<gain>", 0, 0, 0, 0
+};
+
+static tinysh_cmd_t apropos_top_cmd = {
+    0, "widgetreset", "put everything back", 0, 0, 0, 0, 0
+};
+
+/**
+ * Test command search
+ */
+void test_apropos_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Apropos");
+
+    tinysh_cmd_t *found[4];
+    const char *one[] = {"widget"};
+    const char *two[] = {"WIDGET", "gain"};
+    const char *none[] = {"qwertyuiop"};
+    char path[32];
+    int n;
+
+    tinysh_add_command(&apropos_group_cmd);
+    tinysh_add_command(&apropos_leaf_cmd);
+
+    n = tinysh_apropos_search(one, 1, found, 4);
+    test_assert("Apropos finds nested command", n == 1 && found[0] == &apropos_leaf_cmd,
+                "Help text of a child command should be searched");
+
+    // Index rebuilt after the tree changed; name parts match too
+    tinysh_add_command(&apropos_top_cmd);
+    n = tinysh_apropos_search(one, 1, found, 4);
+    test_assert("Apropos index refresh", n == 2, "Command added after a search not found");
+
+    n = tinysh_apropos_search(two, 2, found, 4);
+    test_assert("Apropos ranking", n == 2 && found[0] == &apropos_leaf_cmd,
+                "Command matching more words should come first");
+
+    n = tinysh_apropos_search(none, 1, found, 4);
+    test_assert("Apropos no match", n == 0, "Unknown word should match nothing");
+
+    tinysh_apropos_path(&apropos_leaf_cmd, path, sizeof(path));
+    test_assert("Apropos full path", strcmp(path, "aproposgrp frobnicate") == 0,
+                "Path should include the parents");
+}
+
+/* Parameters the registry tests set */
+static int32_t t_int = 0;
+static uint8_t t_bool = 0;
+static float t_flt = 0;
+static int t_changes = 0;
+
+static void t_changed(tinysh_param_t *p) {
+    (void)p;
+    t_changes++;
+}
+
+TINYSH_PARAM(t_int_param, "t_int", PARAM_INT, &t_int, -10, 10, "mV", t_changed);
+TINYSH_PARAM(t_bool_param, "t_bool", PARAM_BOOL, &t_bool, 0, 0, NULL, t_changed);
+TINYSH_PARAM(t_flt_param, "t_flt", PARAM_FLOAT, &t_flt, 0, 5, NULL, t_changed);
+
+/**
+ * Test parameter registry
+ */
+void test_param_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Parameters");
+
+    int (*saved_printf)(const char *, ...) = tinysh_printf;
+    long v;
+    char buf[16];
+
+    test_assert("Parse number slice",
+                tinysh_parse_long("0x1F,", 4, &v) == 0 && v == 31 &&
+                tinysh_parse_long("-42", -1, &v) == 0 && v == -42 &&
+                tinysh_parse_long("12a", -1, &v) < 0 &&
+                tinysh_parse_long("99999999999999999999", -1, &v) < 0,
+                "Hex, sign, junk and overflow handling wrong");
+
+    tinysh_param_init();  // get/set/list, when run before the shell is set up
+    tinysh_param_register(&t_int_param);
+    tinysh_param_register(&t_bool_param);
+    tinysh_param_register(&t_flt_param);
+
+    test_assert("Param find by slice",
+                tinysh_param_find("t_int=3", 5) == &t_int_param &&
+                tinysh_param_find("t_in", 4) == NULL,
+                "Lookup should use exactly len bytes of the name");
+
+    t_int = 1;
+    t_changes = 0;
+    int range = tinysh_param_set(&t_int_param, "11", -1) == PARAM_ERR_RANGE &&
+                tinysh_param_set(&t_int_param, "-10", -1) == PARAM_OK;
+    test_assert("Param range", range && t_int == -10 && t_changes == 1,
+                "Range should be checked before storing");
+
+    test_capture_start();
+    tinysh_print_out(quiet_printf);
+    t_changes = 0;
+    type_line("set t_int=5 t_bool=on t_flt=2.5");
+    int bulk = t_int == 5 && t_bool == 1 && t_flt > 2.49f && t_flt < 2.51f && t_changes == 3;
+    type_line("set t_int=6 t_flt=9");
+    int atomic = t_int == 5 && t_changes == 3;
+    tinysh_print_out(saved_printf);
+    test_capture_stop();
+    test_assert("Param bulk set", bulk, "All assignments should be applied");
+    test_assert("Param bulk set atomic", atomic, "A bad assignment must leave all unchanged");
+
+    tinysh_param_format(&t_flt_param, buf, sizeof(buf));
+    test_assert("Param format", strcmp(buf, "2.500") == 0, "Float value text wrong");
+}
+
+/* Small RAM flash with NOR rules for the settings store tests */
+#define KV_TEST_SECTOR   256
+#define KV_TEST_SECTORS  4
+static unsigned char kv_flash_mem[KV_TEST_SECTOR * KV_TEST_SECTORS];
+static int kv_flash_erases[KV_TEST_SECTORS];
+
+static int kv_flash_read(unsigned long addr, void *buf, int len) {
+    memcpy(buf, kv_flash_mem + addr, (size_t)len);
+    return 0;
+}
+
+static int kv_flash_write(unsigned long addr, const void *buf, int len) {
+    const unsigned char *p = (const unsigned char *)buf;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        if ((kv_flash_mem[addr + i] & p[i]) != p[i]) return -1;
+    }
+    for (i = 0; i < len; i++) kv_flash_mem[addr + i] &= p[i];
+    return 0;
+}
+
+static int kv_flash_erase(unsigned short sector) {
+    memset(kv_flash_mem + sector * KV_TEST_SECTOR, 0xFF, KV_TEST_SECTOR);
+    kv_flash_erases[sector]++;
+    return 0;
+}
+
+static const tinysh_flash_t kv_test_flash = {
+    KV_TEST_SECTOR, KV_TEST_SECTORS, kv_flash_read, kv_flash_write, kv_flash_erase
+};
+
+/* Stored value as a string, "" when missing */
+static const char *kv_value(const char *key) {
+    static char buf[KV_MAX_VALUE + 1];
+    int n = tinysh_kv_get(key, buf, KV_MAX_VALUE);
+
+    buf[n > 0 ? n : 0] = 0;
+    return buf;
+}
+
+static int32_t kv_p = 0;
+TINYSH_PARAM(kv_p_param, "kv_p", PARAM_INT, &kv_p, 0, 100, NULL, NULL);
+
+/**
+ * Test settings store
+ */
+void test_kv_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Settings Store");
+
+    const tinysh_flash_t *live = tinysh_kv_device();
+    tinysh_kv_stats_t st;
+    char key[8], value[8];
+    int i, err = KV_OK, n, own;
+
+    test_assert("CRC-32 check value", tinysh_crc32(0, "123456789", 9) == 0xCBF43926U,
+                "Standard CRC-32 of \"123456789\" is CBF43926");
+
+    memset(kv_flash_mem, 0, sizeof(kv_flash_mem));  // not even formatted
+    memset(kv_flash_erases, 0, sizeof(kv_flash_erases));
+    int mount = tinysh_kv_mount(&kv_test_flash) == KV_OK;
+    int missing = tinysh_kv_get("a", value, sizeof(value)) == KV_ERR_NOT_FOUND;
+    tinysh_kv_put("a", "1", 1);
+    tinysh_kv_put("b", "xyz", 3);
+    tinysh_kv_put("a", "22", 2);
+    test_assert("KV put and get", mount && missing && strcmp(kv_value("a"), "22") == 0 &&
+                strcmp(kv_value("b"), "xyz") == 0, "Newest value should be returned");
+
+    int deleted = tinysh_kv_delete("b") == KV_OK && tinysh_kv_get("b", value, 1) == KV_ERR_NOT_FOUND &&
+                  tinysh_kv_delete("b") == KV_ERR_NOT_FOUND;
+    tinysh_kv_mount(&kv_test_flash);
+    test_assert("KV remount rebuilds index", deleted && strcmp(kv_value("a"), "22") == 0 &&
+                tinysh_kv_get("b", value, 1) == KV_ERR_NOT_FOUND,
+                "Values and removals should survive a remount");
+
+    // Rewrite a few keys until the log has wrapped around several times
+    for (i = 0; i < 300 && err == KV_OK; i++) {
+        snprintf(key, sizeof(key), "k%d", i % 3);
+        snprintf(value, sizeof(value), "%d", i);
+        err = tinysh_kv_put(key, value, (int)strlen(value));
+    }
+    tinysh_kv_stats(&st);
+    test_assert("KV compaction keeps live data", err == KV_OK && st.compactions > 0 &&
+                strcmp(kv_value("k0"), "297") == 0 && strcmp(kv_value("k2"), "299") == 0 &&
+                strcmp(kv_value("a"), "22") == 0 && st.keys == 4,
+                "Live records should be copied out of reclaimed sectors");
+
+    int spread = 1;
+    for (i = 0; i < KV_TEST_SECTORS; i++) {
+        if (kv_flash_erases[i] < 5) spread = 0;
+    }
+    test_assert("KV wear levelling", spread && st.erase_max - st.erase_min <= 1,
+                "Erases should rotate through all sectors");
+
+    // Fill with large values until the store refuses; nothing may be lost
+    memset(value, 'v', sizeof(value));
+    for (n = 0; n < 40; n++) {
+        char big[KV_MAX_VALUE];
+        memset(big, 'a' + n % 26, sizeof(big));
+        snprintf(key, sizeof(key), "big%d", n);
+        if (tinysh_kv_put(key, big, sizeof(big)) != KV_OK) break;
+    }
+    tinysh_kv_mount(&kv_test_flash);
+    test_assert("KV full", n > 0 && n < 40 && strcmp(kv_value("a"), "22") == 0 &&
+                tinysh_kv_get("big0", value, 1) == KV_MAX_VALUE,
+                "A full store should refuse writes and keep its data");
+
+    // A damaged record is skipped; the value before it is still there
+    memset(kv_flash_mem, 0, sizeof(kv_flash_mem));
+    tinysh_kv_mount(&kv_test_flash);
+    tinysh_kv_put("c", "old", 3);
+    tinysh_kv_put("c", "new", 3);
+    for (i = 0; i < (int)sizeof(kv_flash_mem) - 3; i++) {
+        if (memcmp(kv_flash_mem + i, "cnew", 4) == 0) break;
+    }
+    kv_flash_mem[i + 1] &= 0xF0;  // clear some bits, as a torn write would
+    tinysh_kv_mount(&kv_test_flash);
+    int crc = strcmp(kv_value("c"), "old") == 0;
+    int after = tinysh_kv_put("c", "x", 1) == KV_OK && strcmp(kv_value("c"), "x") == 0;
+    test_assert("KV record CRC", crc && after,
+                "A damaged record should fall back to the older value");
+
+    // Parameters round trip through save and load
+    own = tinysh_param_register(&kv_p_param) == 0;
+    kv_p = 42;
+    int saved = tinysh_kv_save_params(NULL) >= 1;
+    int again = tinysh_kv_save_params(&n) == 0 && n == tinysh_param_count();
+    kv_p = 7;
+    int loaded = tinysh_kv_load_params() >= 1 && kv_p == 42;
+    test_assert("KV save and load parameters", saved && again && loaded,
+                "Saved values should come back; unchanged ones are not rewritten");
+
+    // The test's parameter goes again; only the last one registered can
+    int others = tinysh_param_count() > 1 && tinysh_param_unregister(tinysh_param_at(0)) < 0;
+    if (own) tinysh_param_unregister(&kv_p_param);
+    test_assert("Parameter unregister", others && !tinysh_param_find("kv_p", -1),
+                "The last registered parameter should be removable, no other");
+
+    tinysh_kv_mount(live);
+}
+
+static int txn_commits = 0;
+
+static void txn_committed(void) {
+    txn_commits++;
+}
+
+/**
+ * Test parameter transactions
+ */
+void test_txn_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Transactions");
+
+    int (*saved_printf)(const char *, ...) = tinysh_printf;
+    tinysh_param_commit_t hook;
+    char buf[16], big[200];
+    tinysh_param_t *failed = NULL;
+
+    // Runs in the caller's session: not over a transaction of its own
+    if (tinysh_param_in_transaction()) {
+        tinysh_printf("  (skipped: transaction open)\r\n");
+        return;
+    }
+    tinysh_param_init();
+    tinysh_param_register(&t_int_param);
+    tinysh_param_register(&t_bool_param);
+    tinysh_param_register(&t_flt_param);
+    hook = tinysh_param_on_commit(txn_committed);
+
+    t_int = 1;
+    t_bool = 0;
+    t_changes = 0;
+    txn_commits = 0;
+    test_capture_start();
+    tinysh_print_out(quiet_printf);
+    type_line("begin");
+    type_line("set t_int=4 t_bool=on");
+    type_line("set t_int=5");
+    int staged = t_int == 1 && t_bool == 0 && t_changes == 0 &&
+                 tinysh_param_staged(&t_int_param, buf, sizeof(buf)) == 1 && buf[0] == '5';
+    type_line("commit");
+    tinysh_print_out(saved_printf);
+    test_capture_stop();
+    test_assert("Txn writes staged", staged, "Nothing should change before commit");
+    test_assert("Txn commit applies once", t_int == 5 && t_bool == 1 && t_changes == 2 &&
+                txn_commits == 1 && !tinysh_param_in_transaction(),
+                "Each hook once, then one commit hook call");
+
+    tinysh_param_begin();
+    tinysh_param_write(&t_int_param, "-3", -1);
+    int dropped = tinysh_param_abort() == 1 && t_int == 5 && txn_commits == 1;
+    test_assert("Txn abort", dropped, "Abort should drop staged values");
+
+    tinysh_param_begin();
+    int invalid = tinysh_param_write(&t_int_param, "99", -1) == PARAM_ERR_RANGE &&
+                  tinysh_param_staged(&t_int_param, buf, sizeof(buf)) < 0;
+    memset(big, '0', sizeof(big));
+    int full = tinysh_param_write(&t_int_param, big, sizeof(big)) == PARAM_OK &&
+               tinysh_param_write(&t_flt_param, big, sizeof(big)) == PARAM_ERR_FULL &&
+               tinysh_param_write(&t_int_param, "2", 1) == PARAM_OK &&
+               tinysh_param_write(&t_flt_param, big, sizeof(big)) == PARAM_OK;
+    test_assert("Txn staging bounded", invalid && full,
+                "Bad values are refused; the arena refuses what does not fit");
+
+    int n = tinysh_param_commit(&failed);
+    test_assert("Txn commit result", n == 2 && t_int == 2 && t_flt == 0 && failed == NULL,
+                "Replaced entries should free their space");
+
+    tinysh_param_on_commit(hook);
+}
+
+static tinysh_session_t sess_a, sess_b;
+
+static void sess_input(tinysh_session_t *s, const char *str) {
+    tinysh_session_input(s, str, (int)strlen(str));
+}
+
+/* Output of a session so far, terminated, and consumed */
+static const char *sess_output(tinysh_session_t *s) {
+    static char out[SESSION_OUT_SIZE + 1];
+    const char *p;
+    int len;
+
+    p = tinysh_session_pending(s, &len);
+    memcpy(out, p, (size_t)len);
+    out[len] = 0;
+    tinysh_session_consume(s, len);
+    return out;
+}
+
+static void sess_drain(tinysh_session_t *s) {
+    sess_output(s);
+}
+
+/**
+ * Test sessions
+ */
+void test_session_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Sessions");
+
+    char console_ctx[BUFFER_SIZE + 1];
+    unsigned char console_auth = tinysh_get_auth_level();
+    int i;
+
+    tinysh_auth_init();
+    tinysh_add_command(&quit_cmd);
+    strcpy(console_ctx, tinysh_get_context());
+
+    tinysh_session_init(&sess_a, NULL, NULL);
+    tinysh_session_init(&sess_b, NULL, NULL);
+    test_capture_start();
+    tinysh_session_start(&sess_a);
+    tinysh_session_start(&sess_b);
+    int prompt = strstr(sess_output(&sess_a), _PROMPT_) != NULL &&
+                 strstr(sess_output(&sess_b), _PROMPT_) != NULL;
+
+    sess_input(&sess_b, "test\r");
+    int own_ctx = strstr(sess_output(&sess_b), "test> ") != NULL &&
+                  sess_b.line.cur_cmd_ctx == &test_cmd && sess_a.line.cur_cmd_ctx == NULL;
+
+    sess_input(&sess_a, "auth " DEFAULT_ADMIN_PASSWORD "\r");
+    int own_auth = strstr(sess_output(&sess_a), "successful") != NULL &&
+                   sess_a.line.auth_level == TINYSH_AUTH_ADMIN &&
+                   sess_b.line.auth_level == TINYSH_AUTH_NONE;
+    test_capture_stop();
+    test_assert("Session prompt", prompt, "Starting a session should show the prompt");
+    test_assert("Session context and auth", own_ctx && own_auth,
+                "Context and auth level belong to one session");
+    test_assert("Session leaves console alone", capture_index == 0 &&
+                strcmp(tinysh_get_context(), console_ctx) == 0 &&
+                tinysh_get_auth_level() == console_auth,
+                "Session input and output should not reach the console");
+
+    unsigned long lines = sess_b.lines;
+    sess_input(&sess_b, "\r\n\r");
+    sess_drain(&sess_b);
+    test_assert("Session CR LF", sess_b.lines == lines + 2, "CR LF is one line end");
+
+    int used = tinysh_session_input(&sess_a, "quit\rtest\r", 10);
+    sess_drain(&sess_a);
+    test_assert("Session quit", used == 5 && !tinysh_session_active(&sess_a) &&
+                tinysh_session_active(&sess_b) && is_tinyshell_active(),
+                "Quit should end only its own session");
+
+    // Nobody drains sess_b: its buffer fills and the rest is counted
+    for (i = 0; i < SESSION_OUT_SIZE / 4; i++) sess_input(&sess_b, "\r");
+    int len;
+    tinysh_session_pending(&sess_b, &len);
+    int bounded = len == SESSION_OUT_SIZE && sess_b.dropped > 0;
+
+    // With a flush callback nothing is lost
+    tinysh_session_init(&sess_a, sess_drain, NULL);
+    for (i = 0; i < SESSION_OUT_SIZE / 4; i++) sess_input(&sess_a, "\r");
+    test_assert("Session output bounded", bounded && sess_a.dropped == 0 &&
+                sess_a.bytes_out > SESSION_OUT_SIZE,
+                "A full buffer is flushed, or drops and counts output");
+
+    // Transactions and table format belong to one session too
+    const char *out;
+    tinysh_param_init();
+    tinysh_param_register(&t_int_param);
+    tinysh_table_init();
+    tinysh_session_init(&sess_a, sess_drain, NULL);
+    tinysh_session_init(&sess_b, sess_drain, NULL);
+    tinysh_session_start(&sess_a);
+    tinysh_session_start(&sess_b);
+    t_int = 1;
+    sess_input(&sess_a, "begin\rset t_int=3\rformat csv\r");
+    sess_input(&sess_b, "set t_int=2\r");
+    int direct = t_int == 2 && !tinysh_param_in_transaction();
+    sess_input(&sess_a, "abort\r");
+    sess_output(&sess_b);
+    sess_input(&sess_b, "list\r");
+    out = sess_output(&sess_b);
+    tinysh_line_t *prev = tinysh_line_select(&sess_b.line);
+    int format_b = tinysh_table_format();
+    tinysh_line_select(prev);
+    test_assert("Session transaction and format", direct && t_int == 2 && format_b == TABLE_FORMAT_TEXT &&
+                strstr(out, "Name") && !strstr(out, "Name,"),
+                "One session's begin and format leave the others alone");
+}
+
+/* Sessions in the order their probe commands ran */
+static tinysh_session_t *sched_ran[32];
+static int sched_nran = 0;
+
+static void sched_probe_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+    if (sched_nran < 32) sched_ran[sched_nran++] = tinysh_session_current();
+}
+
+static tinysh_cmd_t sched_probe_cmd = {
+    0, "probe", "record the running session", 0,
+    sched_probe_handler, 0, 0, 0
+};
+
+static void sched_queue(tinysh_session_t *s, const char *str, int times) {
+    while (times-- > 0) tinysh_session_queue(s, str, (int)strlen(str));
+}
+
+static int sched_count(tinysh_session_t *s) {
+    int i, n = 0;
+
+    for (i = 0; i < sched_nran; i++) {
+        if (sched_ran[i] == s) n++;
+    }
+    return n;
+}
+
+/**
+ * Test session scheduling
+ */
+void test_sched_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Session Scheduling");
+
+    tinysh_sched_t sched;
+    tinysh_sched_stats_t st;
+    char big[SESSION_IN_SIZE];
+    int i, len;
+
+    tinysh_add_command(&sched_probe_cmd);
+    memset(&sched, 0, sizeof(sched));
+    tinysh_session_init(&sess_a, sess_drain, NULL);
+    tinysh_session_init(&sess_b, sess_drain, NULL);
+    tinysh_sched_add(&sched, &sess_a);
+    tinysh_sched_add(&sched, &sess_b);
+
+    // A pastes ten commands, B types one: B is not kept waiting. A stops
+    // at the line end of its fifth, so "probe" of it is consumed already
+    sched_nran = 0;
+    sched_queue(&sess_a, "probe\r", 10);
+    sched_queue(&sess_b, "probe\r", 1);
+    tinysh_sched_run(&sched);
+    tinysh_sched_stats(&sched, &st);
+    test_assert("Sched line quota", sched_count(&sess_a) == SESSION_MAX_LINES &&
+                sched_count(&sess_b) == 1 && st.throttled_lines == 1 &&
+                st.backlogged == 1 && st.queued == 6 * (10 - SESSION_MAX_LINES) - 5,
+                "One round runs at most max_lines commands per session");
+
+    while (tinysh_sched_ready(&sched)) tinysh_sched_run(&sched);
+    test_assert("Sched drains backlog", sched_count(&sess_a) == 10 && sess_a.in_len == 0 &&
+                sess_a.deficit == 0, "Later rounds finish the queue; an empty queue forfeits its deficit");
+
+    // Admins and higher priorities go first, whatever the rotation
+    sched_nran = 0;
+    sess_b.line.auth_level = TINYSH_AUTH_ADMIN;
+    sched_queue(&sess_a, "probe\r", 1);
+    sched_queue(&sess_b, "probe\r", 1);
+    tinysh_sched_run(&sched);
+    int admin_first = sched_nran == 2 && sched_ran[0] == &sess_b;
+    sess_b.line.auth_level = TINYSH_AUTH_NONE;
+    sess_a.quota.priority = 1;
+    sched_nran = 0;
+    for (i = 0; i < 2; i++) {
+        sched_queue(&sess_a, "probe\r", 1);
+        sched_queue(&sess_b, "probe\r", 1);
+        tinysh_sched_run(&sched);
+    }
+    test_assert("Sched priority", admin_first && sched_nran == 4 &&
+                sched_ran[0] == &sess_a && sched_ran[2] == &sess_a,
+                "Admin sessions first, then higher priority");
+    sess_a.quota.priority = 0;
+
+    // Input bytes are credited one quantum per round
+    sess_a.quota.quantum = 16;
+    memset(big, 'x', 40);
+    tinysh_session_queue(&sess_a, big, 40);
+    tinysh_sched_run(&sched);
+    int first = sess_a.in_len;
+    tinysh_sched_run(&sched);
+    test_assert("Sched byte quantum", first == 24 && sess_a.in_len == 8,
+                "Each round consumes at most the quantum");
+    tinysh_session_init(&sess_a, sess_drain, NULL);
+
+    // Unsent output holds a session back until the transport drains it
+    tinysh_session_init(&sess_b, NULL, NULL);
+    sess_b.quota.max_out = 20;
+    sched_nran = 0;
+    sched_queue(&sess_b, "probe\r", 20);
+    tinysh_sched_run(&sched);
+    int held = sched_count(&sess_b) < SESSION_MAX_LINES && sess_b.out_len >= 20 &&
+               !tinysh_sched_ready(&sched);
+    tinysh_sched_stats(&sched, &st);
+    tinysh_session_pending(&sess_b, &len);
+    tinysh_session_consume(&sess_b, len);
+    test_assert("Sched output quota", held && st.throttled_out > 0 && tinysh_sched_ready(&sched) == 1,
+                "A session waits while max_out bytes are unsent");
+
+    int room = tinysh_session_queue_room(&sess_b);
+    memset(big, 'y', sizeof(big));
+    test_assert("Sched input queue bounded", tinysh_session_queue(&sess_b, big, sizeof(big)) == room &&
+                tinysh_session_queue_room(&sess_b) == 0 && tinysh_session_queue(&sess_b, "y", 1) == 0,
+                "A full queue accepts no more");
+}
+
+/* Prints argv[1] bytes of a repeating pattern */
+static void ipc_out_handler(int argc, const char **argv) {
+    int n = argc > 1 ? (int)tinysh_atoxi((char *)argv[1]) : 0;
+    int i;
+
+    for (i = 0; i < n; i++) tinysh_printf("%c", 'a' + i % 26);
+}
+
+static tinysh_cmd_t ipc_out_cmd = {
+    0, "ipcout", "print N pattern bytes", "N",
+    ipc_out_handler, 0, 0, 0
+};
+
+/* Read one whole response: its bytes, frame count and status */
+static int ipc_collect(tiny_ipc_client_t *c, uint32_t id, char *buf, int size, int *frames) {
+    tiny_ipc_frame_t f;
+    int len = 0, status = 1;
+
+    *frames = 0;
+    do {
+        if (tiny_ipc_next(c, &f, 0) < 0) return 1;
+        if (f.id != id) status = 2;
+        if (len + (int)f.len < size) {
+            memcpy(buf + len, f.data, f.len);
+            len += (int)f.len;
+        }
+        (*frames)++;
+        tiny_ipc_release(c, &f);
+    } while (!(f.flags & IPC_FRAME_END));
+    buf[len] = 0;
+    return status == 2 ? 2 : f.status;
+}
+
+/**
+ * Test the shared-memory channel, served from this thread
+ */
+void test_ipc_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Shared-Memory Channel");
+
+    tiny_ipc_client_t c, other;
+    char name[32], buf[1024], line[BUFFER_SIZE + 2];
+    uint32_t ids[3];
+    int i, frames, st1, st2, st3, ok;
+
+    snprintf(name, sizeof(name), "/tinysh_test_%d", (int)getpid());
+    if (tiny_ipc_open(name, 1024) < 0) {
+        tinysh_printf("  (skipped: %s)\r\n", strerror(errno));
+        return;
+    }
+    tinysh_add_command(&ipc_out_cmd);
+    test_assert("IPC connect", tiny_ipc_connect(&c, name) == 0 &&
+                tiny_ipc_connect(&other, name) < 0 && errno == EBUSY,
+                "One client attaches, a second is refused");
+
+    // Three requests in flight before any is served
+    ids[0] = tiny_ipc_submit(&c, "ipcout 5", -1);
+    ids[1] = tiny_ipc_submit(&c, "nosuch", -1);
+    ids[2] = tiny_ipc_submit(&c, "ipcout 3", -1);
+    test_assert("IPC pipelined submit", ids[0] && ids[1] == ids[0] + 1 && ids[2] == ids[1] + 1 &&
+                tiny_ipc_poll() == 3, "Requests queue up and are served together");
+
+    st1 = ipc_collect(&c, ids[0], buf, sizeof(buf), &frames);
+    ok = st1 == IPC_STATUS_OK && strcmp(buf, "abcde") == 0;
+    st2 = ipc_collect(&c, ids[1], buf, sizeof(buf), &frames);
+    ok = ok && st2 == IPC_STATUS_NO_COMMAND && strstr(buf, "no match") != NULL;
+    st3 = ipc_collect(&c, ids[2], buf, sizeof(buf), &frames);
+    test_assert("IPC responses in order", ok && st3 == IPC_STATUS_OK && strcmp(buf, "abc") == 0,
+                "Each response carries its id, output and status");
+
+    // 700 bytes twice through a 1024-byte ring: the second response
+    // reaches the ring end and continues in a new frame at its start
+    tiny_ipc_submit(&c, "ipcout 700", -1);
+    tiny_ipc_poll();
+    st1 = ipc_collect(&c, c.last_id, buf, sizeof(buf), &frames);
+    tiny_ipc_submit(&c, "ipcout 700", -1);
+    tiny_ipc_poll();
+    st2 = ipc_collect(&c, c.last_id, buf, sizeof(buf), &frames);
+    ok = st1 == IPC_STATUS_OK && st2 == IPC_STATUS_OK && strlen(buf) == 700 && frames > 1;
+    for (i = 0; ok && i < 700; i++) ok = buf[i] == 'a' + i % 26;
+    test_assert("IPC output spans frames", ok, "Long output wraps the ring in several frames, intact");
+
+    memset(line, 'x', sizeof(line) - 1);
+    line[sizeof(line) - 1] = 0;
+    tiny_ipc_submit(&c, line, -1);
+    tiny_ipc_poll();
+    test_assert("IPC request too long", ipc_collect(&c, c.last_id, buf, sizeof(buf), &frames) ==
+                IPC_STATUS_TOO_LONG, "Lines over BUFFER_SIZE are refused, not cut");
+
+    tiny_ipc_disconnect(&c);
+    test_assert("IPC reconnect", tiny_ipc_connect(&other, name) == 0,
+                "The region is free again once its client detaches");
+    tiny_ipc_disconnect(&other);
+    tiny_ipc_close();
+}
+
+/* Telnet events seen, and the terminal width a session command saw */
+static int telnet_events[3];
+static unsigned short telnet_cols_seen = 0;
+
+static void telnet_event(tinysh_telnet_t *t, int ev) {
+    (void)t;
+    if (ev > 0 && ev < 3) telnet_events[ev]++;
+}
+
+static void telnet_cols_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+    telnet_cols_seen = tinysh_term_cols();
+}
+
+static tinysh_cmd_t telnet_cols_cmd = {
+    0, "cols", "record the terminal width", 0,
+    telnet_cols_handler, 0, 0, 0
+};
+
+/* Do the queued replies equal the given bytes; clears the queue */
+static int telnet_replied(tinysh_telnet_t *t, const char *bytes, int len) {
+    int n;
+    const char *p = tinysh_telnet_pending(t, &n);
+    int same = n == len && memcmp(p, bytes, (size_t)len) == 0;
+
+    tinysh_telnet_consume(t, n);
+    return same;
+}
+
+/**
+ * Test the telnet protocol layer and the session state it feeds
+ */
+void test_telnet_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Telnet");
+
+    tinysh_telnet_t t;
+    char buf[64];
+    unsigned short console_cols = tinysh_term_cols();
+    int n, ok;
+
+    memset(telnet_events, 0, sizeof(telnet_events));
+    tinysh_telnet_init(&t, telnet_event, NULL);
+    tinysh_telnet_start(&t, 0);
+    test_assert("Telnet opening", telnet_replied(&t, "\377\373\001\377\373\003\377\375\003\377\375\037", 12),
+                "WILL ECHO, WILL SGA, DO SGA, DO NAWS");
+
+    // Answers to what we asked for are not answered again; the rest is refused
+    memcpy(buf, "\377\375\001\377\374\037\377\375\030\377\375\001", 12);
+    n = tinysh_telnet_input(&t, buf, 12);
+    test_assert("Telnet negotiation", n == 0 && t.us_echo == TELNET_Q_YES &&
+                t.him_naws == TELNET_Q_NO && telnet_replied(&t, "\377\374\030", 3),
+                "DO ECHO accepted once, WONT NAWS noted, unknown option refused");
+
+    // Commands, escaped 255 and NUL come out of the data in place
+    memcpy(buf, "ab\377\361c\377\377d\r\000e", 11);
+    n = tinysh_telnet_input(&t, buf, 11);
+    test_assert("Telnet data filter", n == 7 && memcmp(buf, "abc\377d\re", 7) == 0,
+                "NOP removed, IAC IAC read as 255, CR NUL read as CR");
+
+    // NAWS split over three chunks, the middle one inside the IAC SE
+    memcpy(buf, "x\377\372\037\000", 5);
+    n = tinysh_telnet_input(&t, buf, 5);
+    memcpy(buf + 8, "\173\000\055\377", 4);
+    ok = n == 1 && tinysh_telnet_input(&t, buf + 8, 4) == 0;
+    memcpy(buf, "\360y", 2);
+    n = tinysh_telnet_input(&t, buf, 2);
+    test_assert("Telnet NAWS", ok && n == 1 && buf[0] == 'y' && t.cols == 123 && t.rows == 45 &&
+                telnet_events[TELNET_EV_SIZE] == 1, "Window size read across chunks");
+
+    // Line mode: ask, client agrees; the client then edits and echoes
+    tinysh_telnet_set_linemode(&t, 1);
+    ok = telnet_replied(&t, "\377\375\042", 3);
+    memcpy(buf, "\377\373\042", 3);
+    tinysh_telnet_input(&t, buf, 3);
+    test_assert("Telnet line mode", ok && tinysh_telnet_linemode(&t) &&
+                telnet_replied(&t, "\377\372\042\001\001\377\360\377\374\001", 10) &&
+                telnet_events[TELNET_EV_MODE] == 1, "DO LINEMODE, then MODE EDIT and WONT ECHO");
+
+    // What the transport does with it: the session's own size and echo
+    tinysh_add_command(&telnet_cols_cmd);
+    tinysh_session_init(&sess_a, sess_drain, NULL);
+    tinysh_session_set_size(&sess_a, t.rows, t.cols);
+    sess_a.line.local_echo = 1;
+    sess_input(&sess_a, "cols\r");
+    ok = strstr(sess_output(&sess_a), "cols") == NULL;
+    test_assert("Telnet session state", ok && telnet_cols_seen == 123 && tinysh_term_cols() == console_cols,
+                "Handlers see the session's width, the console keeps its own; input is not echoed");
+}
+
+/* A fake device on one end of a socketpair: echoes each line, answers,
+   shows its prompt; silent when answer is NULL */
+typedef struct {
+    int fd;
+    const char *answer;
+} fanout_fake_t;
+
+static void *fanout_fake_main(void *arg) {
+    fanout_fake_t *f = arg;
+    char line[64], c;
+    int len = 0;
+
+    while (read(f->fd, &c, 1) == 1) {
+        if (!f->answer) continue;
+        if (c != '\r') {
+            if (len < (int)sizeof(line) - 1) line[len++] = c;
+            continue;
+        }
+        line[len] = 0;
+        len = 0;
+        dprintf(f->fd, "%s\r\n%s", line, f->answer);
+        usleep(2000);               // prompt in a later read
+        dprintf(f->fd, "tinysh> ");
+    }
+    close(f->fd);
+    return NULL;
+}
+
+/**
+ * Test fan-out: parallel runs, timeouts, clean-up and grouping
+ */
+void test_fanout_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Fanout");
+
+    static const char *answers[] = { "ok\r\nv1\r\n", "ok\r\nv1\r\n", "ok\r\nv2\r\n", NULL };
+    static const char *names[] = { "a", "b", "c", "d" };
+    fanout_fake_t fakes[4];
+    pthread_t threads[4];
+    const char *out, *report;
+    int sv[2], i, len, ok = 1;
+    unsigned long start, elapsed;
+
+    for (i = 0; i < 4; i++) {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+        fakes[i].fd = sv[1];
+        fakes[i].answer = answers[i];
+        ok &= tiny_fanout_attach(sv[0], names[i], answers[i] ? 1000 : 100) == i;
+        pthread_create(&threads[i], NULL, fanout_fake_main, &fakes[i]);
+    }
+    test_assert("Fanout attach", ok && tiny_fanout_attach(sv[0], "a", 0) < 0 && errno == EEXIST,
+                "Devices added in order; names are unique");
+
+    // Stale output from before the run is not part of the answer
+    dprintf(sv[1], "late\r\ntinysh> ");
+    // Run as typed in a session, so its report can be read back
+    tinysh_add_command(&fanout_cmd);
+    tinysh_session_init(&sess_a, sess_drain, NULL);
+    start = tinysh_time_ms();
+    sess_input(&sess_a, "fanout run ver\r");
+    elapsed = tinysh_time_ms() - start;
+    test_assert("Fanout run", tiny_fanout_result(0, NULL, NULL) == FANOUT_DONE &&
+                tiny_fanout_result(2, NULL, NULL) == FANOUT_DONE &&
+                tiny_fanout_result(3, NULL, NULL) == FANOUT_TIMEOUT && elapsed < 600,
+                "Three answer, the silent one times out; devices wait in parallel");
+
+    tiny_fanout_result(2, &out, &len);
+    test_assert("Fanout clean-up", len == 6 && memcmp(out, "ok\nv2\n", 6) == 0,
+                "Echo, prompt and CRs removed");
+
+    report = strstr(sess_output(&sess_a), "===");
+    test_assert("Fanout report", report && strncmp(report, "=== a b (2, answered", 20) == 0 &&
+                strstr(report, "=== c (1, answered") && strstr(report, "=== d (1, timed out") &&
+                strstr(report, "4 devices, 3 distinct answers"),
+                "Identical answers grouped, largest group first");
+
+    ok = tiny_fanout_drop("b") == 1 && tiny_fanout_result(1, NULL, NULL) < 0;
+    ok &= tiny_fanout_drop(NULL) == 3;
+    for (i = 0; i < 4; i++) pthread_join(threads[i], NULL);
+    test_assert("Fanout drop", ok && tiny_fanout_result(0, NULL, NULL) < 0, "Devices closed and removed");
+}
+
+/**
+ * Test session scrollback, the shared pool, detach and replay
+ */
+void test_scrollback_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Scrollback");
+
+    char buf[64];
+    const char *out;
+    unsigned long pos = 0;
+    int n, ok, len, pool = tinysh_scrollback_free();
+
+    tinysh_session_init(&sess_a, sess_drain, NULL);
+    tinysh_session_scrollback(&sess_a, 1);
+    tinysh_session_start(&sess_a);
+    sess_input(&sess_a, "ipcout 30\r");
+    sess_output(&sess_a);
+    n = tinysh_session_scrollback_read(&sess_a, &pos, buf, sizeof(buf) - 1);
+    buf[n] = 0;
+    test_assert("Scrollback keeps output", strstr(buf, "abcdefghijklmnopqrstuvwxyzabcd") != NULL &&
+                tinysh_scrollback_free() == pool - 1, "Sent output is still in the ring");
+
+    // Far more than its share: the session reuses its own oldest blocks
+    sess_input(&sess_a, "ipcout 30000\r");
+    pos = 0;
+    n = 0;
+    while ((len = tinysh_session_scrollback_read(&sess_a, &pos, buf, sizeof(buf))) > 0) n += len;
+    test_assert("Scrollback bounded", n <= SCROLLBACK_SESSION_BLOCKS * SCROLLBACK_BLOCK_SIZE &&
+                n > (SCROLLBACK_SESSION_BLOCKS - 1) * SCROLLBACK_BLOCK_SIZE && pos == sess_a.written &&
+                tinysh_scrollback_free() == pool - SCROLLBACK_SESSION_BLOCKS,
+                "Newest output kept, no more than the session's share");
+
+    tinysh_session_init(&sess_b, sess_drain, NULL);
+    tinysh_session_scrollback(&sess_b, 1);
+    sess_input(&sess_b, "ipcout 100\r");
+    ok = tinysh_scrollback_free() == pool - SCROLLBACK_SESSION_BLOCKS - 1;
+    tinysh_session_scrollback(&sess_a, 0);
+    tinysh_session_scrollback(&sess_b, 0);
+    test_assert("Scrollback pool", ok && tinysh_scrollback_free() == pool,
+                "Blocks come from one pool and go back to it");
+
+    // Lost connection: unsent and later output come back on replay
+    tinysh_add_command(&scrollback_cmd);
+    tinysh_session_init(&sess_a, sess_drain, NULL);
+    tinysh_session_scrollback(&sess_a, 1);
+    tinysh_session_start(&sess_a);
+    sess_output(&sess_a);
+    sess_input(&sess_a, "ipcout 5\r");
+    tinysh_session_detach(&sess_a);
+    sess_input(&sess_a, "ipcout 7\r\rscroll");  // ipcout ends no line
+    tinysh_session_pending(&sess_a, &len);
+    ok = len == 0;
+    n = tinysh_session_replay(&sess_a);
+    out = sess_output(&sess_a);
+    test_assert("Scrollback replay", ok && (int)strlen(out) == n && strstr(out, "ipcout 5\n\rabcde") == out &&
+                strstr(out, "abcdefg") && strcmp(out + n - 14, "tinysh> scroll") == 0,
+                "Nothing sent while detached; then the missed tail, partial line included");
+
+    sess_input(&sess_a, "back search abcdef\r");
+    out = sess_output(&sess_a);
+    test_assert("Scrollback search", strstr(out, "abcdefg") && strstr(out, "1 match in") &&
+                !strstr(out, "  tinysh> scrollback"), "Matching lines, not the search itself");
+
+#if AUTHENTICATION_ENABLED
+    // A password typed is echoed live, but not kept
+    tinysh_add_command(&auth_cmd);
+    sess_input(&sess_a, "auth secret42\r");
+    out = sess_output(&sess_a);
+    ok = strstr(out, "secret42") != NULL;
+    sess_input(&sess_a, "scrollback search secret\r");
+    out = sess_output(&sess_a);
+    test_assert("Scrollback hides passwords", ok && strstr(out, "0 matches") && !strstr(out, "secret42"),
+                "The echo of an auth line is masked in the scrollback");
+#endif
+    tinysh_session_scrollback(&sess_a, 0);
+}
+
+/**
+ * Test session transcripts: format, batching, and a writer that cannot keep up
+ */
+void test_transcript_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Transcript");
+
+    const char *path = "/tmp/tinysh_test_transcript.log";
+    const char *fifo = "/tmp/tinysh_test_transcript.fifo";
+    tiny_transcript_stats_t before, after;
+    static char text[8192];
+    struct timespec t0, t1;
+    const char *p;
+    FILE *f;
+    int i, n, outs = 0, reader;
+    long ms;
+
+    tiny_transcript_init();
+    tinysh_add_command(&ipc_out_cmd);
+    unlink(path);
+    tinysh_session_init(&sess_a, sess_drain, NULL);
+    sess_a.id = 7;
+    tinysh_session_start(&sess_a);
+    tiny_transcript_stats(&before);
+    int started = tiny_transcript_start(path) == 0 && tiny_transcript_start(path) < 0;
+    sess_input(&sess_a, "ipcout 5\r");
+    tiny_transcript_stop();
+    tiny_transcript_stats(&after);
+
+    n = 0;
+    if ((f = fopen(path, "r")) != NULL) {
+        n = (int)fread(text, 1, sizeof(text) - 1, f);
+        fclose(f);
+    }
+    text[n] = 0;
+    for (p = text; (p = strstr(p, " 7 > ")) != NULL; p++) outs++;
+    test_assert("Transcript format", started && strncmp(text, "# tinysh transcript ", 20) == 0 &&
+                strstr(text, "\n@") && strstr(text, "\n+0 7 < ipcout 5\\r\n") &&
+                strstr(text, " 7 > ipcout 5\\n\\rabcde"), "Header, time base, escaped records");
+    test_assert("Transcript batching", outs == 1 && after.records - before.records == 2 && !after.running,
+                "Echo and output of one command are one record");
+
+    // Requests over the shared-memory channel are recorded too
+    tiny_ipc_client_t c;
+    char name[32];
+    snprintf(name, sizeof(name), "/tinysh_test_tr_%d", (int)getpid());
+    unlink(path);
+    n = 0;
+    if (tiny_ipc_open(name, 1024) == 0) {
+        if (tiny_ipc_connect(&c, name) == 0 && tiny_transcript_start(path) == 0) {
+            tiny_ipc_submit(&c, "ipcout 4", -1);
+            tiny_ipc_poll();
+            tiny_transcript_stop();
+            if ((f = fopen(path, "r")) != NULL) {
+                n = (int)fread(text, 1, sizeof(text) - 1, f);
+                fclose(f);
+            }
+            tiny_ipc_disconnect(&c);
+        }
+        tiny_ipc_close();
+    }
+    text[n] = 0;
+    test_assert("Transcript IPC", strstr(text, " < ipcout 4\\r\n") && strstr(text, " > abcd\n"),
+                "A channel request and its response are recorded as a session");
+
+#if AUTHENTICATION_ENABLED
+    // Passwords are starred, as typed and as echoed, across input chunks
+    tinysh_add_command(&auth_cmd);
+    unlink(path);
+    n = 0;
+    if (tiny_transcript_start(path) == 0) {
+        sess_input(&sess_a, "auth sec");
+        sess_input(&sess_a, "ret42\r");
+        sess_output(&sess_a);
+        tiny_transcript_stop();
+        if ((f = fopen(path, "r")) != NULL) {
+            n = (int)fread(text, 1, sizeof(text) - 1, f);
+            fclose(f);
+        }
+    }
+    text[n] = 0;
+    test_assert("Transcript hides passwords",
+                strstr(text, " 7 < auth ***\n") && strstr(text, " 7 > auth ***\n") &&
+                strstr(text, " 7 < *****\\r\n") && strstr(text, " 7 > *****\\n\\r") &&
+                !strstr(text, "sec") && !strstr(text, "ret42"),
+                "Password characters and their echo must be recorded starred");
+#endif
+
+    // A reader that never reads: the pipe fills, then the ring; the shell goes on
+    unlink(fifo);
+    mkfifo(fifo, 0600);
+    reader = open(fifo, O_RDONLY | O_NONBLOCK);
+    memset(text, 'x', sizeof(text));
+    tiny_transcript_stats(&before);
+    int piped = reader >= 0 && tiny_transcript_start(fifo) == 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < 1000; i++) {
+        tiny_transcript_record(9, TRANSCRIPT_OUT, text, sizeof(text));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ms = (t1.tv_sec - t0.tv_sec) * 1000L + (t1.tv_nsec - t0.tv_nsec) / 1000000L;
+    tiny_transcript_stats(&after);
+    test_assert("Transcript drops", piped && after.dropped_records > before.dropped_records &&
+                after.ring_used <= TRANSCRIPT_RING_SIZE && ms < 500,
+                "A full ring drops records instead of blocking");
+
+    if (reader >= 0) close(reader);
+    tiny_transcript_stop();
+    tiny_transcript_stats(&after);
+    test_assert("Transcript lost reader", !after.running && after.write_errors > before.write_errors &&
+                after.ring_used == 0, "Writes fail and are counted; stop still completes");
+    unlink(fifo);
+    unlink(path);
+}
+
+/**
+ * Test retained state: save on change, restore after a "reset", and
+ * blocks that must not be trusted
+ */
+void test_retain_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Retain");
+
+    static tinysh_retain_t blk;
+    static tinysh_line_t saved;
+    tinysh_retain_saved_t live;
+    tinysh_line_t *line = tinysh_line_select(0);  // retain keeps the console's state
+    tinysh_line_t *console = tinysh_line_current();
+    tinysh_retain_stats_t st;
+    struct timespec t0, t1;
+    char value[16];
+    long us;
+    int err, ok, own;
+
+    own = tinysh_param_register(&t_int_param) == 0;
+    saved = *console;
+    tinysh_retain_suspend(&live);
+    memset(&blk, 0, sizeof(blk));
+    tinysh_retain_attach(&blk);
+    err = tinysh_retain_restore();
+
+    // Two lines run, a context entered, a change staged
+    tinysh_line_init(console);
+    strcpy(console->input_buffers[0], "echo one");
+    console->cur_buf_index = 1 % HISTORY_DEPTH;
+    tinysh_exec_line("test");
+    tinysh_param_begin();
+    tinysh_param_write(&t_int_param, "-7", -1);
+    strcpy(console->input_buffers[console->cur_buf_index], "half typ");
+    ok = tinysh_retain_tick() == 1 && tinysh_retain_tick() == 0;
+    test_assert("Retain saves on change", err == RETAIN_EMPTY && ok && blk.magic == RETAIN_MAGIC &&
+                strcmp(blk.body.path, "test") == 0, "A cold block starts empty; updated once per change");
+
+    // Reset: all of it gone, then restored from the block
+    tinysh_param_abort();
+    tinysh_line_init(console);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    err = tinysh_retain_restore();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    us = (t1.tv_sec - t0.tv_sec) * 1000000L + (t1.tv_nsec - t0.tv_nsec) / 1000L;
+    ok = err == RETAIN_OK && strcmp(console->input_buffers[0], "echo one") == 0 &&
+         console->input_buffers[console->cur_buf_index][0] == 0 && !console->cur_cmd_ctx;
+    tinysh_retain_tick();
+    tinysh_retain_stats(&st);
+    test_assert("Retain restores", ok && console->cur_cmd_ctx == &test_cmd &&
+                strcmp(tinysh_get_context(), "test") == 0 && tinysh_param_in_transaction() &&
+                tinysh_param_staged(&t_int_param, value, sizeof(value)) == 2 && strcmp(value, "-7") == 0 &&
+                st.resets == 1 && st.staged == 1 && st.dropped == 0,
+                "History at once; context and staged change by name on the first tick");
+    test_assert("Retain restore cost", us < 5000, "Checking and restoring the block is quick");
+
+    // A torn update or another firmware's block is not trusted
+    blk.body.history[0][0] ^= 1;
+    err = tinysh_retain_restore();
+    ok = err == RETAIN_CORRUPT && tinysh_retain_restore() == RETAIN_OK && blk.body.resets == 1 &&
+         blk.body.history[0][0] == 0;
+    blk.version++;
+    test_assert("Retain rejects bad blocks", ok && tinysh_retain_restore() == RETAIN_STALE &&
+                tinysh_retain_restore() == RETAIN_OK, "Checksum or layout mismatch starts over empty");
+
+#if AUTHENTICATION_ENABLED && HISTORY_DEPTH > 1
+    // A line that gave a password stays out of the block
+    tinysh_add_command(&auth_cmd);
+    tinysh_param_abort();
+    tinysh_line_init(console);
+    strcpy(console->input_buffers[0], "auth secret42");
+    console->cur_buf_index = 1;
+    tinysh_retain_tick();
+    test_assert("Retain leaves out passwords", blk.body.history[0][0] == 0 &&
+                blk.body.history_index == 1, "An auth line must not be kept");
+#endif
+
+    tinysh_retain_resume(&live);
+    *console = saved;  // history, context and transaction as they were
+    tinysh_line_select(line);
+    if (own) tinysh_param_unregister(&t_int_param);
+}
+
+/* Clocks the timer tests move by hand */
+static unsigned long fake_ms = 0;
+static unsigned long fake_wall = 0;
+static unsigned long fake_ms_fn(void) { return fake_ms; }
+static unsigned long fake_wall_fn(void) { return fake_wall; }
+
+/* Callback counting its runs, and noting when it ran last */
+static unsigned long timer_fired_at = 0;
+static void timer_count(void *arg) {
+    (*(int *)arg)++;
+    timer_fired_at = fake_ms;
+}
+
+/* Move the fake clock in steps, ticking after each */
+static void timer_run_to(unsigned long ms, unsigned long step) {
+    while (fake_ms + step <= ms) {
+        fake_ms += step;
+        tinysh_timer_tick();
+    }
+    fake_ms = ms;
+    tinysh_timer_tick();
+}
+
+/**
+ * Test the timer wheel, overruns and scheduled command lines
+ */
+void test_timer_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Timer");
+
+    unsigned long (*clock)(void) = tinysh_millis;
+    tinysh_timer_wall_t wall;
+    unsigned long far = 5UL * 3600000 + 1234;
+    tinysh_timer_info_t info;
+    int once = 0, often = 0, late = 0, slow = 0;
+    int a, b, c, ok, err, own;
+    const char *out;
+
+    // The test drives the one wheel there is: not under live jobs
+    if (tinysh_timer_count() > 0) {
+        tinysh_printf("  (skipped: %d jobs scheduled)\r\n", tinysh_timer_count());
+        return;
+    }
+    tinysh_param_init();
+    own = tinysh_param_register(&t_int_param) == 0;
+    wall = tinysh_timer_clock(NULL);
+    tinysh_time_source(fake_ms_fn);
+    fake_ms = 1000000;
+    tinysh_timer_init();
+
+    a = tinysh_timer_call(100, 0, timer_count, &once, "once");
+    b = tinysh_timer_call(0, 50, timer_count, &often, "often");
+    timer_run_to(fake_ms + 1000, 10);
+    ok = once == 1 && often == 21 && tinysh_timer_get(a, &info) < 0;
+    tinysh_timer_cancel(b);
+    timer_run_to(fake_ms + 500, 10);
+    test_assert("Timer once and periodic", ok && often == 21 && tinysh_timer_cancel(b) < 0,
+                "Runs on time; cancelled and finished jobs are gone");
+
+    // Hours ahead: down through every wheel, on the right tick
+    c = tinysh_timer_call(far, 0, timer_count, &late, "late");
+    a = fake_ms + far;
+    timer_run_to(a - 10, 1000);
+    ok = late == 0;
+    timer_run_to(a, 10);
+    test_assert("Timer far ahead", ok && late == 1 && timer_fired_at == (unsigned long)a,
+                "Cascades from the outer wheels and fires on its tick");
+
+    // A second behind: one run, the nine missed ones counted
+    c = tinysh_timer_call(100, 100, timer_count, &slow, "slow");
+    fake_ms += 1050;
+    tinysh_timer_tick();
+    timer_run_to(fake_ms + 50, 10);
+    ok = tinysh_timer_get(c, &info) == 0 && slow == 2 && info.runs == 2 && info.overruns == 9;
+    tinysh_timer_cancel(c);
+    test_assert("Timer overruns", ok, "Missed periods are skipped and counted, not run in a burst");
+
+    // Lines: resolved when scheduled, refused if they would not run
+    tinysh_session_init(&sess_a, sess_drain, NULL);
+    tinysh_session_start(&sess_a);
+    sess_output(&sess_a);
+    t_int = 0;
+    sess_input(&sess_a, "after 100ms set t_int=4\r");
+    out = sess_output(&sess_a);
+    ok = sscanf(strstr(out, "Job ") ? strstr(out, "Job ") : "", "Job %d", &a) == 1 &&
+         tinysh_timer_get(a, &info) == 0 && strcmp(info.what, "set t_int=4") == 0;
+    sess_input(&sess_a, "every 1s no_such_command\rafter 1s test\r");
+    out = sess_output(&sess_a);
+    ok = ok && strstr(out, "Not scheduled: not a command") && strstr(strstr(out, "Not scheduled") + 1, "Not scheduled");
+    sess_input(&sess_a, "jobs\r");
+    out = sess_output(&sess_a);
+    ok = ok && strstr(out, "set t_int=4") && strstr(out, "once");
+    timer_run_to(fake_ms + 100, 10);
+    test_assert("Timer command lines", ok && t_int == 4 && tinysh_timer_get(a, &info) < 0,
+                "Scheduled line runs once; unknown commands and contexts are refused");
+
+    // Time of day: 03:29:50 now
+    tinysh_timer_clock(NULL);
+    err = tinysh_timer_at("03:30", "set t_int=5");
+    tinysh_timer_clock(fake_wall_fn);
+    fake_wall = 86400UL * 20000 + 3 * 3600 + 29 * 60 + 50;
+    a = tinysh_timer_at("03:30", "set t_int=5");
+    b = tinysh_timer_at("*:15", "set t_int=6");
+    ok = err == TIMER_ERR_CLOCK && tinysh_timer_at("24:00", "set t_int=1") == TIMER_ERR_SYNTAX &&
+         tinysh_timer_get(a, &info) == 0 && info.next_ms == 10000 && strcmp(info.at, "03:30:00") == 0 &&
+         tinysh_timer_get(b, &info) == 0 && info.next_ms == (45UL * 60 + 10) * 1000;
+    fake_wall += 10;
+    timer_run_to(fake_ms + 10000, 100);
+    ok = ok && t_int == 5 && tinysh_timer_get(a, &info) == 0 && info.runs == 1 &&
+         info.next_ms == 86400000UL;
+    tinysh_timer_cancel(a);
+    tinysh_timer_cancel(b);
+    test_assert("Timer at", ok, "Next matching time of day, then again a day later");
+
+    if (own) tinysh_param_unregister(&t_int_param);
+    tinysh_timer_clock(wall);
+    tinysh_time_source(clock);
+}
+
+/* Built commands run by the build test record their argument here */
+static int build_ran = -1;
+
+static void build_fn(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+    build_ran = (int)(intptr_t)tinysh_get_arg();
+}
+
+/**
+ * Test building command families in an arena
+ */
+void test_build_handler(int argc, const char **argv) {
+    (void)argc;
+    (void)argv;
+
+    test_section("Build");
+
+    static unsigned char mem[8192], small[512];
+    static tinysh_arena_t arena, tight;
+    static tinysh_cmd_t root, root2;
+    tinysh_cmd_t *cmd, *c;
+    const char *args[] = {"ch12"};
+    char name[16];
+    const char *out;
+    int n, i, ok;
+
+    // A family of 64: named and numbered in order, under its parent
+    memset(&root, 0, sizeof(root));
+    root.name = "root";
+    tinysh_arena_init(&arena, "test", mem, sizeof(mem));
+    n = tinysh_build_family(&arena, &root, "ch%d", 0, 64, "channel state", "[on|off]", build_fn);
+    ok = n == 64 && arena.commands == 64;
+    for (i = 0, c = root.child; c; c = c->next, i++) {
+        snprintf(name, sizeof(name), "ch%d", i);
+        ok = ok && c->parent == &root && strcmp(c->name, name) == 0 && (intptr_t)c->arg == i &&
+             c->function == build_fn;
+    }
+    test_assert("Build family", ok && i == 64, "ch0..ch63 built under the parent, each with its number");
+
+    // Help and usage stored once, shared by all; an equal string interns to it
+    c = root.child;
+    ok = arena.strings == 66 && arena.reused == 126;
+    for (cmd = c; cmd; cmd = cmd->next) {
+        ok = ok && cmd->help == c->help && cmd->usage == c->usage;
+    }
+    snprintf(name, sizeof(name), "ch%d", 5);
+    ok = ok && tinysh_arena_intern(&arena, name) == c->next->next->next->next->next->name &&
+         tinysh_arena_intern(&arena, NULL) == NULL;
+    test_assert("Build interning", ok, "Equal strings are stored once and shared");
+
+    // A built command runs like a static one, with its number as argument
+    for (cmd = root.child; cmd && strcmp(cmd->name, "ch12") != 0; cmd = cmd->next);
+    build_ran = -1;
+    test_assert("Build run", cmd && tinysh_run_command(cmd, 1, args) == 0 && build_ran == 12,
+                "Handler gets the command's number from tinysh_get_arg()");
+
+    // A full arena: the commands that fit are whole and linked, no more
+    memset(&root2, 0, sizeof(root2));
+    root2.name = "root2";
+    tinysh_arena_init(&tight, "tight", small, sizeof(small));
+    n = tinysh_build_family(&tight, &root2, "x%d", 0, 64, "help", 0, build_fn);
+    for (i = 0, c = root2.child; c; c = c->next) i++;
+    ok = n > 0 && n < 64 && i == n && tight.commands == n && tight.used <= tight.size &&
+         tinysh_arena_alloc(&tight, sizeof(small)) == NULL &&
+         tinysh_build_family(&arena, &root2, "%d-a-name-longer-than-the-limit-allows", 0, 1, 0, 0, 0) == 0 &&
+         tinysh_build_family(&arena, &root2, "no-number", 0, 1, 0, 0, 0) == 0;
+    test_assert("Build full arena", ok, "Stops when the arena is full; bad names build nothing");
+
+    // Cost per command: all bytes used over the commands, as "arenas" shows it
+    tinysh_add_command(&arenas_cmd);
+    tinysh_session_init(&sess_a, sess_drain, NULL);
+    tinysh_session_start(&sess_a);
+    sess_output(&sess_a);
+    sess_input(&sess_a, "arenas\r");
+    out = sess_output(&sess_a);
+    snprintf(name, sizeof(name), "%lu", tinysh_arena_per_command(&arena));
+    ok = tinysh_arena_per_command(&arena) == (arena.used + 32) / 64 &&
+         tinysh_arena_per_command(&arena) < sizeof(tinysh_cmd_t) + 48 &&
+         strstr(out, "test") && strstr(out, "tight") && strstr(out, name);
+    test_assert("Build cost", ok, "Bytes per command reported, about one node and its name");
+
+    // Its commands are linked, so the arena cannot start over
+    ok = tinysh_arena_init(&tight, "tight", small, sizeof(small)) == -1 && tight.commands == n;
+    test_assert("Build arena in use", ok, "Setting up an arena holding commands again is refused");
+
+    // The test's commands hang off roots outside the tree: its arenas can go
+    tinysh_arena_remove(&arena);
+    tinysh_arena_remove(&tight);
+    sess_input(&sess_a, "arenas\r");
+    out = sess_output(&sess_a);
+    test_assert("Build arena removed", !strstr(out, "test") && !strstr(out, "tight"),
+                "Removed arenas are no longer listed");
+}
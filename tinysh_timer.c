@@ -0,0 +1,683 @@
+#include "tinysh_timer.h"
+#include "tinysh_table.h"
+#include "tinysh.h"
+#include <stdio.h>
+#include <string.h>
+
+#if TIMER_WHEEL_SLOTS & (TIMER_WHEEL_SLOTS - 1)
+#error "TIMER_WHEEL_SLOTS must be a power of two"
+#endif
+
+#define MASK            (TIMER_WHEEL_SLOTS - 1)
+#define NONE            -1              /* end of a list, or not queued */
+#define DUE             -2              /* in the list of jobs running this tick */
+
+/* Job kinds */
+#define KIND_CALL       0
+#define KIND_LINE       1
+#define KIND_AT         2
+
+typedef struct {
+    int id;                          /* 0 = free */
+    unsigned char kind;
+    unsigned char auth;              /* of the session that scheduled the line */
+    unsigned char argc;
+    signed char at[3];               /* hour, minute, second; -1 = any */
+    short prev, next;                /* in its slot's list */
+    short slot;                      /* level * TIMER_WHEEL_SLOTS + slot, NONE or DUE */
+    unsigned short generation;       /* makes ids of a reused job differ */
+    unsigned long expires;           /* tick */
+    unsigned long period;            /* ticks, 0 = once */
+    void (*fn)(void *arg);
+    void *arg;
+    const char *name;
+    tinysh_cmd_t *cmd;
+    unsigned char arg_off[MAX_ARGS]; /* argv[1..] in args */
+    char line[TIMER_LINE_SIZE];      /* as scheduled, for "jobs" */
+    char args[TIMER_LINE_SIZE];      /* arguments, split */
+    unsigned long runs;
+    unsigned long overruns;
+    unsigned long max_run_ms;
+} job_t;
+
+static job_t jobs[TIMER_MAX_JOBS];
+static short wheel[TIMER_LEVELS * TIMER_WHEEL_SLOTS];  /* first job of each slot */
+static short due = NONE;             /* jobs of the tick being run */
+static unsigned long now_tick = 0;   /* next tick to run */
+static int queued = 0;
+static char started = 0;
+static tinysh_timer_wall_t wall = NULL;
+static tinysh_line_t job_line;       /* lines run in their own line state */
+
+/* Forward declarations */
+static void start(void);
+static unsigned long clock_tick(void);
+static short *head_of(const job_t *j);
+static void enqueue(int i);
+static void dequeue(int i);
+static int alloc(int kind);
+static void release(int i);
+static void cascade(int level, int slot);
+static long next_at(const job_t *j, unsigned long now);
+static int schedule_at(int i);
+static void fire(int i);
+static void advance(void);
+static int parse_line(int i, const char *line);
+static int parse_at(const char *when, signed char at[3]);
+static void format_ms(char *buf, int size, unsigned long ms);
+static int join_args(char *buf, int size, int argc, const char **argv);
+static void schedule_cmd(int argc, const char **argv, int periodic);
+void every_cmd_handler(int argc, const char **argv);
+void after_cmd_handler(int argc, const char **argv);
+void at_cmd_handler(int argc, const char **argv);
+void jobs_cmd_handler(int argc, const char **argv);
+
+/* Timer commands */
+tinysh_cmd_t every_cmd = {
+    0, "every", "run a command periodically", "INTERVAL COMMAND...",
+    every_cmd_handler, 0, 0, 0
+};
+
+tinysh_cmd_t after_cmd = {
+    0, "after", "run a command once, later", "DELAY COMMAND...",
+    after_cmd_handler, 0, 0, 0
+};
+
+tinysh_cmd_t at_cmd = {
+    0, "at", "run a command at a time of day", "HH:MM[:SS] COMMAND...",
+    at_cmd_handler, 0, 0, 0
+};
+
+tinysh_cmd_t jobs_cmd = {
+    0, "jobs", "list or cancel scheduled commands", "[cancel ID]",
+    jobs_cmd_handler, 0, 0, 0
+};
+
+/**
+ * Empty wheels, starting at the current tick
+ */
+static void start(void) {
+    int i;
+
+    for (i = 0; i < TIMER_LEVELS * TIMER_WHEEL_SLOTS; i++) wheel[i] = NONE;
+    tinysh_line_init(&job_line);
+    now_tick = clock_tick();
+    started = 1;
+}
+
+/**
+ * Current tick by the shell's clock
+ */
+static unsigned long clock_tick(void) {
+    return tinysh_time_ms() / TIMER_TICK_MS;
+}
+
+/**
+ * List a job is in
+ */
+static short *head_of(const job_t *j) {
+    return j->slot == DUE ? &due : &wheel[j->slot];
+}
+
+/**
+ * Put a job in the slot for its expiry
+ * A job due within one turn of a wheel goes in that wheel; beyond the
+ * last wheel, it goes where the last wheel ends and is placed again
+ * when that slot comes round.
+ */
+static void enqueue(int i) {
+    job_t *j = &jobs[i];
+    unsigned long delta, span = 1, at;
+    int level;
+
+    if ((long)(j->expires - now_tick) < 0) j->expires = now_tick;
+    delta = j->expires - now_tick;
+    for (level = 0; level < TIMER_LEVELS - 1 && delta >= span * TIMER_WHEEL_SLOTS; level++) {
+        span *= TIMER_WHEEL_SLOTS;
+    }
+    at = delta < span * TIMER_WHEEL_SLOTS ? j->expires : now_tick + span * TIMER_WHEEL_SLOTS - 1;
+
+    j->slot = (short)(level * TIMER_WHEEL_SLOTS + (int)((at / span) & MASK));
+    j->prev = NONE;
+    j->next = wheel[j->slot];
+    if (j->next != NONE) jobs[j->next].prev = (short)i;
+    wheel[j->slot] = (short)i;
+}
+
+/**
+ * Take a job out of its list
+ */
+static void dequeue(int i) {
+    job_t *j = &jobs[i];
+
+    if (j->slot == NONE) return;
+    if (j->prev != NONE) jobs[j->prev].next = j->next;
+    else *head_of(j) = j->next;
+    if (j->next != NONE) jobs[j->next].prev = j->prev;
+    j->slot = NONE;
+}
+
+/**
+ * Find a free job
+ *
+ * @return Index, or -1
+ */
+static int alloc(int kind) {
+    unsigned short generation;
+    int i;
+
+    if (!started) start();
+    for (i = 0; i < TIMER_MAX_JOBS && jobs[i].id; i++);
+    if (i == TIMER_MAX_JOBS) return -1;
+
+    // Idle wheels need not catch up on the time they were idle
+    if (!queued) now_tick = clock_tick();
+    generation = jobs[i].generation;
+    memset(&jobs[i], 0, sizeof(jobs[i]));
+    jobs[i].generation = generation;
+    jobs[i].id = generation * TIMER_MAX_JOBS + i + 1;
+    jobs[i].kind = (unsigned char)kind;
+    jobs[i].slot = NONE;
+    return i;
+}
+
+/**
+ * Free a job
+ */
+static void release(int i) {
+    dequeue(i);
+    jobs[i].id = 0;
+    jobs[i].generation++;
+    queued--;
+}
+
+/**
+ * Move the jobs of a slot to the wheels below
+ */
+static void cascade(int level, int slot) {
+    short *head = &wheel[level * TIMER_WHEEL_SLOTS + slot];
+    int i;
+
+    while (*head != NONE) {
+        i = *head;
+        dequeue(i);
+        enqueue(i);
+    }
+}
+
+/**
+ * Seconds from now until the time of day matches an "at" job
+ * Whole hours and minutes that cannot match are skipped.
+ *
+ * @param now Local seconds since some midnight
+ * @return Seconds (1..86400), or -1 if it never matches
+ */
+static long next_at(const job_t *j, unsigned long now) {
+    unsigned long t, end = now + 86400;
+    unsigned long d;
+
+    for (t = now + 1; t <= end; ) {
+        d = t % 86400;
+        if (j->at[0] >= 0 && (long)(d / 3600) != j->at[0]) {
+            t += 3600 - d % 3600;
+        } else if (j->at[1] >= 0 && (long)(d / 60 % 60) != j->at[1]) {
+            t += 60 - d % 60;
+        } else if (j->at[2] >= 0 && (long)(d % 60) != j->at[2]) {
+            t++;
+        } else {
+            return (long)(t - now);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Queue an "at" job for the next matching time of day
+ *
+ * @return 0, or -1 if it never matches
+ */
+static int schedule_at(int i) {
+    long s = next_at(&jobs[i], wall());
+
+    if (s < 0) return -1;
+    jobs[i].expires = clock_tick() + (unsigned long)s * 1000 / TIMER_TICK_MS;
+    enqueue(i);
+    return 0;
+}
+
+/**
+ * Run a job, then queue it again or free it
+ * A periodic job that fell a period or more behind skips the runs it
+ * missed; they are counted as overruns.
+ */
+static void fire(int i) {
+    job_t *j = &jobs[i];
+    const char *argv[MAX_ARGS];
+    char args[TIMER_LINE_SIZE];
+    tinysh_line_t *line;
+    unsigned long begin = tinysh_time_ms(), took, now, next, missed;
+    int id = j->id, k;
+
+    if (j->kind == KIND_CALL) {
+        j->fn(j->arg);
+    } else {
+        memcpy(args, j->args, sizeof(args));
+        argv[0] = j->cmd->name;
+        for (k = 1; k < j->argc; k++) argv[k] = args + j->arg_off[k];
+        line = tinysh_line_select(&job_line);
+        job_line.auth_level = j->auth;
+        tinysh_run_command(j->cmd, j->argc, argv);
+        tinysh_line_select(line);
+    }
+    if (j->id != id) return;         // it cancelled itself
+
+    took = tinysh_time_ms() - begin;
+    j->runs++;
+    if (took > j->max_run_ms) j->max_run_ms = took;
+
+    if (j->kind == KIND_AT) {
+        if (schedule_at(i) < 0) release(i);
+        return;
+    }
+    if (!j->period) {
+        release(i);
+        return;
+    }
+    next = j->expires + j->period;
+    now = clock_tick();
+    if ((long)(next - now) < 0) {
+        missed = (now - j->expires) / j->period;
+        j->overruns += missed;
+        next = j->expires + (missed + 1) * j->period;
+    }
+    j->expires = next;
+    enqueue(i);
+}
+
+/**
+ * Run one tick: bring jobs down from the wheels whose slot came round,
+ * then run what is due
+ * Due jobs are moved to a list of their own first, so jobs queued while
+ * they run cannot land in the slot being emptied.
+ */
+static void advance(void) {
+    unsigned long t = now_tick, span = TIMER_WHEEL_SLOTS;
+    short *head;
+    int level, i;
+
+    for (level = 1; level < TIMER_LEVELS && t % span == 0; level++) {
+        cascade(level, (int)((t / span) & MASK));
+        span *= TIMER_WHEEL_SLOTS;
+    }
+
+    head = &wheel[t & MASK];
+    due = *head;
+    *head = NONE;
+    for (i = due; i != NONE; i = jobs[i].next) jobs[i].slot = DUE;
+    now_tick = t + 1;
+
+    while (due != NONE) {
+        i = due;
+        dequeue(i);
+        fire(i);
+    }
+}
+
+/**
+ * Run the jobs that are due, catching up on ticks missed
+ */
+void tinysh_timer_tick(void) {
+    unsigned long target;
+
+    if (!started) return;
+    target = clock_tick();
+    if (!queued) {
+        now_tick = target + 1;
+        return;
+    }
+    while ((long)(target - now_tick) >= 0) advance();
+}
+
+/**
+ * Run a callback
+ */
+int tinysh_timer_call(unsigned long delay_ms, unsigned long period_ms,
+                      void (*fn)(void *arg), void *arg, const char *name) {
+    int i = alloc(KIND_CALL);
+
+    if (i < 0) return TIMER_ERR_FULL;
+    jobs[i].fn = fn;
+    jobs[i].arg = arg;
+    jobs[i].name = name;
+    jobs[i].period = period_ms ? (period_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS : 0;
+    jobs[i].expires = clock_tick() + delay_ms / TIMER_TICK_MS;
+    queued++;
+    enqueue(i);
+    return jobs[i].id;
+}
+
+/**
+ * Resolve a line into a job: command, and arguments split once
+ *
+ * @return 0, or TIMER_ERR_*
+ */
+static int parse_line(int i, const char *line) {
+    job_t *j = &jobs[i];
+    const char *args;
+    char *s;
+    int len = tinysh_strlen(line);
+
+    if (len >= TIMER_LINE_SIZE) return TIMER_ERR_TOO_LONG;
+    if (tinysh_resolve_line(line, &j->cmd, &args) < 0) return TIMER_ERR_COMMAND;
+    j->auth = tinysh_get_auth_level();
+    if (tinysh_is_admin_command(j->cmd) && j->auth < TINYSH_AUTH_ADMIN) return TIMER_ERR_COMMAND;
+
+    memcpy(j->line, line, (size_t)len + 1);
+    memcpy(j->args, args, (size_t)tinysh_strlen(args) + 1);
+    s = j->args;
+    j->argc = 1;
+    while (*s && j->argc < MAX_ARGS) {
+        while (*s == ' ') s++;
+        if (!*s) break;
+        j->arg_off[j->argc++] = (unsigned char)(s - j->args);
+        while (*s && *s != ' ') s++;
+        if (*s) *s++ = 0;
+    }
+    return 0;
+}
+
+/**
+ * Run a command line
+ */
+int tinysh_timer_line(unsigned long delay_ms, unsigned long period_ms, const char *line) {
+    int i = alloc(KIND_LINE), err;
+
+    if (i < 0) return TIMER_ERR_FULL;
+    err = parse_line(i, line);
+    if (err < 0) {
+        jobs[i].id = 0;
+        return err;
+    }
+    jobs[i].period = period_ms ? (period_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS : 0;
+    jobs[i].expires = clock_tick() + delay_ms / TIMER_TICK_MS;
+    queued++;
+    enqueue(i);
+    return jobs[i].id;
+}
+
+/**
+ * Parse HH:MM[:SS], each field a number or "*"; seconds default to 0
+ *
+ * @return 0, or TIMER_ERR_SYNTAX
+ */
+static int parse_at(const char *when, signed char at[3]) {
+    static const int limit[3] = {24, 60, 60};
+    int f, v;
+
+    at[2] = 0;
+    for (f = 0; f < 3; f++) {
+        if (*when == '*') {
+            at[f] = -1;
+            when++;
+        } else if (*when >= '0' && *when <= '9') {
+            for (v = 0; *when >= '0' && *when <= '9' && v < 100; when++) v = v * 10 + (*when - '0');
+            if (v >= limit[f]) return TIMER_ERR_SYNTAX;
+            at[f] = (signed char)v;
+        } else {
+            return TIMER_ERR_SYNTAX;
+        }
+        if (*when == 0 && f > 0) return 0;
+        if (*when++ != ':') return TIMER_ERR_SYNTAX;
+    }
+    return TIMER_ERR_SYNTAX;
+}
+
+/**
+ * Run a command line at times of day
+ */
+int tinysh_timer_at(const char *when, const char *line) {
+    signed char at[3];
+    int i, err;
+
+    if (parse_at(when, at) < 0) return TIMER_ERR_SYNTAX;
+    if (!wall) return TIMER_ERR_CLOCK;
+    i = alloc(KIND_AT);
+    if (i < 0) return TIMER_ERR_FULL;
+    err = parse_line(i, line);
+    if (err < 0) {
+        jobs[i].id = 0;
+        return err;
+    }
+    memcpy(jobs[i].at, at, sizeof(at));
+    schedule_at(i);
+    queued++;
+    return jobs[i].id;
+}
+
+/**
+ * Cancel a job
+ */
+int tinysh_timer_cancel(int id) {
+    int i = (id - 1) % TIMER_MAX_JOBS;
+
+    if (id <= 0 || jobs[i].id != id) return -1;
+    release(i);
+    return 0;
+}
+
+/**
+ * Describe a job
+ */
+int tinysh_timer_get(int id, tinysh_timer_info_t *info) {
+    int i = (id - 1) % TIMER_MAX_JOBS;
+    job_t *j = &jobs[i];
+    unsigned long now = clock_tick();
+
+    if (id <= 0 || j->id != id) return -1;
+    info->id = id;
+    info->what = j->kind == KIND_CALL ? j->name : j->line;
+    info->next_ms = (long)(j->expires - now) > 0 ? (j->expires - now) * TIMER_TICK_MS : 0;
+    info->period_ms = j->period * TIMER_TICK_MS;
+    info->at[0] = 0;
+    if (j->kind == KIND_AT) {
+        char f[3][5];
+        int k;
+
+        for (k = 0; k < 3; k++) {
+            if (j->at[k] < 0) snprintf(f[k], sizeof(f[k]), "*");
+            else snprintf(f[k], sizeof(f[k]), "%02d", j->at[k]);
+        }
+        snprintf(info->at, sizeof(info->at), "%s:%s:%s", f[0], f[1], f[2]);
+    }
+    info->runs = j->runs;
+    info->overruns = j->overruns;
+    info->max_run_ms = j->max_run_ms;
+    return 0;
+}
+
+/**
+ * Set the wall clock
+ */
+tinysh_timer_wall_t tinysh_timer_clock(tinysh_timer_wall_t fn) {
+    tinysh_timer_wall_t prev = wall;
+
+    wall = fn;
+    return prev;
+}
+
+/**
+ * Jobs scheduled
+ */
+int tinysh_timer_count(void) {
+    return queued;
+}
+
+/**
+ * Parse an interval
+ */
+int tinysh_timer_parse(const char *s, unsigned long *ms) {
+    unsigned long v = 0;
+    const char *p = s;
+
+    for (; *p >= '0' && *p <= '9'; p++) {
+        if (v > 100000000UL) return TIMER_ERR_SYNTAX;
+        v = v * 10 + (unsigned long)(*p - '0');
+    }
+    if (p == s) return TIMER_ERR_SYNTAX;
+    if (strcmp(p, "ms") == 0) *ms = v;
+    else if (*p == 0 || strcmp(p, "s") == 0) *ms = v * 1000;
+    else if (strcmp(p, "m") == 0) *ms = v * 60000;
+    else if (strcmp(p, "h") == 0) *ms = v * 3600000;
+    else return TIMER_ERR_SYNTAX;
+    return 0;
+}
+
+/**
+ * Message for a TIMER_ERR_* code
+ */
+const char *tinysh_timer_error(int err) {
+    switch (err) {
+    case TIMER_ERR_FULL:     return "too many jobs";
+    case TIMER_ERR_COMMAND:  return "not a command that can run";
+    case TIMER_ERR_TOO_LONG: return "command line too long";
+    case TIMER_ERR_CLOCK:    return "no wall clock";
+    case TIMER_ERR_SYNTAX:   return "bad interval or time";
+    default:                 return "error";
+    }
+}
+
+/**
+ * Register the timer commands
+ */
+void tinysh_timer_init(void) {
+    if (!started) start();
+    tinysh_add_command(&every_cmd);
+    tinysh_add_command(&after_cmd);
+    tinysh_add_command(&at_cmd);
+    tinysh_add_command(&jobs_cmd);
+}
+
+/**
+ * Interval as text, in the largest unit that divides it
+ */
+static void format_ms(char *buf, int size, unsigned long ms) {
+    if (ms && ms % 3600000 == 0) snprintf(buf, (size_t)size, "%luh", ms / 3600000);
+    else if (ms && ms % 60000 == 0) snprintf(buf, (size_t)size, "%lum", ms / 60000);
+    else if (ms && ms % 1000 == 0) snprintf(buf, (size_t)size, "%lus", ms / 1000);
+    else snprintf(buf, (size_t)size, "%lums", ms);
+}
+
+/**
+ * Join arguments into one line
+ *
+ * @return Length, or -1 if they do not fit
+ */
+static int join_args(char *buf, int size, int argc, const char **argv) {
+    int i, len = 0, n;
+
+    buf[0] = 0;
+    for (i = 0; i < argc; i++) {
+        n = tinysh_strlen(argv[i]);
+        if (len + (i > 0) + n + 1 > size) return -1;
+        if (i > 0) buf[len++] = ' ';
+        memcpy(buf + len, argv[i], (size_t)n + 1);
+        len += n;
+    }
+    return len;
+}
+
+/**
+ * Schedule from a command: every, after and at share this
+ */
+static void schedule_cmd(int argc, const char **argv, int periodic) {
+    char line[TIMER_LINE_SIZE];
+    unsigned long ms = 0;
+    int id;
+
+    if (argc < 3) {
+        tinysh_printf("Usage: %s %s\r\n", argv[0], periodic < 0 ? at_cmd.usage : every_cmd.usage);
+        return;
+    }
+    if (join_args(line, sizeof(line), argc - 2, argv + 2) < 0) {
+        id = TIMER_ERR_TOO_LONG;
+    } else if (periodic < 0) {
+        id = tinysh_timer_at(argv[1], line);
+    } else if (tinysh_timer_parse(argv[1], &ms) < 0 || (periodic && ms < TIMER_TICK_MS)) {
+        id = TIMER_ERR_SYNTAX;
+    } else {
+        id = tinysh_timer_line(ms, periodic ? ms : 0, line);
+    }
+    if (id < 0) {
+        tinysh_printf("Not scheduled: %s\r\n", tinysh_timer_error(id));
+    } else {
+        tinysh_printf("Job %d\r\n", id);
+    }
+}
+
+/**
+ * Every command handler
+ */
+void every_cmd_handler(int argc, const char **argv) {
+    schedule_cmd(argc, argv, 1);
+}
+
+/**
+ * After command handler
+ */
+void after_cmd_handler(int argc, const char **argv) {
+    schedule_cmd(argc, argv, 0);
+}
+
+/**
+ * At command handler
+ */
+void at_cmd_handler(int argc, const char **argv) {
+    schedule_cmd(argc, argv, -1);
+}
+
+/**
+ * Jobs command handler
+ */
+void jobs_cmd_handler(int argc, const char **argv) {
+    static const tinysh_table_col_t cols[] = {
+        {"ID", 0, TABLE_ALIGN_RIGHT},
+        {"Next", 0, TABLE_ALIGN_RIGHT},
+        {"Every", 0, 0},
+        {"Runs", 0, TABLE_ALIGN_RIGHT},
+        {"Overruns", 0, TABLE_ALIGN_RIGHT},
+        {"Longest", 0, TABLE_ALIGN_RIGHT},
+        {"Command", 0, 0}
+    };
+    tinysh_timer_info_t info;
+    long n;
+    char id[12], next[24], every[24], runs[24], over[24], longest[24];
+    int i;
+
+    if (argc == 3 && strcmp(argv[1], "cancel") == 0) {
+        if (tinysh_parse_long(argv[2], -1, &n) < 0 || tinysh_timer_cancel((int)n) < 0) {
+            tinysh_printf("No job %s\r\n", argv[2]);
+        }
+        return;
+    }
+    if (argc > 1) {
+        tinysh_puts("Usage: jobs [cancel ID]\r\n");
+        return;
+    }
+
+    tinysh_table_begin(cols, 7);
+    for (i = 0; i < TIMER_MAX_JOBS; i++) {
+        if (!jobs[i].id || tinysh_timer_get(jobs[i].id, &info) < 0) continue;
+        snprintf(id, sizeof(id), "%d", info.id);
+        if (info.next_ms < 10000) snprintf(next, sizeof(next), "%lums", info.next_ms);
+        else if (info.next_ms < 7200000) snprintf(next, sizeof(next), "%lus", info.next_ms / 1000);
+        else snprintf(next, sizeof(next), "%lum", info.next_ms / 60000);
+        if (info.at[0]) snprintf(every, sizeof(every), "at %s", info.at);
+        else if (info.period_ms) format_ms(every, sizeof(every), info.period_ms);
+        else snprintf(every, sizeof(every), "once");
+        snprintf(runs, sizeof(runs), "%lu", info.runs);
+        snprintf(over, sizeof(over), "%lu", info.overruns);
+        format_ms(longest, sizeof(longest), info.max_run_ms);
+        tinysh_table_add(id, next, every, runs, over, longest, info.what);
+    }
+    tinysh_table_end();
+}
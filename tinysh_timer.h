@@ -0,0 +1,185 @@
+/**
+ * TinyShell Timers
+ * ---------------
+ * Runs command lines and callbacks later or periodically, so sampling
+ * and housekeeping need no host: "every 5s sysinfo", "after 100ms ...",
+ * "at 03:30 save".
+ *
+ * Features:
+ * - Hierarchical timing wheel: TIMER_LEVELS wheels of TIMER_WHEEL_SLOTS
+ *   slots each, the first one tick per slot, each further one a whole
+ *   turn of the one below per slot. Scheduling and cancelling are O(1);
+ *   a tick looks at one slot, and jobs move down a level only when the
+ *   wheel below comes round
+ * - Tick-driven: tinysh_timer_tick() from the main loop, with time from
+ *   the shell's clock (tinysh_time_source()); ticks missed while the
+ *   loop was busy are caught up in order
+ * - A command line is resolved to its command and argv when scheduled,
+ *   in the scheduling session's context and with its auth level; a
+ *   line that would not run is refused then, not at 3 am
+ * - Periodic jobs that fall a whole period or more behind skip the
+ *   missed runs instead of running them back to back, and count them
+ *   as overruns
+ * - "at" takes HH:MM[:SS] with "*" for any hour or minute, e.g. "*:15"
+ *   every hour at a quarter past, and needs a wall clock
+ *   (tinysh_timer_clock())
+ * - Jobs run on the thread that ticks, so their output goes to the console
+ * - "every", "after", "at" and "jobs" commands
+ *
+ * Example Usage:
+ *
+ * static void blink(void *arg) { led_toggle(); }
+ *
+ * tinysh_timer_init();
+ * tinysh_timer_call(0, 500, blink, NULL, "blink");
+ * tinysh_timer_line(0, 60000, "chart load");
+ * while (1) {
+ *     ...
+ *     tinysh_timer_tick();
+ * }
+ *
+ * tinysh> every 5s sysinfo
+ * Job 3
+ * tinysh> jobs
+ */
+
+#ifndef TINYSH_TIMER_H
+#define TINYSH_TIMER_H
+
+#include "tinysh.h"
+
+/* Jobs that can be scheduled at once */
+#ifndef TIMER_MAX_JOBS
+#define TIMER_MAX_JOBS            16
+#endif
+
+/* Wheel resolution */
+#ifndef TIMER_TICK_MS
+#define TIMER_TICK_MS             10
+#endif
+
+/* Slots per wheel, a power of two */
+#ifndef TIMER_WHEEL_SLOTS
+#define TIMER_WHEEL_SLOTS         64
+#endif
+
+/* Wheels; 4 x 64 slots of 10 ms reach 46 hours, longer delays are
+   rounded down to that and go round again */
+#ifndef TIMER_LEVELS
+#define TIMER_LEVELS              4
+#endif
+
+/* Longest command line a job can hold */
+#ifndef TIMER_LINE_SIZE
+#define TIMER_LINE_SIZE           64
+#endif
+
+/* Results of scheduling */
+#define TIMER_ERR_FULL            -1    // No free job
+#define TIMER_ERR_COMMAND         -2    // Line names no command that would run
+#define TIMER_ERR_TOO_LONG        -3    // Line longer than TIMER_LINE_SIZE
+#define TIMER_ERR_CLOCK           -4    // "at" without a wall clock
+#define TIMER_ERR_SYNTAX          -5    // Bad interval or time of day
+
+/* Wall clock: local time in seconds since some midnight */
+typedef unsigned long (*tinysh_timer_wall_t)(void);
+
+/* A job, as listed */
+typedef struct {
+    int id;
+    const char *what;                // Command line, or the callback's name
+    unsigned long next_ms;           // Until it runs next
+    unsigned long period_ms;         // 0 = once
+    char at[16];                     // HH:MM:SS pattern of an "at" job, or ""
+    unsigned long runs;
+    unsigned long overruns;          // Periodic runs skipped for being late
+    unsigned long max_run_ms;        // Longest run
+} tinysh_timer_info_t;
+
+/**
+ * Run a callback
+ *
+ * @param delay_ms  First run after this long
+ * @param period_ms Then again at this period, 0 for once
+ * @param fn        Callback
+ * @param arg       Passed to fn
+ * @param name      Shown by "jobs", must stay valid
+ * @return Job id (> 0), or TIMER_ERR_FULL
+ */
+int tinysh_timer_call(unsigned long delay_ms, unsigned long period_ms,
+                      void (*fn)(void *arg), void *arg, const char *name);
+
+/**
+ * Run a command line, resolved now in the current session's context
+ *
+ * @return Job id (> 0), or TIMER_ERR_*
+ */
+int tinysh_timer_line(unsigned long delay_ms, unsigned long period_ms, const char *line);
+
+/**
+ * Run a command line each time the wall clock matches a pattern
+ *
+ * @param when "HH:MM[:SS]", each field a number or "*"
+ * @return Job id (> 0), or TIMER_ERR_*
+ */
+int tinysh_timer_at(const char *when, const char *line);
+
+/**
+ * Cancel a job
+ *
+ * @return 0, or -1 if there is no such job
+ */
+int tinysh_timer_cancel(int id);
+
+/**
+ * Run the jobs that are due
+ */
+void tinysh_timer_tick(void);
+
+/**
+ * Describe a job
+ *
+ * @return 0, or -1 if there is no such job
+ */
+int tinysh_timer_get(int id, tinysh_timer_info_t *info);
+
+/**
+ * Set the wall clock "at" uses
+ *
+ * @param fn Returns local time in seconds since some midnight, e.g.
+ *           epoch seconds plus the UTC offset; NULL for none
+ * @return The wall clock set before, NULL if none
+ */
+tinysh_timer_wall_t tinysh_timer_clock(tinysh_timer_wall_t fn);
+
+/**
+ * Jobs scheduled
+ */
+int tinysh_timer_count(void);
+
+/**
+ * Parse an interval: a number with ms, s, m or h; seconds without
+ *
+ * @param s  Interval text
+ * @param ms Receives milliseconds
+ * @return 0, or TIMER_ERR_SYNTAX
+ */
+int tinysh_timer_parse(const char *s, unsigned long *ms);
+
+/**
+ * Message for a TIMER_ERR_* code
+ */
+const char *tinysh_timer_error(int err);
+
+/**
+ * Register the every, after, at and jobs commands
+ */
+void tinysh_timer_init(void);
+
+/* Timer commands */
+extern tinysh_cmd_t every_cmd;
+extern tinysh_cmd_t after_cmd;
+extern tinysh_cmd_t at_cmd;
+extern tinysh_cmd_t jobs_cmd;
+
+#endif /* TINYSH_TIMER_H */